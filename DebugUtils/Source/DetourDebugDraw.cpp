@@ -335,15 +335,19 @@ static void drawMeshTileBVTree(duDebugDraw* dd, const dtMeshTile* tile)
 	for (int i = 0; i < tile->header->bvNodeCount; ++i)
 	{
 		const dtBVNode* n = &tile->bvTree[i];
-		if (n->i < 0) // Leaf indices are positive.
-			continue;
-		duAppendBoxWire(dd, tile->header->bmin[0] + n->bmin[0]*cs,
-						tile->header->bmin[1] + n->bmin[1]*cs,
-						tile->header->bmin[2] + n->bmin[2]*cs,
-						tile->header->bmin[0] + n->bmax[0]*cs,
-						tile->header->bmin[1] + n->bmax[1]*cs,
-						tile->header->bmin[2] + n->bmax[2]*cs,
-						duRGBA(255,255,255,128));
+		for (int j = 0; j < DT_BVNODE_WIDTH; ++j)
+		{
+			// Leaf indices are negative.
+			if (n->child[j] >= 0)
+				continue;
+			duAppendBoxWire(dd, tile->header->bmin[0] + n->bmin[0][j]*cs,
+							tile->header->bmin[1] + n->bmin[1][j]*cs,
+							tile->header->bmin[2] + n->bmin[2][j]*cs,
+							tile->header->bmin[0] + n->bmax[0][j]*cs,
+							tile->header->bmin[1] + n->bmax[1][j]*cs,
+							tile->header->bmin[2] + n->bmax[2][j]*cs,
+							duRGBA(255,255,255,128));
+		}
 	}
 	dd->end();
 }
@@ -105,6 +105,13 @@ inline float dtVdistSqr(const float* v1, const float* v2)
 	return dx*dx + dy*dy + dz*dz;
 }
 
+inline float dtVdist2DSqr(const float* v1, const float* v2)
+{
+	float dx = v2[0] - v1[0];
+	float dz = v2[2] - v1[2];
+	return dx*dx + dz*dz;
+}
+
 inline void dtVnormalize(float* v)
 {
 	float d = 1.0f / sqrtf(dtSqr(v[0]) + dtSqr(v[1]) + dtSqr(v[2]));
@@ -201,4 +208,17 @@ float dtDistancePtSegSqr2D(const float* pt, const float* p, const float* q, floa
 
 void dtCalcPolyCenter(float* tc, const unsigned short* idx, int nidx, const float* verts);
 
+// Returns the 2D area of a convex polygon, areas[] receives the area of each fan triangle.
+float dtPolyArea2D(const float* verts, const int nverts, float* areas);
+
+// Picks uniformly distributed point inside convex polygon.
+// Params:
+//  verts - (in) polygon vertices.
+//  nverts - (in) number of vertices.
+//  areas - (in,out) scratch space for nverts floats.
+//  s,t - (in) random numbers in range [0..1).
+//  out[3] - (out) resulting point.
+void dtRandomPointInConvexPoly(const float* verts, const int nverts, float* areas,
+							   const float s, const float t, float* out);
+
 #endif // DETOURCOMMON_H
\ No newline at end of file
@@ -0,0 +1,172 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURFLOWFIELD_H
+#define DETOURFLOWFIELD_H
+
+#include "DetourNavMesh.h"
+
+// Stores the cost to the goal and the next polygon towards the goal for every
+// polygon around the goal. The field is searched once with dtNavMesh::findPolysToGoal()
+// and after that any number of agents heading to the same goal can look up their
+// path without searching.
+class dtFlowField
+{
+public:
+	dtFlowField();
+	~dtFlowField();
+
+	// Allocates the field.
+	// Params:
+	//  maxPolys - (in) max number of polygons stored in the field.
+	// Returns: True if succeed, else false.
+	bool init(const int maxPolys);
+
+	// Searches the field towards the goal.
+	// Params:
+	//  navmesh - (in) navmesh to search.
+	//  goalRef - (in) ref to the polygon where the goal lies.
+	//  goalPos[3] - (in) goal location.
+	//  maxCost - (in) polygons which cost more than this to reach the goal are left out.
+	//  filter - (in) path polygon filter.
+	// Returns: True if succeed, else false.
+	bool build(const dtNavMesh* navmesh, dtPolyRef goalRef, const float* goalPos,
+			   const float maxCost, const dtQueryFilter* filter);
+
+	// Empties the field.
+	void clear();
+
+	// Returns true if the field was built for the navmesh and no tile has been
+	// added or removed since. A new tile may open a cheaper way to the goal.
+	bool isValid(const dtNavMesh* navmesh) const;
+
+	// Looks up a polygon from the field.
+	// Params:
+	//  ref - (in) polygon to look up.
+	//  next - (out, opt) next polygon towards the goal, 0 at the goal.
+	//  cost - (out, opt) cost to the goal from the edge shared with the next polygon.
+	// Returns: True if the polygon is in the field.
+	bool getNext(dtPolyRef ref, dtPolyRef* next, float* cost) const;
+
+	// Follows the field from the start polygon to the goal.
+	// Params:
+	//  startRef - (in) polygon to start from.
+	//  path - (out) polygons from the start to the goal.
+	//  maxPath - (in) max number of polygons in the path array.
+	// Returns: Number of polygons in the path, 0 if the start is not in the field.
+	int getPath(dtPolyRef startRef, dtPolyRef* path, const int maxPath) const;
+
+	inline dtPolyRef getGoalRef() const { return m_goalRef; }
+	inline const float* getGoalPos() const { return m_goalPos; }
+	inline int getPolyCount() const { return m_npolys; }
+
+private:
+	inline unsigned int hashRef(dtPolyRef ref) const
+	{
+#ifdef DT_POLYREF64
+		unsigned int a = (unsigned int)(ref ^ (ref >> 32));
+#else
+		unsigned int a = ref;
+#endif
+		a += ~(a<<15);
+		a ^=  (a>>10);
+		a +=  (a<<3);
+		a ^=  (a>>6);
+		a += ~(a<<11);
+		a ^=  (a>>16);
+		return a;
+	}
+
+	int findIndex(dtPolyRef ref) const;
+
+	const dtNavMesh* m_navmesh;
+	dtPolyRef m_goalRef;
+	float m_goalPos[3];
+
+	dtPolyRef* m_refs;
+	dtPolyRef* m_next;
+	float* m_cost;
+	int m_npolys;
+	int m_maxPolys;
+
+	int* m_first;
+	int* m_hashNext;
+	int m_hashSize;
+
+	unsigned int m_tileGeneration;
+};
+
+// Keeps the flow fields of the most recently requested goals. A field is built
+// only after its goal has been requested a number of times, so that goals which
+// are not shared by several agents do not cost more than a regular path search.
+// The fields are keyed by goal polygon only and are searched towards the polygon
+// center, each agent still walks the last polygon to its own goal location.
+// The cache is not thread safe, all requests must come from the same thread.
+class dtFlowFieldCache
+{
+public:
+	dtFlowFieldCache();
+	~dtFlowFieldCache();
+
+	// Allocates the cache.
+	// Params:
+	//  maxFields - (in) max number of goals kept in the cache.
+	//  maxPolys - (in) max number of polygons per field.
+	//  maxCost - (in) max cost to the goal stored in the fields.
+	//  minRequests - (in) number of requests to the same goal before its field is built.
+	// Returns: True if succeed, else false.
+	bool init(const int maxFields, const int maxPolys, const float maxCost, const int minRequests);
+
+	// Returns the flow field towards the goal polygon. The least recently used goal
+	// is replaced when the goal is not in the cache, and the field is built again
+	// if the navmesh has changed under it. Only the polygons of the field are meant
+	// to be shared, the straight path to the goal location is found per agent.
+	// Params:
+	//  navmesh - (in) navmesh to search.
+	//  goalRef - (in) ref to the polygon where the goal lies.
+	//  filter - (in) path polygon filter, the field is shared by requests with equal filters.
+	// Returns: The flow field, or 0 if the field has not been built for the goal (yet).
+	const dtFlowField* getFlowField(const dtNavMesh* navmesh, dtPolyRef goalRef, const dtQueryFilter* filter);
+
+	// Removes all goals from the cache.
+	void clear();
+
+	inline int getBuildCount() const { return m_buildCount; }
+	inline int getHitCount() const { return m_hitCount; }
+
+private:
+	struct dtFlowFieldSlot
+	{
+		dtFlowField field;
+		dtPolyRef goalRef;
+		dtQueryFilter filter;
+		unsigned int lastUsed;
+		int requests;
+		bool built;
+	};
+
+	dtFlowFieldSlot* m_slots;
+	int m_maxFields;
+	float m_maxCost;
+	int m_minRequests;
+	unsigned int m_time;
+	int m_buildCount;
+	int m_hitCount;
+};
+
+#endif // DETOURFLOWFIELD_H
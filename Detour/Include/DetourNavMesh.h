@@ -19,20 +19,40 @@
 #ifndef DETOURNAVMESH_H
 #define DETOURNAVMESH_H
 
+// Define DT_POLYREF64 to use 64-bit polygon and tile references. The extra bits
+// allow far more tiles and polygons per tile than the 32-bit references.
+#ifdef DT_POLYREF64
+
+// Reference to navigation polygon.
+typedef unsigned long long dtPolyRef;
+
+// Reference to navigation mesh tile.
+typedef unsigned long long dtTileRef;
+
+// The reference size changes the tile data and tile state layout,
+// data saved with the other reference size is rejected.
+static const int DT_POLYREF_VERSION = 64<<16;
+
+#else
+
 // Reference to navigation polygon.
 typedef unsigned int dtPolyRef;
 
 // Reference to navigation mesh tile.
 typedef unsigned int dtTileRef;
 
+static const int DT_POLYREF_VERSION = 0;
+
+#endif
+
 // Maximum number of vertices per navigation polygon.
 static const int DT_VERTS_PER_POLYGON = 6;
 
 static const int DT_NAVMESH_MAGIC = 'D'<<24 | 'N'<<16 | 'A'<<8 | 'V'; //'DNAV';
-static const int DT_NAVMESH_VERSION = 4;
+static const int DT_NAVMESH_VERSION = 7 | DT_POLYREF_VERSION;
 
 static const int DT_NAVMESH_STATE_MAGIC = 'D'<<24 | 'N'<<16 | 'M'<<8 | 'S'; //'DNMS';
-static const int DT_NAVMESH_STATE_VERSION = 1;
+static const int DT_NAVMESH_STATE_VERSION = 2 | DT_POLYREF_VERSION;
 
 static const unsigned short DT_EXT_LINK = 0x8000;
 static const unsigned int DT_NULL_LINK = 0xffffffff;
@@ -61,13 +81,6 @@ enum dtPolyTypes
 	DT_POLYTYPE_OFFMESH_CONNECTION = 1,			// Off-mesh connections.
 };
 
-struct dtQueryFilter
-{
-	dtQueryFilter() : includeFlags(0xffff), excludeFlags(0) {}
-	unsigned short includeFlags;				// If any of the flags are set, the poly is included.
-	unsigned short excludeFlags;				// If any of the flags are set, the poly is excluded.
-};
-
 // Structure describing the navigation polygon data.
 struct dtPoly
 {
@@ -99,10 +112,94 @@ struct dtLink
 	unsigned char bmin, bmax;				// If boundary link, defines the sub edge area.
 };
 
+// Custom traversal cost, called for the segment pa-pb crossing the specified polygon.
+typedef float (*dtQueryCostFunc)(const float* pa, const float* pb,
+								 dtPolyRef ref, const dtPoly* poly, void* userData);
+
+// Describes which polygons a query may visit and how much it costs to travel over them.
+// Each query carries its own filter, so different agent types can path with
+// different costs at the same time.
+struct dtQueryFilter
+{
+	dtQueryFilter() : includeFlags(0xffff), excludeFlags(0), costFunc(0), costUserData(0)
+	{
+		for (int i = 0; i < DT_MAX_AREAS; ++i)
+			areaCost[i] = 1.0f;
+	}
+	
+	// Sets the pathfinding cost of the specified area (0-63).
+	inline void setAreaCost(const int area, const float cost)
+	{
+		if (area >= 0 && area < DT_MAX_AREAS)
+			areaCost[area] = cost;
+	}
+	
+	// Returns the pathfinding cost of the specified area (0-63).
+	inline float getAreaCost(const int area) const
+	{
+		if (area >= 0 && area < DT_MAX_AREAS)
+			return areaCost[area];
+		return -1;
+	}
+	
+	float areaCost[DT_MAX_AREAS];				// Cost per area, used when costFunc is not set.
+	unsigned short includeFlags;				// If any of the flags are set, the poly is included.
+	unsigned short excludeFlags;				// If any of the flags are set, the poly is excluded.
+	dtQueryCostFunc costFunc;					// Optional custom cost, overrides the area costs.
+	void* costUserData;							// User data passed to costFunc.
+};
+
+// Returns true if a polygon with the specified flags passes the filter.
+inline bool dtPassFilter(const dtQueryFilter* filter, unsigned short flags)
+{
+	return (flags & filter->includeFlags) != 0 && (flags & filter->excludeFlags) == 0;
+}
+
+// Returns true if the two filters accept the same polygons at the same costs.
+inline bool dtSameFilter(const dtQueryFilter* a, const dtQueryFilter* b)
+{
+	if (a->includeFlags != b->includeFlags || a->excludeFlags != b->excludeFlags)
+		return false;
+	if (a->costFunc != b->costFunc || a->costUserData != b->costUserData)
+		return false;
+	for (int i = 0; i < DT_MAX_AREAS; ++i)
+	{
+		if (a->areaCost[i] != b->areaCost[i])
+			return false;
+	}
+	return true;
+}
+
+// Search strategies for findPath().
+enum dtPathSearchMode
+{
+	DT_SEARCH_ASTAR = 0,						// A* with a slightly underestimating heuristic.
+	DT_SEARCH_WEIGHTED,							// A* with the heuristic inflated by the search weight.
+	DT_SEARCH_BIDIRECTIONAL,					// A* from both ends of the path at the same time.
+};
+
+// Selects how findPath() searches and reports how much work it did.
+struct dtPathSearchParams
+{
+	dtPathSearchParams() : mode(DT_SEARCH_ASTAR), weight(1.5f), nodesExpanded(0) {}
+	
+	int mode;									// Search strategy, see dtPathSearchMode.
+	float weight;								// Weighted mode, the path costs at most this many times the best path.
+	int nodesExpanded;							// (out) Number of polygons expanded by the last search.
+};
+
+// Number of children per BVtree node.
+static const int DT_BVNODE_WIDTH = 4;
+// Marks unused child slot of a BVtree node.
+static const int DT_BVNODE_NULL_CHILD = 0x7fffffff;
+
+// BVtree node, the bounds of the children are stored per axis so that
+// all children of a node can be tested against the query box at once.
 struct dtBVNode
 {
-	unsigned short bmin[3], bmax[3];		// BVnode bounds
-	int i;									// Index to item or if negative, escape index.
+	unsigned short bmin[3][DT_BVNODE_WIDTH];	// Min bounds of the children, per axis.
+	unsigned short bmax[3][DT_BVNODE_WIDTH];	// Max bounds of the children, per axis.
+	int child[DT_BVNODE_WIDTH];					// Index to child node, or if negative, -(poly index+1).
 };
 
 struct dtOffMeshConnection
@@ -119,6 +216,7 @@ struct dtMeshHeader
 	int magic;								// Magic number, used to identify the data.
 	int version;							// Data version number.
 	int x, y;								// Location of the time on the grid.
+	int layer;								// Layer of the tile, tiles on different floors share x,y.
 	unsigned int userId;					// User ID of the tile.
 	int polyCount;							// Number of polygons in the tile.
 	int vertCount;							// Number of vertices in the tile.
@@ -127,6 +225,7 @@ struct dtMeshHeader
 	int detailVertCount;					// Number of detail vertices.
 	int detailTriCount;						// Number of detail triangles.
 	int bvNodeCount;						// Number of BVtree nodes.
+	int bvDepth;							// Number of BVtree levels, sizes the traversal stack.
 	int offMeshConCount;					// Number of Off-Mesh links.
 	int offMeshBase;						// Index to first polygon which is Off-Mesh link.
 	float walkableHeight;					// Height of the agent.
@@ -150,6 +249,8 @@ struct dtMeshTile
 	unsigned char* detailTris;				// Pointer to detail triangles (will be updated when tile added).
 	dtBVNode* bvTree;						// Pointer to BVtree nodes (will be updated when tile added).
 	dtOffMeshConnection* offMeshCons;		// Pointer to Off-Mesh links. (will be updated when tile added).
+	float* polyAreaCdf;						// Cumulative ground polygon areas, built when tile is added.
+	float totalArea;						// Total ground polygon area of the tile.
 		
 	unsigned char* data;					// Pointer to tile data.
 	int dataSize;							// Size of the tile data.
@@ -167,6 +268,23 @@ struct dtNavMeshParams
 };
 
 
+// Visitor for the polygon queries, called for every polygon which overlaps
+// the query box and passes the filter. There is no limit on the number of results.
+class dtPolyQuery
+{
+public:
+	virtual ~dtPolyQuery() {}
+	
+	// Processes a polygon found by the query.
+	// Returns true if the visitor tightened the bmin/bmax query box.
+	virtual bool process(const dtMeshTile* tile, const dtPoly* poly, dtPolyRef ref) = 0;
+	
+	// Returns true when the visitor takes no more polygons, the query then stops.
+	virtual bool full() const { return false; }
+	
+	float bmin[3], bmax[3];					// Query box, visitor may shrink it during the query.
+};
+
 class dtNavMesh
 {
 public:
@@ -216,14 +334,24 @@ public:
 	// Returns pointer to tile at specified location.
 	// Params:
 	//  x,y - (in) Location of the tile to get.
+	//  layer - (in) Layer of the tile to get.
 	// Returns: pointer to tile if tile exists or 0 tile does not exists.
-	dtMeshTile* getTileAt(int x, int y) const;
+	dtMeshTile* getTileAt(int x, int y, int layer) const;
+
+	// Returns all layers of tiles at specified location.
+	// Params:
+	//  x,y - (in) Location of the tiles to get.
+	//  tiles - (out) array holding the found tiles.
+	//  maxTiles - (in) The max number of tiles the tiles array can hold.
+	// Returns: Number of tiles stored in the tiles array.
+	int getTilesAt(int x, int y, dtMeshTile** tiles, const int maxTiles) const;
 
 	// Returns reference to tile at specified location.
 	// Params:
 	//  x,y - (in) Location of the tile to get.
+	//  layer - (in) Layer of the tile to get.
 	// Returns: reference to tile if tile exists or 0 tile does not exists.
-	dtTileRef getTileRefAt(int x, int y) const;
+	dtTileRef getTileRefAt(int x, int y, int layer) const;
 	
 	// Returns tile references of a tile.
 	dtTileRef getTileRef(const dtMeshTile* tile) const;
@@ -234,6 +362,11 @@ public:
 	// Returns max number of tiles.
 	int getMaxTiles() const;
 	
+	// Returns a counter which changes every time a tile is added or removed.
+	// Results which depend on the tile connections, such as cached paths, are
+	// stale when the counter differs from the one they were found with.
+	inline unsigned int getTileGeneration() const { return m_tileGeneration; }
+	
 	// Returns pointer to tile in the tile array.
 	// Params:
 	//  i - (in) Index to the tile to retrieve, max index is getMaxTiles()-1.
@@ -272,6 +405,21 @@ public:
 	dtPolyRef findNearestPoly(const float* center, const float* extents,
 							  const dtQueryFilter* filter, float* nearestPt) const;
 	
+	// Finds the nearest polygon for a batch of positions. Queries are grouped by tile
+	// so that each tile is traversed once per group instead of once per position.
+	// Candidate polygons are tested against their exact bounds, so a polygon just
+	// outside the search box, which findNearestPoly() may still return, is skipped.
+	// Params:
+	//	centers[3*count] - (in) the centers of the search boxes.
+	//	count - (in) number of positions.
+	//	extents[3] - (in) the extents of the search boxes, shared by all positions.
+	//  filter - (in) path polygon filter.
+	//	refs[count] - (out) nearest polygon for each position, or 0 if no polygons found.
+	//  nearestPts[3*count] - (out, opt) the nearest point on found polygons, null if not needed.
+	// Returns: Number of positions for which a polygon was found.
+	int findNearestPolys(const float* centers, const int count, const float* extents,
+						 const dtQueryFilter* filter, dtPolyRef* refs, float* nearestPts) const;
+	
 	// Returns polygons which touch the query box.
 	// Params:
 	//	center[3] - (in) the center of the search box.
@@ -282,6 +430,33 @@ public:
 	// Returns: Number of polygons in search result array.
 	int queryPolygons(const float* center, const float* extents, const dtQueryFilter* filter,
 					  dtPolyRef* polys, const int maxPolys) const;
+
+	// Passes all polygons which touch the query box to the visitor.
+	// Params:
+	//  filter - (in) path polygon filter.
+	//  query - (in) visitor which receives the polygons, its bmin/bmax is the query box.
+	void queryPolygons(const dtQueryFilter* filter, dtPolyQuery* query) const;
+	
+	// Returns random location on the navmesh, the polygons which pass the filter are weighted by their area.
+	// Params:
+	//  filter - (in) path polygon filter.
+	//  frand - (in) function returning random number in range [0..1).
+	//  randomPt[3] - (out) the random location.
+	// Returns: Reference to the polygon containing the location, 0 if failed.
+	dtPolyRef findRandomPoint(const dtQueryFilter* filter, float (*frand)(), float* randomPt) const;
+
+	// Returns random location on the navmesh which is reachable from the start polygon
+	// and touches the search circle. Polygons are weighted by their area.
+	// Params:
+	//	startRef - (in) ref to the polygon where the search starts.
+	//	centerPos[3] - (in) center of the search circle.
+	//	maxRadius - (in) radius of the search circle.
+	//  filter - (in) path polygon filter.
+	//  frand - (in) function returning random number in range [0..1).
+	//  randomPt[3] - (out) the random location.
+	// Returns: Reference to the polygon containing the location, 0 if failed.
+	dtPolyRef findRandomPointAroundCircle(dtPolyRef startRef, const float* centerPos, const float maxRadius,
+										  const dtQueryFilter* filter, float (*frand)(), float* randomPt) const;
 	
 	// Finds path from start polygon to end polygon.
 	// If target polygon canno be reached through the navigation graph,
@@ -293,14 +468,16 @@ public:
 	//	endRef - (in) ref to path end polygon.
 	//	startPos[3] - (in) Path start location.
 	//	endPos[3] - (in) Path end location.
-	//  filter - (in) path polygon filter.
+	//  filter - (in) path polygon filter, also provides the traversal costs.
 	//	path - (out) array holding the search result.
 	//	maxPathSize - (in) The max number of polygons the path array can hold.
+	//	search - (in/out, opt) search strategy and statistics, plain A* if not set.
 	// Returns: Number of polygons in search result array.
 	int findPath(dtPolyRef startRef, dtPolyRef endRef,
 				 const float* startPos, const float* endPos,
 				 const dtQueryFilter* filter,
-				 dtPolyRef* path, const int maxPathSize) const;
+				 dtPolyRef* path, const int maxPathSize,
+				 dtPathSearchParams* search = 0) const;
 
 	// Finds a straight path from start to end locations within the corridor
 	// described by the path polygons.
@@ -376,6 +553,23 @@ public:
 	int	findPolysAround(dtPolyRef centerRef, const float* centerPos, float radius, const dtQueryFilter* filter,
 						dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
 						const int maxResult) const;
+
+	// Finds the cost to reach the goal from the polygons around it. The search runs
+	// backwards from the goal, so the result can be used as a flow field which is
+	// shared by all agents heading to the same goal.
+	// Params:
+	//	goalRef - (in) ref to the polygon where the goal lies.
+	//	goalPos[3] - (in) goal location.
+	//	maxCost - (in) polygons which cost more than this to reach the goal are not visited.
+	//  filter - (in) path polygon filter.
+	//	resultRef - (out) refs to the polygons which can reach the goal.
+	//	resultNext - (out) next polygon towards the goal from each result polygon, 0 for the goal.
+	//	resultCost - (out) cost to the goal from the edge shared with the next polygon.
+	//	maxResult - (int) maximum capacity of search results.
+	// Returns: Number of results.
+	int findPolysToGoal(dtPolyRef goalRef, const float* goalPos, float maxCost, const dtQueryFilter* filter,
+						dtPolyRef* resultRef, dtPolyRef* resultNext, float* resultCost,
+						const int maxResult) const;
 	
 	// Returns closest point on navigation polygon.
 	// Uses detail polygons to find the closest point to the navigation polygon surface. 
@@ -413,17 +607,6 @@ public:
 	// Returns: true if over polygon.
 	bool getPolyHeight(dtPolyRef ref, const float* pos, float* height) const;
 
-	// Sets the pathfinding cost of the specified area.
-	// Params:
-	//  area - (in) area ID (0-63).
-	//  cost - (int) travel cost of the area.
-	void setAreaCost(const int area, float cost);
-
-	// Returns the pathfinding cost of the specified area.
-	// Params:
-	//  area - (in) area ID (0-63).
-	float getAreaCost(const int area) const;
-		
 	// Sets polygon flags.
 	void setPolyFlags(dtPolyRef ref, unsigned short flags);
 
@@ -452,44 +635,52 @@ public:
 	// Encodes a tile id.
 	inline dtPolyRef encodePolyId(unsigned int salt, unsigned int it, unsigned int ip) const
 	{
-		return (salt << (m_polyBits+m_tileBits)) | ((it+1) << m_polyBits) | ip;
+		return ((dtPolyRef)salt << (m_polyBits+m_tileBits)) | ((dtPolyRef)it << m_polyBits) | (dtPolyRef)ip;
 	}
 	
 	// Decodes a tile id.
 	inline void decodePolyId(dtPolyRef ref, unsigned int& salt, unsigned int& it, unsigned int& ip) const
 	{
-		salt = (ref >> (m_polyBits+m_tileBits)) & ((1<<m_saltBits)-1);
-		it = ((ref >> m_polyBits) - 1) & ((1<<m_tileBits)-1);
-		ip = ref & ((1<<m_polyBits)-1);
+		salt = (unsigned int)((ref >> (m_polyBits+m_tileBits)) & (((dtPolyRef)1<<m_saltBits)-1));
+		it = (unsigned int)((ref >> m_polyBits) & (((dtPolyRef)1<<m_tileBits)-1));
+		ip = (unsigned int)(ref & (((dtPolyRef)1<<m_polyBits)-1));
 	}
 
 	// Decodes a tile salt.
 	inline unsigned int decodePolyIdSalt(dtPolyRef ref) const
 	{
-		return (ref >> (m_polyBits+m_tileBits)) & ((1<<m_saltBits)-1);
+		return (unsigned int)((ref >> (m_polyBits+m_tileBits)) & (((dtPolyRef)1<<m_saltBits)-1));
 	}
 	
 	// Decodes a tile id.
 	inline unsigned int decodePolyIdTile(dtPolyRef ref) const
 	{
-		return ((ref >> m_polyBits) - 1) & ((1<<m_tileBits)-1);
+		return (unsigned int)((ref >> m_polyBits) & (((dtPolyRef)1<<m_tileBits)-1));
 	}
 	
 	// Decodes a poly id.
 	inline unsigned int decodePolyIdPoly(dtPolyRef ref) const
 	{
-		return ref & ((1<<m_polyBits)-1);
+		return (unsigned int)(ref & (((dtPolyRef)1<<m_polyBits)-1));
 	}
 	
 private:
 
-	// Returns neighbour tile based on side. 
-	dtMeshTile* getNeighbourTileAt(int x, int y, int side) const;
+	// Returns all layers of neighbour tiles based on side.
+	int getNeighbourTilesAt(int x, int y, int side, dtMeshTile** tiles, const int maxTiles) const;
 	// Returns all polygons in neighbour tile based on portal defined by the segment.
 	int findConnectingPolys(const float* va, const float* vb,
 							const dtMeshTile* tile, int side,
 							dtPolyRef* con, float* conarea, int maxcon) const;
 	
+	// Builds cumulative polygon area table used by the random point queries.
+	void calcTileAreas(dtMeshTile* tile);
+	// Returns polygon index in tile, picked randomly weighted by area.
+	int randomPolyInTile(const dtMeshTile* tile, const float r) const;
+	// Returns random location inside a polygon.
+	void randomPointInPoly(const dtMeshTile* tile, const dtPoly* poly, unsigned int ip,
+						   float (*frand)(), float* pt) const;
+	
 	// Builds internal polygons links for a tile.
 	void connectIntLinks(dtMeshTile* tile);
 	// Builds internal polygons links for a tile.
@@ -500,12 +691,11 @@ private:
 	// Builds external polygon links for a tile.
 	void connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int side);
 	
-	// Removes external links at specified side.
-	void unconnectExtLinks(dtMeshTile* tile, int side);
+	// Removes external links which point to the target tile.
+	void unconnectExtLinks(dtMeshTile* tile, dtMeshTile* target);
 	
 	// Queries polygons within a tile.
-	int queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax, const dtQueryFilter* filter,
-							dtPolyRef* polys, const int maxPolys) const;
+	void queryPolygonsInTile(const dtMeshTile* tile, const dtQueryFilter* filter, dtPolyQuery* query) const;
 	// Find nearest polygon within a tile.
 	dtPolyRef findNearestPolyInTile(const dtMeshTile* tile, const float* center, const float* extents,
 									const dtQueryFilter* filter, float* nearestPt) const;
@@ -519,6 +709,12 @@ private:
 						 dtPolyRef to, const dtPoly* toPoly, const dtMeshTile* toTile,
 						 float* left, float* right) const;
 
+	// Finds path by searching from both the start and the end polygon.
+	int findPathBidirectional(dtPolyRef startRef, dtPolyRef endRef,
+							  const float* startPos, const float* endPos,
+							  const dtQueryFilter* filter,
+							  dtPolyRef* path, const int maxPathSize, int& nodesExpanded) const;
+	
 	// Returns edge mid point between two polygons.
 	bool getEdgeMidPoint(dtPolyRef from, dtPolyRef to, float* mid) const;
 	bool getEdgeMidPoint(dtPolyRef from, const dtPoly* fromPoly, const dtMeshTile* fromTile,
@@ -539,11 +735,12 @@ private:
 	unsigned int m_saltBits;			// Number of salt bits in the tile ID.
 	unsigned int m_tileBits;			// Number of tile bits in the tile ID.
 	unsigned int m_polyBits;			// Number of poly bits in the tile ID.
-
-	float m_areaCost[DT_MAX_AREAS];		// Cost per area.
+	unsigned int m_tileGeneration;		// Bumped by addTile() and removeTile().
 
 	class dtNodePool* m_nodePool;		// Pointer to node pool.
 	class dtNodeQueue* m_openList;		// Pointer to open list queue.
+	class dtNodePool* m_backNodePool;	// Node pool of the backward search.
+	class dtNodeQueue* m_backOpenList;	// Open list of the backward search.
 };
 
 #endif // DETOURNAVMESH_H
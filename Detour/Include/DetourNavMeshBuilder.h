@@ -46,6 +46,7 @@ struct dtNavMeshCreateParams
 	// Tile location
 	unsigned int userId;
 	int tileX, tileY;
+	int tileLayer;
 	float bmin[3], bmax[3];
 	// Settings
 	float walkableHeight;
@@ -19,6 +19,8 @@
 #ifndef DETOURNODE_H
 #define DETOURNODE_H
 
+#include "DetourNavMesh.h"
+
 enum dtNodeFlags
 {
 	DT_NODE_OPEN = 0x01,
@@ -29,7 +31,7 @@ struct dtNode
 {
 	float cost;
 	float total;
-	unsigned int id;
+	dtPolyRef id;
 	unsigned int pidx : 30;
 	unsigned int flags : 2;
 };
@@ -41,8 +43,8 @@ public:
 	~dtNodePool();
 	inline void operator=(const dtNodePool&) {}
 	void clear();
-	dtNode* getNode(unsigned int id);
-	const dtNode* findNode(unsigned int id) const;
+	dtNode* getNode(dtPolyRef id);
+	const dtNode* findNode(dtPolyRef id) const;
 
 	inline unsigned int getNodeIdx(const dtNode* node) const
 	{
@@ -65,8 +67,14 @@ public:
 	}
 	
 private:
-	inline unsigned int hashint(unsigned int a) const
+	inline unsigned int hashRef(dtPolyRef ref) const
 	{
+#ifdef DT_POLYREF64
+		// Fold the upper half in, salt and tile bits live there.
+		unsigned int a = (unsigned int)(ref ^ (ref >> 32));
+#else
+		unsigned int a = ref;
+#endif
 		a += ~(a<<15);
 		a ^=  (a>>10);
 		a +=  (a<<3);
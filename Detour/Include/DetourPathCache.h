@@ -0,0 +1,116 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURPATHCACHE_H
+#define DETOURPATHCACHE_H
+
+#include "DetourNavMesh.h"
+
+// Keeps the most recently found paths between pairs of polygons. The cache is
+// emptied whenever a tile is added to or removed from the navmesh, a new tile
+// next to a cached path may open a shorter way. Polygon flags are checked on
+// every hit.
+class dtPathCache
+{
+public:
+	dtPathCache();
+	~dtPathCache();
+
+	// Allocates the cache.
+	// Params:
+	//  maxPaths - (in) max number of paths kept in the cache.
+	//  maxPathSize - (in) max number of polygons in a cached path.
+	// Returns: True if succeed, else false.
+	bool init(const int maxPaths, const int maxPathSize);
+
+	// Finds path from start polygon to end polygon, see dtNavMesh::findPath().
+	// The path is returned from the cache when a valid path between the polygons
+	// was found earlier with an equal filter. Only complete paths are cached.
+	// The start and end locations are not part of the key, a cached path may differ
+	// from a fresh search if the locations within the polygons have moved.
+	// Params:
+	//  navmesh - (in) navmesh to search.
+	//	startRef - (in) ref to path start polygon.
+	//	endRef - (in) ref to path end polygon.
+	//	startPos[3] - (in) Path start location.
+	//	endPos[3] - (in) Path end location.
+	//  filter - (in) path polygon filter.
+	//	path - (out) array holding the search result.
+	//	maxPathSize - (in) The max number of polygons the path array can hold.
+	//	search - (in/out, opt) search strategy used on a cache miss, no nodes are expanded on a hit.
+	// Returns: Number of polygons in search result array.
+	int findPath(dtNavMesh* navmesh, dtPolyRef startRef, dtPolyRef endRef,
+				 const float* startPos, const float* endPos, const dtQueryFilter* filter,
+				 dtPolyRef* path, const int maxPathSize, dtPathSearchParams* search = 0);
+
+	// Removes all paths from the cache, the counters are kept.
+	void clear();
+
+	inline int getHitCount() const { return m_hitCount; }
+	inline int getMissCount() const { return m_missCount; }
+
+private:
+	struct dtPathCacheEntry
+	{
+		dtPolyRef startRef;
+		dtPolyRef endRef;
+		dtQueryFilter filter;
+		int npath;
+		int next;		// Next entry in the hash bucket or in the free list.
+		int lruPrev;	// Previous (more recently used) entry.
+		int lruNext;	// Next (less recently used) entry.
+	};
+
+	inline unsigned int hashPair(dtPolyRef startRef, dtPolyRef endRef) const
+	{
+#ifdef DT_POLYREF64
+		unsigned int a = (unsigned int)(startRef ^ (startRef >> 32)) * 73856093u;
+		unsigned int b = (unsigned int)(endRef ^ (endRef >> 32)) * 19349663u;
+#else
+		unsigned int a = startRef * 73856093u;
+		unsigned int b = endRef * 19349663u;
+#endif
+		return (a ^ b) & (m_hashSize-1);
+	}
+
+	int findEntry(dtPolyRef startRef, dtPolyRef endRef, const dtQueryFilter* filter) const;
+	void removeEntry(const int idx);
+	void addEntry(dtPolyRef startRef, dtPolyRef endRef, const dtQueryFilter* filter,
+				  const dtPolyRef* path, const int npath);
+	void unlinkLru(const int idx);
+	void pushLru(const int idx);
+
+	const dtNavMesh* m_navmesh;			// Navmesh the cached paths were found on.
+	unsigned int m_tileGeneration;		// Tile generation of the navmesh when they were found.
+
+	dtPathCacheEntry* m_entries;
+	dtPolyRef* m_paths;
+	int m_maxPaths;
+	int m_maxPathSize;
+
+	int* m_first;
+	int m_hashSize;
+	int m_freeList;
+	int m_lruHead;
+	int m_lruTail;
+
+	int m_hitCount;
+	int m_missCount;
+};
+
+#endif // DETOURPATHCACHE_H
@@ -0,0 +1,117 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURPATHCORRIDOR_H
+#define DETOURPATHCORRIDOR_H
+
+#include "DetourNavMesh.h"
+
+// Keeps the polygon corridor of an agent moving towards a target. The agent is moved
+// along the corridor each update, the corridor start is shortened with local raycasts
+// and only the invalid part of the corridor needs to be searched again when the
+// navmesh changes.
+class dtPathCorridor
+{
+public:
+	dtPathCorridor();
+	~dtPathCorridor();
+
+	// Allocates the corridor path buffer.
+	// Params:
+	//  maxPath - (in) max number of polygons in the corridor.
+	// Returns: True if succeed, else false.
+	bool init(const int maxPath);
+
+	// Resets the corridor to a single polygon.
+	// Params:
+	//  ref - (in) polygon where the agent is.
+	//  pos[3] - (in) position of the agent.
+	void reset(dtPolyRef ref, const float* pos);
+
+	// Empties the corridor, used when the agent has no polygon to start from.
+	inline void clear() { m_npath = 0; }
+
+	// Sets the corridor to a path found with dtNavMesh::findPath().
+	// The first polygon of the path should contain the current position.
+	// Params:
+	//  target[3] - (in) target position of the path.
+	//  polys - (in) path polygons.
+	//  npolys - (in) number of polygons in the path.
+	void setCorridor(const float* target, const dtPolyRef* polys, const int npolys);
+
+	// Finds the next corners of the straight path along the corridor.
+	// Params:
+	//  cornerVerts[3*maxCorners] - (out) corner positions.
+	//  cornerFlags[maxCorners] - (out) corner flags, see dtStraightPathFlags.
+	//  cornerPolys[maxCorners] - (out) polygon where each corner starts.
+	//  maxCorners - (in) max number of corners to return.
+	//  navmesh - (in) navmesh the corridor belongs to.
+	// Returns: Number of corners.
+	int findCorners(float* cornerVerts, unsigned char* cornerFlags, dtPolyRef* cornerPolys,
+					const int maxCorners, const dtNavMesh* navmesh) const;
+
+	// Shortens the start of the corridor if the next corner is directly visible.
+	// Params:
+	//  next[3] - (in) position the agent is heading to, usually the next corner.
+	//  pathOptimizationRange - (in) max distance the visibility raycast is allowed to travel.
+	//  navmesh - (in) navmesh the corridor belongs to.
+	//  filter - (in) path polygon filter.
+	void optimizePathVisibility(const float* next, const float pathOptimizationRange,
+								const dtNavMesh* navmesh, const dtQueryFilter* filter);
+
+	// Moves the agent along the corridor, polygons which are passed are removed from the corridor.
+	// Params:
+	//  npos[3] - (in) desired new position of the agent.
+	//  navmesh - (in) navmesh the corridor belongs to.
+	// Returns: True if the position is inside the corridor, false if it was constrained.
+	bool movePosition(const float* npos, const dtNavMesh* navmesh);
+
+	// Checks that the corridor polygons still exist and pass the filter.
+	// Params:
+	//  maxLookAhead - (in) number of polygons to check from the start of the corridor.
+	//  navmesh - (in) navmesh the corridor belongs to.
+	//  filter - (in) path polygon filter.
+	// Returns: Index of the first invalid polygon, or -1 if the corridor is valid.
+	int findInvalidPoly(const int maxLookAhead, const dtNavMesh* navmesh, const dtQueryFilter* filter) const;
+
+	// Replans the part of the corridor which follows the first invalid polygon,
+	// the valid start of the corridor is kept.
+	// Params:
+	//  maxLookAhead - (in) number of polygons to check from the start of the corridor.
+	//  navmesh - (in) navmesh the corridor belongs to.
+	//  filter - (in) path polygon filter.
+	// Returns: True if the corridor is valid, false if the whole path needs to be searched again.
+	bool repairPath(const int maxLookAhead, dtNavMesh* navmesh, const dtQueryFilter* filter);
+
+	inline const float* getPos() const { return m_pos; }
+	inline const float* getTarget() const { return m_target; }
+	inline dtPolyRef getFirstPoly() const { return m_npath ? m_path[0] : 0; }
+	inline dtPolyRef getLastPoly() const { return m_npath ? m_path[m_npath-1] : 0; }
+	inline const dtPolyRef* getPath() const { return m_path; }
+	inline int getPathCount() const { return m_npath; }
+
+private:
+	float m_pos[3];
+	float m_target[3];
+
+	dtPolyRef* m_path;
+	int m_npath;
+	int m_maxPath;
+};
+
+#endif // DETOURPATHCORRIDOR_H
@@ -248,3 +248,53 @@ bool dtDistancePtPolyEdgesSqr(const float* pt, const float* verts, const int nve
 	}
 	return c;
 }
+
+float dtPolyArea2D(const float* verts, const int nverts, float* areas)
+{
+	float area = 0;
+	for (int i = 2; i < nverts; i++)
+	{
+		const float a = dtAbs(dtTriArea2D(&verts[0], &verts[(i-1)*3], &verts[i*3])) * 0.5f;
+		if (areas)
+			areas[i] = a;
+		area += a;
+	}
+	return area;
+}
+
+void dtRandomPointInConvexPoly(const float* verts, const int nverts, float* areas,
+							   const float s, const float t, float* out)
+{
+	// Pick a fan triangle weighted by area.
+	const float areasum = dtPolyArea2D(verts, nverts, areas);
+	const float thr = s*areasum;
+	float acc = 0.0f;
+	float u = 0.0f;
+	int tri = 2;
+	for (int i = 2; i < nverts; i++)
+	{
+		const float dacc = areas[i];
+		if (thr >= acc && thr < (acc+dacc))
+		{
+			u = (thr - acc) / dacc;
+			tri = i;
+			break;
+		}
+		acc += dacc;
+		tri = i;
+	}
+	
+	// Square root keeps the point density uniform across the triangle.
+	const float v = sqrtf(t);
+	
+	const float a = 1 - v;
+	const float b = (1 - u) * v;
+	const float c = u * v;
+	const float* pa = &verts[0];
+	const float* pb = &verts[(tri-1)*3];
+	const float* pc = &verts[tri*3];
+	
+	out[0] = a*pa[0] + b*pb[0] + c*pc[0];
+	out[1] = a*pa[1] + b*pb[1] + c*pc[1];
+	out[2] = a*pa[2] + b*pb[2] + c*pc[2];
+}
@@ -0,0 +1,272 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <math.h>
+#include <string.h>
+#include "DetourFlowField.h"
+#include "DetourCommon.h"
+
+
+dtFlowField::dtFlowField() :
+	m_navmesh(0),
+	m_goalRef(0),
+	m_refs(0),
+	m_next(0),
+	m_cost(0),
+	m_npolys(0),
+	m_maxPolys(0),
+	m_first(0),
+	m_hashNext(0),
+	m_hashSize(0),
+	m_tileGeneration(0)
+{
+	m_goalPos[0] = m_goalPos[1] = m_goalPos[2] = 0;
+}
+
+dtFlowField::~dtFlowField()
+{
+	delete [] m_refs;
+	delete [] m_next;
+	delete [] m_cost;
+	delete [] m_first;
+	delete [] m_hashNext;
+}
+
+bool dtFlowField::init(const int maxPolys)
+{
+	delete [] m_refs;
+	delete [] m_next;
+	delete [] m_cost;
+	delete [] m_first;
+	delete [] m_hashNext;
+
+	m_maxPolys = maxPolys;
+	m_hashSize = (int)dtNextPow2((unsigned int)maxPolys);
+
+	m_refs = new dtPolyRef[m_maxPolys];
+	m_next = new dtPolyRef[m_maxPolys];
+	m_cost = new float[m_maxPolys];
+	m_first = new int[m_hashSize];
+	m_hashNext = new int[m_maxPolys];
+	if (!m_refs || !m_next || !m_cost || !m_first || !m_hashNext)
+		return false;
+
+	clear();
+
+	return true;
+}
+
+void dtFlowField::clear()
+{
+	m_navmesh = 0;
+	m_goalRef = 0;
+	m_npolys = 0;
+	m_tileGeneration = 0;
+	if (m_first)
+		memset(m_first, 0xff, sizeof(int)*m_hashSize);
+}
+
+bool dtFlowField::build(const dtNavMesh* navmesh, dtPolyRef goalRef, const float* goalPos,
+						const float maxCost, const dtQueryFilter* filter)
+{
+	clear();
+
+	if (!m_maxPolys)
+		return false;
+
+	m_npolys = navmesh->findPolysToGoal(goalRef, goalPos, maxCost, filter, m_refs, m_next, m_cost, m_maxPolys);
+	if (!m_npolys)
+		return false;
+
+	m_navmesh = navmesh;
+	m_goalRef = goalRef;
+	dtVcopy(m_goalPos, goalPos);
+
+	// Index the polygons.
+	for (int i = 0; i < m_npolys; ++i)
+	{
+		const unsigned int bucket = hashRef(m_refs[i]) & (m_hashSize-1);
+		m_hashNext[i] = m_first[bucket];
+		m_first[bucket] = i;
+	}
+
+	// The field is stale once any tile is added or removed.
+	m_tileGeneration = navmesh->getTileGeneration();
+
+	return true;
+}
+
+bool dtFlowField::isValid(const dtNavMesh* navmesh) const
+{
+	return m_npolys && navmesh == m_navmesh && navmesh->getTileGeneration() == m_tileGeneration;
+}
+
+int dtFlowField::findIndex(dtPolyRef ref) const
+{
+	if (!m_npolys)
+		return -1;
+	int i = m_first[hashRef(ref) & (m_hashSize-1)];
+	while (i != -1)
+	{
+		if (m_refs[i] == ref)
+			return i;
+		i = m_hashNext[i];
+	}
+	return -1;
+}
+
+bool dtFlowField::getNext(dtPolyRef ref, dtPolyRef* next, float* cost) const
+{
+	const int idx = findIndex(ref);
+	if (idx == -1)
+		return false;
+	if (next)
+		*next = m_next[idx];
+	if (cost)
+		*cost = m_cost[idx];
+	return true;
+}
+
+int dtFlowField::getPath(dtPolyRef startRef, dtPolyRef* path, const int maxPath) const
+{
+	int idx = findIndex(startRef);
+	if (idx == -1)
+		return 0;
+
+	int n = 0;
+	while (idx != -1 && n < maxPath)
+	{
+		path[n++] = m_refs[idx];
+		if (!m_next[idx])
+			break;
+		idx = findIndex(m_next[idx]);
+	}
+
+	return n;
+}
+
+
+dtFlowFieldCache::dtFlowFieldCache() :
+	m_slots(0),
+	m_maxFields(0),
+	m_maxCost(0),
+	m_minRequests(1),
+	m_time(0),
+	m_buildCount(0),
+	m_hitCount(0)
+{
+}
+
+dtFlowFieldCache::~dtFlowFieldCache()
+{
+	delete [] m_slots;
+}
+
+bool dtFlowFieldCache::init(const int maxFields, const int maxPolys, const float maxCost, const int minRequests)
+{
+	delete [] m_slots;
+	m_slots = new dtFlowFieldSlot[maxFields];
+	if (!m_slots)
+		return false;
+	m_maxFields = maxFields;
+	m_maxCost = maxCost;
+	m_minRequests = minRequests;
+
+	for (int i = 0; i < m_maxFields; ++i)
+	{
+		if (!m_slots[i].field.init(maxPolys))
+			return false;
+	}
+
+	clear();
+
+	return true;
+}
+
+void dtFlowFieldCache::clear()
+{
+	for (int i = 0; i < m_maxFields; ++i)
+	{
+		dtFlowFieldSlot& slot = m_slots[i];
+		slot.field.clear();
+		slot.goalRef = 0;
+		slot.lastUsed = 0;
+		slot.requests = 0;
+		slot.built = false;
+	}
+	m_time = 0;
+	m_buildCount = 0;
+	m_hitCount = 0;
+}
+
+const dtFlowField* dtFlowFieldCache::getFlowField(const dtNavMesh* navmesh, dtPolyRef goalRef, const dtQueryFilter* filter)
+{
+	if (!navmesh || !goalRef || !filter || !m_maxFields)
+		return 0;
+
+	// Find the goal, or the least recently used slot to replace.
+	dtFlowFieldSlot* slot = 0;
+	dtFlowFieldSlot* oldest = &m_slots[0];
+	for (int i = 0; i < m_maxFields; ++i)
+	{
+		if (m_slots[i].goalRef == goalRef && dtSameFilter(&m_slots[i].filter, filter))
+		{
+			slot = &m_slots[i];
+			break;
+		}
+		if (m_slots[i].lastUsed < oldest->lastUsed)
+			oldest = &m_slots[i];
+	}
+	if (!slot)
+	{
+		slot = oldest;
+		slot->field.clear();
+		slot->goalRef = goalRef;
+		slot->filter = *filter;
+		slot->requests = 0;
+		slot->built = false;
+	}
+	slot->lastUsed = ++m_time;
+	slot->requests++;
+
+	if (slot->built && slot->field.isValid(navmesh))
+	{
+		m_hitCount++;
+		return &slot->field;
+	}
+
+	slot->built = false;
+	if (slot->requests < m_minRequests)
+		return 0;
+
+	// The field is shared by every goal location on the polygon, search towards its center.
+	int ip = 0;
+	const dtMeshTile* tile = navmesh->getTileByPolyRef(goalRef, &ip);
+	if (!tile)
+		return 0;
+	const dtPoly* poly = &tile->polys[ip];
+	float goalPos[3];
+	dtCalcPolyCenter(goalPos, poly->verts, (int)poly->vertCount, tile->verts);
+
+	if (!slot->field.build(navmesh, goalRef, goalPos, m_maxCost, &slot->filter))
+		return 0;
+	slot->built = true;
+	m_buildCount++;
+
+	return &slot->field;
+}
@@ -20,6 +20,7 @@
 #include <float.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "DetourNavMesh.h"
 #include "DetourNode.h"
 #include "DetourCommon.h"
@@ -142,9 +143,23 @@ inline void freeLink(dtMeshTile* tile, unsigned int link)
 }
 
 
-inline bool passFilter(const dtQueryFilter* filter, unsigned short flags)
+inline float getCost(const dtQueryFilter* filter, const float* pa, const float* pb,
+					 dtPolyRef ref, const dtPoly* poly)
 {
-	return (flags & filter->includeFlags) != 0 && (flags & filter->excludeFlags) == 0;
+	if (filter->costFunc)
+		return filter->costFunc(pa, pb, ref, poly, filter->costUserData);
+	return dtVdist(pa, pb) * filter->areaCost[poly->area];
+}
+
+// Returns true if the polygon has a link to the specified polygon.
+inline bool hasLinkTo(const dtMeshTile* tile, const dtPoly* poly, dtPolyRef ref)
+{
+	for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+	{
+		if (tile->links[i].ref == ref)
+			return true;
+	}
+	return false;
 }
 
 
@@ -162,21 +177,22 @@ dtNavMesh::dtNavMesh() :
 	m_saltBits(0),
 	m_tileBits(0),
 	m_polyBits(0),
+	m_tileGeneration(0),
 	m_nodePool(0),
-	m_openList(0)
+	m_openList(0),
+	m_backNodePool(0),
+	m_backOpenList(0)
 {
 	m_orig[0] = 0;
 	m_orig[1] = 0;
 	m_orig[2] = 0;
-	
-	for (int i = 0; i < DT_MAX_AREAS; ++i)
-		m_areaCost[i] = 1.0f;
 }
 
 dtNavMesh::~dtNavMesh()
 {
 	for (int i = 0; i < m_maxTiles; ++i)
 	{
+		delete [] m_tiles[i].polyAreaCdf;
 		if (m_tiles[i].flags & DT_TILE_FREE_DATA)
 		{
 			delete [] m_tiles[i].data;
@@ -186,6 +202,8 @@ dtNavMesh::~dtNavMesh()
 	}
 	delete m_nodePool;
 	delete m_openList;
+	delete m_backNodePool;
+	delete m_backOpenList;
 	delete [] m_posLookup;
 	delete [] m_tiles;
 }
@@ -214,6 +232,7 @@ bool dtNavMesh::init(const dtNavMeshParams* params)
 	m_nextFree = 0;
 	for (int i = m_maxTiles-1; i >= 0; --i)
 	{
+		m_tiles[i].salt = 1;
 		m_tiles[i].next = m_nextFree;
 		m_nextFree = &m_tiles[i];
 	}
@@ -231,13 +250,30 @@ bool dtNavMesh::init(const dtNavMeshParams* params)
 		if (!m_openList)
 			return false;
 	}
+
+	if (!m_backNodePool)
+	{
+		m_backNodePool = new dtNodePool(params->maxNodes, dtNextPow2(params->maxNodes/4));
+		if (!m_backNodePool)
+			return false;
+	}
+	
+	if (!m_backOpenList)
+	{
+		m_backOpenList = new dtNodeQueue(params->maxNodes);
+		if (!m_backOpenList)
+			return false;
+	}
 	
 	// Init ID generator values.
+	// The salt is never zero, so no valid ref is zero and the tile index is stored as is.
+	const unsigned int refBits = sizeof(dtPolyRef)*8;
 	m_tileBits = dtMax((unsigned int)1, dtIlog2(dtNextPow2((unsigned int)params->maxTiles)));
 	m_polyBits = dtMax((unsigned int)1, dtIlog2(dtNextPow2((unsigned int)params->maxPolys)));
-	m_saltBits = 32 - m_tileBits - m_polyBits;
-	if (m_saltBits < 10)
+	if (m_tileBits + m_polyBits + 10 > refBits)
 		return false;
+	// Salt is kept in an unsigned int per tile.
+	m_saltBits = dtMin((unsigned int)31, refBits - m_tileBits - m_polyBits);
 	
 	return true;
 }
@@ -315,9 +351,11 @@ int dtNavMesh::findConnectingPolys(const float* va, const float* vb,
 	return n;
 }
 
-void dtNavMesh::unconnectExtLinks(dtMeshTile* tile, int side)
+void dtNavMesh::unconnectExtLinks(dtMeshTile* tile, dtMeshTile* target)
 {
-	if (!tile) return;
+	if (!tile || !target) return;
+
+	const unsigned int targetNum = (unsigned int)(target - m_tiles);
 
 	for (int i = 0; i < tile->header->polyCount; ++i)
 	{
@@ -326,7 +364,8 @@ void dtNavMesh::unconnectExtLinks(dtMeshTile* tile, int side)
 		unsigned int pj = DT_NULL_LINK;
 		while (j != DT_NULL_LINK)
 		{
-			if (tile->links[j].side == side)
+			if (tile->links[j].side != 0xff &&
+				decodePolyIdTile(tile->links[j].ref) == targetNum)
 			{
 				// Revove link.
 				unsigned int nj = tile->links[j].next;
@@ -581,6 +620,33 @@ void dtNavMesh::connectIntOffMeshLinks(dtMeshTile* tile)
 	}
 }
 
+void dtNavMesh::calcTileAreas(dtMeshTile* tile)
+{
+	if (!tile) return;
+	
+	delete [] tile->polyAreaCdf;
+	tile->polyAreaCdf = new float[dtMax(tile->header->polyCount, 1)];
+	tile->totalArea = 0;
+	if (!tile->polyAreaCdf)
+		return;
+	
+	float verts[DT_VERTS_PER_POLYGON*3];
+	float area = 0;
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		// Off-mesh connections have no area and are never sampled.
+		if (poly->type == DT_POLYTYPE_GROUND)
+		{
+			for (int j = 0; j < (int)poly->vertCount; ++j)
+				dtVcopy(&verts[j*3], &tile->verts[poly->verts[j]*3]);
+			area += dtPolyArea2D(verts, (int)poly->vertCount, 0);
+		}
+		tile->polyAreaCdf[i] = area;
+	}
+	tile->totalArea = area;
+}
+
 dtTileRef dtNavMesh::addTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef)
 {
 	// Make sure the data is in right format.
@@ -591,7 +657,7 @@ dtTileRef dtNavMesh::addTile(unsigned char* data, int dataSize, int flags, dtTil
 		return 0;
 		
 	// Make sure the location is free.
-	if (getTileAt(header->x, header->y))
+	if (getTileAt(header->x, header->y, header->layer))
 		return 0;
 		
 	// Allocate a tile.
@@ -679,49 +745,67 @@ dtTileRef dtNavMesh::addTile(unsigned char* data, int dataSize, int flags, dtTil
 
 	connectIntLinks(tile);
 	connectIntOffMeshLinks(tile);
+	calcTileAreas(tile);
 
-	// Create connections connections.
+	// Create connections with all layers of the neighbour tiles.
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
 	for (int i = 0; i < 8; ++i)
 	{
-		dtMeshTile* nei = getNeighbourTileAt(header->x, header->y, i);
-		if (nei)
+		const int nneis = getNeighbourTilesAt(header->x, header->y, i, neis, MAX_NEIS);
+		for (int j = 0; j < nneis; ++j)
 		{
-			connectExtLinks(tile, nei, i);
-			connectExtLinks(nei, tile, opposite(i));
-			connectExtOffMeshLinks(tile, nei, i);
-			connectExtOffMeshLinks(nei, tile, opposite(i));
+			connectExtLinks(tile, neis[j], i);
+			connectExtLinks(neis[j], tile, opposite(i));
+			connectExtOffMeshLinks(tile, neis[j], i);
+			connectExtOffMeshLinks(neis[j], tile, opposite(i));
 		}
 	}
 	
+	// The neighbours have new links, paths found before may not be the best anymore.
+	m_tileGeneration++;
+	
 	return getTileRef(tile);
 }
 
-dtMeshTile* dtNavMesh::getTileAt(int x, int y) const
+dtMeshTile* dtNavMesh::getTileAt(int x, int y, int layer) const
 {
 	// Find tile based on hash.
 	int h = computeTileHash(x,y,m_tileLutMask);
 	dtMeshTile* tile = m_posLookup[h];
 	while (tile)
 	{
-		if (tile->header && tile->header->x == x && tile->header->y == y)
+		if (tile->header && tile->header->x == x && tile->header->y == y &&
+			tile->header->layer == layer)
 			return tile;
 		tile = tile->next;
 	}
 	return 0;
 }
 
-dtTileRef dtNavMesh::getTileRefAt(int x, int y) const
+int dtNavMesh::getTilesAt(int x, int y, dtMeshTile** tiles, const int maxTiles) const
 {
-	// Find tile based on hash.
+	int n = 0;
+	
+	// Find tiles based on hash, all layers share the same bucket.
 	int h = computeTileHash(x,y,m_tileLutMask);
 	dtMeshTile* tile = m_posLookup[h];
 	while (tile)
 	{
 		if (tile->header && tile->header->x == x && tile->header->y == y)
-			return getTileRef(tile);
+		{
+			if (n < maxTiles)
+				tiles[n++] = tile;
+		}
 		tile = tile->next;
 	}
-	return 0;
+	
+	return n;
+}
+
+dtTileRef dtNavMesh::getTileRefAt(int x, int y, int layer) const
+{
+	return getTileRef(getTileAt(x, y, layer));
 }
 
 int dtNavMesh::getMaxTiles() const
@@ -750,7 +834,7 @@ const dtMeshTile* dtNavMesh::getTileByPolyRef(dtPolyRef ref, int* polyIndex) con
 	return &m_tiles[it];
 }
 
-dtMeshTile* dtNavMesh::getNeighbourTileAt(int x, int y, int side) const
+int dtNavMesh::getNeighbourTilesAt(int x, int y, int side, dtMeshTile** tiles, const int maxTiles) const
 {
 	switch (side)
 	{
@@ -763,7 +847,7 @@ dtMeshTile* dtNavMesh::getNeighbourTileAt(int x, int y, int side) const
 	case 6: y--; break;
 	case 7: x++; y--; break;
 	};
-	return getTileAt(x,y);
+	return getTilesAt(x, y, tiles, maxTiles);
 }
 
 bool dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSize)
@@ -797,11 +881,13 @@ bool dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSize)
 	}
 	
 	// Remove connections to neighbour tiles.
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
 	for (int i = 0; i < 8; ++i)
 	{
-		dtMeshTile* nei = getNeighbourTileAt(tile->header->x,tile->header->y,i);
-		if (!nei) continue;
-		unconnectExtLinks(nei, opposite(i));
+		const int nneis = getNeighbourTilesAt(tile->header->x, tile->header->y, i, neis, MAX_NEIS);
+		for (int j = 0; j < nneis; ++j)
+			unconnectExtLinks(neis[j], tile);
 	}
 	
 	
@@ -832,8 +918,17 @@ bool dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSize)
 	tile->detailTris = 0;
 	tile->bvTree = 0;
 	tile->offMeshCons = 0;
+	delete [] tile->polyAreaCdf;
+	tile->polyAreaCdf = 0;
+	tile->totalArea = 0;
 		
-	tile->salt++;
+	// Bump the salt so that old references to this tile become invalid.
+	// Zero is skipped on wrap, it would make the ref of the first poly zero.
+	tile->salt = (tile->salt+1) & ((1u<<m_saltBits)-1);
+	if (tile->salt == 0)
+		tile->salt++;
+	
+	m_tileGeneration++;
 
 	// Add to free list.
 	tile->next = m_nextFree;
@@ -854,9 +949,9 @@ const dtMeshTile* dtNavMesh::getTileByRef(dtTileRef ref) const
 	if (!ref) return 0;
 	unsigned int tileIndex = decodePolyIdTile((dtPolyRef)ref);
 	unsigned int tileSalt = decodePolyIdSalt((dtPolyRef)ref);
-	if ((int)tileIndex > m_maxTiles)
+	if ((int)tileIndex >= m_maxTiles)
 		return 0;
-	const dtMeshTile* tile = &m_tiles[m_maxTiles];
+	const dtMeshTile* tile = &m_tiles[tileIndex];
 	if (tile->salt != tileSalt)
 		return 0;
 	return tile;
@@ -1131,143 +1226,458 @@ bool dtNavMesh::getPolyHeight(dtPolyRef ref, const float* pos, float* height) co
 	return false;
 }
 
-void dtNavMesh::setAreaCost(const int area, float cost)
+// Keeps track of the nearest polygon and shrinks the query box as closer polygons are found.
+class dtFindNearestPolyQuery : public dtPolyQuery
 {
-	if (area >= 0 && area < DT_MAX_AREAS)
-		m_areaCost[area] = cost;
-}
+public:
+	dtFindNearestPolyQuery(const dtNavMesh* navMesh, const float* center, const float* extents) :
+		m_navMesh(navMesh),
+		m_nearestDistanceSqr(FLT_MAX),
+		m_nearestRef(0)
+	{
+		dtVcopy(m_center, center);
+		dtVcopy(m_extents, extents);
+		dtVsub(bmin, center, extents);
+		dtVadd(bmax, center, extents);
+		m_nearestPoint[0] = m_nearestPoint[1] = m_nearestPoint[2] = 0;
+	}
+	
+	virtual bool process(const dtMeshTile* /*tile*/, const dtPoly* /*poly*/, dtPolyRef ref)
+	{
+		float closestPtPoly[3];
+		if (!m_navMesh->closestPointOnPoly(ref, m_center, closestPtPoly))
+			return false;
+		const float d = dtVdistSqr(m_center, closestPtPoly);
+		if (d >= m_nearestDistanceSqr)
+			return false;
+		
+		dtVcopy(m_nearestPoint, closestPtPoly);
+		m_nearestDistanceSqr = d;
+		m_nearestRef = ref;
+		
+		// Any closer polygon has to touch the sphere of the current distance.
+		const float r = sqrtf(d);
+		for (int i = 0; i < 3; ++i)
+		{
+			const float e = dtMin(m_extents[i], r);
+			bmin[i] = m_center[i] - e;
+			bmax[i] = m_center[i] + e;
+		}
+		return true;
+	}
+	
+	inline dtPolyRef nearestRef() const { return m_nearestRef; }
+	inline const float* nearestPoint() const { return m_nearestPoint; }
+	
+private:
+	const dtNavMesh* m_navMesh;
+	float m_center[3];
+	float m_extents[3];
+	float m_nearestPoint[3];
+	float m_nearestDistanceSqr;
+	dtPolyRef m_nearestRef;
+};
 
-float dtNavMesh::getAreaCost(const int area) const
+// Collects polygons into a fixed size array.
+class dtCollectPolysQuery : public dtPolyQuery
 {
-	if (area >= 0 && area < DT_MAX_AREAS)
-		return m_areaCost[area];
-	return -1;
-}
+public:
+	dtCollectPolysQuery(dtPolyRef* polys, const int maxPolys) :
+		m_polys(polys),
+		m_maxPolys(maxPolys),
+		m_numPolys(0)
+	{
+	}
+	
+	virtual bool process(const dtMeshTile* /*tile*/, const dtPoly* /*poly*/, dtPolyRef ref)
+	{
+		if (m_numPolys < m_maxPolys)
+			m_polys[m_numPolys++] = ref;
+		return false;
+	}
+	
+	virtual bool full() const { return m_numPolys >= m_maxPolys; }
+	
+	inline int numPolys() const { return m_numPolys; }
+	
+private:
+	dtPolyRef* m_polys;
+	const int m_maxPolys;
+	int m_numPolys;
+};
 
 dtPolyRef dtNavMesh::findNearestPoly(const float* center, const float* extents,
 									 const dtQueryFilter* filter, float* nearestPt) const
 {
-	// Get nearby polygons from proximity grid.
-	dtPolyRef polys[128];
-	int polyCount = queryPolygons(center, extents, filter, polys, 128);
+	dtFindNearestPolyQuery query(this, center, extents);
+	queryPolygons(filter, &query);
+	
+	if (query.nearestRef() && nearestPt)
+		dtVcopy(nearestPt, query.nearestPoint());
+	
+	return query.nearestRef();
+}
+
+dtPolyRef dtNavMesh::findNearestPolyInTile(const dtMeshTile* tile, const float* center, const float* extents,
+										   const dtQueryFilter* filter, float* nearestPt) const
+{
+	dtFindNearestPolyQuery query(this, center, extents);
+	queryPolygonsInTile(tile, filter, &query);
+	
+	if (query.nearestRef() && nearestPt)
+		dtVcopy(nearestPt, query.nearestPoint());
+	
+	return query.nearestRef();
+}
+
+// Collects the polygons of a single tile for the batched nearest poly search.
+// Polygon bounds are stored as separate arrays so that the per query tests run as tight loops.
+class dtBatchCandidateQuery : public dtPolyQuery
+{
+public:
+	dtBatchCandidateQuery() :
+		polys(0), bounds(0), count(0), m_capacity(0)
+	{
+	}
 	
-	// Find nearest polygon amongst the nearby polygons.
-	dtPolyRef nearest = 0;
-	float nearestDistanceSqr = FLT_MAX;
-	for (int i = 0; i < polyCount; ++i)
+	~dtBatchCandidateQuery()
 	{
-		dtPolyRef ref = polys[i];
-		float closestPtPoly[3];
-		if (!closestPointOnPoly(ref, center, closestPtPoly))
-			continue;
-		float d = dtVdistSqr(center, closestPtPoly);
-		if (d < nearestDistanceSqr)
+		delete [] polys;
+		delete [] bounds;
+	}
+	
+	void reset(const int maxPolys)
+	{
+		count = 0;
+		if (maxPolys <= m_capacity)
+			return;
+		delete [] polys;
+		delete [] bounds;
+		m_capacity = maxPolys;
+		polys = new unsigned int[m_capacity];
+		bounds = new float[m_capacity*6];
+	}
+	
+	inline float* bminx() const { return bounds; }
+	inline float* bminy() const { return bounds + m_capacity; }
+	inline float* bminz() const { return bounds + m_capacity*2; }
+	inline float* bmaxx() const { return bounds + m_capacity*3; }
+	inline float* bmaxy() const { return bounds + m_capacity*4; }
+	inline float* bmaxz() const { return bounds + m_capacity*5; }
+	
+	virtual bool process(const dtMeshTile* tile, const dtPoly* poly, dtPolyRef /*ref*/)
+	{
+		if (count >= m_capacity)
+			return false;
+		const float* v = &tile->verts[poly->verts[0]*3];
+		float pmin[3], pmax[3];
+		dtVcopy(pmin, v);
+		dtVcopy(pmax, v);
+		for (int j = 1; j < poly->vertCount; ++j)
 		{
-			if (nearestPt)
-				dtVcopy(nearestPt, closestPtPoly);
-			nearestDistanceSqr = d;
-			nearest = ref;
+			v = &tile->verts[poly->verts[j]*3];
+			dtVmin(pmin, v);
+			dtVmax(pmax, v);
 		}
+		// The closest point is searched on the detail mesh, include it in the bounds too.
+		const unsigned int ip = (unsigned int)(poly - tile->polys);
+		if (ip < (unsigned int)tile->header->detailMeshCount)
+		{
+			const dtPolyDetail* pd = &tile->detailMeshes[ip];
+			for (int j = 0; j < pd->vertCount; ++j)
+			{
+				v = &tile->detailVerts[(pd->vertBase+j)*3];
+				dtVmin(pmin, v);
+				dtVmax(pmax, v);
+			}
+		}
+		bminx()[count] = pmin[0];
+		bminy()[count] = pmin[1];
+		bminz()[count] = pmin[2];
+		bmaxx()[count] = pmax[0];
+		bmaxy()[count] = pmax[1];
+		bmaxz()[count] = pmax[2];
+		polys[count] = ip;
+		count++;
+		return false;
 	}
 	
-	return nearest;
+	unsigned int* polys;
+	float* bounds;
+	int count;
+	
+private:
+	int m_capacity;
+};
+
+struct dtBatchItem
+{
+	int tx, ty;
+	int idx;
+};
+
+static int compareBatchItems(const void* va, const void* vb)
+{
+	const dtBatchItem* a = (const dtBatchItem*)va;
+	const dtBatchItem* b = (const dtBatchItem*)vb;
+	if (a->ty != b->ty)
+		return a->ty < b->ty ? -1 : 1;
+	if (a->tx != b->tx)
+		return a->tx < b->tx ? -1 : 1;
+	return a->idx < b->idx ? -1 : (a->idx > b->idx ? 1 : 0);
 }
 
-dtPolyRef dtNavMesh::findNearestPolyInTile(const dtMeshTile* tile, const float* center, const float* extents,
-										   const dtQueryFilter* filter, float* nearestPt) const
+int dtNavMesh::findNearestPolys(const float* centers, const int count, const float* extents,
+								const dtQueryFilter* filter, dtPolyRef* refs, float* nearestPts) const
 {
-	float bmin[3], bmax[3];
-	dtVsub(bmin, center, extents);
-	dtVadd(bmax, center, extents);
+	if (count <= 0)
+		return 0;
 	
-	// Get nearby polygons from proximity grid.
-	dtPolyRef polys[128];
-	int polyCount = queryPolygonsInTile(tile, bmin, bmax, filter, polys, 128);
+	dtBatchItem* items = new dtBatchItem[count];
 	
-	// Find nearest polygon amongst the nearby polygons.
-	dtPolyRef nearest = 0;
-	float nearestDistanceSqr = FLT_MAX;
-	for (int i = 0; i < polyCount; ++i)
+	for (int i = 0; i < count; ++i)
 	{
-		dtPolyRef ref = polys[i];
-		float closestPtPoly[3];
-		if (!closestPointOnPolyInTile(tile, decodePolyIdPoly(ref), center, closestPtPoly))
-			continue;
-		float d = dtVdistSqr(center, closestPtPoly);
-		if (d < nearestDistanceSqr)
+		const float* c = &centers[i*3];
+		refs[i] = 0;
+		items[i].tx = (int)floorf((c[0]-m_orig[0]) / m_tileWidth);
+		items[i].ty = (int)floorf((c[2]-m_orig[2]) / m_tileHeight);
+		items[i].idx = i;
+	}
+	
+	// Group queries by the tile of their center.
+	qsort(items, count, sizeof(dtBatchItem), compareBatchItems);
+	
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	dtBatchCandidateQuery cands;
+	float* bestDist = new float[count];
+	float* lowerBound = 0;
+	int lowerBoundCap = 0;
+	
+	int nfound = 0;
+	int first = 0;
+	while (first < count)
+	{
+		int last = first+1;
+		while (last < count && items[last].tx == items[first].tx && items[last].ty == items[first].ty)
+			last++;
+		
+		// Query box which covers the whole group.
+		dtVsub(cands.bmin, &centers[items[first].idx*3], extents);
+		dtVadd(cands.bmax, &centers[items[first].idx*3], extents);
+		for (int k = first; k < last; ++k)
+		{
+			const int i = items[k].idx;
+			float qmin[3], qmax[3];
+			dtVsub(qmin, &centers[i*3], extents);
+			dtVadd(qmax, &centers[i*3], extents);
+			dtVmin(cands.bmin, qmin);
+			dtVmax(cands.bmax, qmax);
+			bestDist[i] = FLT_MAX;
+		}
+		
+		// Visit the tiles touched by the group, queries near tile borders
+		// may find their nearest polygon in the neighbour tiles.
+		const int minx = (int)floorf((cands.bmin[0]-m_orig[0]) / m_tileWidth);
+		const int maxx = (int)floorf((cands.bmax[0]-m_orig[0]) / m_tileWidth);
+		const int miny = (int)floorf((cands.bmin[2]-m_orig[2]) / m_tileHeight);
+		const int maxy = (int)floorf((cands.bmax[2]-m_orig[2]) / m_tileHeight);
+		
+		for (int y = miny; y <= maxy; ++y)
+		{
+			for (int x = minx; x <= maxx; ++x)
+			{
+				const int nneis = getTilesAt(x, y, neis, MAX_NEIS);
+				for (int j = 0; j < nneis; ++j)
+				{
+					const dtMeshTile* tile = neis[j];
+					
+					// Traverse the tile once for the whole group.
+					cands.reset(tile->header->polyCount + tile->header->offMeshConCount);
+					queryPolygonsInTile(tile, filter, &cands);
+					if (!cands.count)
+						continue;
+					
+					if (cands.count > lowerBoundCap)
+					{
+						delete [] lowerBound;
+						lowerBoundCap = cands.count;
+						lowerBound = new float[lowerBoundCap];
+					}
+					
+					const dtPolyRef base = getTilePolyRefBase(tile);
+					const float* cbminx = cands.bminx();
+					const float* cbminy = cands.bminy();
+					const float* cbminz = cands.bminz();
+					const float* cbmaxx = cands.bmaxx();
+					const float* cbmaxy = cands.bmaxy();
+					const float* cbmaxz = cands.bmaxz();
+					const int ncands = cands.count;
+					
+					for (int k = first; k < last; ++k)
+					{
+						const int i = items[k].idx;
+						const float* c = &centers[i*3];
+						const float cx = c[0], cy = c[1], cz = c[2];
+						const float ex = extents[0], ey = extents[1], ez = extents[2];
+						if (cx+ex < tile->header->bmin[0] || cx-ex > tile->header->bmax[0] ||
+							cz+ez < tile->header->bmin[2] || cz-ez > tile->header->bmax[2])
+							continue;
+						
+						// Distance from the query center to the candidate bounds, FLT_MAX if
+						// the candidate does not touch the query box. Branch free so that
+						// the compiler can vectorize it.
+						for (int n = 0; n < ncands; ++n)
+						{
+							const float gx = dtMax(dtMax(cbminx[n] - cx, cx - cbmaxx[n]), 0.0f);
+							const float gy = dtMax(dtMax(cbminy[n] - cy, cy - cbmaxy[n]), 0.0f);
+							const float gz = dtMax(dtMax(cbminz[n] - cz, cz - cbmaxz[n]), 0.0f);
+							const bool inside = gx <= ex && gy <= ey && gz <= ez;
+							lowerBound[n] = inside ? gx*gx + gy*gy + gz*gz : FLT_MAX;
+						}
+						
+						float best = bestDist[i];
+						for (int n = 0; n < ncands; ++n)
+						{
+							if (lowerBound[n] >= best)
+								continue;
+							float pt[3];
+							if (!closestPointOnPolyInTile(tile, cands.polys[n], c, pt))
+								continue;
+							const float d = dtVdistSqr(c, pt);
+							if (d < best)
+							{
+								best = d;
+								refs[i] = base | (dtPolyRef)cands.polys[n];
+								if (nearestPts)
+									dtVcopy(&nearestPts[i*3], pt);
+							}
+						}
+						bestDist[i] = best;
+					}
+				}
+			}
+		}
+		
+		for (int k = first; k < last; ++k)
 		{
-			if (nearestPt)
-				dtVcopy(nearestPt, closestPtPoly);
-			nearestDistanceSqr = d;
-			nearest = ref;
+			if (refs[items[k].idx])
+				nfound++;
 		}
+		
+		first = last;
 	}
 	
-	return nearest;
+	delete [] lowerBound;
+	delete [] bestDist;
+	delete [] items;
+	
+	return nfound;
+}
+
+// Quantizes query box to the tile BVtree space.
+inline void quantizeQueryBox(const dtMeshTile* tile, const float* qmin, const float* qmax,
+							 unsigned short* bmin, unsigned short* bmax)
+{
+	const float* tbmin = tile->header->bmin;
+	const float* tbmax = tile->header->bmax;
+	const float qfac = tile->header->bvQuantFactor;
+	
+	// dtClamp query box to world box.
+	float minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
+	float miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
+	float minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
+	float maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
+	float maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
+	float maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
+	// Quantize
+	bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
+	bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
+	bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
+	bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
+	bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
+	bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
+}
+
+// Returns bit mask of the node children which overlap the quantized box. The children are
+// tested together without branches, which lets the compiler vectorize the loop.
+inline unsigned int overlapChildren(const dtBVNode* node, const unsigned short* bmin, const unsigned short* bmax)
+{
+	unsigned int mask = 0;
+	for (int i = 0; i < DT_BVNODE_WIDTH; ++i)
+	{
+		const unsigned int overlap = (unsigned int)(bmin[0] <= node->bmax[0][i]) & (unsigned int)(bmax[0] >= node->bmin[0][i]) &
+									 (unsigned int)(bmin[1] <= node->bmax[1][i]) & (unsigned int)(bmax[1] >= node->bmin[1][i]) &
+									 (unsigned int)(bmin[2] <= node->bmax[2][i]) & (unsigned int)(bmax[2] >= node->bmin[2][i]);
+		mask |= overlap << i;
+	}
+	return mask;
 }
 
-int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
-								   const dtQueryFilter* filter,
-								   dtPolyRef* polys, const int maxPolys) const
+void dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const dtQueryFilter* filter, dtPolyQuery* query) const
 {
+	if (!overlapBoxes(query->bmin, query->bmax, tile->header->bmin, tile->header->bmax))
+		return;
+	
+	dtPolyRef base = getTilePolyRefBase(tile);
+	
 	if (tile->bvTree)
 	{
-		const dtBVNode* node = &tile->bvTree[0];
-		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
-		const float* tbmin = tile->header->bmin;
-		const float* tbmax = tile->header->bmax;
-		const float qfac = tile->header->bvQuantFactor;
-		
 		// Calculate quantized box
 		unsigned short bmin[3], bmax[3];
-		// dtClamp query box to world box.
-		float minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
-		float miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
-		float minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
-		float maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
-		float maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
-		float maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
-		// Quantize
-		bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
-		bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
-		bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
-		bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
-		bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
-		bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
-			
+		quantizeQueryBox(tile, query->bmin, query->bmax, bmin, bmax);
+		
+		// Each level leaves at most DT_BVNODE_WIDTH-1 siblings on the stack, the
+		// tree depth is stored by the builder. Deep trees go to the heap.
+		static const int LOCAL_STACK = 128;
+		int localStack[LOCAL_STACK];
+		const int maxStack = tile->header->bvDepth*(DT_BVNODE_WIDTH-1) + 1;
+		int* stack = maxStack <= LOCAL_STACK ? localStack : new int[maxStack];
+		int nstack = 0;
+		stack[nstack++] = 0;
+		
 		// Traverse tree
-		dtPolyRef base = getTilePolyRefBase(tile);
-		int n = 0;
-		while (node < end)
+		while (nstack > 0)
 		{
-			const bool overlap = dtCheckOverlapBox(bmin, bmax, node->bmin, node->bmax);
-			const bool isLeafNode = node->i >= 0;
+			const dtBVNode* node = &tile->bvTree[stack[--nstack]];
+			const unsigned int mask = overlapChildren(node, bmin, bmax);
+			if (!mask)
+				continue;
 			
-			if (isLeafNode && overlap)
+			for (int i = 0; i < DT_BVNODE_WIDTH; ++i)
 			{
-				if (passFilter(filter, tile->polys[node->i].flags))
+				if (!(mask & (1u << i)))
+					continue;
+				const int child = node->child[i];
+				if (child >= 0)
 				{
-					if (n < maxPolys)
-						polys[n++] = base | (dtPolyRef)node->i;
+					if (child != DT_BVNODE_NULL_CHILD)
+						stack[nstack++] = child;
+					continue;
+				}
+				
+				const int ip = -child-1;
+				const dtPoly* poly = &tile->polys[ip];
+				if (dtPassFilter(filter, poly->flags))
+				{
+					// The visitor may tighten the query box.
+					if (query->process(tile, poly, base | (dtPolyRef)ip))
+						quantizeQueryBox(tile, query->bmin, query->bmax, bmin, bmax);
+					if (query->full())
+					{
+						nstack = 0;
+						break;
+					}
 				}
-			}
-			
-			if (overlap || isLeafNode)
-				node++;
-			else
-			{
-				const int escapeIndex = -node->i;
-				node += escapeIndex;
 			}
 		}
-	
-		return n;
+		
+		if (stack != localStack)
+			delete [] stack;
 	}
 	else
 	{
 		float bmin[3], bmax[3];
-		int n = 0;
-		dtPolyRef base = getTilePolyRefBase(tile);
 		for (int i = 0; i < tile->header->polyCount; ++i)
 		{
 			// Calc polygon bounds.
@@ -1281,105 +1691,390 @@ int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, co
 				dtVmin(bmin, v);
 				dtVmax(bmax, v);
 			}
-			if (overlapBoxes(qmin,qmax, bmin,bmax))
+			if (overlapBoxes(query->bmin, query->bmax, bmin, bmax))
 			{
-				if (passFilter(filter, p->flags))
+				if (dtPassFilter(filter, p->flags))
 				{
-					if (n < maxPolys)
-						polys[n++] = base | (dtPolyRef)i;
+					query->process(tile, p, base | (dtPolyRef)i);
+					if (query->full())
+						return;
 				}
 			}
 		}
-		return n;
 	}
 }
 
-int dtNavMesh::queryPolygons(const float* center, const float* extents, const dtQueryFilter* filter,
-							 dtPolyRef* polys, const int maxPolys) const
+void dtNavMesh::queryPolygons(const dtQueryFilter* filter, dtPolyQuery* query) const
 {
-	float bmin[3], bmax[3];
-	dtVsub(bmin, center, extents);
-	dtVadd(bmax, center, extents);
-	
 	// Find tiles the query touches.
-	const int minx = (int)floorf((bmin[0]-m_orig[0]) / m_tileWidth);
-	const int maxx = (int)floorf((bmax[0]-m_orig[0]) / m_tileWidth);
-	const int miny = (int)floorf((bmin[2]-m_orig[2]) / m_tileHeight);
-	const int maxy = (int)floorf((bmax[2]-m_orig[2]) / m_tileHeight);
-
-	int n = 0;
+	const int minx = (int)floorf((query->bmin[0]-m_orig[0]) / m_tileWidth);
+	const int maxx = (int)floorf((query->bmax[0]-m_orig[0]) / m_tileWidth);
+	const int miny = (int)floorf((query->bmin[2]-m_orig[2]) / m_tileHeight);
+	const int maxy = (int)floorf((query->bmax[2]-m_orig[2]) / m_tileHeight);
+	
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	
 	for (int y = miny; y <= maxy; ++y)
 	{
 		for (int x = minx; x <= maxx; ++x)
 		{
-			const dtMeshTile* tile = getTileAt(x,y);
-			if (!tile) continue;
-			n += queryPolygonsInTile(tile, bmin, bmax, filter, polys+n, maxPolys-n);
-			if (n >= maxPolys) return n;
+			const int nneis = getTilesAt(x, y, neis, MAX_NEIS);
+			for (int j = 0; j < nneis; ++j)
+			{
+				queryPolygonsInTile(neis[j], filter, query);
+				if (query->full())
+					return;
+			}
 		}
 	}
+}
 
-	return n;
+int dtNavMesh::queryPolygons(const float* center, const float* extents, const dtQueryFilter* filter,
+							 dtPolyRef* polys, const int maxPolys) const
+{
+	dtCollectPolysQuery query(polys, maxPolys);
+	dtVsub(query.bmin, center, extents);
+	dtVadd(query.bmax, center, extents);
+	queryPolygons(filter, &query);
+	return query.numPolys();
 }
 
-int dtNavMesh::findPath(dtPolyRef startRef, dtPolyRef endRef,
-						const float* startPos, const float* endPos,
-						const dtQueryFilter* filter,
-						dtPolyRef* path, const int maxPathSize) const
+int dtNavMesh::randomPolyInTile(const dtMeshTile* tile, const float r) const
 {
-	if (!startRef || !endRef)
-		return 0;
+	if (!tile->polyAreaCdf || tile->totalArea <= 0)
+		return -1;
 	
-	if (!maxPathSize)
+	// Binary search for the first polygon whose cumulative area exceeds the threshold.
+	const float thr = r * tile->totalArea;
+	int lo = 0, hi = tile->header->polyCount-1;
+	while (lo < hi)
+	{
+		const int mid = (lo+hi)/2;
+		if (tile->polyAreaCdf[mid] > thr)
+			hi = mid;
+		else
+			lo = mid+1;
+	}
+	if (tile->polyAreaCdf[lo] <= thr)
+		return -1;
+	return lo;
+}
+
+void dtNavMesh::randomPointInPoly(const dtMeshTile* tile, const dtPoly* poly, unsigned int ip,
+								  float (*frand)(), float* pt) const
+{
+	float verts[DT_VERTS_PER_POLYGON*3];
+	float areas[DT_VERTS_PER_POLYGON];
+	for (int j = 0; j < (int)poly->vertCount; ++j)
+		dtVcopy(&verts[j*3], &tile->verts[poly->verts[j]*3]);
+	
+	const float s = frand();
+	const float t = frand();
+	float p[3];
+	dtRandomPointInConvexPoly(verts, (int)poly->vertCount, areas, s, t, p);
+	
+	// Snap the height to the detail mesh.
+	if (!closestPointOnPolyInTile(tile, ip, p, pt))
+		dtVcopy(pt, p);
+}
+
+dtPolyRef dtNavMesh::findRandomPoint(const dtQueryFilter* filter, float (*frand)(), float* randomPt) const
+{
+	if (!frand)
 		return 0;
 	
-	if (!getPolyByRef(startRef) || !getPolyByRef(endRef))
+	float totalArea = 0;
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		if (m_tiles[i].header)
+			totalArea += m_tiles[i].totalArea;
+	}
+	if (totalArea <= 0)
 		return 0;
 	
-	if (startRef == endRef)
+	// The area tables do not know about the filter. Draw a few samples over the
+	// whole mesh and keep the first one, in draw order, which passes the filter.
+	// Every sample picks its own tile, so the result stays uniform over the area
+	// the filter accepts and one mostly filtered tile does not use up all tries.
+	static const int MAX_TRIES = 16;
+	float thr[MAX_TRIES];
+	int order[MAX_TRIES];
+	const dtMeshTile* sampleTile[MAX_TRIES];
+	int samplePoly[MAX_TRIES];
+	for (int i = 0; i < MAX_TRIES; ++i)
 	{
-		path[0] = startRef;
-		return 1;
+		thr[i] = frand()*totalArea;
+		sampleTile[i] = 0;
+		samplePoly[i] = -1;
+		// Insertion sort the samples by threshold.
+		int j = i;
+		while (j > 0 && thr[order[j-1]] > thr[i])
+		{
+			order[j] = order[j-1];
+			j--;
+		}
+		order[j] = i;
 	}
 	
-	if (!m_nodePool || !m_openList)
+	// Walk the tiles once, each sample gets the tile its threshold falls into.
+	float acc = 0;
+	int k = 0;
+	for (int i = 0; i < m_maxTiles && k < MAX_TRIES; ++i)
+	{
+		const dtMeshTile* t = &m_tiles[i];
+		if (!t->header || t->totalArea <= 0) continue;
+		while (k < MAX_TRIES && thr[order[k]] < acc + t->totalArea)
+		{
+			const int s = order[k++];
+			sampleTile[s] = t;
+			samplePoly[s] = randomPolyInTile(t, (thr[s] - acc) / t->totalArea);
+		}
+		acc += t->totalArea;
+	}
+	
+	for (int i = 0; i < MAX_TRIES; ++i)
+	{
+		const dtMeshTile* t = sampleTile[i];
+		const int ip = samplePoly[i];
+		if (!t || ip < 0) continue;
+		const dtPoly* poly = &t->polys[ip];
+		if (!dtPassFilter(filter, poly->flags)) continue;
+		randomPointInPoly(t, poly, (unsigned int)ip, frand, randomPt);
+		return getTilePolyRefBase(t) | (dtPolyRef)ip;
+	}
+	
+	// The filter rejects most of the mesh, choose among the polygons it accepts
+	// directly, weighted by their area.
+	const dtMeshTile* tile = 0;
+	int tileIp = -1;
+	float asum = 0;
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		const dtMeshTile* t = &m_tiles[i];
+		if (!t->header || !t->polyAreaCdf || t->totalArea <= 0) continue;
+		for (int j = 0; j < t->header->polyCount; ++j)
+		{
+			const dtPoly* poly = &t->polys[j];
+			if (poly->type != DT_POLYTYPE_GROUND) continue;
+			if (!dtPassFilter(filter, poly->flags)) continue;
+			const float area = t->polyAreaCdf[j] - (j > 0 ? t->polyAreaCdf[j-1] : 0.0f);
+			if (area <= 0) continue;
+			asum += area;
+			if (frand()*asum <= area)
+			{
+				tile = t;
+				tileIp = j;
+			}
+		}
+	}
+	if (!tile)
 		return 0;
-		
+	
+	randomPointInPoly(tile, &tile->polys[tileIp], (unsigned int)tileIp, frand, randomPt);
+	return getTilePolyRefBase(tile) | (dtPolyRef)tileIp;
+}
+
+dtPolyRef dtNavMesh::findRandomPointAroundCircle(dtPolyRef startRef, const float* centerPos, const float maxRadius,
+												 const dtQueryFilter* filter, float (*frand)(), float* randomPt) const
+{
+	if (!startRef || !frand) return 0;
+	if (!getPolyByRef(startRef)) return 0;
+	if (!m_nodePool || !m_openList) return 0;
+	
 	m_nodePool->clear();
 	m_openList->clear();
 	
-	static const float H_SCALE = 0.999f;	// Heuristic scale.
-	
 	dtNode* startNode = m_nodePool->getNode(startRef);
 	startNode->pidx = 0;
 	startNode->cost = 0;
-	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
+	startNode->total = 0;
 	startNode->id = startRef;
 	startNode->flags = DT_NODE_OPEN;
 	m_openList->push(startNode);
 	
-	dtNode* lastBestNode = startNode;
-	float lastBestNodeCost = startNode->total;
-
-	unsigned int it, ip;
+	const float radiusSqr = dtSqr(maxRadius);
+	float areaSum = 0.0f;
+	
+	const dtMeshTile* randomTile = 0;
+	const dtPoly* randomPoly = 0;
+	dtPolyRef randomPolyRef = 0;
 	
 	while (!m_openList->empty())
 	{
 		dtNode* bestNode = m_openList->pop();
-		// Remove node from open list and put it in closed list.
 		bestNode->flags &= ~DT_NODE_OPEN;
 		bestNode->flags |= DT_NODE_CLOSED;
-
-		// Reached the goal, stop searching.
-		if (bestNode->id == endRef)
-		{
-			lastBestNode = bestNode;
-			break;
-		}
-
-		float previousEdgeMidPoint[3];
-
-		// Get current poly and tile.
+		
+		// Get poly and tile.
+		// The API input has been cheked already, skip checking internal data.
+		const dtPolyRef bestRef = bestNode->id;
+		const unsigned int bit = decodePolyIdTile(bestRef);
+		const unsigned int bip = decodePolyIdPoly(bestRef);
+		const dtMeshTile* bestTile = &m_tiles[bit];
+		const dtPoly* bestPoly = &bestTile->polys[bip];
+		
+		// Pick one of the visited polygons, weighted by area.
+		if (bestPoly->type == DT_POLYTYPE_GROUND && bestTile->polyAreaCdf)
+		{
+			const float area = bestTile->polyAreaCdf[bip] - (bip > 0 ? bestTile->polyAreaCdf[bip-1] : 0.0f);
+			areaSum += area;
+			if (area > 0 && frand()*areaSum <= area)
+			{
+				randomTile = bestTile;
+				randomPoly = bestPoly;
+				randomPolyRef = bestRef;
+			}
+		}
+		
+		// Get parent ref.
+		dtPolyRef parentRef = 0;
+		if (bestNode->pidx)
+			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+		
+		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		{
+			const dtLink* link = &bestTile->links[i];
+			dtPolyRef neighbourRef = link->ref;
+			// Skip invalid neighbours and do not follow back to parent.
+			if (!neighbourRef || neighbourRef == parentRef)
+				continue;
+			
+			// Expand to neighbour
+			const dtMeshTile* neighbourTile = &m_tiles[decodePolyIdTile(neighbourRef)];
+			const dtPoly* neighbourPoly = &neighbourTile->polys[decodePolyIdPoly(neighbourRef)];
+			
+			if (!dtPassFilter(filter, neighbourPoly->flags))
+				continue;
+			
+			// Find edge and calc distance to the edge.
+			float va[3], vb[3];
+			if (!getPortalPoints(bestRef, bestPoly, bestTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
+				continue;
+			
+			// If the circle is not touching the next polygon, skip it.
+			float tseg;
+			const float distSqr = dtDistancePtSegSqr2D(centerPos, va, vb, tseg);
+			if (distSqr > radiusSqr)
+				continue;
+			
+			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
+			if (!neighbourNode)
+				continue;
+			if (neighbourNode->flags & DT_NODE_CLOSED)
+				continue;
+			
+			// Expand polygons closest to the center first.
+			float edgeMidPoint[3];
+			dtVlerp(edgeMidPoint, va, vb, 0.5f);
+			const float total = dtVdist(centerPos, edgeMidPoint);
+			
+			// The node is already in open list and the new result is worse, skip.
+			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
+				continue;
+			
+			neighbourNode->id = neighbourRef;
+			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+			neighbourNode->total = total;
+			
+			if (neighbourNode->flags & DT_NODE_OPEN)
+			{
+				m_openList->modify(neighbourNode);
+			}
+			else
+			{
+				neighbourNode->flags = DT_NODE_OPEN;
+				m_openList->push(neighbourNode);
+			}
+		}
+	}
+	
+	if (!randomPoly)
+		return 0;
+	
+	randomPointInPoly(randomTile, randomPoly, decodePolyIdPoly(randomPolyRef), frand, randomPt);
+	
+	return randomPolyRef;
+}
+
+int dtNavMesh::findPath(dtPolyRef startRef, dtPolyRef endRef,
+						const float* startPos, const float* endPos,
+						const dtQueryFilter* filter,
+						dtPolyRef* path, const int maxPathSize,
+						dtPathSearchParams* search) const
+{
+	if (search)
+		search->nodesExpanded = 0;
+	
+	if (!startRef || !endRef)
+		return 0;
+	
+	if (!maxPathSize)
+		return 0;
+	
+	if (!getPolyByRef(startRef) || !getPolyByRef(endRef))
+		return 0;
+	
+	if (startRef == endRef)
+	{
+		path[0] = startRef;
+		return 1;
+	}
+	
+	if (!m_nodePool || !m_openList)
+		return 0;
+	
+	if (search && search->mode == DT_SEARCH_BIDIRECTIONAL)
+		return findPathBidirectional(startRef, endRef, startPos, endPos, filter,
+									 path, maxPathSize, search->nodesExpanded);
+	
+	m_nodePool->clear();
+	m_openList->clear();
+	
+	static const float H_SCALE = 0.999f;	// Heuristic scale.
+	
+	// The weighted search inflates the heuristic and does not reopen visited nodes,
+	// the found path costs at most weight times the best path.
+	float hscale = H_SCALE;
+	bool reopen = true;
+	if (search && search->mode == DT_SEARCH_WEIGHTED)
+	{
+		hscale = H_SCALE * dtMax(1.0f, search->weight);
+		reopen = false;
+	}
+	int nodesExpanded = 0;
+	
+	dtNode* startNode = m_nodePool->getNode(startRef);
+	startNode->pidx = 0;
+	startNode->cost = 0;
+	startNode->total = dtVdist(startPos, endPos) * hscale;
+	startNode->id = startRef;
+	startNode->flags = DT_NODE_OPEN;
+	m_openList->push(startNode);
+	
+	dtNode* lastBestNode = startNode;
+	float lastBestNodeCost = startNode->total;
+
+	unsigned int it, ip;
+	
+	while (!m_openList->empty())
+	{
+		dtNode* bestNode = m_openList->pop();
+		// Remove node from open list and put it in closed list.
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+		nodesExpanded++;
+
+		// Reached the goal, stop searching.
+		if (bestNode->id == endRef)
+		{
+			lastBestNode = bestNode;
+			break;
+		}
+
+		float previousEdgeMidPoint[3];
+
+		// Get current poly and tile.
 		// The API input has been cheked already, skip checking internal data.
 		const dtPolyRef bestRef = bestNode->id;
 		it = decodePolyIdTile(bestRef);
@@ -1423,7 +2118,7 @@ int dtNavMesh::findPath(dtPolyRef startRef, dtPolyRef endRef,
 			const dtMeshTile* neighbourTile = &m_tiles[it];
 			const dtPoly* neighbourPoly = &neighbourTile->polys[ip];
 
-			if (!passFilter(filter, neighbourPoly->flags))
+			if (!dtPassFilter(filter, neighbourPoly->flags))
 				continue;
 
 			dtNode newNode;
@@ -1442,8 +2137,8 @@ int dtNavMesh::findPath(dtPolyRef startRef, dtPolyRef endRef,
 			{
 				// Cost
 				newNode.cost = bestNode->cost +
-								dtVdist(previousEdgeMidPoint,edgeMidPoint) * m_areaCost[bestPoly->area] +
-								dtVdist(edgeMidPoint, endPos) * m_areaCost[neighbourPoly->area];
+								getCost(filter, previousEdgeMidPoint, edgeMidPoint, bestRef, bestPoly) +
+								getCost(filter, edgeMidPoint, endPos, neighbourRef, neighbourPoly);
 				// Heuristic
 				h = 0;
 			}
@@ -1451,9 +2146,9 @@ int dtNavMesh::findPath(dtPolyRef startRef, dtPolyRef endRef,
 			{
 				// Cost
 				newNode.cost = bestNode->cost +
-								dtVdist(previousEdgeMidPoint,edgeMidPoint) * m_areaCost[bestPoly->area];
+								getCost(filter, previousEdgeMidPoint, edgeMidPoint, bestRef, bestPoly);
 				// Heuristic
-				h = dtVdist(edgeMidPoint,endPos)*H_SCALE;
+				h = dtVdist(edgeMidPoint,endPos)*hscale;
 			}
 			newNode.total = newNode.cost + h;
 			
@@ -1465,7 +2160,7 @@ int dtNavMesh::findPath(dtPolyRef startRef, dtPolyRef endRef,
 			if ((actualNode->flags & DT_NODE_OPEN) && newNode.total >= actualNode->total)
 				continue;
 			// The node is already visited and process, and the new result is worse, skip.
-			if ((actualNode->flags & DT_NODE_CLOSED) && newNode.total >= actualNode->total)
+			if ((actualNode->flags & DT_NODE_CLOSED) && (!reopen || newNode.total >= actualNode->total))
 				continue;
 
 			// Add or update the node.
@@ -1495,6 +2190,9 @@ int dtNavMesh::findPath(dtPolyRef startRef, dtPolyRef endRef,
 		}
 	}
 	
+	if (search)
+		search->nodesExpanded = nodesExpanded;
+	
 	// Reverse the path.
 	dtNode* prev = 0;
 	dtNode* node = lastBestNode;
@@ -1520,6 +2218,216 @@ int dtNavMesh::findPath(dtPolyRef startRef, dtPolyRef endRef,
 	return n;
 }
 
+int dtNavMesh::findPathBidirectional(dtPolyRef startRef, dtPolyRef endRef,
+									 const float* startPos, const float* endPos,
+									 const dtQueryFilter* filter,
+									 dtPolyRef* path, const int maxPathSize, int& nodesExpanded) const
+{
+	nodesExpanded = 0;
+	
+	if (!m_backNodePool || !m_backOpenList)
+		return 0;
+	
+	static const float H_SCALE = 0.999f;	// Heuristic scale.
+	
+	// Index 0 is the search from the start, index 1 the search from the end.
+	dtNodePool* pools[2] = { m_nodePool, m_backNodePool };
+	dtNodeQueue* openLists[2] = { m_openList, m_backOpenList };
+	const dtPolyRef origins[2] = { startRef, endRef };
+	const float* originPos[2] = { startPos, endPos };
+	const float* targetPos[2] = { endPos, startPos };
+	
+	for (int i = 0; i < 2; ++i)
+	{
+		pools[i]->clear();
+		openLists[i]->clear();
+		
+		dtNode* node = pools[i]->getNode(origins[i]);
+		node->pidx = 0;
+		node->cost = 0;
+		node->total = dtVdist(startPos, endPos) * H_SCALE;
+		node->id = origins[i];
+		node->flags = DT_NODE_OPEN;
+		openLists[i]->push(node);
+	}
+	
+	dtNode* lastBestNode = pools[0]->getNode(startRef);
+	float lastBestNodeCost = lastBestNode->total;
+	
+	// Polygon where the searches meet.
+	unsigned int meetIdx[2] = { 0, 0 };
+	
+	unsigned int it, ip;
+	int side = 1;
+	
+	while (!openLists[0]->empty())
+	{
+		// Alternate between the searches. When the search from the end runs out
+		// without meeting, the end cannot be reached and the search from the start
+		// continues alone to find the nearest polygon.
+		side = openLists[1]->empty() ? 0 : 1-side;
+		dtNodePool* pool = pools[side];
+		dtNodeQueue* openList = openLists[side];
+		
+		dtNode* bestNode = openList->pop();
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+		nodesExpanded++;
+		
+		const dtPolyRef bestRef = bestNode->id;
+		
+		// Stop where the searches first meet. Waiting for a provably cheaper meeting
+		// point would expand more polygons than the search from the start alone.
+		const dtNode* otherNode = pools[1-side]->findNode(bestRef);
+		if (otherNode)
+		{
+			meetIdx[side] = pool->getNodeIdx(bestNode);
+			meetIdx[1-side] = pools[1-side]->getNodeIdx(otherNode);
+			break;
+		}
+		
+		float previousEdgeMidPoint[3];
+		
+		// Get current poly and tile.
+		// The API input has been cheked already, skip checking internal data.
+		it = decodePolyIdTile(bestRef);
+		ip = decodePolyIdPoly(bestRef);
+		const dtMeshTile* bestTile = &m_tiles[it];
+		const dtPoly* bestPoly = &bestTile->polys[ip];
+		
+		// Get parent poly and tile.
+		dtPolyRef parentRef = 0;
+		if (bestNode->pidx)
+			parentRef = pool->getNodeAtIdx(bestNode->pidx)->id;
+		if (parentRef)
+		{
+			it = decodePolyIdTile(parentRef);
+			ip = decodePolyIdPoly(parentRef);
+			const dtMeshTile* parentTile = &m_tiles[it];
+			const dtPoly* parentPoly = &parentTile->polys[ip];
+			
+			getEdgeMidPoint(parentRef, parentPoly, parentTile,
+							bestRef, bestPoly, bestTile, previousEdgeMidPoint);
+		}
+		else
+		{
+			dtVcopy(previousEdgeMidPoint, originPos[side]);
+		}
+		
+		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		{
+			dtPolyRef neighbourRef = bestTile->links[i].ref;
+			
+			// Skip invalid ids and do not expand back to where we came from.
+			if (!neighbourRef || neighbourRef == parentRef)
+				continue;
+			
+			// Get neighbour poly and tile.
+			// The API input has been cheked already, skip checking internal data.
+			it = decodePolyIdTile(neighbourRef);
+			ip = decodePolyIdPoly(neighbourRef);
+			const dtMeshTile* neighbourTile = &m_tiles[it];
+			const dtPoly* neighbourPoly = &neighbourTile->polys[ip];
+			
+			if (!dtPassFilter(filter, neighbourPoly->flags))
+				continue;
+			
+			// The search from the end runs against the direction of travel,
+			// off-mesh connections may only be traversed one way.
+			if (side == 1 &&
+				(bestPoly->type == DT_POLYTYPE_OFFMESH_CONNECTION || neighbourPoly->type == DT_POLYTYPE_OFFMESH_CONNECTION) &&
+				!hasLinkTo(neighbourTile, neighbourPoly, bestRef))
+				continue;
+			
+			float edgeMidPoint[3];
+			getEdgeMidPoint(bestRef, bestPoly, bestTile,
+							neighbourRef, neighbourPoly, neighbourTile, edgeMidPoint);
+			
+			// Cost of crossing the best polygon, in the direction of travel.
+			float cost;
+			if (side == 0)
+				cost = bestNode->cost + getCost(filter, previousEdgeMidPoint, edgeMidPoint, bestRef, bestPoly);
+			else
+				cost = bestNode->cost + getCost(filter, edgeMidPoint, previousEdgeMidPoint, bestRef, bestPoly);
+			const float h = dtVdist(edgeMidPoint, targetPos[side]) * H_SCALE;
+			const float total = cost + h;
+			
+			dtNode* actualNode = pool->getNode(neighbourRef);
+			if (!actualNode)
+				continue;
+			
+			// The node is already in open list and the new result is worse, skip.
+			if ((actualNode->flags & DT_NODE_OPEN) && total >= actualNode->total)
+				continue;
+			// The node is already visited and process, and the new result is worse, skip.
+			if ((actualNode->flags & DT_NODE_CLOSED) && total >= actualNode->total)
+				continue;
+			
+			// Add or update the node.
+			actualNode->flags &= ~DT_NODE_CLOSED;
+			actualNode->pidx = pool->getNodeIdx(bestNode);
+			actualNode->cost = cost;
+			actualNode->total = total;
+			
+			// Update nearest node to target so far.
+			if (side == 0 && h < lastBestNodeCost)
+			{
+				lastBestNodeCost = h;
+				lastBestNode = actualNode;
+			}
+			
+			if (actualNode->flags & DT_NODE_OPEN)
+			{
+				// Already in open, update node location.
+				openList->modify(actualNode);
+			}
+			else
+			{
+				// Put the node in open list.
+				actualNode->flags |= DT_NODE_OPEN;
+				openList->push(actualNode);
+			}
+		}
+	}
+	
+	// Without a meeting point, return the path to the nearest polygon.
+	dtNode* node = meetIdx[0] ? m_nodePool->getNodeAtIdx(meetIdx[0]) : lastBestNode;
+	
+	// Reverse the path from the start.
+	dtNode* prev = 0;
+	do
+	{
+		dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
+		node->pidx = m_nodePool->getNodeIdx(prev);
+		prev = node;
+		node = next;
+	}
+	while (node);
+	
+	// Store path
+	node = prev;
+	int n = 0;
+	do
+	{
+		path[n++] = node->id;
+		node = m_nodePool->getNodeAtIdx(node->pidx);
+	}
+	while (node && n < maxPathSize);
+	
+	// Continue with the path from the meeting point to the end.
+	if (meetIdx[1])
+	{
+		node = m_backNodePool->getNodeAtIdx(m_backNodePool->getNodeAtIdx(meetIdx[1])->pidx);
+		while (node && n < maxPathSize)
+		{
+			path[n++] = node->id;
+			node = m_backNodePool->getNodeAtIdx(node->pidx);
+		}
+	}
+	
+	return n;
+}
+
 int dtNavMesh::findStraightPath(const float* startPos, const float* endPos,
 								const dtPolyRef* path, const int pathSize,
 								float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
@@ -2099,7 +3007,7 @@ int dtNavMesh::raycast(dtPolyRef centerRef, const float* startPos, const float*
 				continue;
 				
 			// Skip links based on filter.
-			if (!passFilter(filter, nextPoly->flags))
+			if (!dtPassFilter(filter, nextPoly->flags))
 				continue;
 		
 			// If the link is internal, just return the ref.
@@ -2270,7 +3178,7 @@ int dtNavMesh::findPolysAround(dtPolyRef centerRef, const float* centerPos, floa
 			const dtMeshTile* neighbourTile = &m_tiles[it];
 			const dtPoly* neighbourPoly = &neighbourTile->polys[ip];
 			
-			if (!passFilter(filter, neighbourPoly->flags))
+			if (!dtPassFilter(filter, neighbourPoly->flags))
 				continue;
 			
 			dtNode newNode;
@@ -2321,6 +3229,139 @@ int dtNavMesh::findPolysAround(dtPolyRef centerRef, const float* centerPos, floa
 	return n;
 }
 
+int dtNavMesh::findPolysToGoal(dtPolyRef goalRef, const float* goalPos, float maxCost, const dtQueryFilter* filter,
+							   dtPolyRef* resultRef, dtPolyRef* resultNext, float* resultCost,
+							   const int maxResult) const
+{
+	if (!goalRef || !maxResult) return 0;
+	if (!getPolyByRef(goalRef)) return 0;
+	if (!m_nodePool || !m_openList) return 0;
+	
+	m_nodePool->clear();
+	m_openList->clear();
+	
+	dtNode* startNode = m_nodePool->getNode(goalRef);
+	startNode->pidx = 0;
+	startNode->cost = 0;
+	startNode->total = 0;
+	startNode->id = goalRef;
+	startNode->flags = DT_NODE_OPEN;
+	m_openList->push(startNode);
+	
+	int n = 0;
+	resultRef[n++] = goalRef;
+	
+	unsigned int it, ip;
+	
+	while (!m_openList->empty())
+	{
+		dtNode* bestNode = m_openList->pop();
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+		
+		float nextEdgeMidPoint[3];
+		
+		// Get poly and tile.
+		// The API input has been cheked already, skip checking internal data.
+		const dtPolyRef bestRef = bestNode->id;
+		it = decodePolyIdTile(bestRef);
+		ip = decodePolyIdPoly(bestRef);
+		const dtMeshTile* bestTile = &m_tiles[it];
+		const dtPoly* bestPoly = &bestTile->polys[ip];
+		
+		// Get the polygon which leads towards the goal.
+		dtPolyRef nextRef = 0;
+		if (bestNode->pidx)
+			nextRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+		if (nextRef)
+		{
+			it = decodePolyIdTile(nextRef);
+			ip = decodePolyIdPoly(nextRef);
+			const dtMeshTile* nextTile = &m_tiles[it];
+			const dtPoly* nextPoly = &nextTile->polys[ip];
+			
+			getEdgeMidPoint(bestRef, bestPoly, bestTile,
+							nextRef, nextPoly, nextTile, nextEdgeMidPoint);
+		}
+		else
+		{
+			dtVcopy(nextEdgeMidPoint, goalPos);
+		}
+		
+		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		{
+			dtPolyRef neighbourRef = bestTile->links[i].ref;
+			
+			// Skip invalid ids and do not expand back to where we came from.
+			if (!neighbourRef || neighbourRef == nextRef)
+				continue;
+			
+			it = decodePolyIdTile(neighbourRef);
+			ip = decodePolyIdPoly(neighbourRef);
+			const dtMeshTile* neighbourTile = &m_tiles[it];
+			const dtPoly* neighbourPoly = &neighbourTile->polys[ip];
+			
+			if (!dtPassFilter(filter, neighbourPoly->flags))
+				continue;
+			
+			// The search runs against the direction of travel, off-mesh connections
+			// may only be traversed one way.
+			if ((bestPoly->type == DT_POLYTYPE_OFFMESH_CONNECTION || neighbourPoly->type == DT_POLYTYPE_OFFMESH_CONNECTION) &&
+				!hasLinkTo(neighbourTile, neighbourPoly, bestRef))
+				continue;
+			
+			// Cost of crossing the best polygon when coming from the neighbour.
+			float edgeMidPoint[3];
+			getEdgeMidPoint(bestRef, bestPoly, bestTile,
+							neighbourRef, neighbourPoly, neighbourTile, edgeMidPoint);
+			const float cost = bestNode->cost + getCost(filter, edgeMidPoint, nextEdgeMidPoint, bestRef, bestPoly);
+			if (cost > maxCost)
+				continue;
+			
+			dtNode* actualNode = m_nodePool->getNode(neighbourRef);
+			if (!actualNode)
+				continue;
+			
+			// The node is already visited and the new result is worse, skip.
+			if ((actualNode->flags & (DT_NODE_OPEN | DT_NODE_CLOSED)) && cost >= actualNode->cost)
+				continue;
+			
+			if (!actualNode->flags)
+			{
+				// Out of result space, do not expand further.
+				if (n >= maxResult)
+					continue;
+				resultRef[n++] = neighbourRef;
+			}
+			
+			actualNode->flags &= ~DT_NODE_CLOSED;
+			actualNode->pidx = m_nodePool->getNodeIdx(bestNode);
+			actualNode->cost = cost;
+			actualNode->total = cost;
+			
+			if (actualNode->flags & DT_NODE_OPEN)
+			{
+				m_openList->modify(actualNode);
+			}
+			else
+			{
+				actualNode->flags |= DT_NODE_OPEN;
+				m_openList->push(actualNode);
+			}
+		}
+	}
+	
+	// Nodes may have been improved after they were found, read the final results.
+	for (int i = 0; i < n; ++i)
+	{
+		const dtNode* node = m_nodePool->findNode(resultRef[i]);
+		resultNext[i] = node->pidx ? m_nodePool->getNodeAtIdx(node->pidx)->id : 0;
+		resultCost[i] = node->cost;
+	}
+	
+	return n;
+}
+
 float dtNavMesh::findDistanceToWall(dtPolyRef centerRef, const float* centerPos, float maxRadius, const dtQueryFilter* filter,
 									float* hitPos, float* hitNormal) const
 {
@@ -2391,14 +3432,14 @@ float dtNavMesh::findDistanceToWall(dtPolyRef centerRef, const float* centerPos,
 					const dtLink* link = &bestTile->links[k];
 					if (link->edge == j)
 					{
-						if (link->ref != 0 && passFilter(filter, getPolyFlags(link->ref)))
+						if (link->ref != 0 && dtPassFilter(filter, getPolyFlags(link->ref)))
 							solid = false;
 						break;
 					}
 				}
 				if (!solid) continue;
 			}
-			else if (bestPoly->neis[j] && passFilter(filter, bestTile->polys[bestPoly->neis[j]].flags))
+			else if (bestPoly->neis[j] && dtPassFilter(filter, bestTile->polys[bestPoly->neis[j]].flags))
 			{
 				// Internal edge
 				continue;
@@ -2446,7 +3487,7 @@ float dtNavMesh::findDistanceToWall(dtPolyRef centerRef, const float* centerPos,
 			const dtMeshTile* neighbourTile = &m_tiles[it];
 			const dtPoly* neighbourPoly = &neighbourTile->polys[ip];
 			
-			if (!passFilter(filter, neighbourPoly->flags))
+			if (!dtPassFilter(filter, neighbourPoly->flags))
 				continue;
 			
 			dtNode newNode;
@@ -91,29 +91,41 @@ static void calcExtends(BVItem* items, const int /*nitems*/, const int imin, con
 	}
 }
 
-inline int longestAxis(unsigned short x, unsigned short y, unsigned short z)
+// Node of the temporary binary tree which is collapsed into the wide BVtree.
+struct BVBuildNode
 {
-	int	axis = 0;
-	unsigned short maxVal = x;
-	if (y > maxVal)
-	{
-		axis = 1;
-		maxVal = y;
-	}
-	if (z > maxVal)
-	{
-		axis = 2;
-		maxVal = z;
-	}
-	return axis;
+	unsigned short bmin[3];
+	unsigned short bmax[3];
+	int left, right;	// Child nodes, -1 for leaves.
+	int i;				// Polygon index of a leaf.
+};
+
+inline float boxArea(const unsigned short* bmin, const unsigned short* bmax)
+{
+	const float dx = (float)(bmax[0] - bmin[0]);
+	const float dy = (float)(bmax[1] - bmin[1]);
+	const float dz = (float)(bmax[2] - bmin[2]);
+	return dx*dy + dy*dz + dz*dx;
 }
 
-static void subdivide(BVItem* items, int nitems, int imin, int imax, int& curNode, dtBVNode* nodes)
+inline void sortItems(BVItem* items, const int inum, const int axis)
+{
+	if (axis == 0)
+		qsort(items, inum, sizeof(BVItem), compareItemX);
+	else if (axis == 1)
+		qsort(items, inum, sizeof(BVItem), compareItemY);
+	else
+		qsort(items, inum, sizeof(BVItem), compareItemZ);
+}
+
+static int subdivide(BVItem* items, int nitems, int imin, int imax, int& curNode, BVBuildNode* nodes,
+					 float* areas)
 {
 	int inum = imax - imin;
 	int icur = curNode;
 	
-	dtBVNode& node = nodes[curNode++];
+	BVBuildNode& node = nodes[curNode++];
+	node.left = node.right = -1;
 	
 	if (inum == 1)
 	{
@@ -127,50 +139,147 @@ static void subdivide(BVItem* items, int nitems, int imin, int imax, int& curNod
 		node.bmax[2] = items[imin].bmax[2];
 		
 		node.i = items[imin].i;
+		return icur;
 	}
-	else
+	
+	calcExtends(items, nitems, imin, imax, node.bmin, node.bmax);
+	node.i = -1;
+	
+	// Pick the split with the smallest surface area cost. The split is kept within
+	// the middle half of the items, so that the tree depth stays logarithmic.
+	const int margin = inum/4 > 1 ? inum/4 : 1;
+	float bestCost = 0;
+	int bestAxis = -1;
+	int bestSplit = imin + inum/2;
+	
+	for (int axis = 0; axis < 3; ++axis)
 	{
-		// Split
-		calcExtends(items, nitems, imin, imax, node.bmin, node.bmax);
+		sortItems(items+imin, inum, axis);
 		
-		int	axis = longestAxis(node.bmax[0] - node.bmin[0],
-							   node.bmax[1] - node.bmin[1],
-							   node.bmax[2] - node.bmin[2]);
+		// Area of the bounds of the items right of each split.
+		unsigned short bmin[3], bmax[3];
+		calcExtends(items, nitems, imax-1, imax, bmin, bmax);
+		for (int i = imax-1; i > imin; --i)
+		{
+			const BVItem& it = items[i];
+			for (int j = 0; j < 3; ++j)
+			{
+				if (it.bmin[j] < bmin[j]) bmin[j] = it.bmin[j];
+				if (it.bmax[j] > bmax[j]) bmax[j] = it.bmax[j];
+			}
+			areas[i] = boxArea(bmin, bmax) * (float)(imax-i);
+		}
 		
-		if (axis == 0)
+		calcExtends(items, nitems, imin, imin+1, bmin, bmax);
+		for (int i = imin+1; i < imax; ++i)
+		{
+			if (i - imin >= margin && imax - i >= margin)
+			{
+				const float cost = boxArea(bmin, bmax) * (float)(i-imin) + areas[i];
+				if (bestAxis == -1 || cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+			const BVItem& it = items[i];
+			for (int j = 0; j < 3; ++j)
+			{
+				if (it.bmin[j] < bmin[j]) bmin[j] = it.bmin[j];
+				if (it.bmax[j] > bmax[j]) bmax[j] = it.bmax[j];
+			}
+		}
+	}
+	
+	if (bestAxis != 2)
+		sortItems(items+imin, inum, bestAxis);
+	
+	const int left = subdivide(items, nitems, imin, bestSplit, curNode, nodes, areas);
+	const int right = subdivide(items, nitems, bestSplit, imax, curNode, nodes, areas);
+	nodes[icur].left = left;
+	nodes[icur].right = right;
+	
+	return icur;
+}
+
+// Stores binary node 'ib' as a wide node, pulling up grandchildren until the
+// node is full. Nodes are stored in depth first order, 'maxDepth' is the
+// deepest level (1 based) reached.
+static int collapse(const BVBuildNode* bnodes, const int ib, const int depth, int& maxDepth,
+					int& curNode, dtBVNode* nodes)
+{
+	if (depth > maxDepth)
+		maxDepth = depth;
+
+	int children[DT_BVNODE_WIDTH];
+	int nchildren = 0;
+	children[nchildren++] = bnodes[ib].left >= 0 ? bnodes[ib].left : ib;
+	if (bnodes[ib].right >= 0)
+		children[nchildren++] = bnodes[ib].right;
+	
+	while (nchildren < DT_BVNODE_WIDTH)
+	{
+		// Open up the largest inner child.
+		int best = -1;
+		float bestArea = -1;
+		for (int i = 0; i < nchildren; ++i)
 		{
-			// Sort along x-axis
-			qsort(items+imin, inum, sizeof(BVItem), compareItemX);
+			const BVBuildNode& c = bnodes[children[i]];
+			if (c.left < 0)
+				continue;
+			const float area = boxArea(c.bmin, c.bmax);
+			if (area > bestArea)
+			{
+				bestArea = area;
+				best = i;
+			}
 		}
-		else if (axis == 1)
+		if (best == -1)
+			break;
+		const BVBuildNode& c = bnodes[children[best]];
+		children[best] = c.left;
+		children[nchildren++] = c.right;
+	}
+	
+	const int icur = curNode++;
+	for (int i = 0; i < DT_BVNODE_WIDTH; ++i)
+	{
+		dtBVNode& node = nodes[icur];
+		if (i >= nchildren)
 		{
-			// Sort along y-axis
-			qsort(items+imin, inum, sizeof(BVItem), compareItemY);
+			// Unused slot, inverted bounds never overlap.
+			for (int j = 0; j < 3; ++j)
+			{
+				node.bmin[j][i] = 0xffff;
+				node.bmax[j][i] = 0;
+			}
+			node.child[i] = DT_BVNODE_NULL_CHILD;
+			continue;
 		}
-		else
+		const BVBuildNode& c = bnodes[children[i]];
+		for (int j = 0; j < 3; ++j)
 		{
-			// Sort along z-axis
-			qsort(items+imin, inum, sizeof(BVItem), compareItemZ);
+			node.bmin[j][i] = c.bmin[j];
+			node.bmax[j][i] = c.bmax[j];
 		}
-		
-		int isplit = imin+inum/2;
-		
-		// Left
-		subdivide(items, nitems, imin, isplit, curNode, nodes);
-		// Right
-		subdivide(items, nitems, isplit, imax, curNode, nodes);
-		
-		int iescape = curNode - icur;
-		// Negative index means escape.
-		node.i = -iescape;
+		if (c.left < 0)
+			node.child[i] = -(c.i+1);
+		else
+			node.child[i] = collapse(bnodes, children[i], depth+1, maxDepth, curNode, nodes);
 	}
+	
+	return icur;
 }
 
 static int createBVTree(const unsigned short* verts, const int /*nverts*/,
 						const unsigned short* polys, const int npolys, const int nvp,
-						const float cs, const float ch,
-						const int /*nnodes*/, dtBVNode* nodes)
+						const float cs, const float ch, dtBVNode* nodes, int& depth)
 {
+	depth = 0;
+	if (!npolys)
+		return 0;
+	
 	// Build tree
 	BVItem* items = new BVItem[npolys];
 	for (int i = 0; i < npolys; i++)
@@ -203,9 +312,17 @@ static int createBVTree(const unsigned short* verts, const int /*nverts*/,
 		it.bmax[1] = (unsigned short)ceilf((float)it.bmax[1]*ch/cs);
 	}
 	
+	// Build binary tree and collapse it into wide nodes.
+	BVBuildNode* bnodes = new BVBuildNode[npolys*2];
+	float* areas = new float[npolys];
 	int curNode = 0;
-	subdivide(items, npolys, 0, npolys, curNode, nodes);
+	subdivide(items, npolys, 0, npolys, curNode, bnodes, areas);
 	
+	curNode = 0;
+	collapse(bnodes, 0, 1, depth, curNode, nodes);
+	
+	delete [] areas;
+	delete [] bnodes;
 	delete [] items;
 	
 	return curNode;
@@ -331,6 +448,13 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 		uniqueDetailVertCount += ndv;
 	}
 	
+	// Create BVtree, the wide tree never needs more nodes than there are polygons.
+	// TODO: take detail mesh into account! use byte per bbox extent?
+	dtBVNode* bvNodes = new dtBVNode[params->polyCount > 0 ? params->polyCount : 1];
+	int bvDepth = 0;
+	const int bvNodeCount = createBVTree(params->verts, params->vertCount, params->polys, params->polyCount,
+										 nvp, params->cs, params->ch, bvNodes, bvDepth);
+	
 	// Calculate data size
 	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
 	const int vertsSize = dtAlign4(sizeof(float)*3*totVertCount);
@@ -339,7 +463,7 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*params->polyCount);
 	const int detailVertsSize = dtAlign4(sizeof(float)*3*uniqueDetailVertCount);
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*params->detailTriCount);
-	const int bvTreeSize = dtAlign4(sizeof(dtBVNode)*params->polyCount*2);
+	const int bvTreeSize = dtAlign4(sizeof(dtBVNode)*bvNodeCount);
 	const int offMeshConsSize = dtAlign4(sizeof(dtOffMeshConnection)*storedOffMeshConCount);
 	
 	const int dataSize = headerSize + vertsSize + polysSize + linksSize +
@@ -349,6 +473,7 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	unsigned char* data = new unsigned char[dataSize];
 	if (!data)
 	{
+		delete [] bvNodes;
 		delete [] offMeshConClass;
 		return false;
 	}
@@ -371,6 +496,7 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	header->version = DT_NAVMESH_VERSION;
 	header->x = params->tileX;
 	header->y = params->tileY;
+	header->layer = params->tileLayer;
 	header->userId = params->userId;
 	header->polyCount = totPolyCount;
 	header->vertCount = totVertCount;
@@ -386,7 +512,8 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	header->walkableRadius = params->walkableRadius;
 	header->walkableClimb = params->walkableClimb;
 	header->offMeshConCount = storedOffMeshConCount;
-	header->bvNodeCount = params->polyCount*2;
+	header->bvNodeCount = bvNodeCount;
+	header->bvDepth = bvDepth;
 	
 	const int offMeshVertsBase = params->vertCount;
 	const int offMeshPolyBase = params->polyCount;
@@ -503,10 +630,9 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	// Store triangles.
 	memcpy(navDTris, params->detailTris, sizeof(unsigned char)*4*params->detailTriCount);
 
-	// Store and create BVtree.
-	// TODO: take detail mesh into account! use byte per bbox extent?
-	createBVTree(params->verts, params->vertCount, params->polys, params->polyCount,
-				 nvp, params->cs, params->ch, params->polyCount*2, navBvtree);
+	// Store BVtree.
+	memcpy(navBvtree, bvNodes, sizeof(dtBVNode)*bvNodeCount);
+	delete [] bvNodes;
 	
 	// Store Off-Mesh connections.
 	n = 0;
@@ -595,6 +721,7 @@ bool dtNavMeshHeaderSwapEndian(unsigned char* data, const int /*dataSize*/)
 	swapEndian(&header->version);
 	swapEndian(&header->x);
 	swapEndian(&header->y);
+	swapEndian(&header->layer);
 	swapEndian(&header->userId);
 	swapEndian(&header->polyCount);
 	swapEndian(&header->vertCount);
@@ -603,6 +730,7 @@ bool dtNavMeshHeaderSwapEndian(unsigned char* data, const int /*dataSize*/)
 	swapEndian(&header->detailVertCount);
 	swapEndian(&header->detailTriCount);
 	swapEndian(&header->bvNodeCount);
+	swapEndian(&header->bvDepth);
 	swapEndian(&header->offMeshConCount);
 	swapEndian(&header->offMeshBase);
 	swapEndian(&header->walkableHeight);
@@ -692,12 +820,15 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	for (int i = 0; i < header->bvNodeCount; ++i)
 	{
 		dtBVNode* node = &bvTree[i];
-		for (int j = 0; j < 3; ++j)
+		for (int j = 0; j < DT_BVNODE_WIDTH; ++j)
 		{
-			swapEndian(&node->bmin[j]);
-			swapEndian(&node->bmax[j]);
+			for (int k = 0; k < 3; ++k)
+			{
+				swapEndian(&node->bmin[k][j]);
+				swapEndian(&node->bmax[k][j]);
+			}
+			swapEndian(&node->child[j]);
 		}
-		swapEndian(&node->i);
 	}
 
 	// Off-mesh Connections.
@@ -51,9 +51,9 @@ void dtNodePool::clear()
 	m_nodeCount = 0;
 }
 
-const dtNode* dtNodePool::findNode(unsigned int id) const
+const dtNode* dtNodePool::findNode(dtPolyRef id) const
 {
-	unsigned int bucket = hashint(id) & (m_hashSize-1);
+	unsigned int bucket = hashRef(id) & (m_hashSize-1);
 	unsigned short i = m_first[bucket];
 	while (i != DT_NULL_IDX)
 	{
@@ -64,9 +64,9 @@ const dtNode* dtNodePool::findNode(unsigned int id) const
 	return 0;
 }
 
-dtNode* dtNodePool::getNode(unsigned int id)
+dtNode* dtNodePool::getNode(dtPolyRef id)
 {
-	unsigned int bucket = hashint(id) & (m_hashSize-1);
+	unsigned int bucket = hashRef(id) & (m_hashSize-1);
 	unsigned short i = m_first[bucket];
 	dtNode* node = 0;
 	while (i != DT_NULL_IDX)
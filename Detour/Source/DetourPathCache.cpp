@@ -0,0 +1,239 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <math.h>
+#include <string.h>
+#include "DetourPathCache.h"
+#include "DetourCommon.h"
+
+
+
+dtPathCache::dtPathCache() :
+	m_navmesh(0),
+	m_tileGeneration(0),
+	m_entries(0),
+	m_paths(0),
+	m_maxPaths(0),
+	m_maxPathSize(0),
+	m_first(0),
+	m_hashSize(0),
+	m_freeList(-1),
+	m_lruHead(-1),
+	m_lruTail(-1),
+	m_hitCount(0),
+	m_missCount(0)
+{
+}
+
+dtPathCache::~dtPathCache()
+{
+	delete [] m_entries;
+	delete [] m_paths;
+	delete [] m_first;
+}
+
+bool dtPathCache::init(const int maxPaths, const int maxPathSize)
+{
+	delete [] m_entries;
+	delete [] m_paths;
+	delete [] m_first;
+
+	m_maxPaths = maxPaths;
+	m_maxPathSize = maxPathSize;
+	m_hashSize = (int)dtNextPow2((unsigned int)maxPaths);
+
+	m_entries = new dtPathCacheEntry[m_maxPaths];
+	m_paths = new dtPolyRef[m_maxPaths*m_maxPathSize];
+	m_first = new int[m_hashSize];
+	if (!m_entries || !m_paths || !m_first)
+		return false;
+
+	clear();
+
+	return true;
+}
+
+void dtPathCache::clear()
+{
+	if (!m_entries)
+		return;
+	memset(m_first, 0xff, sizeof(int)*m_hashSize);
+	for (int i = 0; i < m_maxPaths; ++i)
+	{
+		m_entries[i].startRef = 0;
+		m_entries[i].endRef = 0;
+		m_entries[i].npath = 0;
+		m_entries[i].next = i+1 < m_maxPaths ? i+1 : -1;
+		m_entries[i].lruPrev = -1;
+		m_entries[i].lruNext = -1;
+	}
+	m_freeList = m_maxPaths ? 0 : -1;
+	m_lruHead = -1;
+	m_lruTail = -1;
+}
+
+int dtPathCache::findEntry(dtPolyRef startRef, dtPolyRef endRef, const dtQueryFilter* filter) const
+{
+	int i = m_first[hashPair(startRef, endRef)];
+	while (i != -1)
+	{
+		const dtPathCacheEntry& e = m_entries[i];
+		if (e.startRef == startRef && e.endRef == endRef && dtSameFilter(&e.filter, filter))
+			return i;
+		i = e.next;
+	}
+	return -1;
+}
+
+void dtPathCache::unlinkLru(const int idx)
+{
+	dtPathCacheEntry& e = m_entries[idx];
+	if (e.lruPrev != -1)
+		m_entries[e.lruPrev].lruNext = e.lruNext;
+	else
+		m_lruHead = e.lruNext;
+	if (e.lruNext != -1)
+		m_entries[e.lruNext].lruPrev = e.lruPrev;
+	else
+		m_lruTail = e.lruPrev;
+	e.lruPrev = e.lruNext = -1;
+}
+
+void dtPathCache::pushLru(const int idx)
+{
+	dtPathCacheEntry& e = m_entries[idx];
+	e.lruPrev = -1;
+	e.lruNext = m_lruHead;
+	if (m_lruHead != -1)
+		m_entries[m_lruHead].lruPrev = idx;
+	m_lruHead = idx;
+	if (m_lruTail == -1)
+		m_lruTail = idx;
+}
+
+void dtPathCache::removeEntry(const int idx)
+{
+	dtPathCacheEntry& e = m_entries[idx];
+
+	// Remove from hash bucket.
+	const unsigned int bucket = hashPair(e.startRef, e.endRef);
+	if (m_first[bucket] == idx)
+	{
+		m_first[bucket] = e.next;
+	}
+	else
+	{
+		int i = m_first[bucket];
+		while (i != -1 && m_entries[i].next != idx)
+			i = m_entries[i].next;
+		if (i != -1)
+			m_entries[i].next = e.next;
+	}
+
+	unlinkLru(idx);
+
+	e.startRef = 0;
+	e.endRef = 0;
+	e.npath = 0;
+	e.next = m_freeList;
+	m_freeList = idx;
+}
+
+void dtPathCache::addEntry(dtPolyRef startRef, dtPolyRef endRef, const dtQueryFilter* filter,
+						   const dtPolyRef* path, const int npath)
+{
+	// Make room by dropping the least recently used path.
+	if (m_freeList == -1)
+		removeEntry(m_lruTail);
+
+	const int idx = m_freeList;
+	dtPathCacheEntry& e = m_entries[idx];
+	m_freeList = e.next;
+
+	e.startRef = startRef;
+	e.endRef = endRef;
+	e.filter = *filter;
+	e.npath = npath;
+	memcpy(&m_paths[idx*m_maxPathSize], path, sizeof(dtPolyRef)*npath);
+
+	const unsigned int bucket = hashPair(startRef, endRef);
+	e.next = m_first[bucket];
+	m_first[bucket] = idx;
+
+	pushLru(idx);
+}
+
+int dtPathCache::findPath(dtNavMesh* navmesh, dtPolyRef startRef, dtPolyRef endRef,
+						  const float* startPos, const float* endPos, const dtQueryFilter* filter,
+						  dtPolyRef* path, const int maxPathSize, dtPathSearchParams* search)
+{
+	if (search)
+		search->nodesExpanded = 0;
+
+	if (!m_maxPaths || !maxPathSize)
+		return navmesh->findPath(startRef, endRef, startPos, endPos, filter, path, maxPathSize, search);
+
+	// Tiles have been added or removed since the paths were found.
+	if (navmesh != m_navmesh || navmesh->getTileGeneration() != m_tileGeneration)
+	{
+		clear();
+		m_navmesh = navmesh;
+		m_tileGeneration = navmesh->getTileGeneration();
+	}
+
+	const int idx = findEntry(startRef, endRef, filter);
+	if (idx != -1)
+	{
+		const dtPathCacheEntry& e = m_entries[idx];
+		const dtPolyRef* cached = &m_paths[idx*m_maxPathSize];
+
+		// Polygon flags may have changed since the path was found.
+		bool valid = true;
+		for (int i = 0; i < e.npath; ++i)
+		{
+			const dtPoly* poly = navmesh->getPolyByRef(cached[i]);
+			if (!poly || !dtPassFilter(filter, poly->flags))
+			{
+				valid = false;
+				break;
+			}
+		}
+
+		if (valid)
+		{
+			const int n = dtMin(e.npath, maxPathSize);
+			memcpy(path, cached, sizeof(dtPolyRef)*n);
+			unlinkLru(idx);
+			pushLru(idx);
+			m_hitCount++;
+			return n;
+		}
+
+		removeEntry(idx);
+	}
+
+	m_missCount++;
+
+	const int n = navmesh->findPath(startRef, endRef, startPos, endPos, filter, path, maxPathSize, search);
+
+	// Partial paths depend on the end location, do not store them.
+	if (n && path[n-1] == endRef && n <= m_maxPathSize)
+		addEntry(startRef, endRef, filter, path, n);
+
+	return n;
+}
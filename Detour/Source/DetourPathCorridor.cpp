@@ -0,0 +1,249 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include "DetourPathCorridor.h"
+#include "DetourCommon.h"
+
+
+// Replaces the start of the path with the visited polygons, up to the furthest
+// polygon which is common to both.
+static int mergeCorridorStart(dtPolyRef* path, const int npath, const int maxPath,
+							  const dtPolyRef* visited, const int nvisited)
+{
+	int furthestPath = -1;
+	int furthestVisited = -1;
+
+	// Find furthest common polygon.
+	for (int i = npath-1; i >= 0; --i)
+	{
+		for (int j = nvisited-1; j >= 0; --j)
+		{
+			if (path[i] == visited[j])
+			{
+				furthestPath = i;
+				furthestVisited = j;
+				break;
+			}
+		}
+		if (furthestPath != -1)
+			break;
+	}
+
+	// If no intersection found just return current path.
+	if (furthestPath == -1 || furthestVisited <= 0)
+		return npath;
+
+	// Concatenate paths.
+	const int req = furthestVisited;
+	const int orig = furthestPath;
+	int size = npath - orig;
+	if (req + size > maxPath)
+		size = maxPath - req;
+	if (size > 0)
+		memmove(path+req, path+orig, size*sizeof(dtPolyRef));
+
+	// Store visited
+	for (int i = 0; i < req; ++i)
+		path[i] = visited[i];
+
+	return req + size;
+}
+
+
+dtPathCorridor::dtPathCorridor() :
+	m_path(0),
+	m_npath(0),
+	m_maxPath(0)
+{
+	m_pos[0] = m_pos[1] = m_pos[2] = 0;
+	m_target[0] = m_target[1] = m_target[2] = 0;
+}
+
+dtPathCorridor::~dtPathCorridor()
+{
+	delete [] m_path;
+}
+
+bool dtPathCorridor::init(const int maxPath)
+{
+	delete [] m_path;
+	m_path = new dtPolyRef[maxPath];
+	if (!m_path)
+		return false;
+	m_npath = 0;
+	m_maxPath = maxPath;
+	return true;
+}
+
+void dtPathCorridor::reset(dtPolyRef ref, const float* pos)
+{
+	dtVcopy(m_pos, pos);
+	dtVcopy(m_target, pos);
+	m_path[0] = ref;
+	m_npath = 1;
+}
+
+void dtPathCorridor::setCorridor(const float* target, const dtPolyRef* polys, const int npolys)
+{
+	dtVcopy(m_target, target);
+	m_npath = dtMin(npolys, m_maxPath);
+	memcpy(m_path, polys, sizeof(dtPolyRef)*m_npath);
+}
+
+int dtPathCorridor::findCorners(float* cornerVerts, unsigned char* cornerFlags, dtPolyRef* cornerPolys,
+								const int maxCorners, const dtNavMesh* navmesh) const
+{
+	static const float MIN_TARGET_DIST = 0.01f;
+
+	if (!m_npath)
+		return 0;
+
+	int ncorners = navmesh->findStraightPath(m_pos, m_target, m_path, m_npath,
+											 cornerVerts, cornerFlags, cornerPolys, maxCorners);
+
+	// Prune points in the beginning of the path which are too close.
+	int skip = 0;
+	while (skip < ncorners && dtVdist2DSqr(&cornerVerts[skip*3], m_pos) < dtSqr(MIN_TARGET_DIST))
+		skip++;
+	if (skip)
+	{
+		ncorners -= skip;
+		memmove(cornerVerts, cornerVerts + skip*3, sizeof(float)*3*ncorners);
+		memmove(cornerFlags, cornerFlags + skip, sizeof(unsigned char)*ncorners);
+		memmove(cornerPolys, cornerPolys + skip, sizeof(dtPolyRef)*ncorners);
+	}
+
+	// Prune points after an off-mesh connection.
+	for (int i = 0; i < ncorners; ++i)
+	{
+		if (cornerFlags[i] & DT_STRAIGHTPATH_OFFMESH_CONNECTION)
+		{
+			ncorners = i+1;
+			break;
+		}
+	}
+
+	return ncorners;
+}
+
+void dtPathCorridor::optimizePathVisibility(const float* next, const float pathOptimizationRange,
+											const dtNavMesh* navmesh, const dtQueryFilter* filter)
+{
+	if (!m_npath)
+		return;
+
+	// Clamp the ray to max distance.
+	float goal[3];
+	dtVcopy(goal, next);
+	float dist = sqrtf(dtVdist2DSqr(m_pos, goal));
+
+	// If too close to the goal, do not try to optimize.
+	if (dist < 0.01f)
+		return;
+
+	// Overshoot a little. This helps to optimize open fields in tiled meshes.
+	dist = dtMin(dist+0.01f, pathOptimizationRange);
+
+	// Adjust ray length.
+	float delta[3];
+	dtVsub(delta, goal, m_pos);
+	const float s = dist / sqrtf(dtSqr(delta[0]) + dtSqr(delta[2]));
+	goal[0] = m_pos[0] + delta[0]*s;
+	goal[2] = m_pos[2] + delta[2]*s;
+
+	static const int MAX_RES = 32;
+	dtPolyRef res[MAX_RES];
+	float t, norm[3];
+	const int nres = navmesh->raycast(m_path[0], m_pos, goal, filter, t, norm, res, MAX_RES);
+	// A full result buffer may have cut the visited polygons short.
+	if (nres > 1 && nres < MAX_RES && t > 0.99f)
+		m_npath = mergeCorridorStart(m_path, m_npath, m_maxPath, res, nres);
+}
+
+bool dtPathCorridor::movePosition(const float* npos, const dtNavMesh* navmesh)
+{
+	if (!m_npath)
+		return false;
+
+	float result[3];
+	const int n = navmesh->moveAlongPathCorridor(m_pos, npos, result, m_path, m_npath);
+
+	// Remove the polygons which were passed.
+	if (n > 0 && n < m_npath)
+	{
+		m_npath -= n;
+		memmove(m_path, m_path+n, sizeof(dtPolyRef)*m_npath);
+	}
+
+	float h = result[1];
+	if (navmesh->getPolyHeight(m_path[0], result, &h))
+		result[1] = h;
+	dtVcopy(m_pos, result);
+
+	return dtVdist2DSqr(result, npos) < dtSqr(0.01f);
+}
+
+int dtPathCorridor::findInvalidPoly(const int maxLookAhead, const dtNavMesh* navmesh, const dtQueryFilter* filter) const
+{
+	const int n = dtMin(m_npath, maxLookAhead);
+	for (int i = 0; i < n; ++i)
+	{
+		const dtPoly* poly = navmesh->getPolyByRef(m_path[i]);
+		if (!poly || !dtPassFilter(filter, poly->flags))
+			return i;
+	}
+	return -1;
+}
+
+bool dtPathCorridor::repairPath(const int maxLookAhead, dtNavMesh* navmesh, const dtQueryFilter* filter)
+{
+	const int invalid = findInvalidPoly(maxLookAhead, navmesh, filter);
+	if (invalid == -1)
+		return true;
+
+	// The agent or the target has lost its polygon, a new path is needed.
+	if (invalid == 0 || invalid == m_npath-1)
+		return false;
+	const dtPolyRef endRef = m_path[m_npath-1];
+	if (!navmesh->getPolyByRef(endRef))
+		return false;
+
+	// Search again from the last valid polygon, the start of the corridor is kept.
+	const int keep = invalid-1;
+	float startPos[3];
+	if (!navmesh->closestPointOnPolyBoundary(m_path[keep], m_pos, startPos))
+		return false;
+	const int npolys = navmesh->findPath(m_path[keep], endRef, startPos, m_target, filter,
+										 m_path+keep, m_maxPath-keep);
+	if (!npolys)
+		return false;
+	m_npath = keep + npolys;
+
+	// The target is not reachable anymore, stop at the closest polygon.
+	if (m_path[m_npath-1] != endRef)
+	{
+		float pt[3];
+		if (navmesh->closestPointOnPoly(m_path[m_npath-1], m_target, pt))
+			dtVcopy(m_target, pt);
+	}
+
+	return true;
+}
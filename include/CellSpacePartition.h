@@ -36,10 +36,16 @@
 //
 //  Author: Mat Buckland (www.ai-junkie.com)
 //
-//  Desc:   class to divide a 2D space into a grid of cells each of which
-//          may contain a number of entities. Once created and initialized 
-//          with entities, fast proximity querys can be made by calling the
-//          CalculateNeighbors method with a position and proximity radius.
+//  Desc:   class to divide a 2D space into a uniform grid of cells each of
+//          which may contain a number of entities. Once created and
+//          initialized with entities, fast proximity querys can be made by
+//          calling the CalculateNeighbors method with a position and
+//          proximity radius.
+//
+//          A query only visits the cells covered by its radius and writes the
+//          neighbors into a buffer owned by the caller, so any number of
+//          threads may query the space at once as long as no entity is being
+//          added or updated at the same time.
 //
 //          If an entity is capable of moving, and therefore capable of moving
 //          between cells, the Update method should be called each update-cycle
@@ -49,7 +55,6 @@
 #pragma warning (disable:4786)
 
 #include <vector>
-#include <list>
 #include <cassert>
 
 #include "OgreTemplate.h"
@@ -61,25 +66,6 @@
 
 
 class SinbadCharacterController;
-//------------------------------------------------------------------------
-//
-//  defines a cell containing a list of pointers to entities
-//------------------------------------------------------------------------
-template <class entity>
-class Cell
-{
-public:
-	//all the entities inhabiting this cell
-	std::list<entity>    Members;
-
-	//the cell's bounding box (it's inverted because the Window's default
-	//co-ordinate system has a y axis that increases as it descends)
-	InvertedAABBox2D     BBox;
-
-	Cell(Vector2D topleft,
-		Vector2D botright):BBox(InvertedAABBox2D(topleft, botright))
-	{}
-};
 
 /////////// //////////////////////////////////////////////////////////////////
 //  the subdivision class
@@ -90,16 +76,15 @@ class CellSpacePartition
 {
 private:
 
-	//the required amount of cells in the space
-	std::vector<Cell<entity> >               m_Cells;
+	//the entities inhabiting each cell. The members of a cell are kept
+	//contiguous and an entity leaving a cell is swapped with the last one
+	std::vector<std::vector<entity> >        m_Cells;
 
-	//this is used to store any valid neighbors when an agent searches
-	//its neighboring space
-	std::vector<entity>                      m_Neighbors;
+	//the number of entities in the space
+	int     m_iNumEntities;
 
-	//this iterator will be used by the methods next and begin to traverse
-	//through the above vector of neighbors
-	typename std::vector<entity>::iterator   m_curNeighbor;
+	//the largest bounding radius of the entities added
+	double  m_dMaxBRadius;
 
 	//the width and height of the world space the entities inhabit
 	double  m_dSpaceWidth;
@@ -114,10 +99,19 @@ private:
 	double  m_OffsetX;
 	double  m_OffsetY;
 
+	//given a coordinate in the game space these methods determine the
+	//column and row of the cell holding it, clamped to the grid
+	inline int  PositionToCellX(double x)const;
+	inline int  PositionToCellY(double y)const;
+
 	//given a position in the game space this method determines the           
 	//relevant cell's index
 	inline int  PositionToIndex(const Vector2D& pos)const;
 
+	//takes an entity out of its cell. The cell at HintIdx is searched
+	//first. Returns false if the entity is not in the space
+	inline bool TakeEntity(const entity& ent, int HintIdx);
+
 public:
 
 	/*
@@ -144,19 +138,22 @@ public:
 	//update an entity's cell by calling this from your entity's Update method 
 	inline void UpdateEntity(const entity& ent, Vector2D OldPos);
 
-	//this method calculates all a target's neighbors and stores them in
-	//the neighbor vector. After you have called this method use the begin, 
-	//next and end methods to iterate through the vector.
-	inline void CalculateNeighbors(Vector2D TargetPos, double QueryRadius);
+	//removes an entity, call this before the entity is deleted
+	inline void RemoveEntity(const entity& ent);
 
-	//returns a reference to the entity at the front of the neighbor vector
-	inline entity& begin(){m_curNeighbor = m_Neighbors.begin(); return *m_curNeighbor;}
+	//this method finds all a target's neighbors and stores them in the
+	//caller's Neighbors vector, which is cleared first. Keep the vector
+	//around between calls so its memory is reused. Returns the number
+	//of neighbors found
+	inline int  CalculateNeighbors(Vector2D TargetPos, double QueryRadius,
+								   std::vector<entity>& Neighbors)const;
 
-	//this returns the next entity in the neighbor vector
-	inline entity& next(){++m_curNeighbor; return *m_curNeighbor;}
+	//returns the number of entities in the space
+	int         NumEntities()const{return m_iNumEntities;}
 
-	//returns true if the end of the vector is found (a zero value marks the end)
-	inline bool   end(){return (m_curNeighbor == m_Neighbors.end()) || (*m_curNeighbor == 0);}   
+	//returns the largest bounding radius of the entities added. Add the
+	//radius to a query to find every entity whose bounds reach into it
+	double      MaxBRadius()const{return m_dMaxBRadius;}
 
 	//empties the cells of entities
 	void        EmptyCells();
@@ -172,84 +169,72 @@ public:
 template<class entity>
 CellSpacePartition<entity>::CellSpacePartition(double width, double height, int cellsX,	int cellsY, 
 											   int MaxEntitys, double offsetX, double offsetY):
+m_iNumEntities(0),
+m_dMaxBRadius(0.0),
 m_dSpaceWidth(width),
 m_dSpaceHeight(height),
 m_iNumCellsX(cellsX),
 m_iNumCellsY(cellsY),
-m_Neighbors(MaxEntitys, entity()),
 m_OffsetX(offsetX),
 m_OffsetY(offsetY)
 {
 	//calculate bounds of each cell
 	m_dCellSizeX = width  / cellsX;
 	m_dCellSizeY = height / cellsY;
-	
 
 	//create the cells
-	for (int y=0; y<m_iNumCellsY; ++y)
-	{
-		for (int x=0; x<m_iNumCellsX; ++x)
-		{
-			double left  = x * m_dCellSizeX;
-			double right = left + m_dCellSizeX;
-			double top   = y * m_dCellSizeY;
-			double bot   = top + m_dCellSizeY;
+	m_Cells.resize(m_iNumCellsX * m_iNumCellsY);
 
-			m_Cells.push_back(Cell<entity>(Vector2D(left, top), Vector2D(right, bot)));
-		}
+	//make room for an even spread of entities so that the members of a
+	//cell rarely need to grow
+	const int perCell = MaxEntitys / (int)m_Cells.size() + 1;
+	for (unsigned int i=0; i<m_Cells.size(); ++i)
+	{
+		m_Cells[i].reserve(perCell);
 	}
 }
 
 //----------------------- CalculateNeighbors ----------------------------
 //
-//  This must be called to create the vector of neighbors.This method 
-//  examines each cell within range of the target, If the 
-//  cells contain entities then they are tested to see if they are situated
-//  within the target's neighborhood region. If they are they are added to
-//  neighbor list
+//  This must be called to create the vector of neighbors. This method 
+//  works out the range of cells overlapped by the target's query box and
+//  only examines those. The entities they contain are tested to see if
+//  they are situated within the target's neighborhood region. If they are
+//  they are added to the neighbor vector
 //------------------------------------------------------------------------
 template<class entity>
-void CellSpacePartition<entity>::CalculateNeighbors(Vector2D TargetPos,
-													double   QueryRadius)
+int CellSpacePartition<entity>::CalculateNeighbors(Vector2D TargetPos,
+												   double   QueryRadius,
+												   std::vector<entity>& Neighbors)const
 {
-	const Vector2D offSet(m_OffsetX, m_OffsetY);
-	const Vector2D newPos = (TargetPos + offSet);
-	//create an iterator and set it to the beginning of the neighbor vector
-	std::vector<entity>::iterator curNbor = m_Neighbors.begin();
-
-	//create the query box that is the bounding box of the target's query
-	//area
-	//InvertedAABBox2D QueryBox(TargetPos - Vector2D(QueryRadius, QueryRadius),
-	//	TargetPos + Vector2D(QueryRadius, QueryRadius));
-	InvertedAABBox2D QueryBox(newPos - Vector2D(QueryRadius, QueryRadius),
-		newPos + Vector2D(QueryRadius, QueryRadius));
-
-	//iterate through each cell and test to see if its bounding box overlaps
-	//with the query box. If it does and it also contains entities then
-	//make further proximity tests.
-	std::vector<Cell<entity> >::iterator curCell; 
-	for (curCell=m_Cells.begin(); curCell!=m_Cells.end(); ++curCell)
+	Neighbors.clear();
+
+	//the cells overlapped by the bounding box of the target's query area
+	const int minX = PositionToCellX(TargetPos.x - QueryRadius);
+	const int maxX = PositionToCellX(TargetPos.x + QueryRadius);
+	const int minY = PositionToCellY(TargetPos.y - QueryRadius);
+	const int maxY = PositionToCellY(TargetPos.y + QueryRadius);
+
+	const double QueryRadiusSq = QueryRadius*QueryRadius;
+
+	for (int y=minY; y<=maxY; ++y)
 	{
-		//test to see if this cell contains members and if it overlaps the
-		//query box
-		if (curCell->BBox.isOverlappedWith(QueryBox) &&
-			!curCell->Members.empty())
+		for (int x=minX; x<=maxX; ++x)
 		{
+			const std::vector<entity>& Members = m_Cells[x + y*m_iNumCellsX];
+
 			//add any entities found within query radius to the neighbor list
-			std::list<entity>::iterator it = curCell->Members.begin();
-			for (it; it!=curCell->Members.end(); ++it)
+			for (unsigned int i=0; i<Members.size(); ++i)
 			{     
-				if (Vec2DDistanceSq((*it)->Pos()+offSet, TargetPos+offSet) <
-					QueryRadius*QueryRadius)
+				if (Vec2DDistanceSq(Members[i]->Pos(), TargetPos) < QueryRadiusSq)
 				{
-					*curNbor++ = *it;
+					Neighbors.push_back(Members[i]);
 				}
 			}    
 		}
 	}//next cell
 
-	//mark the end of the list with a zero.
-	*curNbor = 0;
+	return (int)Neighbors.size();
 }
 
 
@@ -260,12 +245,36 @@ void CellSpacePartition<entity>::CalculateNeighbors(Vector2D TargetPos,
 template<class entity>
 void CellSpacePartition<entity>::EmptyCells()
 {
-	std::vector<Cell<entity> >::iterator it = m_Cells.begin();
-
-	for (it; it!=m_Cells.end(); ++it)
+	for (unsigned int i=0; i<m_Cells.size(); ++i)
 	{
-		it->Members.clear();
+		m_Cells[i].clear();
 	}
+	m_iNumEntities = 0;
+	m_dMaxBRadius = 0.0;
+}
+
+//------------------- PositionToCellX / PositionToCellY ------------------
+//
+//  Given a coordinate in the game world, these methods calculate the
+//  column or row of the cell containing it. Positions outside the space
+//  go to the cells along its edge
+//------------------------------------------------------------------------
+template<class entity>
+inline int CellSpacePartition<entity>::PositionToCellX(double x)const
+{
+	int cx = (int)floor((x + m_OffsetX) / m_dCellSizeX);
+	if (cx < 0) return 0;
+	if (cx >= m_iNumCellsX) return m_iNumCellsX-1;
+	return cx;
+}
+
+template<class entity>
+inline int CellSpacePartition<entity>::PositionToCellY(double y)const
+{
+	int cy = (int)floor((y + m_OffsetY) / m_dCellSizeY);
+	if (cy < 0) return 0;
+	if (cy >= m_iNumCellsY) return m_iNumCellsY-1;
+	return cy;
 }
 
 //--------------------- PositionToIndex ----------------------------------
@@ -276,16 +285,7 @@ void CellSpacePartition<entity>::EmptyCells()
 template<class entity>
 inline int CellSpacePartition<entity>::PositionToIndex(const Vector2D& pos)const
 {
-	const Vector2D offSet(m_OffsetX, m_OffsetY);
-	const Vector2D newPos = (pos + offSet);
-	int idx = (int)(m_iNumCellsX * newPos.x / m_dSpaceWidth) + 
-		((int)((m_iNumCellsY) * newPos.y / m_dSpaceHeight) * m_iNumCellsX);
-
-	//if the entity's position is equal to vector2d(m_dSpaceWidth, m_dSpaceHeight)
-	//then the index will overshoot. We need to check for this and adjust
-	if (idx > (int)m_Cells.size()-1) idx = (int)m_Cells.size()-1;
-
-	return idx;
+	return PositionToCellX(pos.x) + PositionToCellY(pos.y) * m_iNumCellsX;
 }
 
 //----------------------- AddEntity --------------------------------------
@@ -297,10 +297,10 @@ inline void CellSpacePartition<entity>::AddEntity(const entity& ent)
 { 
 	assert (ent);
 
-	int sz = m_Cells.size();
-	int idx = PositionToIndex(ent->Pos());
+	m_Cells[PositionToIndex(ent->Pos())].push_back(ent);
+	++m_iNumEntities;
 
-	m_Cells[idx].Members.push_back(ent);
+	if (ent->BRadius() > m_dMaxBRadius) m_dMaxBRadius = ent->BRadius();
 }
 
 //----------------------- UpdateEntity -----------------------------------
@@ -319,10 +319,42 @@ inline void CellSpacePartition<entity>::UpdateEntity(const entity&  ent,
 
 	if (NewIdx == OldIdx) return;
 
-	//the entity has moved into another cell so delete from current cell
-	//and add to new one
-	m_Cells[OldIdx].Members.remove(ent);
-	m_Cells[NewIdx].Members.push_back(ent);
+	//the entity has moved into another cell so swap it out of the current
+	//cell and add it to the new one
+	if (!TakeEntity(ent, OldIdx)) ++m_iNumEntities;
+	m_Cells[NewIdx].push_back(ent);
+}
+
+//----------------------- RemoveEntity -----------------------------------
+//------------------------------------------------------------------------
+template<class entity>
+inline void CellSpacePartition<entity>::RemoveEntity(const entity& ent)
+{
+	if (TakeEntity(ent, PositionToIndex(ent->Pos()))) --m_iNumEntities;
+}
+
+//----------------------- TakeEntity -------------------------------------
+//
+//  Swaps the entity with the last member of its cell. An entity which has
+//  been moved without updating its cell is searched for in every cell
+//------------------------------------------------------------------------
+template<class entity>
+inline bool CellSpacePartition<entity>::TakeEntity(const entity& ent, int HintIdx)
+{
+	for (unsigned int c=0; c<=m_Cells.size(); ++c)
+	{
+		std::vector<entity>& Cell = m_Cells[c == 0 ? HintIdx : c-1];
+		for (unsigned int i=0; i<Cell.size(); ++i)
+		{
+			if (Cell[i] == ent)
+			{
+				Cell[i] = Cell.back();
+				Cell.pop_back();
+				return true;
+			}
+		}
+	}
+	return false;
 }
 
 //-------------------------- RenderCells -----------------------------------
@@ -330,10 +362,17 @@ inline void CellSpacePartition<entity>::UpdateEntity(const entity&  ent,
 template<class entity>
 inline void CellSpacePartition<entity>::RenderCells(DebugDrawGL* dd, double offSetX, double offSetY)const
 {
-	std::vector<Cell<entity> >::const_iterator curCell;
-	for (curCell=m_Cells.begin(); curCell!=m_Cells.end(); ++curCell)
+	for (int y=0; y<m_iNumCellsY; ++y)
 	{
-		curCell->BBox.Render(dd, false, offSetX, offSetY);
+		for (int x=0; x<m_iNumCellsX; ++x)
+		{
+			double left  = x * m_dCellSizeX;
+			double right = left + m_dCellSizeX;
+			double top   = y * m_dCellSizeY;
+			double bot   = top + m_dCellSizeY;
+
+			InvertedAABBox2D(Vector2D(left, top), Vector2D(right, bot)).Render(dd, false, offSetX, offSetY);
+		}
 	}
 }
 
@@ -45,5 +45,43 @@ bool rcCreateChunkyTriMesh(const float* verts, const int* tris, int ntris,
 // Returns the chunk indices which touch the input rectable.
 int rcGetChunksInRect(const rcChunkyTriMesh* cm, float bmin[2], float bmax[2], int* ids, const int maxIds);
 
+// Grid aligned base of one chunk, its positions are 16-bit offsets from it.
+struct rcQuantizedChunk
+{
+	int base[3];
+	int vi, nv;
+};
+
+// Compact copy of the chunky mesh leaves. Positions are snapped to one grid
+// shared by all chunks (orig + index*step) and stored as 16-bit offsets from
+// the chunk base, so border vertices decode identically in neighbouring chunks.
+// Indices are local to the chunk. Only the up component of each triangle normal
+// is kept, at full precision, so the walkable flags match the float geometry.
+// The triangles are in chunky order, so rcChunkyTriMeshNode::i indexes 'tris'
+// and 'normalY' as it does rcChunkyTriMesh::tris.
+struct rcQuantizedTriMesh
+{
+	inline rcQuantizedTriMesh() : chunks(0), verts(0), tris(0), normalY(0) {};
+	inline ~rcQuantizedTriMesh() { delete [] chunks; delete [] verts; delete [] tris; delete [] normalY; }
+
+	float orig[3], step[3];
+	rcQuantizedChunk* chunks; // one per chunky node, only leaves are valid
+	unsigned short* verts;
+	int nverts;
+	unsigned short* tris;
+	float* normalY;
+	int ntris;
+	int maxVertsPerChunk;
+};
+
+// Builds the quantized copy of the leaves of 'cm'.
+bool rcCreateQuantizedTriMesh(const float* verts, const int nverts, const rcChunkyTriMesh* cm,
+							  rcQuantizedTriMesh* qm);
+
+// Decodes the leaf chunk 'nodeIdx' into 'verts' (maxVertsPerChunk*3) and chunk local 'tris' (node.n*3).
+// Returns the number of vertices written.
+int rcDecodeQuantizedChunk(const rcQuantizedTriMesh* qm, const rcChunkyTriMesh* cm, const int nodeIdx,
+						   float* verts, int* tris);
+
 
 #endif // CHUNKYTRIMESH_H
@@ -65,6 +65,11 @@ struct ConvexVolume
 
 class InputGeom
 {
+public:
+	// Max triangles per chunky mesh leaf.
+	static const int MAX_CHUNK_TRIS = 256;
+
+private:
 	rcChunkyTriMesh* m_chunkyMesh;
 	rcMeshLoaderObj* m_mesh;
 	float m_meshBMin[3], m_meshBMax[3];
@@ -82,11 +87,49 @@ class InputGeom
 	static const int MAX_VOLUMES = 256;
 	ConvexVolume m_volumes[MAX_VOLUMES];
 	int m_volumeCount;
+
+	// Binary geometry cache. When the scene was loaded from the cache the
+	// mesh and chunky tree arrays point directly into this mapping.
+	void* m_cacheData;
+	size_t m_cacheSize;
+	Ogre::String m_cachePath;
+	unsigned int m_cacheHash;
+
+	bool loadGeometryCache(const char* filepath, unsigned int hash);
+	bool saveGeometryCache(const char* filepath, unsigned int hash);
+	// Rewrites the convex volumes and off-mesh links of the current cache file,
+	// called whenever they are edited.
+	bool updateGeometryCache();
+	void writeGeometryCacheAuthoredData(FILE* fp);
+	bool buildChunkyMesh();
+	void freeGeometry();
+
+	// Triangle normals in chunky mesh order, stored as separate x, y and z
+	// arrays of ntris each, and the walkable flags derived for m_walkableSlope.
+	float* m_triNormals;
+	unsigned char* m_triWalkable;
+	float m_walkableSlope;
+
+	bool calcTriNormals();
+
+	// Optional quantized storage, replaces the float geometry when enabled.
+	rcQuantizedTriMesh* m_quantMesh;
+	bool m_quantize;
+
+	bool quantizeGeometry();
+
+	// Segment cast against the chunks the segment passes over, thread safe.
+	bool raycastChunks(const float* src, const float* dst, float& tmin) const;
 	
 public:
 	InputGeom();
 	~InputGeom();
 	
+	// Store the geometry quantized (see rcQuantizedTriMesh), must be set before loading.
+	// The float verts/tris of the mesh object are released, chunks are decoded on the fly.
+	inline void setQuantizedStorage(bool quantize) { m_quantize = quantize; }
+	inline const rcQuantizedTriMesh* getQuantizedMesh() const { return m_quantMesh; }
+
 	bool loadMesh(Ogre::StringVector entNames, Ogre::StringVector filepaths);
 	bool loadTerrain();
 	inline rcMeshLoaderObj* getMeshObject() { return m_mesh; }
@@ -99,7 +142,15 @@ public:
 	inline const float* getMeshBoundsMin() const { return m_meshBMin; }
 	inline const float* getMeshBoundsMax() const { return m_meshBMax; }
 	inline const rcChunkyTriMesh* getChunkyMesh() const { return m_chunkyMesh; }
+	inline const float* getTriNormals() const { return m_triNormals; }
+	// RC_WALKABLE flags for each chunky mesh triangle, only recomputed when the slope changes.
+	const unsigned char* getWalkableTriFlags(const float walkableSlopeAngle);
 	bool raycastMesh(float* src, float* dst, float& tmin);
+	// Casts 'nrays' segments src[i*3] -> dst[i*3] in one go, spread over the worker threads.
+	// tmins[i] gets the hit parameter along the segment (1 on a miss), hits[i] (optional) 1 on a hit.
+	// Returns the number of rays that hit.
+	int raycastMeshBatch(const float* src, const float* dst, const int nrays,
+						 float* tmins, unsigned char* hits = 0) const;
 
 	// Off-Mesh connections.
 	int getOffMeshConnectionCount() const { return m_offMeshConCount; }
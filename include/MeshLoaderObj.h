@@ -72,6 +72,20 @@ public:
 	bool load(Ogre::StringVector entNames, Ogre::StringVector fileNames);
 	bool load();
 
+	// the two halves of load(), so that InputGeom can skip the geometry
+	// extraction when it has a valid cache for the scene
+	bool loadEntities(Ogre::StringVector entNames, Ogre::StringVector fileNames);
+	bool buildEntityGeometry();
+	bool buildTerrainGeometry();
+
+	// fingerprint of the source data (mesh files, node transforms, terrain heights)
+	// must be called after the entities / terrain are in the scene
+	unsigned int calcSourceHash();
+	// use externally owned geometry ( e.g. a mapped geometry cache ) instead of building it
+	void setCachedGeometry(float* cverts, int cnverts, int* ctris, int cntris, float* cnormals);
+	// frees verts, tris and normals, getVerts() etc return 0 afterwards
+	void releaseGeometry();
+
 	inline const float* getVerts() const { return verts; }
 	inline const float* getNormals() const { return m_normals; }
 	inline const int* getTris() const { return tris; }
@@ -111,6 +125,7 @@ private:
 
 	void addVertex(float x, float y, float z, int& cap);
 	void addTriangle(int a, int b, int c, int& cap);
+	void calcNormals();
 
 	Ogre::MaterialPtr myManualObjectMaterial;
 	Ogre::ManualObject *obj;
@@ -126,6 +141,7 @@ private:
 	float* m_normals;
 	int m_vertCount;
 	int m_triCount;
+	bool m_ownsGeometry;
 
 	float bmin[3];
 	float bmax[3];
@@ -51,6 +51,8 @@
 
 #include "OgreTemplate.h"
 #include "DetourNavMesh.h"
+#include "DetourFlowField.h"
+#include "DetourPathCache.h"
 #include "SharedData.h"
 #include <vector>
 
@@ -58,6 +60,7 @@
 #include "CellSpacePartition.h"
 #include "BaseOgreRecastEntity.h"
 #include "OgreRecastEntityFunctionTemplate.h"
+#include "OgreRecastSteeringCrowd.h"
 
 
 
@@ -91,6 +94,8 @@ class NavMeshTesterTool : public SampleTool
 
 	static const int MAX_POLYS = 2048; //512;
 	static const int MAX_SMOOTH = 12096;
+	static const int MAX_FLOW_FIELDS = 4;
+	static const int MAX_CACHED_PATHS = 64;
 
 	dtPolyRef m_startRef;
 	dtPolyRef m_endRef;
@@ -144,8 +149,28 @@ class NavMeshTesterTool : public SampleTool
 	std::vector<BaseGameEntity*>  m_Obstacles;
 	std::vector<Wall2D>           m_Walls;
 	CellSpacePartition<SinbadCharacterController*>* m_pCellSpace;
+	// neighbours found when drawing the cell space
+	std::vector<SinbadCharacterController*> m_CellNeighbors;
+	// vehicles tagged by the last TagVehiclesWithinViewRange
+	std::vector<SinbadCharacterController*> m_TaggedVehicles;
 	Vector2D	m_offSetVec;
 
+	// flow fields of goals shared by several agents
+	dtFlowFieldCache m_flowFields;
+	// recently found agent paths
+	dtPathCache m_pathCache;
+
+	// steers the agents in one batch instead of one SteeringBehavior at a time
+	// when m_bUseSteeringCrowd is set. It is refilled from the agents every frame
+	SteeringCrowd m_SteeringCrowd;
+	bool m_bUseSteeringCrowd;
+	// agents the crowd steered last frame, the others used their own SteeringBehavior
+	int m_iCrowdSteered;
+	// time spent working out the steering and the frames it was summed over,
+	// [0] for the SteeringBehavior of each agent, [1] for the crowd
+	int m_iSteerTimeUsec[2];
+	int m_iSteerFrames[2];
+
 	bool                          m_bPaused;
 	int                           m_cxClient, m_cyClient;
 	int                           m_cxClientMin, m_cyClientMin;
@@ -201,16 +226,38 @@ public:
 	void toggleEntityLabels(void);
 
 	void removeLatestEntity(void);
+	// creates an agent standing at pos[3] and hands it to the database and the cell space
+	SinbadCharacterController* spawnEntity(const float* pos);
+	// spawns up to 'count' agents at random places on the navmesh, without going over MAXIMUM_ENTITIES
+	void spawnCrowd(int count);
+	// tries 'count' random spots in the level, their ground rays are cast in one batch and
+	// snapped to the navmesh in one query. The spots that hit the navmesh are written to
+	// positions[3*count], rayHeight is the height the rays start from.
+	// Returns the number of positions found.
+	int findSpawnPositions(float* positions, const int count, const float rayHeight = 5000.0f);
+	// snaps the search start of every agent waiting for a path to the navmesh, agents with the
+	// same filter and search box go through one findNearestPolys query. Run after the agents
+	// have moved and before the database delivers their MSG_SearchPath
+	void snapSearchStarts(void);
+	// works out the steering and movement of every agent, one SteeringBehavior at a time
+	void computeVehicleMovement(float _timeSinceLastFrame);
+	// the same in one SteeringCrowd step. Agents with a behavior the crowd does
+	// not have use their own SteeringBehavior
+	void computeCrowdMovement(float _timeSinceLastFrame);
+	// logs the average time each way of steering took since the last call
+	void logSteeringTimes(void);
+	void ToggleSteeringCrowd(){m_bUseSteeringCrowd = !m_bUseSteeringCrowd;}
+	bool UseSteeringCrowd()const{return m_bUseSteeringCrowd;}
 	// TODO : implement member functions for this get/set
 	// public so its accessible from the GUI
 	dtQueryFilter m_filter;
 
 
-	void  NonPenetrationContraint(SinbadCharacterController* v){EnforceNonPenetrationConstraint(v, m_Vehicles);}
+	void  NonPenetrationContraint(SinbadCharacterController* v){EnforceNonPenetrationConstraint(v, *m_pCellSpace, m_CellNeighbors);}
 
 	void  TagVehiclesWithinViewRange(BaseGameEntity* pVehicle, double range)
 	{
-		TagNeighbors(pVehicle, m_Vehicles, range);
+		TagNeighbors(pVehicle, *m_pCellSpace, m_TaggedVehicles, range);
 	}
 
 	void  TagObstaclesWithinViewRange(BaseGameEntity* pVehicle, double range)
@@ -220,6 +267,8 @@ public:
 
 	const std::vector<Wall2D>&							Walls(){return m_Walls;}                          
 	CellSpacePartition<SinbadCharacterController*>*     CellSpace(){return m_pCellSpace;}
+	dtFlowFieldCache*									FlowFields(){return &m_flowFields;}
+	dtPathCache*										PathCache(){return &m_pathCache;}
 	const std::vector<BaseGameEntity*>&					Obstacles()const{return m_Obstacles;}
 	const std::vector<SinbadCharacterController*>&      Agents(){return m_Vehicles;}
 
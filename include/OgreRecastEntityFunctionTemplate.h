@@ -31,8 +31,11 @@
 #ifndef __H_OGRERECAST_ENTITY_FUNCTION_TEMPLATES_H_
 #define __H_OGRERECAST_ENTITY_FUNCTION_TEMPLATES_H_
 
+#include <vector>
+
 #include "BaseOgreRecastEntity.h"
 #include "SinbadController.h"
+#include "CellSpacePartition.h"
 #include "Geometry.h"
 #include "MiscUtils.h"
 
@@ -101,6 +104,46 @@ void TagNeighbors(const T& entity, conT& ContainerOfEntities, double radius)
 	}//next entity
 }
 
+//----------------------- TagNeighbors ----------------------------------
+//
+//  tags any entities in a cell-space partition that are within the
+//  radius of the single entity parameter. Only the cells around the
+//  entity are searched, so instead of clearing the tag of every entity
+//  the entities tagged by the previous call, held in Tagged, are untagged.
+//  On return Tagged holds the newly tagged entities
+//------------------------------------------------------------------------
+template <class T, class entityT>
+void TagNeighbors(const T& entity, const CellSpacePartition<entityT>& CellSpace,
+				  std::vector<entityT>& Tagged, double radius)
+{
+	//first clear the current tags
+	for (unsigned int i=0; i<Tagged.size(); ++i)
+	{
+		Tagged[i]->UnTag();
+	}
+
+	//the widest bounding radius is added so that no entity reaching into
+	//the range is missed
+	CellSpace.CalculateNeighbors(entity->Pos(), radius + CellSpace.MaxBRadius(), Tagged);
+
+	unsigned int NumTagged = 0;
+	for (unsigned int i=0; i<Tagged.size(); ++i)
+	{
+		Vector2D to = Tagged[i]->Pos() - entity->Pos();
+
+		//the bounding radius of the other is taken into account by adding it 
+		//to the range
+		double range = radius + Tagged[i]->BRadius();
+
+		if ( (Tagged[i] != entity) && (to.LengthSq() < range*range))
+		{
+			Tagged[i]->Tag();
+			Tagged[NumTagged++] = Tagged[i];
+		}
+	}
+	Tagged.resize(NumTagged);
+}
+
 
 //------------------- EnforceNonPenetrationConstraint ---------------------
 //
@@ -141,6 +184,22 @@ void EnforceNonPenetrationConstraint(const T&    entity,
 	}//next entity
 }
 
+//------------------- EnforceNonPenetrationConstraint ---------------------
+//
+//  As above, but only the entities of a cell-space partition whose bounds
+//  may overlap the entity are checked. Neighbors is a buffer for the
+//  entities found, keep it around between calls so its memory is reused
+//------------------------------------------------------------------------
+template <class T, class entityT>
+void EnforceNonPenetrationConstraint(const T& entity,
+									 const CellSpacePartition<entityT>& CellSpace,
+									 std::vector<entityT>& Neighbors)
+{
+	CellSpace.CalculateNeighbors(entity->Pos(), entity->BRadius() + CellSpace.MaxBRadius(), Neighbors);
+
+	EnforceNonPenetrationConstraint(entity, Neighbors);
+}
+
 
 
 
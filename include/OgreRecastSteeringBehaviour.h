@@ -165,6 +165,10 @@ private:
   //how far the agent can 'see'
   double        m_dViewDistance;
 
+  //the neighbors found in cell space by the last call to Calculate. Each
+  //vehicle keeps its own so that vehicles can be updated in parallel
+  std::vector<SinbadCharacterController*> m_Neighbors;
+
   //pointer to any current path
   Path*          m_pPath;
 
@@ -195,6 +199,11 @@ private:
   //what type of method is used to sum any active behavior
   summing_method  m_SummingMethod;
 
+  //state of the random sequence used by wander and dithered summing
+  unsigned int  m_iRandSeed;
+
+  double        NextRandom();
+
   // Debug renderers for Ogre3D debug rendering
   DebugDrawGL* ddForce;
   DebugDrawGL* ddWanderCircle;
@@ -344,12 +353,20 @@ public:
   bool		PathDone() { return m_pPath->GetPathRunThroughOnce(); }
   void		SetPathDone(bool _doneOnce) { m_pPath->SetPathRunThroughOnce(_doneOnce); }
 
+  //moves on to the next waypoint of the path once the vehicle is close
+  //enough to the current one. FollowPath does this itself, it is public
+  //for vehicles whose path force is worked out by a SteeringCrowd
+  void      UpdatePathWaypoint();
+  Vector2D  PathWaypoint()const{return m_pPath->CurrentWaypoint();}
+  bool      PathFinished()const{return m_pPath->PathFinished();}
+
   Vector2D Force()const{return m_vSteeringForce;}
 
   void      ToggleSpacePartitioningOnOff(){m_bCellSpaceOn = !m_bCellSpaceOn;}
   bool      isSpacePartitioningOn()const{return m_bCellSpaceOn;}
 
   void      SetSummingMethod(summing_method sm){m_SummingMethod = sm;}
+  summing_method SummingMethod()const{return m_SummingMethod;}
 
 
   void FleeOn(){m_iFlags |= flee;}
@@ -412,6 +429,7 @@ public:
   double SeparationWeight()const{return m_dWeightSeparation;}
   double AlignmentWeight()const{return m_dWeightAlignment;}
   double CohesionWeight()const{return m_dWeightCohesion;}
+  double FollowPathWeight()const{return m_dWeightFollowPath;}
 
   double WaypointSeekDistance()const{return m_dWaypointSeekDistSq;}
   void setWaypointSeekDistance(double _waypointSeek) {m_dWaypointSeekDistSq = _waypointSeek;}
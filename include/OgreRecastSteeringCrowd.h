@@ -0,0 +1,195 @@
+//----------------------------------------------------------------------------------//
+// OgreRecast Demo - A demonstration of integrating Recast Navigation Meshes		//
+//					 with the Ogre3D rendering engine.								//
+//																					//
+//	This file was either Created by or Modified by :								//
+//													Paul A Wilson 					//
+//			All contents are Copyright (C) 2010 Paul A Wilson						//
+//			Except where otherwise mentioned or where previous						//
+//			copyright exists. In the case of pre-existing copyrights				//
+//			all rights remain with the original Authors, and this is				//
+//			to be considered a derivative work.										//
+//																					//
+//	Contact Email	:	paulwilson77@dodo.com.au									//
+//																					//
+// This 'SOFTWARE' is provided 'AS-IS', without any express or implied				//
+// warranty.  In no event will the authors be held liable for any damages			//
+// arising from the use of this software.											//
+// Permission is granted to anyone to use this software for any purpose,			//
+// including commercial applications, and to alter it and redistribute it			//
+// freely, subject to the following restrictions:									//
+// 1. The origin of this software must not be misrepresented; you must not			//
+//    claim that you wrote the original software. If you use this software			//
+//    in a product, an acknowledgment in the product documentation would be			//
+//    appreciated but is not required.												//
+// 2. Altered source versions must be plainly marked as such, and must not be		//
+//    misrepresented as being the original software.								//
+// 3. This notice may not be removed or altered from any source distribution.		//
+//																					//
+//----------------------------------------------------------------------------------//
+
+//------------------------------------------------------------------------
+//
+//  Name:   OgreRecastSteeringCrowd.h
+//
+//  Desc:   a crowd of steered agents kept in structure of arrays form.
+//          Where SteeringBehavior steers one vehicle object at a time,
+//          the crowd stores the state of every agent in flat float arrays
+//          and runs each steering behavior over all the agents in one
+//          loop. Seek, Arrive, Separation, Alignment, Cohesion and
+//          FollowPath are supported and are summed as a weighted sum.
+//
+//          A behavior is switched on by giving it a weight other than
+//          zero, so the loop summing the forces has no per-agent flag
+//          tests. Only gathering the neighbors and moving along the path
+//          are skipped for agents whose weights do not need them.
+//
+//------------------------------------------------------------------------
+
+#ifndef __H_STEERINGCROWD_H_
+#define __H_STEERINGCROWD_H_
+#pragma warning (disable:4786)
+
+#include <math.h>
+#include <vector>
+#include <list>
+
+#include "Vector2D.h"
+
+
+class SteeringCrowd
+{
+private:
+
+	int     m_iNumAgents;
+	int     m_iMaxAgents;
+	int     m_iMaxPathPoints;
+
+	//how far the agents can 'see' their neighbors
+	float   m_fViewDistance;
+
+	//the distance (squared) an agent has to be from a path waypoint
+	//before it starts seeking to the next waypoint
+	float   m_fWaypointSeekDistSq;
+
+	//the time Arrive plans to take to reach its target
+	float   m_fArriveTime;
+
+	//agent state
+	std::vector<float>  m_PosX, m_PosY;
+	std::vector<float>  m_VelX, m_VelY;
+	std::vector<float>  m_HeadingX, m_HeadingY;
+	std::vector<float>  m_MaxSpeed;
+	std::vector<float>  m_MaxForce;
+	std::vector<float>  m_InvMass;
+	std::vector<float>  m_Radius;
+
+	//the target of Seek and Arrive
+	std::vector<float>  m_TargetX, m_TargetY;
+
+	//behavior weights, zero switches a behavior off
+	std::vector<float>  m_WeightSeek;
+	std::vector<float>  m_WeightArrive;
+	std::vector<float>  m_WeightSeparation;
+	std::vector<float>  m_WeightAlignment;
+	std::vector<float>  m_WeightCohesion;
+	std::vector<float>  m_WeightFollowPath;
+
+	//the paths, m_iMaxPathPoints waypoints per agent
+	std::vector<float>  m_PathX, m_PathY;
+	std::vector<int>    m_PathCount;
+	std::vector<int>    m_PathCurrent;
+	std::vector<char>   m_PathLoop;
+
+	//per step scratch: the waypoint followed and whether it is the last,
+	//the sums over the neighbors and the resulting force
+	std::vector<float>  m_WaypointX, m_WaypointY;
+	std::vector<float>  m_WaypointArrive;
+	std::vector<float>  m_SeparationX, m_SeparationY;
+	std::vector<float>  m_AlignmentX, m_AlignmentY;
+	std::vector<float>  m_CohesionX, m_CohesionY;
+	std::vector<float>  m_ForceX, m_ForceY;
+
+	//hashed grid of view distance sized cells, the agents are sorted into
+	//its buckets by a counting sort every step
+	std::vector<int>    m_AgentCellX, m_AgentCellY;
+	std::vector<int>    m_AgentBucket;
+	std::vector<int>    m_BucketStart;
+	std::vector<int>    m_BucketAgents;
+	int     m_iNumBuckets;
+
+	inline int  HashCell(int x, int y)const
+	{
+		return (int)(((unsigned int)x*73856093u ^ (unsigned int)y*19349663u) & (unsigned int)(m_iNumBuckets-1));
+	}
+
+	inline int  PositionToCell(float p)const{return (int)floorf(p / m_fViewDistance);}
+
+	//sorts the agents into the grid
+	void    BuildGrid();
+
+	//sums the separation, alignment and cohesion terms of one agent
+	void    GatherNeighbors(int idx);
+
+	//advances the agent along its path and works out the waypoint to steer to
+	void    UpdateWaypoint(int idx);
+
+	//combines the behaviors of every agent into its steering force
+	void    SumForces();
+
+	//applies the steering forces and moves the agents
+	void    Integrate(float time_elapsed);
+
+public:
+
+	SteeringCrowd();
+
+	//allocates room for the agents
+	// MaxAgents      - max number of agents in the crowd
+	// MaxPathPoints  - max number of waypoints in the path of an agent
+	// ViewDistance   - radius the group behaviors look for neighbors in
+	// WaypointSeekDist - distance at which a waypoint counts as reached
+	void      Init(int MaxAgents, int MaxPathPoints, double ViewDistance, double WaypointSeekDist);
+
+	//adds an agent standing still and facing along +x with all behaviors
+	//switched off. Returns the index of the agent, or -1 if the crowd is full
+	int       AddAgent(Vector2D pos, double radius, double max_speed, double max_force, double mass);
+
+	//removes an agent, the last agent in the crowd takes over its index
+	void      RemoveAgent(int idx);
+
+	//removes every agent
+	void      Clear(){m_iNumAgents = 0;}
+
+	void      SetTarget(int idx, Vector2D target);
+
+	//sets the waypoints the FollowPath behavior leads along
+	void      SetPath(int idx, const std::list<Vector2D>& path, bool loop);
+
+	//makes FollowPath head for a single waypoint of a path kept outside the
+	//crowd. The waypoint is sought, or arrived at if it ends the path
+	void      SetWaypoint(int idx, Vector2D waypoint, bool arrive);
+	bool      PathFinished(int idx)const;
+
+	void      SetWeights(int idx, double seek, double arrive, double separation,
+						 double alignment, double cohesion, double follow_path);
+
+	//calculates the steering force of every agent
+	void      CalculateSteering();
+
+	//calculates the steering forces and moves the agents
+	void      Update(double time_elapsed);
+
+	int       NumAgents()const{return m_iNumAgents;}
+
+	Vector2D  Pos(int idx)const{return Vector2D(m_PosX[idx], m_PosY[idx]);}
+	void      SetPos(int idx, Vector2D pos){m_PosX[idx] = (float)pos.x; m_PosY[idx] = (float)pos.y;}
+	Vector2D  Velocity(int idx)const{return Vector2D(m_VelX[idx], m_VelY[idx]);}
+	void      SetVelocity(int idx, Vector2D vel){m_VelX[idx] = (float)vel.x; m_VelY[idx] = (float)vel.y;}
+	Vector2D  Heading(int idx)const{return Vector2D(m_HeadingX[idx], m_HeadingY[idx]);}
+	void      SetHeading(int idx, Vector2D heading){m_HeadingX[idx] = (float)heading.x; m_HeadingY[idx] = (float)heading.y;}
+	Vector2D  Force(int idx)const{return Vector2D(m_ForceX[idx], m_ForceY[idx]);}
+	double    BRadius(int idx)const{return m_Radius[idx];}
+};
+
+#endif // __H_STEERINGCROWD_H_
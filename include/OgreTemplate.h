@@ -78,6 +78,9 @@ class DebugLog;
 
 #define DEBUG_STATE_MACHINE true
 #define NAVMESHFILE Ogre::String("all_tiles_navmesh.bin")
+// store the terrain scene input geometry quantized, roughly a third of the memory
+// but the input mesh debug drawing and the solo mesh build are not available
+#define QUANTIZE_TERRAIN_GEOMETRY false
 
 
 class DebugDrawGL : public duDebugDraw
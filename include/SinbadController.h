@@ -49,6 +49,7 @@
 #include "MovingOgreRecastEntity.h"
 #include "MoveableTextOverlay.h"
 #include "MiscUtils.h"
+#include "DetourPathCorridor.h"
 
 using namespace Ogre;
 
@@ -115,7 +116,16 @@ public:
 	// public accessor for the body node object
 	Ogre::SceneNode* GetBodyNode() const { return mBodyNode; }
 
-	// updates the whole class
+	// works out this frame's steering and new position without changing the
+	// vehicle or anything else, so the vehicles can be computed in parallel.
+	// Every vehicle sees the others as they were at the start of the frame
+	void computeMovement(Real deltaTime);
+	// the same with a steering force worked out outside the vehicle, by a SteeringCrowd
+	void computeMovement(Real deltaTime, const Vector2D& SteeringForce);
+	// true if the steering moves the vehicle this frame
+	bool isSteering(void);
+	// updates the whole class, applying the movement from computeMovement
+	// (which is run first if it has not been this frame)
 	void addTime(Real deltaTime, int _applicationMode);
 	//updates the vehicle's position and orientation
 	void        Update(double time_elapsed);
@@ -147,16 +157,30 @@ public:
 	bool getHasMoved(void) { return mHasMoved; }
 	void toggleHasMoved(void) { mHasMoved = !mHasMoved; }
 
-	void setPathStart(float x, float y, float z) { mPathStart.x = x;  mPathStart.y = y;  mPathStart.z = z; m_sposSet = true; }
-	void setPathStart(Ogre::Vector3 pos) {  mPathStart = pos; m_sposSet = true; }
-	void setPathStart(float* pos) {  mPathStart.x = pos[0];  mPathStart.y = pos[1];  mPathStart.z = pos[2]; m_sposSet = true; }
+	void setPathStart(float x, float y, float z) { mPathStart.x = x;  mPathStart.y = y;  mPathStart.z = z; m_sposSet = true; m_sposRef = 0; }
+	void setPathStart(Ogre::Vector3 pos) {  mPathStart = pos; m_sposSet = true; m_sposRef = 0; }
+	void setPathStart(float* pos) {  mPathStart.x = pos[0];  mPathStart.y = pos[1];  mPathStart.z = pos[2]; m_sposSet = true; m_sposRef = 0; }
+	// start position together with the polygon it was snapped to, recalc() does not search for it again
+	void setPathStart(const float* pos, dtPolyRef ref) {  mPathStart.x = pos[0];  mPathStart.y = pos[1];  mPathStart.z = pos[2]; m_sposSet = true; m_sposRef = ref; }
 	Ogre::Vector3 getPathStart(void) { return mPathStart; }
 
-	void setPathEnd(float x, float y, float z) { mPathEnd.x = x;  mPathEnd.y = y;  mPathEnd.z = z; m_eposSet = true; }
-	void setPathEnd(Ogre::Vector3 pos) {  mPathEnd = pos; m_eposSet = true; }
-	void setPathEnd(float* pos) { mPathEnd.x = pos[0];  mPathEnd.y = pos[1];  mPathEnd.z = pos[2]; m_eposSet = true; }
+	void setPathEnd(float x, float y, float z) { mPathEnd.x = x;  mPathEnd.y = y;  mPathEnd.z = z; m_eposSet = true; m_eposRef = 0; }
+	void setPathEnd(Ogre::Vector3 pos) {  mPathEnd = pos; m_eposSet = true; m_eposRef = 0; }
+	void setPathEnd(float* pos) { mPathEnd.x = pos[0];  mPathEnd.y = pos[1];  mPathEnd.z = pos[2]; m_eposSet = true; m_eposRef = 0; }
+	// end position together with the polygon it lies on, recalc() does not search for it again
+	void setPathEnd(const float* pos, dtPolyRef ref) { mPathEnd.x = pos[0];  mPathEnd.y = pos[1];  mPathEnd.z = pos[2]; m_eposSet = true; m_eposRef = ref; }
 	Ogre::Vector3 getPathEnd(void) { return mPathEnd; }
 
+	// true while the agent waits in STATE_FindPath for its next path
+	bool isFindingPath(void) const { return mFindingPath; }
+	// the position the next path search starts from, the ground below the body on the terrain
+	void getSearchStart(float* pos);
+	// hands in the search start snapped ahead of MSG_SearchPath, the tool snaps all agents
+	// waiting for a path in one batch. Used by findStartEndPositions() if the agent has not moved
+	void setSnappedSearchStart(const float* pos, dtPolyRef ref) { m_snapPos[0] = pos[0]; m_snapPos[1] = pos[1]; m_snapPos[2] = pos[2]; m_snapRef = ref; }
+	const dtQueryFilter* getFilter(void) const { return &m_filter; }
+	const float* getPolyPickExtents(void) const { return m_polyPickExt; }
+
 	void setEntityMode(int _entMode);
 	EntityAIMode getEntityMode(void) { return m_EntityAIMode; }
 	bool getIsSelected()const{return m_bIsSelected;}
@@ -269,6 +293,39 @@ private:
 	// its a pretty basic state machine, made possible by the awesome work of Steve Rabin. You can
 	// find more info about at the AIWisdom.com AI site.
 	virtual bool States( State_Machine_Event event, MSG_Object * msg, int state, int substate );
+	// the characters dispatch their events through this table, States() is the same
+	// state machine written with the macros and only used to check the table
+	static StateTable s_stateTable;
+	void buildStateTable(void);
+	// true if the table and States() pick the same handler for every state, event and message
+	bool checkStateTable(void);
+	// States() calls its handlers through this, checkStateTable() only notes which one it picked
+	typedef void (SinbadCharacterController::*Handler)(MSG_Object* msg);
+	void runHandler(Handler handler, MSG_Object* msg);
+	bool m_probeHandlers;
+	StateHandler m_probedHandler;
+
+	// state handlers
+	void ignoreEvent(MSG_Object* msg);
+	void stopMoving(MSG_Object* msg);
+	void onDamaged(MSG_Object* msg);
+	void onModeChange(MSG_Object* msg);
+	void onFindPath(MSG_Object* msg);
+	void enterInitialize(MSG_Object* msg);
+	void enterWander(MSG_Object* msg);
+	void onWanderAttack(MSG_Object* msg);
+	void enterAttack(MSG_Object* msg);
+	void onAttack(MSG_Object* msg);
+	void enterDie(MSG_Object* msg);
+	void enterModeChange(MSG_Object* msg);
+	void enterFindPath(MSG_Object* msg);
+	void updateFindPath(MSG_Object* msg);
+	void onSearchPath(MSG_Object* msg);
+	void enterIdle(MSG_Object* msg);
+	void updateIdle(MSG_Object* msg);
+	void onIdleChange(MSG_Object* msg);
+	void enterDance(MSG_Object* msg);
+
 	virtual void recalc(void);
 	virtual void findStartEndPositions();
 	// returns a position that will be valid for starting a pathing entity from
@@ -277,6 +334,12 @@ private:
 	//						 this can be adjusted to enable the position returned to be above or below
 	//						 other parts of the level geometry. To be safe, a high value( 5000+ ) is safest.
 	virtual Ogre::Vector3 findValidSpawnPosition(float _rayHeight = 5000.0f);
+	// moves the entity along its polygon corridor, repairs the corridor when the navmesh
+	// changes and refreshes the steering waypoints from the corridor corners.
+	// @return : false if the corridor could not be repaired and a new path is needed
+	bool updateCorridor(double time_elapsed);
+	// replaces the steering path with the next corners of the corridor
+	void setSteeringPathFromCorridor(void);
 
 	objectID m_curTarget;
 	GameObject* GetClosestPlayer( void );
@@ -320,6 +383,10 @@ private:
 	float m_distanceToWall;
 	bool m_sposSet;
 	bool m_eposSet;
+	dtPolyRef m_sposRef;			// polygon of the start position if already known, or 0
+	dtPolyRef m_eposRef;			// polygon of the end position if already known, or 0
+	float m_snapPos[3];				// search start snapped by the tool before MSG_SearchPath
+	dtPolyRef m_snapRef;
 
 	int m_pathIterNum;
 	const dtPolyRef* m_pathIterPolys; 
@@ -329,11 +396,26 @@ private:
 	static const int MAX_STEER_POINTS = 200;
 	float m_steerPoints[MAX_STEER_POINTS*3];
 	int m_steerPointCount;
+
+	static const int MAX_CORNERS = 16;
+	// polygon corridor of the current path, agents move along it instead of searching again
+	dtPathCorridor m_corridor;
+	float m_corridorTimer;
+	bool m_cornersReachEnd;			// false when the steering only has the first corners of the corridor
 	dtQueryFilter m_filter;
 	EntityAIMode m_EntityAIMode;
 	
 	// object to smooth out the framerate for animations and AI
 	Smoother<double>*	m_pFrameSmoother;
+	double				m_dFrameTime;
+
+	// movement worked out by calculateMovement, applied by Update
+	bool				m_bMovementComputed;
+	bool				m_bMoving;
+	Vector2D			m_vNewPos;
+	Vector2D			m_vNewVelocity;
+	// uses the given steering force, or the vehicle's own SteeringBehavior without one
+	void calculateMovement(double time_elapsed, const Vector2D* SteeringForce = 0);
 	// this is managed completely from this class instance
 	MovableTextOverlay* m_EntityLabel;
 
@@ -351,6 +433,8 @@ private:
 	bool					m_bSmoothingOn;
 	bool					m_bIsSelected;
 	double					m_dTimeElapsed;
+	// agents near enough to overlap this one, found in cell space
+	std::vector<SinbadCharacterController*> m_OverlapCandidates;
 
 	Path*                         m_pPath;
 	//buffer for the vehicle shape
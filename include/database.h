@@ -71,13 +71,82 @@ public:
 	
 	void ComposeList( dbCompositionList & list, unsigned int type = 0 );
 
+	//Run the think steps of Update on worker threads
+	void SetParallelUpdate( bool parallel )						{ m_parallelUpdate = parallel; }
+	bool IsParallelUpdate( void )								{ return( m_parallelUpdate ); }
 
-private:
+	//Broadcast receivers on top of the ones picked by type
+	void Subscribe( objectID id, MSG_Name name );
+	void Unsubscribe( objectID id, MSG_Name name );
+
+	//Iterating the receivers, the lists keep their size and order between
+	//LockLists and UnlockLists; removed objects read back as 0 and objects
+	//stored meanwhile are appended
+	void LockLists( void )											{ ++m_iterating; }
+	void UnlockLists( void );
+
+	inline unsigned int GetStoredObjectCount( void )				{ return( (unsigned int)m_objects.size() ); }
+	inline unsigned int GetStoredPosition( objectID id )			{ return( m_slots[id].position ); }
+
+	inline bool HasSubscribers( MSG_Name name )						{ return( !m_subscribers[name].empty() ); }
+	GameObject* GetSubscriberFrom( MSG_Name name, unsigned int position );
 
-	typedef std::list<GameObject*> dbContainer;
+	inline unsigned int GetTypeListCount( void )					{ return( (unsigned int)m_typeLists.size() ); }
+	inline unsigned int GetTypeListType( unsigned int list )		{ return( m_typeLists[list].type ); }
+	inline unsigned int GetTypeListSize( unsigned int list )		{ return( (unsigned int)m_typeLists[list].objects.size() ); }
+	inline GameObject* GetTypeListObject( unsigned int list, unsigned int i )	{ return( m_typeLists[list].objects[i] ); }
+
+
+private:
 
-	//Make this a more efficient data structure (like a hash table)
-	dbContainer m_database;
+	struct dbSlot
+	{
+		GameObject* object;			//0 if the ID is not in the database
+		unsigned int position;		//Index of the object in m_objects
+		unsigned int typeList;		//Index of the object's type list
+		unsigned int typePosition;	//Index of the object in its type list
+		unsigned int subscriptions;	//Number of names the object is subscribed to
+		objectID nextByName;		//Next object in the same name bucket
+	};
+
+	//Objects sharing the same type, in the order they were stored
+	struct dbTypeList
+	{
+		unsigned int type;
+		dbCompositionList objects;
+		unsigned int holes;
+	};
+
+	unsigned int FindSubscriber( MSG_Name name, unsigned int position );
+	unsigned int HashName( const char* name ) const;
+	void AddName( objectID id );
+	void RemoveName( objectID id );
+	void GrowNameBuckets( void );
+	void Compact( void );
+
+	//Slots are indexed directly by objectID, IDs are handed out in sequence
+	std::vector<dbSlot> m_slots;
+
+	//Objects in the order they were stored. Removed objects leave a 0 behind
+	//(in the type lists too) until the next compaction, so that
+	//Update and broadcasts can keep iterating by index.
+	std::vector<GameObject*> m_objects;
+	std::vector<dbTypeList> m_typeLists;
+	unsigned int m_holes;				//Removed objects not compacted yet
+
+	//Objects subscribed to each message name, in the order they were stored.
+	//Compacting keeps that order, so the lists are never sorted again
+	std::vector<objectID> m_subscribers[MSG_NUM];
+
+	//Heads of the name hash chains, the size is a power of two
+	std::vector<objectID> m_nameBuckets;
+	unsigned int m_count;
+
+	//Objects marked for deletion during Update, deleted when it is done
+	std::vector<GameObject*> m_deleted;
+	unsigned int m_iterating;
+	bool m_parallelUpdate;
+	bool m_thinking;							//Think steps are running on worker threads
 
 	objectID m_nextFreeID;
 
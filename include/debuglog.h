@@ -43,8 +43,9 @@
 #include "statemch.h"
 #include "gameobject.h"
 #include "SharedData.h"
+#include "msg.h"
 #include "singleton.h"
-#include <list>
+#include <vector>
 
 #define REGISTER_MESSAGE_NAME(x) #x,
 static const char* MessageNameText[] =
@@ -55,6 +56,9 @@ static const char* MessageNameText[] =
 #undef REGISTER_MESSAGE_NAME
 
 
+//One logged state machine event. Only IDs, enum values and pointers to the
+//string literals of the state machine macros are stored, the names are
+//looked up when the log is printed.
 class LogEntry
 {
 public:
@@ -62,42 +66,77 @@ public:
 	LogEntry( void );
 	~LogEntry( void ) {}
 
+	float m_timestamp;
+	unsigned int m_sequence;	//Logging order across all threads
 	objectID m_owner;
-	char m_name[GAME_OBJECT_MAX_NAME_SIZE];
+	const char* m_statename;
+	const char* m_substatename;
+	int m_state;				//State changes only
+	int m_substate;
+	unsigned short m_event;		//State_Machine_Event, or LOG_STATE_CHANGE
+	unsigned short m_msgname;	//MSG_Name
 	bool m_handled;
 
-	float m_timestamp;
-	char m_statename[64];
-	char m_substatename[64];
-	char m_eventmsgname[64];
-
 	//msg only info
 	bool m_msg;
 	objectID m_receiver;
 	objectID m_sender;
-	unsigned int m_data;
+	MSG_Data m_data;
 
 
 };
 
+#define LOG_STATE_CHANGE 0xffff
+
+
 class DebugLog : public STM::Singleton <DebugLog>
 {
 public:
 
-	DebugLog( void ) {}
+	DebugLog( void );
 	~DebugLog( void );
 
-	void LogStateMachineEvent( objectID id, char* name, MSG_Object * msg, const char* statename, const char* substatename, char* eventmsgname, bool handled ); 
-	void LogStateMachineStateChange( objectID id, char* name, unsigned int state, int substate ); 
+	//Runtime switches, the events are only recorded when enabled and only
+	//printed as they come in when echoing
+	void SetEnabled( bool enabled )				{ m_enabled = enabled; }
+	bool IsEnabled( void )						{ return( m_enabled ); }
+	void SetEcho( bool echo )					{ m_echo = echo; }
+
+	inline void LogStateMachineEvent( objectID id, MSG_Object * msg, const char* statename, const char* substatename, int event, bool handled )
+	{
+		if( m_enabled ) {
+			RecordEvent( id, msg, statename, substatename, event, handled );
+		}
+	}
+	inline void LogStateMachineStateChange( objectID id, unsigned int state, int substate )
+	{
+		if( m_enabled ) {
+			RecordStateChange( id, state, substate );
+		}
+	}
 
 	void Dump( objectID id );
 
 private:
 
-	typedef std::list<LogEntry*> LoggingContainer;
-
-	LoggingContainer m_log;
-
+	//Each thread records into its own ring of entries, the oldest entries
+	//are overwritten
+	struct LogRing
+	{
+		LogEntry* entries;
+		unsigned int next;
+		unsigned int count;
+	};
+
+	std::vector<LogRing> m_rings;
+	volatile long m_sequence;		//Last sequence number handed out, see NextSequence
+	bool m_enabled;
+	bool m_echo;
+
+	LogEntry* NextEntry( void );
+	unsigned int NextSequence( void );
+	void RecordEvent( objectID id, MSG_Object * msg, const char* statename, const char* substatename, int event, bool handled );
+	void RecordStateChange( objectID id, unsigned int state, int substate );
 	void PrintLogEntry( LogEntry& entry );
 
 };
@@ -97,6 +97,8 @@ public:
 	inline int GetInt( void )				{ ASSERTMSG( m_valueType == MSG_DATA_INT, "Message data not of correct type" ); return( m_data.intValue ); }
 	inline void SetFloat( float data )		{ m_data.floatValue = data; m_valueType = MSG_DATA_FLOAT; }
 	inline float GetFloat( void )			{ ASSERTMSG( m_valueType == MSG_DATA_FLOAT, "Message data not of correct type" ); return( m_data.floatValue ); }
+	inline bool IsInt( void )				{ return( m_valueType == MSG_DATA_INT ); }
+	inline bool IsFloat( void )				{ return( m_valueType == MSG_DATA_FLOAT ); }
 
 private:
 	MSG_Data_Value m_valueType;
@@ -43,6 +43,7 @@ REGISTER_MESSAGE_NAME(MSG_Attack)
 REGISTER_MESSAGE_NAME(MSG_Damaged)
 REGISTER_MESSAGE_NAME(MSG_Wander)
 REGISTER_MESSAGE_NAME(MSG_FindPath)
+REGISTER_MESSAGE_NAME(MSG_SearchPath)
 REGISTER_MESSAGE_NAME(MSG_WalkPath)
 REGISTER_MESSAGE_NAME(MSG_Idle)
 REGISTER_MESSAGE_NAME(MSG_Think)
@@ -42,15 +42,15 @@
 
 #include "msg.h"
 #include "singleton.h"
-#include <list>
+#include <vector>
 
-typedef std::list<MSG_Object*> MessageContainer;
+class GameObject;
 
 class MsgRoute : public STM::Singleton <MsgRoute>
 {
 public:
 
-	MsgRoute( void ) {}
+	MsgRoute( void );
 	~MsgRoute( void );
 
 	void DeliverDelayedMessages( void );
@@ -65,10 +65,83 @@ public:
 	void RemoveMsg( MSG_Name name, objectID receiver, objectID sender, bool timer );
 	void PurgeScopedMsg( objectID receiver );
 
+	//Phased update: messages sent by think steps running on worker threads
+	//are buffered, EndBuffering delivers them in update order
+	void BeginBuffering( void );
+	void SetBufferOrder( unsigned int order );
+	void EndBuffering( void );
+
 private:
 
-	MessageContainer m_delayedMessages;
+	enum BufferedCommand {
+		BUFFERED_SEND,
+		BUFFERED_BROADCAST,
+		BUFFERED_REMOVE,
+		BUFFERED_PURGE
+	};
+
+	struct BufferedMsg
+	{
+		BufferedCommand command;
+		unsigned int order;			//Update order of the object that sent the message
+		unsigned int sequence;		//Send order within the object's think step
+		float delay;
+		unsigned int type;			//Object type of a broadcast
+		MSG_Object msg;
+	};
+
+	struct MsgBuffer
+	{
+		std::vector<BufferedMsg> msgs;
+		unsigned int order;
+		unsigned int sequence;
+	};
+
+	//Position of a broadcast in one of the database type lists
+	struct BroadcastCursor
+	{
+		unsigned int list;
+		unsigned int index;
+		unsigned int end;			//Size of the list when the broadcast started
+	};
+
+	//One buffer per worker thread, merged into m_merged
+	std::vector<MsgBuffer> m_buffers;
+	std::vector<BufferedMsg> m_merged;
+	bool m_buffering;
+
+	struct DelayedMsg
+	{
+		MSG_Object msg;
+		unsigned int sequence;		//Send order, breaks ties between equal delivery times
+		unsigned int heapIndex;		//Position in m_delayedMessages
+		DelayedMsg* next;			//Next message in the receiver bucket, or in the free list
+	};
+
+	//Delayed messages ordered by delivery time (binary min-heap)
+	std::vector<DelayedMsg*> m_delayedMessages;
+
+	//Delayed messages chained by receiver, the size is a power of two
+	std::vector<DelayedMsg*> m_receiverBuckets;
+
+	//Delayed messages are allocated in blocks and recycled through the free list
+	std::vector<DelayedMsg*> m_blocks;
+	DelayedMsg* m_freeList;
+
+	unsigned int m_nextSequence;
 
 	void RouteMsg( MSG_Object & msg );
+	void BroadcastTo( MSG_Object & msg, GameObject * object );
+	void BufferMsg( BufferedCommand command, float delay, MSG_Object & msg, unsigned int type );
+	static bool IsBufferedEarlier( const BufferedMsg & a, const BufferedMsg & b );
+
+	DelayedMsg* AllocMsg( void );
+	void FreeMsg( DelayedMsg* delayed );
+	DelayedMsg** GetReceiverBucket( objectID receiver );
+	void GrowReceiverBuckets( void );
+	void UnlinkMsg( DelayedMsg* delayed );
+	bool IsEarlier( DelayedMsg* a, DelayedMsg* b );
+	void SiftUp( unsigned int index );
+	void SiftDown( unsigned int index );
 
 };
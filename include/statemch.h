@@ -47,17 +47,17 @@
 #include "timesm.h"
 
 #define MAX_STATE_NAME_SIZE 64
-#define DEBUG_STATE_MACHINE_MACROS		//Comment out to get the release macros (no debug logging info)
+#define DEBUG_STATE_MACHINE_MACROS		//Comment out to get the release macros (no debug logging info), see also DebugLog::SetEnabled
 
 //State Machine Language Macros (put the 9 keywords in the file USERTYPE.DAT in the same directory as MSDEV.EXE to get keyword highlighting)
 #ifdef DEBUG_STATE_MACHINE_MACROS
-	#define BeginStateMachine				StateName laststatedeclared; char eventbuffer[5]; if( state < 0 ) { const char statename[MAX_STATE_NAME_SIZE] = "STATE_Global"; const char substatename[MAX_STATE_NAME_SIZE] = ""; if( EVENT_Message == event && msg && MSG_CHANGE_STATE_DELAYED == msg->GetName() ) { ChangeState( static_cast<unsigned int>( msg->GetIntData() ) ); return( true ); } if( EVENT_Message == event && msg && MSG_CHANGE_SUBSTATE_DELAYED == msg->GetName() ) { ChangeSubstate( static_cast<unsigned int>( msg->GetIntData() ) );
-	#define EndStateMachine					return( true ); } g_debuglog.LogStateMachineEvent( m_owner->GetID(), m_owner->GetName(), msg, statename, substatename, itoa(event, eventbuffer, 10), false ); return( false ); } ASSERTMSG( 0, "Invalid State" ); return( false );
-	#define DeclareState(name)				return( true ); } g_debuglog.LogStateMachineEvent( m_owner->GetID(), m_owner->GetName(), msg, statename, substatename, itoa(event, eventbuffer, 10), false ); return( false ); } laststatedeclared = name; if( name == state && substate < 0 ) { const char statename[MAX_STATE_NAME_SIZE] = #name; const char substatename[MAX_STATE_NAME_SIZE] = ""; if( EVENT_Enter == event ) { SetCurrentStateName( #name ); } if(0) { 
-	#define DeclareSubstate(name)			return( true ); } return( false ); } else if( laststatedeclared == state && name == substate ) { const char statename[MAX_STATE_NAME_SIZE] = ""; const char substatename[MAX_STATE_NAME_SIZE] = #name; if( EVENT_Enter == event ) { SetCurrentSubstateName( #name ); } SubstateName verifysubstatename = name; if(0) { 
-	#define OnMsg(msgname)					return( true ); } else if( EVENT_Message == event && msg && msgname == msg->GetName() ) { VerifyMessageEnum( msgname ); g_debuglog.LogStateMachineEvent( m_owner->GetID(), m_owner->GetName(), msg, statename, substatename, #msgname, true );
-	#define OnCCMsg(msgname)				return( true ); } else if( EVENT_CCMessage == event && msg && msgname == msg->GetName() ) { g_debuglog.LogStateMachineEvent( m_owner->GetID(), m_owner->GetName(), msg, statename, substatename, #msgname, true );
-	#define ONEVENT_INTERNAL_HELPER(a)		return( true ); } else if( a == event ) { g_debuglog.LogStateMachineEvent( m_owner->GetID(), m_owner->GetName(), msg, statename, substatename, #a, true );
+	#define BeginStateMachine				StateName laststatedeclared; if( state < 0 ) { const char* statename = "STATE_Global"; const char* substatename = ""; if( EVENT_Message == event && msg && MSG_CHANGE_STATE_DELAYED == msg->GetName() ) { ChangeState( static_cast<unsigned int>( msg->GetIntData() ) ); return( true ); } if( EVENT_Message == event && msg && MSG_CHANGE_SUBSTATE_DELAYED == msg->GetName() ) { ChangeSubstate( static_cast<unsigned int>( msg->GetIntData() ) );
+	#define EndStateMachine					return( true ); } g_debuglog.LogStateMachineEvent( m_owner->GetID(), msg, statename, substatename, event, false ); return( false ); } ASSERTMSG( 0, "Invalid State" ); return( false );
+	#define DeclareState(name)				return( true ); } g_debuglog.LogStateMachineEvent( m_owner->GetID(), msg, statename, substatename, event, false ); return( false ); } laststatedeclared = name; if( name == state && substate < 0 ) { const char* statename = #name; const char* substatename = ""; if( EVENT_Enter == event ) { SetCurrentStateName( #name ); } if(0) { 
+	#define DeclareSubstate(name)			return( true ); } return( false ); } else if( laststatedeclared == state && name == substate ) { const char* statename = ""; const char* substatename = #name; if( EVENT_Enter == event ) { SetCurrentSubstateName( #name ); } SubstateName verifysubstatename = name; if(0) { 
+	#define OnMsg(msgname)					return( true ); } else if( EVENT_Message == event && msg && msgname == msg->GetName() ) { VerifyMessageEnum( msgname ); g_debuglog.LogStateMachineEvent( m_owner->GetID(), msg, statename, substatename, event, true );
+	#define OnCCMsg(msgname)				return( true ); } else if( EVENT_CCMessage == event && msg && msgname == msg->GetName() ) { g_debuglog.LogStateMachineEvent( m_owner->GetID(), msg, statename, substatename, event, true );
+	#define ONEVENT_INTERNAL_HELPER(a)		return( true ); } else if( a == event ) { g_debuglog.LogStateMachineEvent( m_owner->GetID(), msg, statename, substatename, event, true );
 	#define OnUpdate						ONEVENT_INTERNAL_HELPER( EVENT_Update )
 	#define OnEnter							ONEVENT_INTERNAL_HELPER( EVENT_Enter )
 	#define OnExit							ONEVENT_INTERNAL_HELPER( EVENT_Exit )
@@ -82,7 +82,72 @@ enum State_Machine_Event {
 	EVENT_Message,
 	EVENT_CCMessage,
 	EVENT_Enter,
-	EVENT_Exit
+	EVENT_Exit,
+	EVENT_NUM
+};
+
+
+class StateMachine;
+
+//Handler of a table-driven state machine, a member function of the state
+//machine class cast with STATE_HANDLER
+typedef void (StateMachine::*StateHandler)( MSG_Object * msg );
+#define STATE_HANDLER(handler)			static_cast<StateHandler>( &handler )
+
+#define STATE_GLOBAL	(-1)			//State of the handlers that apply in every state
+#define NO_SUBSTATE		(-1)
+
+
+//Dispatch table of a state machine class, an alternative to the macros. The
+//table is filled once per class and shared by its instances; handlers are
+//looked up by state, substate and event or message without any comparisons.
+//Lookups go from the substate to the state to the global state, like with
+//the macros.
+class StateTable
+{
+public:
+
+	StateTable( void );
+	~StateTable( void ) {}
+
+	//Registration, states have to be declared before their handlers
+	void AddState( int state, const char * name );
+	void AddSubstate( int state, int substate, const char * name );
+	void AddEventHandler( int state, int substate, State_Machine_Event event, StateHandler handler );
+	void AddMsgHandler( int state, int substate, MSG_Name name, StateHandler handler );
+	void AddCCMsgHandler( int state, int substate, MSG_Name name, StateHandler handler );
+
+	//Mark the table as filled, so that later instances skip the registration
+	void SetBuilt( void )						{ m_built = true; }
+	bool IsBuilt( void )						{ return( m_built ); }
+
+	//Lookup, returns false if the state or substate was not declared
+	bool FindHandler( int state, int substate, State_Machine_Event event, MSG_Object * msg, StateHandler & handler );
+	const char * GetName( int state, int substate );
+
+
+private:
+
+	//Handler slots: events, then messages, then CC messages
+	enum { SLOT_MSG = EVENT_NUM, SLOT_CCMSG = EVENT_NUM + MSG_NUM, SLOT_NUM = EVENT_NUM + 2 * MSG_NUM };
+
+	struct StateRow
+	{
+		StateRow( void ) : name( 0 ) {}
+
+		const char * name;						//0 if the state was not declared
+		std::vector<StateHandler> handlers;		//Empty until a handler is registered
+	};
+
+	typedef std::vector<StateRow> StateRowContainer;
+
+	StateRowContainer m_states;					//Indexed by state + 1 (global state first)
+	std::vector<StateRowContainer> m_substates;	//Indexed by state + 1, then by substate
+	bool m_built;
+
+	StateRow * GetRow( int state, int substate );
+	void SetHandler( int state, int substate, int slot, StateHandler handler );
+
 };
 
 
@@ -109,6 +174,9 @@ public:
 	//Main state machine code stored in here
 	void Process( State_Machine_Event event, MSG_Object * msg );
 
+	//Dispatch through a table instead of States (set in the constructor)
+	void SetStateTable( StateTable * table )	{ m_stateTable = table; }
+
 	//Debug info
 	char * GetCurrentStateNameString( void )	{ return( m_currentStateNameString ); }
 	char * GetCurrentSubstateNameString( void )	{ return( m_currentSubstateNameString ); }
@@ -167,8 +235,8 @@ protected:
 	inline void VerifyMessageEnum( MSG_Name name ) {}
 
 	//Used for debug to capture current state/substate name string
-	void SetCurrentStateName( char * state )			{ strcpy( m_currentStateNameString, state ); m_currentSubstateNameString[0] = 0; }
-	void SetCurrentSubstateName( char * substate )		{ strcpy( m_currentSubstateNameString, substate ); }
+	void SetCurrentStateName( const char * state )			{ strcpy( m_currentStateNameString, state ); m_currentSubstateNameString[0] = 0; }
+	void SetCurrentSubstateName( const char * substate )	{ strcpy( m_currentSubstateNameString, substate ); }
 
 
 private:
@@ -195,6 +263,8 @@ private:
 	objectID m_ccMessagesToGameObject;			//A GameObject to CC messages to
 	BroadcastListContainer m_broadcastList;		//List of GameObjects to broadcast to
 	StateListContainer m_stack;					//Stack of past states (used for PopState)
+	StateTable * m_stateTable;					//Dispatch table, 0 when States is used
+	unsigned int m_randSeed;					//State of the random sequence used by RandDelay
 
 
 	//Debug info
@@ -202,7 +272,9 @@ private:
 	char m_currentSubstateNameString[MAX_STATE_NAME_SIZE];	//Current substate name string
 
 	void Initialize( void );
-	virtual bool States( State_Machine_Event event, MSG_Object * msg, int state, int substate ) = 0;
+	virtual bool States( State_Machine_Event /*event*/, MSG_Object * /*msg*/, int /*state*/, int /*substate*/ ) { return( false ); }
+	bool Dispatch( State_Machine_Event event, MSG_Object * msg, int state, int substate );
+	bool DispatchTable( State_Machine_Event event, MSG_Object * msg, int state, int substate );
 	void PerformStateChanges( void );
 	void SendCCMsg( MSG_Name name, objectID receiver, MSG_Data data );
 	void SendMsgDelayedToMeHelper( float delay, MSG_Name name, Scope_Rule scope, MSG_Data data, bool timer );
@@ -19,6 +19,8 @@
 #include "ChunkyTriMesh.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 struct BoundsItem
 {
@@ -243,3 +245,202 @@ int rcGetChunksInRect(const rcChunkyTriMesh* cm,
 	return n;
 }
 
+
+
+bool rcCreateQuantizedTriMesh(const float* verts, const int nverts, const rcChunkyTriMesh* cm,
+							  rcQuantizedTriMesh* qm)
+{
+	qm->chunks = new rcQuantizedChunk[cm->nnodes];
+	qm->tris = new unsigned short[cm->ntris*3];
+	qm->normalY = new float[cm->ntris];
+	// Worst case every triangle has its own vertices.
+	unsigned short* qverts = new unsigned short[cm->ntris*3*3];
+	int* remap = new int[nverts];
+	int* local = new int[cm->maxTrisPerChunk*3];
+	int* grid = new int[cm->maxTrisPerChunk*3*3];
+	if (!qm->chunks || !qm->tris || !qm->normalY || !qverts || !remap || !local || !grid)
+	{
+		delete [] qverts;
+		delete [] remap;
+		delete [] local;
+		delete [] grid;
+		return false;
+	}
+	memset(qm->chunks, 0, sizeof(rcQuantizedChunk)*cm->nnodes);
+	memset(remap, 0xff, sizeof(int)*nverts);
+
+	qm->ntris = cm->ntris;
+	qm->nverts = 0;
+	qm->maxVertsPerChunk = 0;
+
+	// One quantization grid for the whole mesh, so a vertex shared by two chunks
+	// snaps to the same grid point in both and the chunk borders stay closed.
+	// The step is set by the largest chunk, every chunk then fits in 16 bits
+	// from its own grid aligned base.
+	float maxExtent[3] = { 0.0f, 0.0f, 0.0f };
+	for (int k = 0; k < 3; ++k)
+		qm->orig[k] = nverts ? verts[k] : 0.0f;
+	for (int j = 1; j < nverts; ++j)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			if (verts[j*3+k] < qm->orig[k])
+				qm->orig[k] = verts[j*3+k];
+		}
+	}
+	for (int i = 0; i < cm->nnodes; ++i)
+	{
+		const rcChunkyTriMeshNode& node = cm->nodes[i];
+		if (node.i < 0) continue;
+		float bmin[3], bmax[3];
+		const int* tris = &cm->tris[node.i*3];
+		for (int k = 0; k < 3; ++k)
+			bmin[k] = bmax[k] = verts[tris[0]*3+k];
+		for (int j = 1; j < node.n*3; ++j)
+		{
+			const float* v = &verts[tris[j]*3];
+			for (int k = 0; k < 3; ++k)
+			{
+				if (v[k] < bmin[k]) bmin[k] = v[k];
+				if (v[k] > bmax[k]) bmax[k] = v[k];
+			}
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			if (bmax[k] - bmin[k] > maxExtent[k])
+				maxExtent[k] = bmax[k] - bmin[k];
+		}
+	}
+	// One step of slack, the chunk base is rounded down to the grid.
+	for (int k = 0; k < 3; ++k)
+		qm->step[k] = maxExtent[k] / 65534.0f;
+
+	for (int i = 0; i < cm->nnodes; ++i)
+	{
+		const rcChunkyTriMeshNode& node = cm->nodes[i];
+		if (node.i < 0) continue;
+
+		rcQuantizedChunk& chunk = qm->chunks[i];
+		const int* tris = &cm->tris[node.i*3];
+
+		// Collect chunk local vertices.
+		int nv = 0;
+		for (int j = 0; j < node.n*3; ++j)
+		{
+			const int v = tris[j];
+			if (remap[v] < 0)
+			{
+				remap[v] = nv;
+				local[nv++] = v;
+			}
+		}
+		if (nv > 0xffff)
+		{
+			delete [] local;
+			delete [] qverts;
+			delete [] remap;
+			delete [] grid;
+			return false;
+		}
+
+		// Grid coordinates of the chunk vertices, the lowest one is the chunk base.
+		for (int j = 0; j < nv; ++j)
+		{
+			const float* v = &verts[local[j]*3];
+			for (int k = 0; k < 3; ++k)
+				grid[j*3+k] = qm->step[k] > 0.0f ? (int)floor((double)(v[k] - qm->orig[k]) / qm->step[k] + 0.5) : 0;
+		}
+		for (int k = 0; k < 3; ++k)
+			chunk.base[k] = nv ? grid[k] : 0;
+		for (int j = 1; j < nv; ++j)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				if (grid[j*3+k] < chunk.base[k])
+					chunk.base[k] = grid[j*3+k];
+			}
+		}
+		chunk.vi = qm->nverts;
+		chunk.nv = nv;
+
+		for (int j = 0; j < nv; ++j)
+		{
+			unsigned short* dst = &qverts[(chunk.vi+j)*3];
+			for (int k = 0; k < 3; ++k)
+			{
+				const int q = grid[j*3+k] - chunk.base[k];
+				dst[k] = (unsigned short)(q < 0xffff ? q : 0xffff);
+			}
+		}
+		qm->nverts += nv;
+		if (nv > qm->maxVertsPerChunk)
+			qm->maxVertsPerChunk = nv;
+
+		// Local indices and the up component of the full precision normals.
+		for (int j = 0; j < node.n; ++j)
+		{
+			const int* t = &tris[j*3];
+			unsigned short* dst = &qm->tris[(node.i+j)*3];
+			dst[0] = (unsigned short)remap[t[0]];
+			dst[1] = (unsigned short)remap[t[1]];
+			dst[2] = (unsigned short)remap[t[2]];
+
+			// same arithmetic as InputGeom::calcTriNormals, so the walkable
+			// flags come out exactly as for the float geometry
+			const float* v0 = &verts[t[0]*3];
+			const float* v1 = &verts[t[1]*3];
+			const float* v2 = &verts[t[2]*3];
+			const float e0x = v1[0]-v0[0], e0y = v1[1]-v0[1], e0z = v1[2]-v0[2];
+			const float e1x = v2[0]-v0[0], e1y = v2[1]-v0[1], e1z = v2[2]-v0[2];
+			const float x = e0y*e1z - e0z*e1y;
+			const float y = e0z*e1x - e0x*e1z;
+			const float z = e0x*e1y - e0y*e1x;
+			const float d = sqrtf(x*x + y*y + z*z);
+			const float id = d > 0.0f ? 1.0f/d : 0.0f;
+			qm->normalY[node.i+j] = y*id;
+		}
+
+		// Reset the remap for the next chunk.
+		for (int j = 0; j < nv; ++j)
+			remap[local[j]] = -1;
+	}
+
+	delete [] remap;
+	delete [] local;
+	delete [] grid;
+
+	// Shrink the vertex buffer to what was actually used.
+	qm->verts = new unsigned short[qm->nverts*3];
+	if (!qm->verts)
+	{
+		delete [] qverts;
+		return false;
+	}
+	memcpy(qm->verts, qverts, sizeof(unsigned short)*qm->nverts*3);
+	delete [] qverts;
+
+	return true;
+}
+
+int rcDecodeQuantizedChunk(const rcQuantizedTriMesh* qm, const rcChunkyTriMesh* cm, const int nodeIdx,
+						   float* verts, int* tris)
+{
+	const rcChunkyTriMeshNode& node = cm->nodes[nodeIdx];
+	const rcQuantizedChunk& chunk = qm->chunks[nodeIdx];
+
+	// The grid index is formed before the conversion, so a vertex decodes to
+	// the same float in every chunk that uses it.
+	const unsigned short* src = &qm->verts[chunk.vi*3];
+	for (int i = 0; i < chunk.nv*3; i += 3)
+	{
+		verts[i+0] = qm->orig[0] + (float)(chunk.base[0] + src[i+0])*qm->step[0];
+		verts[i+1] = qm->orig[1] + (float)(chunk.base[1] + src[i+1])*qm->step[1];
+		verts[i+2] = qm->orig[2] + (float)(chunk.base[2] + src[i+2])*qm->step[2];
+	}
+
+	const unsigned short* t = &qm->tris[node.i*3];
+	for (int i = 0; i < node.n*3; ++i)
+		tris[i] = t[i];
+
+	return chunk.nv;
+}
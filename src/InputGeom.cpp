@@ -63,6 +63,124 @@
 
 #include "SharedData.h"
 
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#	ifndef WIN32_LEAN_AND_MEAN
+#	define WIN32_LEAN_AND_MEAN
+#	endif
+#	ifndef NOMINMAX
+#	define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+// file extension of the binary geometry cache written next to the executable
+#define GEOMCACHE_EXT Ogre::String(".geomcache")
+
+// header / version of the geometry cache
+static const int GEOMCACHE_MAGIC = 'G'<<24 | 'E'<<16 | 'O'<<8 | 'M'; //'GEOM';
+static const int GEOMCACHE_VERSION = 2;
+
+// datafile header of the geometry cache, followed by (in order) :
+// verts[nverts*3], tris[ntris*3], normals[ntris*3], chunky nodes[nnodes], chunky tris[ntris*3],
+// and the authored data, which is stored at full capacity so it can be rewritten in place :
+// convex volumes[maxVolumes], off-mesh verts[maxOffMeshCons*6], rads, flags, dirs, areas
+struct GeomCacheHeader
+{
+	int magic;
+	int version;
+	unsigned int hash;
+	int nverts;
+	int ntris;
+	int nnodes;
+	int maxTrisPerChunk;
+	int offMeshConCount;
+	int volumeCount;
+	int maxOffMeshCons;
+	int maxVolumes;
+	float bmin[3], bmax[3];
+};
+
+// offset of the authored data (convex volumes and off-mesh links) in the cache
+static size_t calcGeomCacheAuthoredOffset(const GeomCacheHeader& h)
+{
+	size_t size = sizeof(GeomCacheHeader);
+	size += sizeof(float)*h.nverts*3;
+	size += sizeof(int)*h.ntris*3;
+	size += sizeof(float)*h.ntris*3;
+	size += sizeof(rcChunkyTriMeshNode)*h.nnodes;
+	size += sizeof(int)*h.ntris*3;
+	return size;
+}
+
+static size_t calcGeomCacheSize(const GeomCacheHeader& h)
+{
+	size_t size = calcGeomCacheAuthoredOffset(h);
+	size += sizeof(ConvexVolume)*h.maxVolumes;
+	size += sizeof(float)*h.maxOffMeshCons*3*2;
+	size += sizeof(float)*h.maxOffMeshCons;
+	size += sizeof(unsigned short)*h.maxOffMeshCons;
+	size += sizeof(unsigned char)*h.maxOffMeshCons*2;
+	return size;
+}
+
+// Maps the whole file copy-on-write, the caller never writes back to the file.
+static void* mapCacheFile(const char* path, size_t& size)
+{
+	size = 0;
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return 0;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return 0;
+	}
+	HANDLE mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+	CloseHandle(file);
+	if (!mapping)
+		return 0;
+	void* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	// the view keeps the mapping alive
+	CloseHandle(mapping);
+	if (!data)
+		return 0;
+	size = (size_t)fileSize.QuadPart;
+	return data;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+	void* data = mmap(0, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return 0;
+	size = (size_t)st.st_size;
+	return data;
+#endif
+}
+
+static void unmapCacheFile(void* data, size_t size)
+{
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap(data, size);
+#endif
+}
+
 static bool intersectSegmentTriangle(const float* sp, const float* sq,
 									 const float* a, const float* b, const float* c,
 									 float &t)
@@ -142,27 +260,317 @@ InputGeom::InputGeom() :
 	m_chunkyMesh(0),
 	m_mesh(0),
 	m_offMeshConCount(0),
-	m_volumeCount(0)
+	m_volumeCount(0),
+	m_cacheData(0),
+	m_cacheSize(0),
+	m_cacheHash(0),
+	m_triNormals(0),
+	m_triWalkable(0),
+	m_walkableSlope(-1.0f),
+	m_quantMesh(0),
+	m_quantize(false)
 {
 }
 
 InputGeom::~InputGeom()
 {
+	freeGeometry();
+}
+
+void InputGeom::freeGeometry()
+{
+	if (m_chunkyMesh && m_cacheData)
+	{
+		// the chunky tree lives in the mapped cache, it must not free it
+		m_chunkyMesh->nodes = 0;
+		m_chunkyMesh->tris = 0;
+	}
 	delete m_chunkyMesh;
+	m_chunkyMesh = 0;
 	delete m_mesh;
+	m_mesh = 0;
+	delete [] m_triNormals;
+	m_triNormals = 0;
+	delete [] m_triWalkable;
+	m_triWalkable = 0;
+	m_walkableSlope = -1.0f;
+	delete m_quantMesh;
+	m_quantMesh = 0;
+
+	if (m_cacheData)
+	{
+		unmapCacheFile(m_cacheData, m_cacheSize);
+		m_cacheData = 0;
+		m_cacheSize = 0;
+	}
+	m_cachePath.clear();
+	m_cacheHash = 0;
+}
+
+bool InputGeom::buildChunkyMesh()
+{
+	m_chunkyMesh = new rcChunkyTriMesh;
+	if (!m_chunkyMesh)
+	{
+		if (rcGetLog())
+			rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Out of memory 'm_chunkyMesh'.");
+		return false;
+	}
+	if (!rcCreateChunkyTriMesh(m_mesh->getVerts(), m_mesh->getTris(), m_mesh->getTriCount(), MAX_CHUNK_TRIS, m_chunkyMesh))
+	{
+		if (rcGetLog())
+			rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Failed to build chunky mesh.");
+		return false;
+	}		
+
+	return calcTriNormals();
+}
+
+bool InputGeom::calcTriNormals()
+{
+	const int nt = m_chunkyMesh->ntris;
+	const float* verts = m_mesh->getVerts();
+	const int* tris = m_chunkyMesh->tris;
+
+	m_triNormals = new float[nt*3];
+	m_triWalkable = new unsigned char[nt];
+	if (!m_triNormals || !m_triWalkable)
+	{
+		if (rcGetLog())
+			rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Out of memory 'm_triNormals' (%d).", nt);
+		return false;
+	}
+	m_walkableSlope = -1.0f;
+
+	float* nx = &m_triNormals[0];
+	float* ny = &m_triNormals[nt];
+	float* nz = &m_triNormals[nt*2];
+
+	// no branches and no shared writes, so this splits across cores and
+	// the compiler is free to vectorize the arithmetic
+#pragma omp parallel for
+	for (int i = 0; i < nt; ++i)
+	{
+		const float* v0 = &verts[tris[i*3+0]*3];
+		const float* v1 = &verts[tris[i*3+1]*3];
+		const float* v2 = &verts[tris[i*3+2]*3];
+		const float e0x = v1[0]-v0[0], e0y = v1[1]-v0[1], e0z = v1[2]-v0[2];
+		const float e1x = v2[0]-v0[0], e1y = v2[1]-v0[1], e1z = v2[2]-v0[2];
+		const float x = e0y*e1z - e0z*e1y;
+		const float y = e0z*e1x - e0x*e1z;
+		const float z = e0x*e1y - e0y*e1x;
+		const float d = sqrtf(x*x + y*y + z*z);
+		const float id = d > 0.0f ? 1.0f/d : 0.0f;
+		nx[i] = x*id;
+		ny[i] = y*id;
+		nz[i] = z*id;
+	}
+
+	return true;
+}
+
+const unsigned char* InputGeom::getWalkableTriFlags(const float walkableSlopeAngle)
+{
+	if (!m_triWalkable)
+		return 0;
+
+	// the flags only change with the slope, so tile rebuilds reuse them
+	if (walkableSlopeAngle != m_walkableSlope)
+	{
+		const int nt = m_chunkyMesh->ntris;
+		const float walkableThr = cosf(walkableSlopeAngle/180.0f*(float)M_PI);
+		if (m_triNormals)
+		{
+			const float* ny = &m_triNormals[nt];
+#pragma omp parallel for
+			for (int i = 0; i < nt; ++i)
+				m_triWalkable[i] = ny[i] > walkableThr ? (unsigned char)RC_WALKABLE : 0;
+		}
+		else
+		{
+			// the quantized mesh keeps the full precision up component for this
+			const float* ny = m_quantMesh->normalY;
+#pragma omp parallel for
+			for (int i = 0; i < nt; ++i)
+				m_triWalkable[i] = ny[i] > walkableThr ? (unsigned char)RC_WALKABLE : 0;
+		}
+		m_walkableSlope = walkableSlopeAngle;
+	}
+
+	return m_triWalkable;
+}
+
+bool InputGeom::loadGeometryCache(const char* filepath, unsigned int hash)
+{
+	size_t size = 0;
+	unsigned char* data = (unsigned char*)mapCacheFile(filepath, size);
+	if (!data)
+		return false;
+
+	const GeomCacheHeader* header = (const GeomCacheHeader*)data;
+	if (size < sizeof(GeomCacheHeader) ||
+		header->magic != GEOMCACHE_MAGIC ||
+		header->version != GEOMCACHE_VERSION ||
+		header->hash != hash ||
+		header->nverts < 0 || header->ntris < 0 || header->nnodes < 0 ||
+		header->maxOffMeshCons != MAX_OFFMESH_CONNECTIONS || header->maxVolumes != MAX_VOLUMES ||
+		header->offMeshConCount < 0 || header->offMeshConCount > MAX_OFFMESH_CONNECTIONS ||
+		header->volumeCount < 0 || header->volumeCount > MAX_VOLUMES ||
+		calcGeomCacheSize(*header) != size)
+	{
+		if (rcGetLog())
+			rcGetLog()->log(RC_LOG_PROGRESS, "loadGeometryCache: '%s' is out of date, rebuilding.", filepath);
+		unmapCacheFile(data, size);
+		return false;
+	}
+
+	unsigned char* d = data + sizeof(GeomCacheHeader);
+	float* verts = (float*)d; d += sizeof(float)*header->nverts*3;
+	int* tris = (int*)d; d += sizeof(int)*header->ntris*3;
+	float* normals = (float*)d; d += sizeof(float)*header->ntris*3;
+	rcChunkyTriMeshNode* nodes = (rcChunkyTriMeshNode*)d; d += sizeof(rcChunkyTriMeshNode)*header->nnodes;
+	int* chunkyTris = (int*)d; d += sizeof(int)*header->ntris*3;
+
+	m_chunkyMesh = new rcChunkyTriMesh;
+	if (!m_chunkyMesh)
+	{
+		unmapCacheFile(data, size);
+		return false;
+	}
+	m_chunkyMesh->nodes = nodes;
+	m_chunkyMesh->nnodes = header->nnodes;
+	m_chunkyMesh->tris = chunkyTris;
+	m_chunkyMesh->ntris = header->ntris;
+	m_chunkyMesh->maxTrisPerChunk = header->maxTrisPerChunk;
+	m_cacheData = data;
+	m_cacheSize = size;
+
+	m_mesh->setCachedGeometry(verts, header->nverts, tris, header->ntris, normals);
+	rcVcopy(m_meshBMin, header->bmin);
+	rcVcopy(m_meshBMax, header->bmax);
+
+	// the authored data is small, copy it out so it can be edited freely
+	m_volumeCount = header->volumeCount;
+	memcpy(m_volumes, d, sizeof(m_volumes)); d += sizeof(m_volumes);
+	m_offMeshConCount = header->offMeshConCount;
+	memcpy(m_offMeshConVerts, d, sizeof(m_offMeshConVerts)); d += sizeof(m_offMeshConVerts);
+	memcpy(m_offMeshConRads, d, sizeof(m_offMeshConRads)); d += sizeof(m_offMeshConRads);
+	memcpy(m_offMeshConFlags, d, sizeof(m_offMeshConFlags)); d += sizeof(m_offMeshConFlags);
+	memcpy(m_offMeshConDirs, d, sizeof(m_offMeshConDirs)); d += sizeof(m_offMeshConDirs);
+	memcpy(m_offMeshConAreas, d, sizeof(m_offMeshConAreas));
+
+	if (rcGetLog())
+		rcGetLog()->log(RC_LOG_PROGRESS, "loadGeometryCache: loaded '%s' (%.1fK verts, %.1fK tris).", filepath, header->nverts/1000.0f, header->ntris/1000.0f);
+
+	return calcTriNormals();
+}
+
+bool InputGeom::saveGeometryCache(const char* filepath, unsigned int hash)
+{
+	if (!m_mesh || !m_chunkyMesh) return false;
+
+	FILE* fp = fopen(filepath, "wb");
+	if (!fp)
+	{
+		if (rcGetLog())
+			rcGetLog()->log(RC_LOG_WARNING, "saveGeometryCache: Could not open '%s' for writing.", filepath);
+		return false;
+	}
+
+	// Store header.
+	GeomCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = GEOMCACHE_MAGIC;
+	header.version = GEOMCACHE_VERSION;
+	header.hash = hash;
+	header.nverts = m_mesh->getVertCount();
+	header.ntris = m_mesh->getTriCount();
+	header.nnodes = m_chunkyMesh->nnodes;
+	header.maxTrisPerChunk = m_chunkyMesh->maxTrisPerChunk;
+	header.offMeshConCount = m_offMeshConCount;
+	header.volumeCount = m_volumeCount;
+	header.maxOffMeshCons = MAX_OFFMESH_CONNECTIONS;
+	header.maxVolumes = MAX_VOLUMES;
+	rcVcopy(header.bmin, m_meshBMin);
+	rcVcopy(header.bmax, m_meshBMax);
+	fwrite(&header, sizeof(GeomCacheHeader), 1, fp);
+
+	// Store geometry and chunky tree.
+	fwrite(m_mesh->getVerts(), sizeof(float)*header.nverts*3, 1, fp);
+	fwrite(m_mesh->getTris(), sizeof(int)*header.ntris*3, 1, fp);
+	fwrite(m_mesh->getNormals(), sizeof(float)*header.ntris*3, 1, fp);
+	fwrite(m_chunkyMesh->nodes, sizeof(rcChunkyTriMeshNode)*header.nnodes, 1, fp);
+	fwrite(m_chunkyMesh->tris, sizeof(int)*header.ntris*3, 1, fp);
+
+	// Store convex volumes and off-mesh links.
+	writeGeometryCacheAuthoredData(fp);
+
+	const bool ok = ferror(fp) == 0;
+	fclose(fp);
+
+	if (!ok)
+	{
+		// never leave a truncated cache behind
+		remove(filepath);
+		return false;
+	}
+
+	return true;
+}
+
+void InputGeom::writeGeometryCacheAuthoredData(FILE* fp)
+{
+	fwrite(m_volumes, sizeof(m_volumes), 1, fp);
+	fwrite(m_offMeshConVerts, sizeof(m_offMeshConVerts), 1, fp);
+	fwrite(m_offMeshConRads, sizeof(m_offMeshConRads), 1, fp);
+	fwrite(m_offMeshConFlags, sizeof(m_offMeshConFlags), 1, fp);
+	fwrite(m_offMeshConDirs, sizeof(m_offMeshConDirs), 1, fp);
+	fwrite(m_offMeshConAreas, sizeof(m_offMeshConAreas), 1, fp);
+}
+
+bool InputGeom::updateGeometryCache()
+{
+	if (m_cachePath.empty()) return false;
+
+	// The convex volumes and off-mesh links are authored after the scene is loaded,
+	// rewrite them in place. The size of the file never changes, so this is safe
+	// while the geometry part is still mapped.
+	FILE* fp = fopen(m_cachePath.c_str(), "r+b");
+	if (!fp)
+		return false;
+
+	GeomCacheHeader header;
+	if (fread(&header, sizeof(GeomCacheHeader), 1, fp) != 1 ||
+		header.magic != GEOMCACHE_MAGIC ||
+		header.version != GEOMCACHE_VERSION ||
+		header.hash != m_cacheHash ||
+		header.maxOffMeshCons != MAX_OFFMESH_CONNECTIONS || header.maxVolumes != MAX_VOLUMES)
+	{
+		fclose(fp);
+		return false;
+	}
+
+	header.offMeshConCount = m_offMeshConCount;
+	header.volumeCount = m_volumeCount;
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&header, sizeof(GeomCacheHeader), 1, fp);
+	fseek(fp, (long)calcGeomCacheAuthoredOffset(header), SEEK_SET);
+	writeGeometryCacheAuthoredData(fp);
+
+	const bool ok = ferror(fp) == 0;
+	fclose(fp);
+
+	if (!ok && rcGetLog())
+		rcGetLog()->log(RC_LOG_WARNING, "updateGeometryCache: Could not write '%s'.", m_cachePath.c_str());
+
+	return ok;
 }
 		
 bool InputGeom::loadMesh(Ogre::StringVector entNames, Ogre::StringVector filepaths)
 {
 	rcSetLog(&SharedData::getSingleton().mDbgLog);
 
-	if (m_mesh)
-	{
-		delete m_chunkyMesh;
-		m_chunkyMesh = 0;
-		delete m_mesh;
-		m_mesh = 0;
-	}
+	freeGeometry();
 	m_offMeshConCount = 0;
 	m_volumeCount = 0;
 	
@@ -174,34 +582,43 @@ bool InputGeom::loadMesh(Ogre::StringVector entNames, Ogre::StringVector filepat
 		return false;
 	}
 
-	if (!m_mesh->load(entNames, filepaths))
+	if (entNames.empty() || !m_mesh->loadEntities(entNames, filepaths))
 	{
 		if (rcGetLog())
 		{
 			int sza = filepaths.size();
 			for(int i = 0; i < sza; ++i)
 			{
-				rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Could not load '%s'", filepaths[i]);
+				rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Could not load '%s'", filepaths[i].c_str());
 			}
 		}
 		return false;
 	}
-	
-	rcCalcBounds(m_mesh->getVerts(), m_mesh->getVertCount(), m_meshBMin, m_meshBMax);
 
-	m_chunkyMesh = new rcChunkyTriMesh;
-	if (!m_chunkyMesh)
+	// entities are in the scene now, so the transforms are final
+	const Ogre::String cachePath = entNames[0] + GEOMCACHE_EXT;
+	const unsigned int hash = m_mesh->calcSourceHash();
+	m_cachePath = cachePath;
+	m_cacheHash = hash;
+	if (!loadGeometryCache(cachePath.c_str(), hash))
 	{
-		if (rcGetLog())
-			rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Out of memory 'm_chunkyMesh'.");
-		return false;
+		if (!m_mesh->buildEntityGeometry())
+		{
+			if (rcGetLog())
+				rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Could not build entity geometry.");
+			return false;
+		}
+	
+		rcCalcBounds(m_mesh->getVerts(), m_mesh->getVertCount(), m_meshBMin, m_meshBMax);
+
+		if (!buildChunkyMesh())
+			return false;
+
+		saveGeometryCache(cachePath.c_str(), hash);
 	}
-	if (!rcCreateChunkyTriMesh(m_mesh->getVerts(), m_mesh->getTris(), m_mesh->getTriCount(), 256, m_chunkyMesh))
-	{
-		if (rcGetLog())
-			rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Failed to build chunky mesh.");
-		return false;
-	}		
+
+	if (m_quantize)
+		return quantizeGeometry();
 
 	return true;
 }
@@ -210,13 +627,7 @@ bool InputGeom::loadTerrain()
 {
 	rcSetLog(&SharedData::getSingleton().mDbgLog);
 
-	if (m_mesh)
-	{
-		delete m_chunkyMesh;
-		m_chunkyMesh = 0;
-		delete m_mesh;
-		m_mesh = 0;
-	}
+	freeGeometry();
 	m_offMeshConCount = 0;
 	m_volumeCount = 0;
 
@@ -228,30 +639,71 @@ bool InputGeom::loadTerrain()
 		return false;
 	}
 
-	if (!m_mesh->load())
+	// the terrain itself is always needed for rendering, only the recast
+	// geometry extraction can come from the cache
+	m_mesh->setupContent();
+
+	const Ogre::String cachePath = Ogre::String("Terrain") + GEOMCACHE_EXT;
+	const unsigned int hash = m_mesh->calcSourceHash();
+	m_cachePath = cachePath;
+	m_cacheHash = hash;
+	if (!loadGeometryCache(cachePath.c_str(), hash))
 	{
-		if (rcGetLog())
+		if (!m_mesh->buildTerrainGeometry())
 		{
-				rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Could not create Terrain.");
+			if (rcGetLog())
+			{
+					rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Could not create Terrain.");
+			}
+			return false;
 		}
-		return false;
+
+		rcCalcBounds(m_mesh->getVerts(), m_mesh->getVertCount(), m_meshBMin, m_meshBMax);
+
+		if (!buildChunkyMesh())
+			return false;
+
+		saveGeometryCache(cachePath.c_str(), hash);
 	}
 
-	rcCalcBounds(m_mesh->getVerts(), m_mesh->getVertCount(), m_meshBMin, m_meshBMax);
+	if (m_quantize)
+		return quantizeGeometry();
 
-	m_chunkyMesh = new rcChunkyTriMesh;
-	if (!m_chunkyMesh)
+	return true;
+}
+
+bool InputGeom::quantizeGeometry()
+{
+	m_quantMesh = new rcQuantizedTriMesh;
+	if (!m_quantMesh)
 	{
 		if (rcGetLog())
-			rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Out of memory 'm_chunkyMesh'.");
+			rcGetLog()->log(RC_LOG_ERROR, "quantizeGeometry: Out of memory 'm_quantMesh'.");
 		return false;
 	}
-	if (!rcCreateChunkyTriMesh(m_mesh->getVerts(), m_mesh->getTris(), m_mesh->getTriCount(), 256, m_chunkyMesh))
+	if (!rcCreateQuantizedTriMesh(m_mesh->getVerts(), m_mesh->getVertCount(), m_chunkyMesh, m_quantMesh))
 	{
 		if (rcGetLog())
-			rcGetLog()->log(RC_LOG_ERROR, "buildTiledNavigation: Failed to build chunky mesh.");
+			rcGetLog()->log(RC_LOG_ERROR, "quantizeGeometry: Failed to build quantized mesh.");
+		delete m_quantMesh;
+		m_quantMesh = 0;
 		return false;
-	}		
+	}
+
+	// From here on the chunks are decoded on demand, drop the full precision copies.
+	m_mesh->releaseGeometry();
+	if (!m_cacheData)
+		delete [] m_chunkyMesh->tris;
+	m_chunkyMesh->tris = 0;
+	delete [] m_triNormals;
+	m_triNormals = 0;
+	m_walkableSlope = -1.0f;
+
+	if (rcGetLog())
+		rcGetLog()->log(RC_LOG_PROGRESS, "quantizeGeometry: %.1fK verts, %.1fK tris, %.1f kB.",
+						m_quantMesh->nverts/1000.0f, m_quantMesh->ntris/1000.0f,
+						(m_quantMesh->nverts*3*sizeof(unsigned short) + m_quantMesh->ntris*(3*sizeof(unsigned short) + sizeof(float)) +
+						 m_chunkyMesh->nnodes*sizeof(rcQuantizedChunk))/1024.0f);
 
 	return true;
 }
@@ -381,38 +833,164 @@ bool InputGeom::save(const char* filepath)
 }
 
 bool InputGeom::raycastMesh(float* src, float* dst, float& tmin)
+{
+	return raycastChunks(src, dst, tmin);
+}
+
+bool InputGeom::raycastChunks(const float* src, const float* dst, float& tmin) const
 {
 	float dir[3];
 	rcVsub(dir, dst, src);
-	
-	int nt = m_mesh->getTriCount();
+
+	float bmin[2], bmax[2];
+	bmin[0] = rcMin(src[0], dst[0]);
+	bmin[1] = rcMin(src[2], dst[2]);
+	bmax[0] = rcMax(src[0], dst[0]);
+	bmax[1] = rcMax(src[2], dst[2]);
+
+	const int nt = m_chunkyMesh->ntris;
 	const float* verts = m_mesh->getVerts();
-	const float* normals = m_mesh->getNormals();
-	const int* tris = m_mesh->getTris();
+	// scratch for decoding quantized chunks, on the stack so batches can run threaded
+	float qverts[MAX_CHUNK_TRIS*3*3];
+	int qtris[MAX_CHUNK_TRIS*3];
 	tmin = 1.0f;
 	bool hit = false;
-	
-	for (int i = 0; i < nt*3; i += 3)
+
+	// Traverse the chunky tree, only leaves the segment passes over are tested.
+	int i = 0;
+	while (i < m_chunkyMesh->nnodes)
 	{
-		const float* n = &normals[i];
-		if (rcVdot(dir, n) > 0)
-			continue;
-		
-		float t = 1;
-		if (intersectSegmentTriangle(src, dst,
-									 &verts[tris[i]*3],
-									 &verts[tris[i+1]*3],
-									 &verts[tris[i+2]*3], t))
+		const rcChunkyTriMeshNode& node = m_chunkyMesh->nodes[i];
+		const bool overlap = !(bmin[0] > node.bmax[0] || bmax[0] < node.bmin[0] ||
+							   bmin[1] > node.bmax[1] || bmax[1] < node.bmin[1]);
+		const bool isLeafNode = node.i >= 0;
+
+		if (isLeafNode && overlap)
 		{
-			if (t < tmin)
-				tmin = t;
-			hit = true;
+			const float* cverts = verts;
+			const int* ctris = 0;
+			if (m_quantMesh)
+			{
+				rcDecodeQuantizedChunk(m_quantMesh, m_chunkyMesh, i, qverts, qtris);
+				cverts = qverts;
+				ctris = qtris;
+			}
+			else
+			{
+				ctris = &m_chunkyMesh->tris[node.i*3];
+			}
+
+			for (int j = 0; j < node.n; ++j)
+			{
+				// back face cull with the precomputed normals, the quantized mesh
+				// has none and relies on the one sided test in intersectSegmentTriangle
+				if (!m_quantMesh)
+				{
+					const int k = node.i+j;
+					const float n[3] = { m_triNormals[k], m_triNormals[nt+k], m_triNormals[nt*2+k] };
+					if (rcVdot(dir, n) > 0)
+						continue;
+				}
+
+				const int* tri = &ctris[j*3];
+				float t = 1;
+				if (intersectSegmentTriangle(src, dst,
+											 &cverts[tri[0]*3],
+											 &cverts[tri[1]*3],
+											 &cverts[tri[2]*3], t))
+				{
+					if (t < tmin)
+						tmin = t;
+					hit = true;
+				}
+			}
 		}
+
+		if (overlap || isLeafNode)
+			i++;
+		else
+			i += -node.i;
 	}
-	
+
 	return hit;
 }
 
+// Interleaves the low 16 bits of x and y.
+inline unsigned int mortonKey(unsigned int x, unsigned int y)
+{
+	x &= 0xffff;
+	y &= 0xffff;
+	x = (x | (x << 8)) & 0x00ff00ff;
+	x = (x | (x << 4)) & 0x0f0f0f0f;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	y = (y | (y << 8)) & 0x00ff00ff;
+	y = (y | (y << 4)) & 0x0f0f0f0f;
+	y = (y | (y << 2)) & 0x33333333;
+	y = (y | (y << 1)) & 0x55555555;
+	return x | (y << 1);
+}
+
+struct RayOrderItem
+{
+	unsigned int key;
+	int i;
+};
+
+static int compareRayOrder(const void* va, const void* vb)
+{
+	const RayOrderItem* a = (const RayOrderItem*)va;
+	const RayOrderItem* b = (const RayOrderItem*)vb;
+	if (a->key < b->key)
+		return -1;
+	if (a->key > b->key)
+		return 1;
+	return a->i - b->i;
+}
+
+int InputGeom::raycastMeshBatch(const float* src, const float* dst, const int nrays,
+								float* tmins, unsigned char* hits) const
+{
+	if (!m_mesh || !m_chunkyMesh || nrays <= 0)
+		return 0;
+
+	// Order the rays along a z-curve over the mesh bounds, so rays handled
+	// together (and by the same thread) touch the same chunks.
+	RayOrderItem* order = new RayOrderItem[nrays];
+	if (!order)
+		return 0;
+	const float sx = 65535.0f / rcMax(m_meshBMax[0] - m_meshBMin[0], 1.0f);
+	const float sz = 65535.0f / rcMax(m_meshBMax[2] - m_meshBMin[2], 1.0f);
+	for (int i = 0; i < nrays; ++i)
+	{
+		const float* s = &src[i*3];
+		const float* e = &dst[i*3];
+		const float x = rcClamp((s[0]+e[0])*0.5f - m_meshBMin[0], 0.0f, m_meshBMax[0] - m_meshBMin[0]);
+		const float z = rcClamp((s[2]+e[2])*0.5f - m_meshBMin[2], 0.0f, m_meshBMax[2] - m_meshBMin[2]);
+		order[i].key = mortonKey((unsigned int)(x*sx), (unsigned int)(z*sz));
+		order[i].i = i;
+	}
+	qsort(order, nrays, sizeof(RayOrderItem), compareRayOrder);
+
+	int nhits = 0;
+#pragma omp parallel for schedule(static) reduction(+:nhits)
+	for (int i = 0; i < nrays; ++i)
+	{
+		const int r = order[i].i;
+		float tmin = 1.0f;
+		const bool hit = raycastChunks(&src[r*3], &dst[r*3], tmin);
+		tmins[r] = tmin;
+		if (hits)
+			hits[r] = hit ? 1 : 0;
+		if (hit)
+			nhits++;
+	}
+
+	delete [] order;
+
+	return nhits;
+}
+
 void InputGeom::addOffMeshConnection(const float* spos, const float* epos, const float rad,
 									 unsigned char bidir, unsigned char area, unsigned short flags)
 {
@@ -425,6 +1003,8 @@ void InputGeom::addOffMeshConnection(const float* spos, const float* epos, const
 	rcVcopy(&v[0], spos);
 	rcVcopy(&v[3], epos);
 	m_offMeshConCount++;
+
+	updateGeometryCache();
 }
 
 void InputGeom::deleteOffMeshConnection(int i)
@@ -438,6 +1018,8 @@ void InputGeom::deleteOffMeshConnection(int i)
 	m_offMeshConDirs[i] = m_offMeshConDirs[m_offMeshConCount];
 	m_offMeshConAreas[i] = m_offMeshConAreas[m_offMeshConCount];
 	m_offMeshConFlags[i] = m_offMeshConFlags[m_offMeshConCount];
+
+	updateGeometryCache();
 }
 
 void InputGeom::drawOffMeshConnections(duDebugDraw* dd, bool hilight)
@@ -482,12 +1064,16 @@ void InputGeom::addConvexVolume(const float* verts, const int nverts,
 	vol->hmax = maxh;
 	vol->nverts = nverts;
 	vol->area = area;
+
+	updateGeometryCache();
 }
 
 void InputGeom::deleteConvexVolume(int i)
 {
 	m_volumeCount--;
 	m_volumes[i] = m_volumes[m_volumeCount];
+
+	updateGeometryCache();
 }
 
 void InputGeom::drawConvexVolumes(struct duDebugDraw* dd, bool /*hilight*/)
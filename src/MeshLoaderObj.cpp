@@ -69,7 +69,7 @@ using namespace Ogre;
 
 
 rcMeshLoaderObj::rcMeshLoaderObj() :
-	m_verts(0),	m_tris(0), m_normals(0), m_vertCount(0), m_triCount(0),
+	m_verts(0),	m_tris(0), m_normals(0), m_vertCount(0), m_triCount(0), m_ownsGeometry(true),
 	myManualObjectMaterial(0), obj(0), mMatsLoaded(false), ntris(0),
 	tris(0), verts(0), nverts(0), numEnt(0), mTerrainGroup(0), mTerrainPaging(0),
 	mTerrainGlobals(0), mPageManager(0), mFly(true), mFallVelocity(0), mMode(MODE_NORMAL),
@@ -91,10 +91,13 @@ rcMeshLoaderObj::rcMeshLoaderObj() :
 rcMeshLoaderObj::~rcMeshLoaderObj()
 {
 	delete [] m_verts;
-	delete [] m_normals;
 	delete [] m_tris;
-	delete [] tris;
-	delete [] verts;
+	if (m_ownsGeometry)
+	{
+		delete [] m_normals;
+		delete [] tris;
+		delete [] verts;
+	}
 	
 	for(unsigned int i = 0; i < numEnt; ++i)
 	{
@@ -170,6 +173,136 @@ void rcMeshLoaderObj::addTriangle(int a, int b, int c, int& cap)
 	//obj->triangle(a, b, c);
 }
 
+void rcMeshLoaderObj::calcNormals()
+{
+	m_normals = new float[ntris*3];
+#pragma omp parallel for
+	for (int i = 0; i < ntris*3; i += 3)
+	{
+		const float* v0 = &verts[tris[i]*3];
+		const float* v1 = &verts[tris[i+1]*3];
+		const float* v2 = &verts[tris[i+2]*3];
+		float e0[3], e1[3];
+		for (int j = 0; j < 3; ++j)
+		{
+			e0[j] = (v1[j] - v0[j]);
+			e1[j] = (v2[j] - v0[j]);
+		}
+		float* n = &m_normals[i];
+		n[0] = ((e0[1]*e1[2]) - (e0[2]*e1[1]));
+		n[1] = ((e0[2]*e1[0]) - (e0[0]*e1[2]));
+		n[2] = ((e0[0]*e1[1]) - (e0[1]*e1[0]));
+
+		float d = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		if (d > 0)
+		{
+			d = 1.0f/d;
+			n[0] *= d;
+			n[1] *= d;
+			n[2] *= d;
+		}	
+	}
+}
+
+// FNV-1a, used to fingerprint the source data of the geometry cache.
+static unsigned int hashBytes(unsigned int h, const void* data, size_t size)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+unsigned int rcMeshLoaderObj::calcSourceHash()
+{
+	unsigned int h = 2166136261u;
+
+	// terrain pages, only present in the terrain scene
+	if (mTerrainGroup)
+	{
+		TerrainGroup::TerrainIterator ti = mTerrainGroup->getTerrainIterator();
+		while(ti.hasMoreElements())
+		{
+			Terrain* trn = ti.getNext()->instance;
+			if (!trn)
+				continue;
+			const int mapSize = trn->getSize();
+			const float worldSize = trn->getWorldSize();
+			const Ogre::Vector3 pos = trn->getPosition();
+			h = hashBytes(h, &mapSize, sizeof(mapSize));
+			h = hashBytes(h, &worldSize, sizeof(worldSize));
+			h = hashBytes(h, pos.ptr(), sizeof(Ogre::Real)*3);
+			h = hashBytes(h, trn->getHeightData(), sizeof(float)*mapSize*mapSize);
+		}
+	}
+
+	// entities, hash the mesh file itself and the full transform of its node
+	const NavSceneNodeList& nodes = SharedData::getSingleton().mNavNodeList;
+	for (uint i = 0; i < nodes.size(); ++i)
+	{
+		Ogre::Entity* ent = (Ogre::Entity*)nodes[i]->getAttachedObject(0);
+		const Ogre::MeshPtr& entMesh = ent->getMesh();
+		const Ogre::String& meshName = entMesh->getName();
+		h = hashBytes(h, meshName.c_str(), meshName.size());
+		try
+		{
+			Ogre::DataStreamPtr stream = Ogre::ResourceGroupManager::getSingleton().openResource(meshName, entMesh->getGroup());
+			char buf[4096];
+			while (!stream->eof())
+			{
+				const size_t n = stream->read(buf, sizeof(buf));
+				if (!n)
+					break;
+				h = hashBytes(h, buf, n);
+			}
+			stream->close();
+		}
+		catch (Ogre::Exception&)
+		{
+			// manually created mesh, no file to fingerprint - fall back to its name only
+		}
+
+		const Ogre::Matrix4 transform = nodes[i]->_getFullTransform();
+		for (int r = 0; r < 4; ++r)
+			h = hashBytes(h, transform[r], sizeof(Ogre::Real)*4);
+	}
+
+	return h;
+}
+
+void rcMeshLoaderObj::setCachedGeometry(float* cverts, int cnverts, int* ctris, int cntris, float* cnormals)
+{
+	if (m_ownsGeometry)
+	{
+		delete [] m_normals;
+		delete [] tris;
+		delete [] verts;
+	}
+	verts = cverts;
+	nverts = cnverts;
+	tris = ctris;
+	ntris = cntris;
+	m_normals = cnormals;
+	m_ownsGeometry = false;
+}
+
+void rcMeshLoaderObj::releaseGeometry()
+{
+	if (m_ownsGeometry)
+	{
+		delete [] m_normals;
+		delete [] tris;
+		delete [] verts;
+	}
+	// keep the counts, they are still valid for the quantized copy
+	verts = 0;
+	tris = 0;
+	m_normals = 0;
+}
+
 static char* parseRow(char* buf, char* bufEnd, char* row, int len)
 {
 	bool cont = false;
@@ -232,8 +365,15 @@ static int parseFace(char* row, int* data, int n, int vcnt)
 	return j;
 }
 
-// PARTS OF THE FOLLOWING METHOD WERE TAKEN FROM AN OGRE3D FORUM POST ABOUT RECAST
 bool rcMeshLoaderObj::load(Ogre::StringVector entNames, Ogre::StringVector fileNames)
+{
+	if (!loadEntities(entNames, fileNames))
+		return false;
+
+	return buildEntityGeometry();
+}
+
+bool rcMeshLoaderObj::loadEntities(Ogre::StringVector entNames, Ogre::StringVector fileNames)
 {
 	// check to make sure we have the same amount of filenames and entity names
 	if(entNames.size() != fileNames.size())
@@ -258,6 +398,12 @@ bool rcMeshLoaderObj::load(Ogre::StringVector entNames, Ogre::StringVector fileN
 		offsetZ += 270.0f;
 	}
 
+	return true;
+}
+
+// PARTS OF THE FOLLOWING METHOD WERE TAKEN FROM AN OGRE3D FORUM POST ABOUT RECAST
+bool rcMeshLoaderObj::buildEntityGeometry()
+{
 		//get all vertices and triangles
 		// mesh data to retrieve
 		const int numNodes = SharedData::getSingleton().mNavNodeList.size();
@@ -330,35 +476,8 @@ bool rcMeshLoaderObj::load(Ogre::StringVector entNames, Ogre::StringVector fileN
 
 		// calculate normals data for Recast - im not 100% sure where this is required
 		// but it is used, Ogre handles its own Normal data for rendering, this is not related
-		// to Ogre at all ( its also not correct lol )
-		// TODO : fix this
-	 	m_normals = new float[ntris*3];
-	 	for (int i = 0; i < ntris*3; i += 3)
-	 	{
-	 		const float* v0 = &verts[tris[i]*3];
-	 		const float* v1 = &verts[tris[i+1]*3];
-	 		const float* v2 = &verts[tris[i+2]*3];
-	 		float e0[3], e1[3];
-	 		for (int j = 0; j < 3; ++j)
-	 		{
-	 			e0[j] = (v1[j] - v0[j]);
-	 			e1[j] = (v2[j] - v0[j]);
-	 		}
-	 		float* n = &m_normals[i];
-	  		n[0] = ((e0[1]*e1[2]) - (e0[2]*e1[1]));
-	  		n[1] = ((e0[2]*e1[0]) - (e0[0]*e1[2]));
-	  		n[2] = ((e0[0]*e1[1]) - (e0[1]*e1[0]));
-	 		
-	 		float d = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
-	 		if (d > 0)
-	 		{
-	 			d = 1.0f/d;
-	 			n[0] *= d;
-	 			n[1] *= d;
-	 			n[2] *= d;
-	 		}	
-	 	}
-
+		// to Ogre at all
+		calcNormals();
 
 	return true;
 }
@@ -367,9 +486,15 @@ bool rcMeshLoaderObj::load(Ogre::StringVector entNames, Ogre::StringVector fileN
 // PARTS OF THE FOLLOWING CODE WERE TAKEN AND MODIFIED FROM AN OGRE3D FORUM POST
 bool rcMeshLoaderObj::load()
 {
-	
 	setupContent();
 
+	return buildTerrainGeometry();
+}
+
+//-------------------------------------------------------------------------------
+// PARTS OF THE FOLLOWING CODE WERE TAKEN AND MODIFIED FROM AN OGRE3D FORUM POST
+bool rcMeshLoaderObj::buildTerrainGeometry()
+{
 	const int numNodes = SharedData::getSingleton().mNavNodeList.size();
 	const int totalMeshes = numNodes + mPagesTotal;
 
@@ -621,32 +746,7 @@ bool rcMeshLoaderObj::load()
 	//---------------------------------------------------------------------------------------------
 	// RECAST **ONLY** NORMAL CALCS ( These are not used anywhere other than internally by recast)
 
-	m_normals = new float[ntris*3];
-	for (int i = 0; i < ntris*3; i += 3)
-	{
-		const float* v0 = &verts[tris[i]*3];
-		const float* v1 = &verts[tris[i+1]*3];
-		const float* v2 = &verts[tris[i+2]*3];
-		float e0[3], e1[3];
-		for (int j = 0; j < 3; ++j)
-		{
-			e0[j] = (v1[j] - v0[j]);
-			e1[j] = (v2[j] - v0[j]);
-		}
-		float* n = &m_normals[i];
-		n[0] = ((e0[1]*e1[2]) - (e0[2]*e1[1]));
-		n[1] = ((e0[2]*e1[0]) - (e0[0]*e1[2]));
-		n[2] = ((e0[0]*e1[1]) - (e0[1]*e1[0]));
-
-		float d = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
-		if (d > 0)
-		{
-			d = 1.0f/d;
-			n[0] *= d;
-			n[1] *= d;
-			n[2] *= d;
-		}	
-	}
+	calcNormals();
 
 	return true;
 }
@@ -48,6 +48,7 @@
 
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <float.h>
 #include <stdio.h>
 #include <string.h>
 #include "Ogre.h"
@@ -59,9 +60,11 @@
 #include "GUIManager.h"
 #include "Recast.h"
 #include "RecastDebugDraw.h"
+#include "DetourCommon.h"
 #include "DetourNavMesh.h"
 #include "DetourNavMeshBuilder.h"
 #include "DetourDebugDraw.h"
+#include "RecastTimer.h"
 #include "SinbadController.h"
 #include "MoveableTextOverlay.h"
 #include "timesm.h"
@@ -142,6 +145,12 @@ static bool getSteerTarget(dtNavMesh* navMesh, const float* startPos, const floa
 	return true;
 }
 
+// random number in range [0..1) for placing agents at random spots on the navmesh
+static float frand()
+{
+	return (float)rand() / ((float)RAND_MAX + 1.0f);
+}
+
 static void getPolyCenter(dtNavMesh* navMesh, dtPolyRef ref, float* center)
 {
 	const dtPoly* p = navMesh->getPolyByRef(ref);
@@ -173,7 +182,7 @@ NavMeshTesterTool::NavMeshTesterTool() :
 		m_bShowFPS(true), m_dAvFrameTime(0), m_bRenderNeighbors(true), m_bViewKeys(true), mLastObjectSelection(0),
 		m_bShowCellSpaceInfo(true), m_vCrosshair(Vector2D(0, 0)), mCurrentObjectSelection(0),
 		m_bShowEntityLabels(true), ddCrosshair(0), ddCellAgentView(0), ddCellAgentNeigh(0),
-		m_offSetVec(Vector2D(0, 0))
+		m_offSetVec(Vector2D(0, 0)), m_bUseSteeringCrowd(false), m_iCrowdSteered(0)
 {
 	m_filter.includeFlags = SAMPLE_POLYFLAGS_ALL;
 	m_filter.excludeFlags = 0;
@@ -184,6 +193,9 @@ NavMeshTesterTool::NavMeshTesterTool() :
 
 	m_EntityList.resize(0);
 	m_GameObjectList.resize(0);
+
+	memset(m_iSteerTimeUsec, 0, sizeof(m_iSteerTimeUsec));
+	memset(m_iSteerFrames, 0, sizeof(m_iSteerFrames));
 }
 
 NavMeshTesterTool::~NavMeshTesterTool()
@@ -245,6 +257,7 @@ NavMeshTesterTool::~NavMeshTesterTool()
 	m_GameObjectList.resize(0);
 	m_EntityList.resize(0);
 	m_Vehicles.resize(0);
+	m_TaggedVehicles.clear();
 
 	SharedData::getSingleton().iSceneMgr->destroyQuery(mRaySceneQuery);
 }
@@ -256,6 +269,8 @@ void NavMeshTesterTool::removeLatestEntity(void)
 
 	if(m_GameObjectList.size() > 0)
 	{
+		m_pCellSpace->RemoveEntity(m_Vehicles.back());
+		m_TaggedVehicles.clear();
 		g_database.Remove(static_cast<GameObject*>(m_GameObjectList[(unsigned int)(m_GameObjectList.size() - 1)])->GetID());
 		delete m_GameObjectList[(unsigned int)(m_GameObjectList.size() - 1)];
 		m_GameObjectList.pop_back();
@@ -272,6 +287,11 @@ void NavMeshTesterTool::init(OgreTemplate* sample)
 	m_navMesh = sample->getNavMesh();
 	recalc();
 
+	// a goal gets its own flow field once a second agent heads there,
+	// the field size is bounded by the number of polygons
+	m_flowFields.init(MAX_FLOW_FIELDS, MAX_POLYS, FLT_MAX, 2);
+	m_pathCache.init(MAX_CACHED_PATHS, MAX_POLYS);
+
 	// setup the bounds for our steering agents
 	const float* maxBound = m_sample->getBoundsMax();
 	const float* minBound = m_sample->getBoundsMin();
@@ -286,18 +306,17 @@ void NavMeshTesterTool::init(OgreTemplate* sample)
 	m_offSetVec.y = m_cyClientMin;
 	//setup the spatial subdivision class
 	m_pCellSpace = new CellSpacePartition<SinbadCharacterController*>((double)cx, (double)cy, Prm.NumCellsX, Prm.NumCellsY, Prm.NumAgents, (m_cxClientMin / -1), (m_cyClientMin / -1));
+	// the crowd follows the agents' own paths one waypoint at a time
+	m_SteeringCrowd.Init(MAXIMUM_ENTITIES, 1, Prm.ViewDistance, WaypointSeekDist);
 
 
-	if (m_navMesh)
-	{
-		// Change costs.
-		m_navMesh->setAreaCost(SAMPLE_POLYAREA_GROUND, 1.0f);
-		m_navMesh->setAreaCost(SAMPLE_POLYAREA_WATER, 10.0f);
-		m_navMesh->setAreaCost(SAMPLE_POLYAREA_ROAD, 1.0f);
-		m_navMesh->setAreaCost(SAMPLE_POLYAREA_DOOR, 1.0f);
-		m_navMesh->setAreaCost(SAMPLE_POLYAREA_GRASS, 2.0f);
-		m_navMesh->setAreaCost(SAMPLE_POLYAREA_JUMP, 1.5f);
-	}
+	// Change costs.
+	m_filter.setAreaCost(SAMPLE_POLYAREA_GROUND, 1.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_WATER, 10.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_ROAD, 1.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_DOOR, 1.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_GRASS, 2.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_JUMP, 1.5f);
 
 	if(m_toolMode == TOOLMODE_PATHFIND_ITER || m_toolMode == TOOLMODE_PATHFIND_STRAIGHT)
 	{
@@ -335,6 +354,7 @@ void NavMeshTesterTool::init(OgreTemplate* sample)
 	m_GameObjectList.resize(0);
 	m_EntityList.resize(0);
 	m_Vehicles.resize(0);
+	m_TaggedVehicles.clear();
 
 	// Create RaySceneQuery
 	mRaySceneQuery = SharedData::getSingleton().iSceneMgr->createRayQuery(Ogre::Ray());
@@ -372,51 +392,7 @@ void NavMeshTesterTool::handleClick(const float* p, bool shift)
 				m_EntityList[i]->setIsSelected(false);
 			}
 			if(mCurrentEntities < MAXIMUM_ENTITIES)
-			{	// cycle and set all selected to zero - then at end set newly made ent to selected state true
-				GameObject* SinbadEntity = new GameObject( g_database.GetNewObjectID(), OBJECT_Enemy | OBJECT_Character, const_cast<char*>(TemplateUtils::GetUniqueName("SinbadControl_").c_str()));
-				g_database.Store( *SinbadEntity );
-				m_GameObjectList.push_back( SinbadEntity );
-				SinbadCharacterController* chara = new SinbadCharacterController(m_sample, *SinbadEntity, this, Vector2D(m_spos[0],m_spos[2]),
-					RandFloat()*TwoPi,  Vector2D(0,0), Prm.VehicleMass, Prm.MaxSteeringForce, Prm.MaxSpeed, Prm.MaxTurnRatePerSecond, Prm.VehicleScale );
-				chara->setLabelAttributes(m_OverlayAttributes);
-				chara->Initialize();
-				if(SharedData::getSingleton().m_AppMode == APPMODE_TERRAINSCENE)
-				{
-					chara->GetBodyNode()->setScale(5.0f, 5.0f, 5.0f);
-					chara->setCharHeightVal((5.0f * 5.0f));
-					chara->SetScale(Vector2D(7, 10));
-				}
-				else
-				{
-					chara->GetBodyNode()->setScale(2.5f, 2.5f, 2.5f);
-					chara->setCharHeightVal((5.0f * 2.5f));
-					chara->SetScale(Vector2D(5, 6));
-				}
-				chara->GetBodyNode()->setPosition(m_spos[0], m_spos[1], m_spos[2]);
-				chara->setGroundHeight(m_spos[1]);
-				chara->setSinbadPosition(m_spos[0], m_spos[1], m_spos[2]);
-				chara->setPathStart(Ogre::Vector3(m_spos[0], m_spos[1], m_spos[2]));
-				chara->setInitialPosition(Ogre::Vector3(m_spos[0], m_spos[1], m_spos[2]));
-				chara->setHasMoved(true);
-
-				SinbadEntity->PushStateMachine(*chara);
-				m_EntityList.push_back(chara);
-				chara->setEntityMode(m_EntityMode);
-
-				m_pCellSpace->AddEntity(chara);
-				chara->Steering()->FollowPathOff();
-				chara->Steering()->FlockingOff();
-				chara->Steering()->SeparationOn();
-				chara->Steering()->ObstacleAvoidanceOn();
-				chara->Steering()->ToggleSpacePartitioningOnOff();
-				chara->SmoothingOn();
-
-				m_Vehicles.push_back(chara);
-
-				chara->sendModeChangeMessage();
-				++mCurrentEntities;
-				m_sample->getGUI()->setEntitiesCreatedInfo(mCurrentEntities);
-			}
+				spawnEntity(m_spos);
 		}
 	}
 	else
@@ -431,6 +407,190 @@ void NavMeshTesterTool::handleClick(const float* p, bool shift)
 	recalc();
 }
 
+SinbadCharacterController* NavMeshTesterTool::spawnEntity(const float* pos)
+{
+	GameObject* SinbadEntity = new GameObject( g_database.GetNewObjectID(), OBJECT_Enemy | OBJECT_Character, const_cast<char*>(TemplateUtils::GetUniqueName("SinbadControl_").c_str()));
+	g_database.Store( *SinbadEntity );
+	m_GameObjectList.push_back( SinbadEntity );
+	SinbadCharacterController* chara = new SinbadCharacterController(m_sample, *SinbadEntity, this, Vector2D(pos[0],pos[2]),
+		RandFloat()*TwoPi,  Vector2D(0,0), Prm.VehicleMass, Prm.MaxSteeringForce, Prm.MaxSpeed, Prm.MaxTurnRatePerSecond, Prm.VehicleScale );
+	chara->setLabelAttributes(m_OverlayAttributes);
+	chara->Initialize();
+	if(SharedData::getSingleton().m_AppMode == APPMODE_TERRAINSCENE)
+	{
+		chara->GetBodyNode()->setScale(5.0f, 5.0f, 5.0f);
+		chara->setCharHeightVal((5.0f * 5.0f));
+		chara->SetScale(Vector2D(7, 10));
+	}
+	else
+	{
+		chara->GetBodyNode()->setScale(2.5f, 2.5f, 2.5f);
+		chara->setCharHeightVal((5.0f * 2.5f));
+		chara->SetScale(Vector2D(5, 6));
+	}
+	chara->GetBodyNode()->setPosition(pos[0], pos[1], pos[2]);
+	chara->setGroundHeight(pos[1]);
+	chara->setSinbadPosition(pos[0], pos[1], pos[2]);
+	chara->setPathStart(Ogre::Vector3(pos[0], pos[1], pos[2]));
+	chara->setInitialPosition(Ogre::Vector3(pos[0], pos[1], pos[2]));
+	chara->setHasMoved(true);
+
+	SinbadEntity->PushStateMachine(*chara);
+	m_EntityList.push_back(chara);
+	chara->setEntityMode(m_EntityMode);
+
+	m_pCellSpace->AddEntity(chara);
+	chara->Steering()->FollowPathOff();
+	chara->Steering()->FlockingOff();
+	chara->Steering()->SeparationOn();
+	chara->Steering()->ObstacleAvoidanceOn();
+	chara->Steering()->ToggleSpacePartitioningOnOff();
+	chara->SmoothingOn();
+
+	m_Vehicles.push_back(chara);
+
+	chara->sendModeChangeMessage();
+	++mCurrentEntities;
+	m_sample->getGUI()->setEntitiesCreatedInfo(mCurrentEntities);
+
+	return chara;
+}
+
+int NavMeshTesterTool::findSpawnPositions(float* positions, const int count, const float rayHeight)
+{
+	if (!m_navMesh || count <= 0)
+		return 0;
+
+	static const float borderZone = 10.0f;
+	std::vector<float> rays(count*3);
+	std::vector<float> raye(count*3);
+	std::vector<float> tt(count);
+	std::vector<unsigned char> hits(count, 0);
+	std::vector<float> spos(count*3);
+	std::vector<dtPolyRef> polyRefs(count);
+	std::vector<float> vpos(count*3);
+
+	const bool terrainScene = SharedData::getSingleton().m_AppMode == APPMODE_TERRAINSCENE;
+
+	for (int i = 0; i < count; ++i)
+	{
+		const float XVal = (float)RandInRange(m_cxClientMin + borderZone, m_cxClient - borderZone);
+		const float ZVal = (float)RandInRange(m_cyClientMin + borderZone, m_cyClient - borderZone);
+		spos[i*3+0] = XVal;
+		spos[i*3+1] = 0.0f;
+		spos[i*3+2] = ZVal;
+		if (terrainScene)
+		{
+			spos[i*3+1] = m_sample->getInputGeom()->getMesh()->mTerrainGroup->getHeightAtWorldPosition(Ogre::Vector3(XVal, rayHeight, ZVal));
+		}
+		else
+		{
+			// straight down from rayHeight, twice its length
+			rays[i*3+0] = XVal; rays[i*3+1] = rayHeight; rays[i*3+2] = ZVal;
+			raye[i*3+0] = XVal; raye[i*3+1] = -rayHeight; raye[i*3+2] = ZVal;
+		}
+	}
+
+	// the ground rays of all candidates go through the chunky mesh in one batch
+	if (!terrainScene)
+	{
+		m_sample->getInputGeom()->raycastMeshBatch(&rays[0], &raye[0], count, &tt[0], &hits[0]);
+		for (int i = 0; i < count; ++i)
+		{
+			if (hits[i])
+				spos[i*3+1] = rays[i*3+1] + (raye[i*3+1] - rays[i*3+1])*tt[i];
+		}
+	}
+
+	// a large box maximizes the chances of finding a valid place, with a shorter
+	// Y extent so that different levels of 3d geometry can still be picked
+	const float polyPickExtent[3] = { 75.0f, 25.0f, 75.0f };
+	if (!m_navMesh->findNearestPolys(&spos[0], count, polyPickExtent, &m_filter, &polyRefs[0], &vpos[0]))
+		return 0;
+
+	int n = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (polyRefs[i])
+		{
+			rcVcopy(&positions[n*3], &vpos[i*3]);
+			++n;
+		}
+	}
+	return n;
+}
+
+void NavMeshTesterTool::spawnCrowd(int count)
+{
+	if (!m_navMesh)
+		return;
+	if (count > (int)(MAXIMUM_ENTITIES - mCurrentEntities))
+		count = (int)(MAXIMUM_ENTITIES - mCurrentEntities);
+	if (count <= 0)
+		return;
+
+	std::vector<float> positions(count*3);
+	int n = 0;
+	for (int tries = 0; tries < 4 && n < count; ++tries)
+		n += findSpawnPositions(&positions[n*3], count - n);
+	// the candidates that missed the navmesh are replaced by any spot on it
+	for (; n < count; ++n)
+	{
+		if (!m_navMesh->findRandomPoint(&m_filter, frand, &positions[n*3]))
+			break;
+	}
+
+	for (int i = 0; i < n; ++i)
+		spawnEntity(&positions[i*3]);
+}
+
+void NavMeshTesterTool::snapSearchStarts(void)
+{
+	if (!m_navMesh)
+		return;
+
+	std::vector<SinbadCharacterController*> agents;
+	for (unsigned int i = 0; i < m_EntityList.size(); ++i)
+	{
+		if (m_EntityList[i]->isFindingPath())
+			agents.push_back(m_EntityList[i]);
+	}
+	const int count = (int)agents.size();
+	if (!count)
+		return;
+
+	std::vector<float> spos(count*3);
+	for (int i = 0; i < count; ++i)
+		agents[i]->getSearchStart(&spos[i*3]);
+
+	// each agent searches with its own filter, group the ones that can share a query
+	std::vector<unsigned char> done(count, 0);
+	std::vector<int> group;
+	std::vector<float> gpos;
+	std::vector<dtPolyRef> grefs;
+	for (int i = 0; i < count; ++i)
+	{
+		if (done[i])
+			continue;
+		const dtQueryFilter* filter = agents[i]->getFilter();
+		const float* ext = agents[i]->getPolyPickExtents();
+		group.resize(0);
+		gpos.resize(0);
+		for (int j = i; j < count; ++j)
+		{
+			if (done[j] || !dtSameFilter(filter, agents[j]->getFilter()) || !dtVequal(ext, agents[j]->getPolyPickExtents()))
+				continue;
+			done[j] = 1;
+			group.push_back(j);
+			gpos.insert(gpos.end(), &spos[j*3], &spos[j*3] + 3);
+		}
+		grefs.resize(group.size());
+		m_navMesh->findNearestPolys(&gpos[0], (int)group.size(), ext, filter, &grefs[0], 0);
+		for (unsigned int k = 0; k < group.size(); ++k)
+			agents[group[k]]->setSnappedSearchStart(&gpos[k*3], grefs[k]);
+	}
+}
+
 void NavMeshTesterTool::handleStep()
 {
 	// TODO: merge separate to a path iterator. Use same code in recalc() too.
@@ -629,6 +789,7 @@ void NavMeshTesterTool::reset()
 	m_GameObjectList.resize(0);
 	m_EntityList.resize(0);
 	m_Vehicles.resize(0);
+	m_TaggedVehicles.clear();
 
 	m_startRef = 0;
 	m_endRef = 0;
@@ -960,6 +1121,111 @@ void NavMeshTesterTool::setEntityMode(int _entityMode)
 	}
 }
 
+void NavMeshTesterTool::computeVehicleMovement(float _timeSinceLastFrame)
+{
+	// the result does not depend on the number of threads. Entities without
+	// space partitioning tag their neighbours, which writes to the other
+	// entities, so those are worked out on this thread
+	const int NumEntities = (int)m_EntityList.size();
+	for(int i = 0; i < NumEntities; ++i)
+	{
+		if(!m_EntityList[i]->Steering()->isSpacePartitioningOn())
+			m_EntityList[i]->computeMovement(_timeSinceLastFrame);
+	}
+#pragma omp parallel for schedule(dynamic, 16)
+	for(int i = 0; i < NumEntities; ++i)
+	{
+		if(m_EntityList[i]->Steering()->isSpacePartitioningOn())
+			m_EntityList[i]->computeMovement(_timeSinceLastFrame);
+	}
+}
+
+// sets the crowd weights that steer like the SteeringBehavior does. Returns false
+// if the behavior uses something the crowd does not have. Obstacle and wall
+// avoidance add nothing while there are none to avoid. The crowd sums the forces
+// by weight, which gives what the prioritized sum gives until the forces add up
+// to more than the max force
+static bool setCrowdWeights(SteeringCrowd& crowd, int idx, SteeringBehavior* steering, bool noObstacles, bool noWalls)
+{
+	if(steering->SummingMethod() == SteeringBehavior::dithered)
+		return false;
+	if(steering->isSeekOn() || steering->isFleeOn() || steering->isArriveOn() || steering->isWanderOn() ||
+	   steering->isPursuitOn() || steering->isEvadeOn() || steering->isInterposeOn() || steering->isHideOn() ||
+	   steering->isOffsetPursuitOn())
+		return false;
+	if((steering->isObstacleAvoidanceOn() && !noObstacles) || (steering->isWallAvoidanceOn() && !noWalls))
+		return false;
+
+	crowd.SetWeights(idx, 0.0, 0.0,
+		steering->isSeparationOn() ? steering->SeparationWeight() : 0.0,
+		steering->isAlignmentOn() ? steering->AlignmentWeight() : 0.0,
+		steering->isCohesionOn() ? steering->CohesionWeight() : 0.0,
+		steering->isFollowPathOn() ? steering->FollowPathWeight() : 0.0);
+	return true;
+}
+
+void NavMeshTesterTool::computeCrowdMovement(float _timeSinceLastFrame)
+{
+	const bool noObstacles = m_Obstacles.empty();
+	const bool noWalls = m_Walls.empty();
+	const int NumEntities = (int)m_EntityList.size();
+
+	// every agent is a neighbour, only the ones the crowd can steer get weights
+	m_SteeringCrowd.Clear();
+	m_iCrowdSteered = 0;
+	std::vector<char> steered(NumEntities, 0);
+	for(int i = 0; i < NumEntities; ++i)
+	{
+		SinbadCharacterController* chara = m_EntityList[i];
+		const int idx = m_SteeringCrowd.AddAgent(chara->Pos(), chara->BRadius(), chara->MaxSpeed(), chara->MaxForce(), chara->Mass());
+		if(idx < 0)
+			continue;
+		m_SteeringCrowd.SetVelocity(idx, chara->Velocity());
+		m_SteeringCrowd.SetHeading(idx, chara->Heading());
+
+		SteeringBehavior* steering = chara->Steering();
+		if(!chara->isSteering() || !setCrowdWeights(m_SteeringCrowd, idx, steering, noObstacles, noWalls))
+			continue;
+		// the agent keeps moving along its own path, the crowd only steers to the waypoint
+		if(steering->isFollowPathOn())
+		{
+			steering->UpdatePathWaypoint();
+			m_SteeringCrowd.SetWaypoint(idx, steering->PathWaypoint(), steering->PathFinished());
+		}
+		steered[i] = 1;
+		++m_iCrowdSteered;
+	}
+
+	m_SteeringCrowd.CalculateSteering();
+
+	// the crowd was filled in agent order, so agent i is crowd agent i
+	for(int i = 0; i < NumEntities; ++i)
+	{
+		if(steered[i])
+			m_EntityList[i]->computeMovement(_timeSinceLastFrame, m_SteeringCrowd.Force(i));
+		else
+			m_EntityList[i]->computeMovement(_timeSinceLastFrame);
+	}
+}
+
+void NavMeshTesterTool::logSteeringTimes(void)
+{
+	static const char* names[2] = { "SteeringBehavior", "SteeringCrowd" };
+	for(int i = 0; i < 2; ++i)
+	{
+		if(!m_iSteerFrames[i])
+			continue;
+		char msg[256];
+		snprintf(msg, sizeof(msg), "Steering with %s : %.3f ms a frame over %d frames, %d agents",
+			names[i], m_iSteerTimeUsec[i] / 1000.0f / m_iSteerFrames[i], m_iSteerFrames[i], (int)m_EntityList.size());
+		if(i == 1)
+			snprintf(msg + strlen(msg), sizeof(msg) - strlen(msg), ", %d steered by the crowd", m_iCrowdSteered);
+		LogManager::getSingleton().logMessage(msg);
+	}
+	memset(m_iSteerTimeUsec, 0, sizeof(m_iSteerTimeUsec));
+	memset(m_iSteerFrames, 0, sizeof(m_iSteerFrames));
+}
+
 void NavMeshTesterTool::handleRender(float _timeSinceLastFrame)
 {
 
@@ -1018,6 +1284,21 @@ void NavMeshTesterTool::handleRender(float _timeSinceLastFrame)
 	// HANDLE ENTITY UPDATING -----------------------------------------------------------
 	if(m_toolMode == TOOLMODE_ENTITY_DEMO)
 	{
+		// work out the steering and movement of every entity first. Nothing
+		// is moved until all are done, so each entity sees the others where
+		// they were at the start of the frame
+		const rcTimeVal steerStart = rcGetPerformanceTimer();
+		if(m_bUseSteeringCrowd)
+			computeCrowdMovement(_timeSinceLastFrame);
+		else
+			computeVehicleMovement(_timeSinceLastFrame);
+		const int steerMode = m_bUseSteeringCrowd ? 1 : 0;
+		m_iSteerTimeUsec[steerMode] += rcGetDeltaTimeUsec(steerStart, rcGetPerformanceTimer());
+		++m_iSteerFrames[steerMode];
+		if(mframeTimeCount >= 5.0f)
+			logSteeringTimes();
+
+		// then move them one at a time, in order
 		// TODO : enable GUI options to turn this drawing on and off
 		// code already exists for turning on and off, just have to add
 		// it to gui
@@ -1040,9 +1321,10 @@ void NavMeshTesterTool::handleRender(float _timeSinceLastFrame)
 
 				//gdi->RedPen();
 				ddCellAgentNeigh->begin(DU_DRAW_LINES, 5.0f);
-				CellSpace()->CalculateNeighbors(m_Vehicles[i]->Pos(), Prm.ViewDistance);
-				for (BaseGameEntity* pV = CellSpace()->begin();!CellSpace()->end();pV = CellSpace()->next())
+				CellSpace()->CalculateNeighbors(m_Vehicles[i]->Pos(), Prm.ViewDistance, m_CellNeighbors);
+				for (unsigned int n=0; n<m_CellNeighbors.size(); ++n)
 				{
+					BaseGameEntity* pV = m_CellNeighbors[n];
 					duAppendCircle(ddCellAgentNeigh, pV->Pos().x, pV->Pos().yUP, pV->Pos().y, pV->BRadius(), (unsigned int)0);
 				}
 				ddCellAgentNeigh->end();
@@ -1052,6 +1334,10 @@ void NavMeshTesterTool::handleRender(float _timeSinceLastFrame)
 				ddCellAgentView->end();
 			}
 		}
+		// the agents waiting for a path search from where they stand now, snap
+		// them all before g_database.Update() delivers their MSG_SearchPath
+		snapSearchStarts();
+
 		// render any steering walls
 		for (unsigned int w=0; w<m_Walls.size(); ++w)
 		{
@@ -1425,6 +1711,15 @@ void NavMeshTesterTool::handleKeyStrokes(const OIS::KeyEvent &arg)
 			m_Vehicles[i]->Steering()->setWaypointSeekDistance( (5.0 + m_Vehicles[i]->Steering()->WaypointSeekDistance()) );
 		}
 		break;
+	case OIS::KC_N:
+		// fill the scene up with agents in one go
+		spawnCrowd(MAXIMUM_ENTITIES);
+		break;
+	case OIS::KC_C:
+		// switch between steering each agent by itself and in one SteeringCrowd step,
+		// the time both take is logged every 5 seconds
+		ToggleSteeringCrowd();
+		break;
 	case OIS::KC_L:
 		for(unsigned int i = 0; i < m_Vehicles.size(); ++i)
 		{
@@ -1516,7 +1811,9 @@ void NavMeshTesterTool::handleMouseMove( const OIS::MouseEvent &arg )
 						{
 							if( m_Vehicles[v]->getIsSelected() )
 							{
+								Vector2D OldPos = m_Vehicles[v]->Pos();
 								m_Vehicles[v]->SetPos(Vector2D(rayResult.position.x, rayResult.position.y+25.0f, rayResult.position.z));
+								m_pCellSpace->UpdateEntity(m_Vehicles[v], OldPos);
 								m_Vehicles[v]->SetVelocity(Vector2D(0.0, 0.0, 0.0));
 							}
 						}
@@ -1544,7 +1841,9 @@ void NavMeshTesterTool::handleMouseMove( const OIS::MouseEvent &arg )
 					{
 						if( m_Vehicles[v]->getIsSelected())
 						{
+							Vector2D OldPos = m_Vehicles[v]->Pos();
 							m_Vehicles[v]->SetPos(Vector2D(posHit.x, posHit.y+12.5f, posHit.z));
+							m_pCellSpace->UpdateEntity(m_Vehicles[v], OldPos);
 							m_Vehicles[v]->SetVelocity(Vector2D(0.0, 0.0, 0.0));
 						}
 					}
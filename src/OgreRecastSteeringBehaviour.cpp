@@ -80,7 +80,8 @@ SteeringBehavior::SteeringBehavior(SinbadCharacterController* agent):
              m_dWeightEvade(Prm.EvadeWeight),
              m_dWeightFollowPath(Prm.FollowPathWeight),
              m_bCellSpaceOn(false),
-             m_SummingMethod(prioritized)
+             m_SummingMethod(prioritized),
+             m_iRandSeed((unsigned int)rand())
 
 
 {
@@ -130,6 +131,20 @@ SteeringBehavior::~SteeringBehavior()
 }
 
 
+//---------------------------- NextRandom --------------------------------
+//
+//  returns a random number in [0, 1) from this vehicle's own sequence, so
+//  that vehicles can be steered in parallel and still give the same
+//  results every run
+//------------------------------------------------------------------------
+double SteeringBehavior::NextRandom()
+{
+  m_iRandSeed = m_iRandSeed * 1664525u + 1013904223u;
+
+  return (m_iRandSeed >> 8) / 16777216.0;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////// CALCULATE METHODS 
 
 
@@ -159,7 +174,7 @@ Vector2D SteeringBehavior::Calculate()
     //behaviors are switched on
     if (On(separation) || On(allignment) || On(cohesion))
     {
-      m_pVehicle->World()->CellSpace()->CalculateNeighbors(m_pVehicle->Pos(), m_dViewDistance);
+      m_pVehicle->World()->CellSpace()->CalculateNeighbors(m_pVehicle->Pos(), m_dViewDistance, m_Neighbors);
     }
   }
 
@@ -556,7 +571,7 @@ Vector2D SteeringBehavior::CalculateDithered()
   //reset the steering force
    m_vSteeringForce.Zero();
 
-  if (On(wall_avoidance) && RandFloat() < Prm.prWallAvoidance)
+  if (On(wall_avoidance) && NextRandom() < Prm.prWallAvoidance)
   {
     m_vSteeringForce = WallAvoidance(m_pVehicle->World()->Walls()) *
                          m_dWeightWallAvoidance / Prm.prWallAvoidance;
@@ -569,7 +584,7 @@ Vector2D SteeringBehavior::CalculateDithered()
     }
   }
    
-  if (On(obstacle_avoidance) && RandFloat() < Prm.prObstacleAvoidance)
+  if (On(obstacle_avoidance) && NextRandom() < Prm.prObstacleAvoidance)
   {
     m_vSteeringForce += ObstacleAvoidance(m_pVehicle->World()->Obstacles()) * 
             m_dWeightObstacleAvoidance / Prm.prObstacleAvoidance;
@@ -584,7 +599,7 @@ Vector2D SteeringBehavior::CalculateDithered()
 
   if (!isSpacePartitioningOn())
   {
-    if (On(separation) && RandFloat() < Prm.prSeparation)
+    if (On(separation) && NextRandom() < Prm.prSeparation)
     {
       m_vSteeringForce += Separation(m_pVehicle->World()->Agents()) * 
                           m_dWeightSeparation / Prm.prSeparation;
@@ -600,7 +615,7 @@ Vector2D SteeringBehavior::CalculateDithered()
 
   else
   {
-    if (On(separation) && RandFloat() < Prm.prSeparation)
+    if (On(separation) && NextRandom() < Prm.prSeparation)
     {
       m_vSteeringForce += SeparationPlus(m_pVehicle->World()->Agents()) * 
                           m_dWeightSeparation / Prm.prSeparation;
@@ -615,7 +630,7 @@ Vector2D SteeringBehavior::CalculateDithered()
   }
 
 
-  if (On(flee) && RandFloat() < Prm.prFlee)
+  if (On(flee) && NextRandom() < Prm.prFlee)
   {
    // m_vSteeringForce += Flee(m_pVehicle->World()->Crosshair()) * m_dWeightFlee / Prm.prFlee;
 
@@ -627,7 +642,7 @@ Vector2D SteeringBehavior::CalculateDithered()
     }
   }
 
-  if (On(evade) && RandFloat() < Prm.prEvade)
+  if (On(evade) && NextRandom() < Prm.prEvade)
   {
     assert(m_pTargetAgent1 && "Evade target not assigned");
     
@@ -644,7 +659,7 @@ Vector2D SteeringBehavior::CalculateDithered()
 
   if (!isSpacePartitioningOn())
   {
-    if (On(allignment) && RandFloat() < Prm.prAlignment)
+    if (On(allignment) && NextRandom() < Prm.prAlignment)
     {
       m_vSteeringForce += Alignment(m_pVehicle->World()->Agents()) *
                           m_dWeightAlignment / Prm.prAlignment;
@@ -657,7 +672,7 @@ Vector2D SteeringBehavior::CalculateDithered()
       }
     }
 
-    if (On(cohesion) && RandFloat() < Prm.prCohesion)
+    if (On(cohesion) && NextRandom() < Prm.prCohesion)
     {
       m_vSteeringForce += Cohesion(m_pVehicle->World()->Agents()) * 
                           m_dWeightCohesion / Prm.prCohesion;
@@ -672,7 +687,7 @@ Vector2D SteeringBehavior::CalculateDithered()
   }
   else
   {
-    if (On(allignment) && RandFloat() < Prm.prAlignment)
+    if (On(allignment) && NextRandom() < Prm.prAlignment)
     {
       m_vSteeringForce += AlignmentPlus(m_pVehicle->World()->Agents()) *
                           m_dWeightAlignment / Prm.prAlignment;
@@ -685,7 +700,7 @@ Vector2D SteeringBehavior::CalculateDithered()
       }
     }
 
-    if (On(cohesion) && RandFloat() < Prm.prCohesion)
+    if (On(cohesion) && NextRandom() < Prm.prCohesion)
     {
       m_vSteeringForce += CohesionPlus(m_pVehicle->World()->Agents()) *
                           m_dWeightCohesion / Prm.prCohesion;
@@ -699,7 +714,7 @@ Vector2D SteeringBehavior::CalculateDithered()
     }
   }
 
-  if (On(wander) && RandFloat() < Prm.prWander)
+  if (On(wander) && NextRandom() < Prm.prWander)
   {
     m_vSteeringForce += Wander() * m_dWeightWander / Prm.prWander;
 
@@ -711,7 +726,7 @@ Vector2D SteeringBehavior::CalculateDithered()
     }
   }
 
-  if (On(seek) && RandFloat() < Prm.prSeek)
+  if (On(seek) && NextRandom() < Prm.prSeek)
   {
   //  m_vSteeringForce += Seek(m_pVehicle->World()->Crosshair()) * m_dWeightSeek / Prm.prSeek;
 
@@ -723,7 +738,7 @@ Vector2D SteeringBehavior::CalculateDithered()
     }
   }
 
-  if (On(arrive) && RandFloat() < Prm.prArrive)
+  if (On(arrive) && NextRandom() < Prm.prArrive)
   {
  //   m_vSteeringForce += Arrive(m_pVehicle->World()->Crosshair(), m_Deceleration) * 
                         m_dWeightArrive / Prm.prArrive;
@@ -884,8 +899,8 @@ Vector2D SteeringBehavior::Wander()
   double JitterThisTimeSlice = m_dWanderJitter * m_pVehicle->TimeElapsed();
 
   //first, add a small random vector to the target's position
-  m_vWanderTarget += Vector2D(RandomClamped() * JitterThisTimeSlice,
-                              RandomClamped() * JitterThisTimeSlice);
+  m_vWanderTarget += Vector2D((NextRandom() - NextRandom()) * JitterThisTimeSlice,
+                              (NextRandom() - NextRandom()) * JitterThisTimeSlice);
 
   //reproject this new vector back on to a unit circle
   m_vWanderTarget.Normalize();
@@ -920,9 +935,6 @@ Vector2D SteeringBehavior::ObstacleAvoidance(const std::vector<BaseGameEntity*>&
                   (m_pVehicle->Speed()/m_pVehicle->MaxSpeed()) *
                   Prm.MinDetectionBoxLength;
 
-  //tag all obstacles within range of the box for processing
-  m_pVehicle->World()->TagObstaclesWithinViewRange(m_pVehicle, m_dDBoxLength);
-
   //this will keep track of the closest intersecting obstacle (CIB)
   BaseGameEntity* ClosestIntersectingObstacle = NULL;
  
@@ -936,8 +948,12 @@ Vector2D SteeringBehavior::ObstacleAvoidance(const std::vector<BaseGameEntity*>&
 
   while(curOb != obstacles.end())
   {
-    //if the obstacle has been tagged within range proceed
-    if ((*curOb)->IsTagged())
+    //if the obstacle is within range of the box proceed. The range is
+    //tested here rather than by tagging, the obstacles are shared by
+    //vehicles which may be steering on other threads
+    double range = m_dDBoxLength + (*curOb)->BRadius();
+
+    if (Vec2DDistanceSq((*curOb)->Pos(), m_pVehicle->Pos()) < range*range)
     {
       //calculate this obstacle's position in local space
       Vector2D LocalPos = PointToLocalSpace((*curOb)->Pos(),
@@ -1233,10 +1249,10 @@ Vector2D SteeringBehavior::SeparationPlus(const std::vector<SinbadCharacterContr
   Vector2D SteeringForce;
 
   //iterate through the neighbors and sum up all the position vectors
-  for (BaseGameEntity* pV = m_pVehicle->World()->CellSpace()->begin();
-                         !m_pVehicle->World()->CellSpace()->end();     
-                       pV = m_pVehicle->World()->CellSpace()->next())
+  for (unsigned int a=0; a<m_Neighbors.size(); ++a)
   {    
+    BaseGameEntity* pV = m_Neighbors[a];
+
     //make sure this agent isn't included in the calculations and that
     //the agent being examined is close enough
     if(pV != m_pVehicle)
@@ -1268,10 +1284,10 @@ Vector2D SteeringBehavior::AlignmentPlus(const std::vector<SinbadCharacterContro
   double    NeighborCount = 0.0;
 
   //iterate through the neighbors and sum up all the position vectors
-  for (MovingEntity* pV = m_pVehicle->World()->CellSpace()->begin();
-                         !m_pVehicle->World()->CellSpace()->end();     
-                     pV = m_pVehicle->World()->CellSpace()->next())
+  for (unsigned int a=0; a<m_Neighbors.size(); ++a)
   {
+    MovingEntity* pV = m_Neighbors[a];
+
     //make sure *this* agent isn't included in the calculations and that
     //the agent being examined  is close enough
     if(pV != m_pVehicle)
@@ -1311,10 +1327,10 @@ Vector2D SteeringBehavior::CohesionPlus(const std::vector<SinbadCharacterControl
   int NeighborCount = 0;
 
   //iterate through the neighbors and sum up all the position vectors
-  for (BaseGameEntity* pV = m_pVehicle->World()->CellSpace()->begin();
-                         !m_pVehicle->World()->CellSpace()->end();     
-                       pV = m_pVehicle->World()->CellSpace()->next())
+  for (unsigned int a=0; a<m_Neighbors.size(); ++a)
   {
+    BaseGameEntity* pV = m_Neighbors[a];
+
     //make sure *this* agent isn't included in the calculations and that
     //the agent being examined is close enough
     if(pV != m_pVehicle)
@@ -1447,13 +1463,7 @@ Vector2D SteeringBehavior::GetHidingPosition(const Vector2D& posOb,
 //------------------------------------------------------------------------
 Vector2D SteeringBehavior::FollowPath()
 { 
-  //move to next target if close enough to current target (working in
-  //distance squared space)
-  if(Vec2DDistanceSq(m_pPath->CurrentWaypoint(), m_pVehicle->Pos()) <
-     m_dWaypointSeekDistSq)
-  {
-    m_pPath->SetNextWaypoint();
-  }
+  UpdatePathWaypoint();
 
   if (!m_pPath->PathFinished())
   {
@@ -1465,6 +1475,20 @@ Vector2D SteeringBehavior::FollowPath()
   }
 }
 
+//------------------------ UpdatePathWaypoint ----------------------------
+//
+//  move to next target if close enough to current target (working in
+//  distance squared space)
+//------------------------------------------------------------------------
+void SteeringBehavior::UpdatePathWaypoint()
+{
+  if(Vec2DDistanceSq(m_pPath->CurrentWaypoint(), m_pVehicle->Pos()) <
+     m_dWaypointSeekDistSq)
+  {
+    m_pPath->SetNextWaypoint();
+  }
+}
+
 //------------------------- Offset Pursuit -------------------------------
 //
 //  Produces a steering force that keeps a vehicle at a specified offset
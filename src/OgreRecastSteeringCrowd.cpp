@@ -0,0 +1,525 @@
+//----------------------------------------------------------------------------------//
+// OgreRecast Demo - A demonstration of integrating Recast Navigation Meshes		//
+//					 with the Ogre3D rendering engine.								//
+//																					//
+//	This file was either Created by or Modified by :								//
+//													Paul A Wilson 					//
+//			All contents are Copyright (C) 2010 Paul A Wilson						//
+//			Except where otherwise mentioned or where previous						//
+//			copyright exists. In the case of pre-existing copyrights				//
+//			all rights remain with the original Authors, and this is				//
+//			to be considered a derivative work.										//
+//																					//
+//	Contact Email	:	paulwilson77@dodo.com.au									//
+//																					//
+// This 'SOFTWARE' is provided 'AS-IS', without any express or implied				//
+// warranty.  In no event will the authors be held liable for any damages			//
+// arising from the use of this software.											//
+// Permission is granted to anyone to use this software for any purpose,			//
+// including commercial applications, and to alter it and redistribute it			//
+// freely, subject to the following restrictions:									//
+// 1. The origin of this software must not be misrepresented; you must not			//
+//    claim that you wrote the original software. If you use this software			//
+//    in a product, an acknowledgment in the product documentation would be			//
+//    appreciated but is not required.												//
+// 2. Altered source versions must be plainly marked as such, and must not be		//
+//    misrepresented as being the original software.								//
+// 3. This notice may not be removed or altered from any source distribution.		//
+//																					//
+//----------------------------------------------------------------------------------//
+
+#include "OgreRecastSteeringCrowd.h"
+#include <math.h>
+#include <cassert>
+
+
+//------------------------- ctor -----------------------------------------
+//
+//------------------------------------------------------------------------
+SteeringCrowd::SteeringCrowd():
+	m_iNumAgents(0),
+	m_iMaxAgents(0),
+	m_iMaxPathPoints(0),
+	m_fViewDistance(0.0f),
+	m_fWaypointSeekDistSq(0.0f),
+	m_fArriveTime(0.6f),
+	m_iNumBuckets(0)
+{
+}
+
+//------------------------------- Init -----------------------------------
+//
+//  sizes every array for MaxAgents agents. The crowd is emptied
+//------------------------------------------------------------------------
+void SteeringCrowd::Init(int MaxAgents, int MaxPathPoints, double ViewDistance, double WaypointSeekDist)
+{
+	assert(MaxAgents > 0 && MaxPathPoints > 0 && ViewDistance > 0.0);
+
+	m_iNumAgents = 0;
+	m_iMaxAgents = MaxAgents;
+	m_iMaxPathPoints = MaxPathPoints;
+	m_fViewDistance = (float)ViewDistance;
+	m_fWaypointSeekDistSq = (float)(WaypointSeekDist*WaypointSeekDist);
+
+	std::vector<float>* arrays[] =
+	{
+		&m_PosX, &m_PosY, &m_VelX, &m_VelY, &m_HeadingX, &m_HeadingY,
+		&m_MaxSpeed, &m_MaxForce, &m_InvMass, &m_Radius, &m_TargetX, &m_TargetY,
+		&m_WeightSeek, &m_WeightArrive, &m_WeightSeparation, &m_WeightAlignment,
+		&m_WeightCohesion, &m_WeightFollowPath,
+		&m_WaypointX, &m_WaypointY, &m_WaypointArrive,
+		&m_SeparationX, &m_SeparationY, &m_AlignmentX, &m_AlignmentY,
+		&m_CohesionX, &m_CohesionY, &m_ForceX, &m_ForceY
+	};
+	for (unsigned int i=0; i<sizeof(arrays)/sizeof(arrays[0]); ++i)
+	{
+		arrays[i]->assign(MaxAgents, 0.0f);
+	}
+
+	m_PathX.assign(MaxAgents*MaxPathPoints, 0.0f);
+	m_PathY.assign(MaxAgents*MaxPathPoints, 0.0f);
+	m_PathCount.assign(MaxAgents, 0);
+	m_PathCurrent.assign(MaxAgents, 0);
+	m_PathLoop.assign(MaxAgents, 0);
+
+	//twice as many buckets as agents keeps the unrelated cells sharing a
+	//bucket few
+	m_iNumBuckets = 1;
+	while (m_iNumBuckets < MaxAgents*2)
+	{
+		m_iNumBuckets *= 2;
+	}
+	m_AgentCellX.assign(MaxAgents, 0);
+	m_AgentCellY.assign(MaxAgents, 0);
+	m_AgentBucket.assign(MaxAgents, 0);
+	m_BucketStart.assign(m_iNumBuckets+1, 0);
+	m_BucketAgents.assign(MaxAgents, 0);
+}
+
+//----------------------------- AddAgent ---------------------------------
+//------------------------------------------------------------------------
+int SteeringCrowd::AddAgent(Vector2D pos, double radius, double max_speed, double max_force, double mass)
+{
+	if (m_iNumAgents >= m_iMaxAgents) return -1;
+
+	assert(mass > 0.0);
+
+	const int idx = m_iNumAgents++;
+
+	m_PosX[idx] = (float)pos.x;
+	m_PosY[idx] = (float)pos.y;
+	m_VelX[idx] = m_VelY[idx] = 0.0f;
+	m_HeadingX[idx] = 1.0f;
+	m_HeadingY[idx] = 0.0f;
+	m_MaxSpeed[idx] = (float)max_speed;
+	m_MaxForce[idx] = (float)max_force;
+	m_InvMass[idx] = (float)(1.0 / mass);
+	m_Radius[idx] = (float)radius;
+	m_TargetX[idx] = m_PosX[idx];
+	m_TargetY[idx] = m_PosY[idx];
+	m_PathCount[idx] = 0;
+	m_PathCurrent[idx] = 0;
+	m_PathLoop[idx] = 0;
+
+	SetWeights(idx, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+
+	return idx;
+}
+
+//---------------------------- RemoveAgent -------------------------------
+//
+//  the last agent is moved into the removed agent's slot so that the
+//  arrays stay packed
+//------------------------------------------------------------------------
+void SteeringCrowd::RemoveAgent(int idx)
+{
+	assert(idx >= 0 && idx < m_iNumAgents);
+
+	const int last = --m_iNumAgents;
+	if (idx == last) return;
+
+	std::vector<float>* arrays[] =
+	{
+		&m_PosX, &m_PosY, &m_VelX, &m_VelY, &m_HeadingX, &m_HeadingY,
+		&m_MaxSpeed, &m_MaxForce, &m_InvMass, &m_Radius, &m_TargetX, &m_TargetY,
+		&m_WeightSeek, &m_WeightArrive, &m_WeightSeparation, &m_WeightAlignment,
+		&m_WeightCohesion, &m_WeightFollowPath, &m_ForceX, &m_ForceY
+	};
+	for (unsigned int i=0; i<sizeof(arrays)/sizeof(arrays[0]); ++i)
+	{
+		(*arrays[i])[idx] = (*arrays[i])[last];
+	}
+
+	for (int i=0; i<m_PathCount[last]; ++i)
+	{
+		m_PathX[idx*m_iMaxPathPoints + i] = m_PathX[last*m_iMaxPathPoints + i];
+		m_PathY[idx*m_iMaxPathPoints + i] = m_PathY[last*m_iMaxPathPoints + i];
+	}
+	m_PathCount[idx] = m_PathCount[last];
+	m_PathCurrent[idx] = m_PathCurrent[last];
+	m_PathLoop[idx] = m_PathLoop[last];
+}
+
+//----------------------------- SetTarget --------------------------------
+//------------------------------------------------------------------------
+void SteeringCrowd::SetTarget(int idx, Vector2D target)
+{
+	m_TargetX[idx] = (float)target.x;
+	m_TargetY[idx] = (float)target.y;
+}
+
+//------------------------------ SetPath ---------------------------------
+//
+//  waypoints past the max path size are dropped
+//------------------------------------------------------------------------
+void SteeringCrowd::SetPath(int idx, const std::list<Vector2D>& path, bool loop)
+{
+	int n = 0;
+	std::list<Vector2D>::const_iterator it = path.begin();
+	for (; it != path.end() && n < m_iMaxPathPoints; ++it, ++n)
+	{
+		m_PathX[idx*m_iMaxPathPoints + n] = (float)it->x;
+		m_PathY[idx*m_iMaxPathPoints + n] = (float)it->y;
+	}
+	m_PathCount[idx] = n;
+	m_PathCurrent[idx] = 0;
+	m_PathLoop[idx] = loop ? 1 : 0;
+}
+
+//---------------------------- SetWaypoint -------------------------------
+//
+//  a path of one waypoint. Looped it is sought for good, one-way it is
+//  the end of the path and arrived at
+//------------------------------------------------------------------------
+void SteeringCrowd::SetWaypoint(int idx, Vector2D waypoint, bool arrive)
+{
+	m_PathX[idx*m_iMaxPathPoints] = (float)waypoint.x;
+	m_PathY[idx*m_iMaxPathPoints] = (float)waypoint.y;
+	m_PathCount[idx] = 1;
+	m_PathCurrent[idx] = 0;
+	m_PathLoop[idx] = arrive ? 0 : 1;
+}
+
+//--------------------------- PathFinished -------------------------------
+//
+//  true once the agent heads for the last waypoint of a one-way path
+//------------------------------------------------------------------------
+bool SteeringCrowd::PathFinished(int idx)const
+{
+	return !m_PathLoop[idx] && m_PathCurrent[idx] >= m_PathCount[idx]-1;
+}
+
+//----------------------------- SetWeights -------------------------------
+//------------------------------------------------------------------------
+void SteeringCrowd::SetWeights(int idx, double seek, double arrive, double separation,
+							   double alignment, double cohesion, double follow_path)
+{
+	m_WeightSeek[idx] = (float)seek;
+	m_WeightArrive[idx] = (float)arrive;
+	m_WeightSeparation[idx] = (float)separation;
+	m_WeightAlignment[idx] = (float)alignment;
+	m_WeightCohesion[idx] = (float)cohesion;
+	m_WeightFollowPath[idx] = (float)follow_path;
+}
+
+//----------------------------- BuildGrid --------------------------------
+//
+//  sorts the agents by the bucket of their cell. Within a bucket the
+//  agents stay in index order
+//------------------------------------------------------------------------
+void SteeringCrowd::BuildGrid()
+{
+	const int n = m_iNumAgents;
+
+	for (int b=0; b<=m_iNumBuckets; ++b)
+	{
+		m_BucketStart[b] = 0;
+	}
+
+	//count the agents in each bucket
+	for (int i=0; i<n; ++i)
+	{
+		m_AgentCellX[i] = PositionToCell(m_PosX[i]);
+		m_AgentCellY[i] = PositionToCell(m_PosY[i]);
+		m_AgentBucket[i] = HashCell(m_AgentCellX[i], m_AgentCellY[i]);
+		++m_BucketStart[m_AgentBucket[i]+1];
+	}
+
+	for (int b=0; b<m_iNumBuckets; ++b)
+	{
+		m_BucketStart[b+1] += m_BucketStart[b];
+	}
+
+	//scatter the agents, m_BucketStart[b] ends up at the start of bucket b+1
+	for (int i=0; i<n; ++i)
+	{
+		m_BucketAgents[m_BucketStart[m_AgentBucket[i]]++] = i;
+	}
+	for (int b=m_iNumBuckets; b>0; --b)
+	{
+		m_BucketStart[b] = m_BucketStart[b-1];
+	}
+	m_BucketStart[0] = 0;
+}
+
+//-------------------------- GatherNeighbors -----------------------------
+//
+//  visits the cells within view distance of the agent and sums the
+//  repelling forces, the headings and the positions of the neighbors
+//------------------------------------------------------------------------
+void SteeringCrowd::GatherNeighbors(int idx)
+{
+	const float px = m_PosX[idx];
+	const float py = m_PosY[idx];
+	const float ViewDistSq = m_fViewDistance*m_fViewDistance;
+
+	const int minX = PositionToCell(px - m_fViewDistance);
+	const int maxX = PositionToCell(px + m_fViewDistance);
+	const int minY = PositionToCell(py - m_fViewDistance);
+	const int maxY = PositionToCell(py + m_fViewDistance);
+
+	float sepX = 0.0f, sepY = 0.0f;
+	float aliX = 0.0f, aliY = 0.0f;
+	float cohX = 0.0f, cohY = 0.0f;
+	int count = 0;
+
+	for (int y=minY; y<=maxY; ++y)
+	{
+		for (int x=minX; x<=maxX; ++x)
+		{
+			const int b = HashCell(x, y);
+			for (int k=m_BucketStart[b]; k<m_BucketStart[b+1]; ++k)
+			{
+				const int j = m_BucketAgents[k];
+
+				//skip the agents of other cells sharing the bucket
+				if (m_AgentCellX[j] != x || m_AgentCellY[j] != y) continue;
+
+				const float dx = px - m_PosX[j];
+				const float dy = py - m_PosY[j];
+				const float DistSq = dx*dx + dy*dy;
+
+				//agents on the same spot cannot be pushed apart
+				if (j == idx || DistSq >= ViewDistSq || DistSq <= 0.0f) continue;
+
+				//scale the force inversely proportional to the distance
+				sepX += dx / DistSq;
+				sepY += dy / DistSq;
+				aliX += m_HeadingX[j];
+				aliY += m_HeadingY[j];
+				cohX += m_PosX[j];
+				cohY += m_PosY[j];
+				++count;
+			}
+		}
+	}
+
+	m_SeparationX[idx] = sepX;
+	m_SeparationY[idx] = sepY;
+
+	if (count > 0)
+	{
+		const float invCount = 1.0f / count;
+		m_AlignmentX[idx] = aliX*invCount - m_HeadingX[idx];
+		m_AlignmentY[idx] = aliY*invCount - m_HeadingY[idx];
+		m_CohesionX[idx] = cohX*invCount;
+		m_CohesionY[idx] = cohY*invCount;
+	}
+	else
+	{
+		//no pull towards the center of mass
+		m_AlignmentX[idx] = m_AlignmentY[idx] = 0.0f;
+		m_CohesionX[idx] = px;
+		m_CohesionY[idx] = py;
+	}
+}
+
+//-------------------------- UpdateWaypoint ------------------------------
+//
+//  moves on to the next waypoint once the current one is close enough.
+//  The last waypoint of a one-way path is arrived at, the others are
+//  sought
+//------------------------------------------------------------------------
+void SteeringCrowd::UpdateWaypoint(int idx)
+{
+	const int count = m_PathCount[idx];
+	if (!count)
+	{
+		m_WaypointX[idx] = m_PosX[idx];
+		m_WaypointY[idx] = m_PosY[idx];
+		m_WaypointArrive[idx] = 1.0f;
+		return;
+	}
+
+	const float* pathX = &m_PathX[idx*m_iMaxPathPoints];
+	const float* pathY = &m_PathY[idx*m_iMaxPathPoints];
+	int cur = m_PathCurrent[idx];
+
+	const float dx = pathX[cur] - m_PosX[idx];
+	const float dy = pathY[cur] - m_PosY[idx];
+	if (dx*dx + dy*dy < m_fWaypointSeekDistSq)
+	{
+		if (cur < count-1)
+			++cur;
+		else if (m_PathLoop[idx])
+			cur = 0;
+		m_PathCurrent[idx] = cur;
+	}
+
+	m_WaypointX[idx] = pathX[cur];
+	m_WaypointY[idx] = pathY[cur];
+	m_WaypointArrive[idx] = PathFinished(idx) ? 1.0f : 0.0f;
+}
+
+//----------------------------- SumForces --------------------------------
+//
+//  evaluates every behavior for every agent and adds them up by weight.
+//  The loop body is straight line float math so the compiler is free to
+//  vectorize it; a behavior with a zero weight adds nothing
+//------------------------------------------------------------------------
+void SteeringCrowd::SumForces()
+{
+	const int n = m_iNumAgents;
+	const float invArriveTime = 1.0f / m_fArriveTime;
+
+	for (int i=0; i<n; ++i)
+	{
+		const float px = m_PosX[i], py = m_PosY[i];
+		const float vx = m_VelX[i], vy = m_VelY[i];
+		const float MaxSpeed = m_MaxSpeed[i];
+
+		//seek: full speed towards the target
+		float tx = m_TargetX[i] - px, ty = m_TargetY[i] - py;
+		float dist = sqrtf(tx*tx + ty*ty);
+		float s = dist > 0.0f ? MaxSpeed / dist : 0.0f;
+		const float seekX = tx*s - vx, seekY = ty*s - vy;
+
+		//arrive: slow down so as to stop at the target
+		float speed = dist * invArriveTime;
+		speed = speed < MaxSpeed ? speed : MaxSpeed;
+		s = dist > 0.0f ? speed / dist : 0.0f;
+		const float arriveX = dist > 0.0f ? tx*s - vx : 0.0f;
+		const float arriveY = dist > 0.0f ? ty*s - vy : 0.0f;
+
+		//follow path: seek the current waypoint, arrive at the last one
+		tx = m_WaypointX[i] - px;
+		ty = m_WaypointY[i] - py;
+		dist = sqrtf(tx*tx + ty*ty);
+		s = dist > 0.0f ? MaxSpeed / dist : 0.0f;
+		speed = dist * invArriveTime;
+		speed = speed < MaxSpeed ? speed : MaxSpeed;
+		const float sa = dist > 0.0f ? speed / dist : 0.0f;
+		const float a = m_WaypointArrive[i];
+		const float sp = s + (sa - s)*a;
+		const float pathX = dist > 0.0f ? tx*sp - vx : 0.0f;
+		const float pathY = dist > 0.0f ? ty*sp - vy : 0.0f;
+
+		//cohesion: seek the center of mass, normalized
+		tx = m_CohesionX[i] - px;
+		ty = m_CohesionY[i] - py;
+		dist = sqrtf(tx*tx + ty*ty);
+		s = dist > 0.0f ? MaxSpeed / dist : 0.0f;
+		float cohX = dist > 0.0f ? tx*s - vx : 0.0f;
+		float cohY = dist > 0.0f ? ty*s - vy : 0.0f;
+		const float cohLen = sqrtf(cohX*cohX + cohY*cohY);
+		s = cohLen > 0.0f ? 1.0f / cohLen : 0.0f;
+		cohX *= s;
+		cohY *= s;
+
+		float fx = seekX*m_WeightSeek[i] + arriveX*m_WeightArrive[i] + pathX*m_WeightFollowPath[i] +
+				   m_SeparationX[i]*m_WeightSeparation[i] + m_AlignmentX[i]*m_WeightAlignment[i] +
+				   cohX*m_WeightCohesion[i];
+		float fy = seekY*m_WeightSeek[i] + arriveY*m_WeightArrive[i] + pathY*m_WeightFollowPath[i] +
+				   m_SeparationY[i]*m_WeightSeparation[i] + m_AlignmentY[i]*m_WeightAlignment[i] +
+				   cohY*m_WeightCohesion[i];
+
+		//truncate to the max force
+		const float len = sqrtf(fx*fx + fy*fy);
+		s = len > m_MaxForce[i] ? m_MaxForce[i] / len : 1.0f;
+		m_ForceX[i] = fx*s;
+		m_ForceY[i] = fy*s;
+	}
+}
+
+//------------------------- CalculateSteering ----------------------------
+//------------------------------------------------------------------------
+void SteeringCrowd::CalculateSteering()
+{
+	const int n = m_iNumAgents;
+	if (!n) return;
+
+	BuildGrid();
+
+	for (int i=0; i<n; ++i)
+	{
+		//only the group behaviors need the neighbors
+		if (m_WeightSeparation[i] != 0.0f || m_WeightAlignment[i] != 0.0f || m_WeightCohesion[i] != 0.0f)
+		{
+			GatherNeighbors(i);
+		}
+		else
+		{
+			m_SeparationX[i] = m_SeparationY[i] = 0.0f;
+			m_AlignmentX[i] = m_AlignmentY[i] = 0.0f;
+			m_CohesionX[i] = m_PosX[i];
+			m_CohesionY[i] = m_PosY[i];
+		}
+
+		if (m_WeightFollowPath[i] != 0.0f)
+		{
+			UpdateWaypoint(i);
+		}
+		else
+		{
+			m_WaypointX[i] = m_PosX[i];
+			m_WaypointY[i] = m_PosY[i];
+			m_WaypointArrive[i] = 1.0f;
+		}
+	}
+
+	SumForces();
+}
+
+//----------------------------- Integrate --------------------------------
+//
+//  Acceleration = Force/Mass, the velocity is truncated to the max speed
+//  and the heading follows the velocity
+//------------------------------------------------------------------------
+void SteeringCrowd::Integrate(float time_elapsed)
+{
+	const int n = m_iNumAgents;
+
+	for (int i=0; i<n; ++i)
+	{
+		float vx = m_VelX[i] + m_ForceX[i]*m_InvMass[i]*time_elapsed;
+		float vy = m_VelY[i] + m_ForceY[i]*m_InvMass[i]*time_elapsed;
+
+		const float SpeedSq = vx*vx + vy*vy;
+		const float MaxSpeed = m_MaxSpeed[i];
+		const float speed = sqrtf(SpeedSq);
+		const float s = speed > MaxSpeed ? MaxSpeed / speed : 1.0f;
+		vx *= s;
+		vy *= s;
+
+		m_VelX[i] = vx;
+		m_VelY[i] = vy;
+		m_PosX[i] += vx*time_elapsed;
+		m_PosY[i] += vy*time_elapsed;
+
+		//update the heading if the agent has a non zero velocity
+		if (SpeedSq > 0.00000001f)
+		{
+			const float invSpeed = 1.0f / (speed*s);
+			m_HeadingX[i] = vx*invSpeed;
+			m_HeadingY[i] = vy*invSpeed;
+		}
+	}
+}
+
+//------------------------------ Update ----------------------------------
+//------------------------------------------------------------------------
+void SteeringCrowd::Update(double time_elapsed)
+{
+	CalculateSteering();
+	Integrate((float)time_elapsed);
+}
@@ -85,7 +85,7 @@ using namespace OgreBites;
 // header / version of NavMeshSet
 static const int NAVMESHSET_MAGIC = 'M'<<24 | 'S'<<16 | 'E'<<8 | 'T'; //'MSET';
 // header / version of NavMeshSet
-static const int NAVMESHSET_VERSION = 1;
+static const int NAVMESHSET_VERSION = 3;
 
 // datafile header for NavMeshSet of NavMesh Tiles
 struct NavMeshSetHeader
@@ -96,10 +96,11 @@ struct NavMeshSetHeader
 	dtNavMeshParams params;
 };
 
-// datafile header for individual NavMesh Tiles
+// datafile header for individual NavMesh Tiles,
+// the tile ref is always stored 64 bits wide whatever the dtTileRef size
 struct NavMeshTileHeader
 {
-	dtTileRef tileRef;
+	unsigned long long tileRef;
 	int dataSize;
 };
 
@@ -230,6 +231,7 @@ OgreTemplate::OgreTemplate(void):
 
 	master_time = new Time();
 	master_database = new Database();
+	master_database->SetParallelUpdate( true );
 	master_msgroute = new MsgRoute();
 	master_debuglog = new DebugLog();
 }
@@ -376,6 +378,14 @@ bool OgreTemplate::buildNavMesh(NavSceneNodeList sceneNodeList, Ogre::SceneNode
 {
 		
 
+		 if (!geom->getMesh()->getVerts())
+		 {
+			 // quantized input geometry only supports the tiled build
+			 if (rcGetLog())
+				 rcGetLog()->log(RC_LOG_ERROR, "buildNavigation: No full precision geometry, use the tiled build.");
+			 return false;
+		 }
+
 		 const float* bmin = geom->getMeshBoundsMin();
 		 const float* bmax = geom->getMeshBoundsMax();
 		 const float* verts = geom->getMesh()->getVerts();
@@ -755,7 +765,7 @@ void OgreTemplate::handleRenderTiles()
 	if (!geom || !geom->getMesh())
 		return;
 
-	if (m_drawMode == DRAWMODE_MESH)
+	if (m_drawMode == DRAWMODE_MESH && geom->getMesh()->getVerts())
 	{
 		// Draw mesh
 		duDebugDrawTriMesh(ddMain, geom->getMesh()->getVerts(), geom->getMesh()->getVertCount(),
@@ -965,7 +975,7 @@ void OgreTemplate::handleRenderDebug()
 	ddMain->depthMask(true);
 	ddOffMesh->depthMask(true);
 
-	if (m_drawMode == DRAWMODE_MESH)
+	if (m_drawMode == DRAWMODE_MESH && geom->getMesh()->getVerts())
 	{
 		// Draw mesh
 		duDebugDrawTriMeshSlope(ddMain, geom->getMesh()->getVerts(), geom->getMesh()->getVertCount(),
@@ -1277,10 +1287,11 @@ bool OgreTemplate::frameRenderingQueued(const Ogre::FrameEvent& evt)
 			sTiles += StringConverter::toString(tw) + "  x  " + StringConverter::toString(th);
 
 			// Max tiles and max polys affect how the tile IDs are caculated.
-			// There are 22 bits available for identifying a tile and a polygon.
-			int tileBits = rcMin((int)ilog2(nextPow2(tw*th)), 14);
-			if (tileBits > 14) tileBits = 14;
-			int polyBits = 22 - tileBits;
+			// dtNavMesh::init() needs at least 10 salt bits and 1 tile bit, which
+			// leaves 22 bits of a 32-bit ref for identifying a tile and a polygon.
+			const int saltBits = 10;
+			int tileBits = rcClamp((int)ilog2(nextPow2(tw*th)), 1, 14);
+			int polyBits = 32 - saltBits - tileBits;
 			m_maxTiles = 1 << tileBits;
 			m_maxPolysPerTile = 1 << polyBits;
 			sMaxTiles += StringConverter::toString(m_maxTiles);
@@ -1842,6 +1853,7 @@ void OgreTemplate::handleMeshChange(void)
 	else if(currentMeshName == "Terrain Scene")
 	{
 		// TODO : add entity support for terrain entities
+		geom->setQuantizedStorage(QUANTIZE_TERRAIN_GEOMETRY);
 		geom->loadTerrain();
 		SharedData::getSingleton().m_AppMode = APPMODE_TERRAINSCENE;
 		DemoGUI->setPresetOgreTerrain();
@@ -1962,7 +1974,7 @@ dtNavMesh* OgreTemplate::loadAll(const char* path)
 		memset(data, 0, tileHeader.dataSize);
 		fread(data, tileHeader.dataSize, 1, fp);
 
-		mesh->addTile(data, tileHeader.dataSize, DT_TILE_FREE_DATA, tileHeader.tileRef);
+		mesh->addTile(data, tileHeader.dataSize, DT_TILE_FREE_DATA, (dtTileRef)tileHeader.tileRef);
 	}
 
 	fclose(fp);
@@ -2060,7 +2072,7 @@ void OgreTemplate::buildTile(const float* pos)
 	if (data)
 	{
 		// Remove any previous data (navmesh owns and deletes the data).
-		m_navMesh->removeTile(m_navMesh->getTileRefAt(tx,ty),0,0);
+		m_navMesh->removeTile(m_navMesh->getTileRefAt(tx,ty,0),0,0);
 
 		// Let the navmesh own the data.
 		if (!m_navMesh->addTile(data,dataSize,DT_TILE_FREE_DATA))
@@ -2091,7 +2103,7 @@ void OgreTemplate::removeTile(const float* pos)
 
 	m_tileCol = duRGBA(204,25,0,255);
 
-	m_navMesh->removeTile(m_navMesh->getTileRefAt(tx,ty),0,0);
+	m_navMesh->removeTile(m_navMesh->getTileRefAt(tx,ty,0),0,0);
 }
 
 //-------------------------------------------------------------------------------------
@@ -2188,7 +2200,7 @@ void OgreTemplate::buildAllTiles()
 			if (data)
 			{
 				// Remove any previous data (navmesh owns and deletes the data).
-				m_navMesh->removeTile(m_navMesh->getTileRefAt(x,y),0,0);
+				m_navMesh->removeTile(m_navMesh->getTileRefAt(x,y,0),0,0);
 				// Let the navmesh own the data.
 				if (!m_navMesh->addTile(data,dataSize,true))
 					delete [] data;
@@ -2215,7 +2227,7 @@ void OgreTemplate::removeAllTiles()
 
 	for (int y = 0; y < th; ++y)
 		for (int x = 0; x < tw; ++x)
-			m_navMesh->removeTile(m_navMesh->getTileRefAt(x,y),0,0);
+			m_navMesh->removeTile(m_navMesh->getTileRefAt(x,y,0),0,0);
 }
 
 //-------------------------------------------------------------------------------------
@@ -2234,6 +2246,7 @@ unsigned char* OgreTemplate::buildTileMesh(const int tx, const int ty, const flo
 	const int nverts = geom->getMesh()->getVertCount();
 	const int ntris = geom->getMesh()->getTriCount();
 	const rcChunkyTriMesh* chunkyMesh = geom->getChunkyMesh();
+	const unsigned char* walkableFlags = geom->getWalkableTriFlags(agentMaxSlope);
 
 	// Init build configuration from GUI
 	memset(&m_cfg, 0, sizeof(m_cfg));
@@ -2315,21 +2328,41 @@ unsigned char* OgreTemplate::buildTileMesh(const int tx, const int ty, const flo
 
 	m_tileTriCount = 0;
 
+	// quantized input geometry is decoded one chunk at a time
+	const rcQuantizedTriMesh* quantMesh = geom->getQuantizedMesh();
+	float* chunkVerts = 0;
+	int* chunkTris = 0;
+	if (quantMesh)
+	{
+		chunkVerts = new float[quantMesh->maxVertsPerChunk*3];
+		chunkTris = new int[chunkyMesh->maxTrisPerChunk*3];
+	}
+
 	for (int i = 0; i < ncid; ++i)
 	{
 		const rcChunkyTriMeshNode& node = chunkyMesh->nodes[cid[i]];
-		const int* tris = &chunkyMesh->tris[node.i*3];
 		const int ntris = node.n;
 
 		m_tileTriCount += ntris;
 
-		memset(m_triflags, 0, ntris*sizeof(unsigned char));
-		rcMarkWalkableTriangles(m_cfg.walkableSlopeAngle,
-			verts, nverts, tris, ntris, m_triflags);
+		// walkable flags are precomputed per chunky triangle by the input geometry
+		memcpy(m_triflags, &walkableFlags[node.i], ntris*sizeof(unsigned char));
 
-		rcRasterizeTriangles(verts, nverts, tris, m_triflags, ntris, *m_solid, m_cfg.walkableClimb);
+		if (quantMesh)
+		{
+			const int nchunkVerts = rcDecodeQuantizedChunk(quantMesh, chunkyMesh, cid[i], chunkVerts, chunkTris);
+			rcRasterizeTriangles(chunkVerts, nchunkVerts, chunkTris, m_triflags, ntris, *m_solid, m_cfg.walkableClimb);
+		}
+		else
+		{
+			const int* tris = &chunkyMesh->tris[node.i*3];
+			rcRasterizeTriangles(verts, nverts, tris, m_triflags, ntris, *m_solid, m_cfg.walkableClimb);
+		}
 	}
 
+	delete [] chunkVerts;
+	delete [] chunkTris;
+
 	if (!m_keepInterResults)
 	{
 		delete [] m_triflags;
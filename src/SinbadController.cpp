@@ -38,6 +38,7 @@
 #include "NavMeshTesterTool.h"
 #include "GUtility.h"
 #include "Recast.h"
+#include "DetourCommon.h"
 #include "DetourNavMesh.h"
 #include "DetourNavMeshBuilder.h"
 
@@ -57,6 +58,13 @@
 #include "CellSpacePartition.h"
 #include "OgreRecastPath.h"
 
+// random number in range [0..1) for the navmesh random point queries. These
+// only run serially (see MSG_SearchPath), so the calls come in update order.
+static float frand()
+{
+	return (float)rand() / ((float)RAND_MAX + 1.0f);
+}
+
 //------------------------------------------------------------------------------------
 // TODO : Replace these properly with variables, setter and getters etc etc..
 #define CAM_HEIGHT 5  //(12)         // height of camera above character's center of mass
@@ -193,6 +201,14 @@ StateMachine( object ), MovingEntity(position, scale, velocity, max_speed, Vecto
 m_vSmoothedHeading(Vector2D(0,0)), m_bSmoothingOn(true), m_dTimeElapsed(0.0)
 {
 	mIsInitialized = false;
+	m_probeHandlers = false;
+	m_probedHandler = 0;
+	if(!s_stateTable.IsBuilt())
+	{
+		buildStateTable();
+		ASSERTMSG(checkStateTable(), "SinbadCharacterController - The state table and States() handle events differently.");
+	}
+	SetStateTable(&s_stateTable);
 	mGndHgt = 0.0f;
 	mCurGroundHeight = 0.0f;
 	if(_m_sample)
@@ -236,8 +252,15 @@ m_vSmoothedHeading(Vector2D(0,0)), m_bSmoothingOn(true), m_dTimeElapsed(0.0)
 	m_distanceToWall = 0;
 	m_sposSet = false;
 	m_eposSet = false;
+	m_sposRef = 0;
+	m_eposRef = 0;
+	m_snapPos[0] = m_snapPos[1] = m_snapPos[2] = 0.0f;
+	m_snapRef = 0;
 	m_pathIterNum = 0;
 	m_steerPointCount = 0;
+	m_corridor.init(MAX_POLYS);
+	m_corridorTimer = 0.0f;
+	m_cornersReachEnd = true;
 	m_polyPickExt[0] = 20;
 	m_polyPickExt[1] = 30;
 	m_polyPickExt[2] = 20;
@@ -245,6 +268,13 @@ m_vSmoothedHeading(Vector2D(0,0)), m_bSmoothingOn(true), m_dTimeElapsed(0.0)
 	m_pPath = NULL;
 	m_filter.includeFlags = SAMPLE_POLYFLAGS_ALL;
 	m_filter.excludeFlags = 0;
+	// area costs travel with the filter, each character can weigh them differently
+	m_filter.setAreaCost(SAMPLE_POLYAREA_GROUND, 1.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_WATER, 10.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_ROAD, 1.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_DOOR, 1.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_GRASS, 2.0f);
+	m_filter.setAreaCost(SAMPLE_POLYAREA_JUMP, 1.5f);
 	ddPoints = 0;
 	ddBounds = 0;
 
@@ -256,6 +286,9 @@ m_vSmoothedHeading(Vector2D(0,0)), m_bSmoothingOn(true), m_dTimeElapsed(0.0)
 	//set up the smoother
 	m_pHeadingSmoother = new Smoother<Vector2D>(Prm.NumSamplesForSmoothing, Vector2D(0.0, 0.0, 0.0));
 	m_pFrameSmoother = new Smoother<double>(Prm.NumFrameSamplesForSmoothing, 0.0);
+	m_dFrameTime = 0.0;
+	m_bMovementComputed = false;
+	m_bMoving = false;
 }
 //------------------------------------------------------------------------------------
 SinbadCharacterController::~SinbadCharacterController(void)
@@ -333,7 +366,9 @@ void SinbadCharacterController::addTime(Real deltaTime, int _applicationMode)
 {
 	mChangeRunAnimCount += deltaTime;
 	
-	float time_elapsed = m_pFrameSmoother->Update(deltaTime);
+	if(!m_bMovementComputed)
+		computeMovement(deltaTime);
+	float time_elapsed = (float)m_dFrameTime;
 
 	Update((time_elapsed));
 	updateBody(time_elapsed, _applicationMode);
@@ -346,6 +381,60 @@ void SinbadCharacterController::addTime(Real deltaTime, int _applicationMode)
 		mBodyNode->showBoundingBox(false);
 }
 
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::computeMovement(Real deltaTime)
+{
+	m_dFrameTime = m_pFrameSmoother->Update(deltaTime);
+	calculateMovement(m_dFrameTime);
+}
+
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::computeMovement(Real deltaTime, const Vector2D& SteeringForce)
+{
+	m_dFrameTime = m_pFrameSmoother->Update(deltaTime);
+	calculateMovement(m_dFrameTime, &SteeringForce);
+}
+
+//------------------------------------------------------------------------------------
+bool SinbadCharacterController::isSteering(void)
+{
+	return !m_pSteering->PathDone() && !mFindingPath && !m_bIsSelected;
+}
+
+//------------------------- calculateMovement ----------------------------
+//
+//  Sums the steering behaviors and integrates the new velocity and
+//  position into m_vNewVelocity and m_vNewPos. Only this vehicle's own
+//  steering state is changed, the vehicle itself moves in Update. A
+//  steering force handed in replaces the vehicle's own SteeringBehavior
+//------------------------------------------------------------------------
+void SinbadCharacterController::calculateMovement(double time_elapsed, const Vector2D* SteeringForce)
+{
+	m_bMovementComputed = true;
+	m_bMoving = isSteering();
+	if(!m_bMoving)
+		return;
+
+	//update the time elapsed
+	m_dTimeElapsed = time_elapsed;
+
+	//calculate the combined force from each steering behavior in the 
+	//vehicle's list
+	Vector2D Force = SteeringForce ? *SteeringForce : m_pSteering->Calculate();
+
+	//Acceleration = Force/Mass
+	Vector2D acceleration = Force / m_dMass;
+
+	//update velocity
+	m_vNewVelocity = m_vVelocity + acceleration * time_elapsed; 
+
+	//make sure vehicle does not exceed maximum velocity
+	m_vNewVelocity.Truncate(m_dMaxSpeed);
+
+	//update the position
+	m_vNewPos = m_vPos + m_vNewVelocity * time_elapsed;
+}
+
 //------------------------------ Update ----------------------------------
 //
 //  Updates the vehicle's position from a series of steering behaviors
@@ -354,33 +443,18 @@ void SinbadCharacterController::Update(double time_elapsed)
 {   
 	Ogre::Vector3 OldBodyPos = mBodyNode->getPosition();
 
+	if(!m_bMovementComputed)
+		calculateMovement(time_elapsed);
+	m_bMovementComputed = false;
 	
-	if(!m_pSteering->PathDone() && !mFindingPath && !m_bIsSelected)
+	if(m_bMoving)
 	{
-		//update the time elapsed
-		m_dTimeElapsed = time_elapsed;
-
 		//keep a record of its old position so we can update its cell later
 		//in this method
 		Vector2D OldPos = Pos();
 
-		Vector2D SteeringForce;
-
-		//calculate the combined force from each steering behavior in the 
-		//vehicle's list
-		SteeringForce = m_pSteering->Calculate();
-
-		//Acceleration = Force/Mass
-		Vector2D acceleration = SteeringForce / m_dMass;
-
-		//update velocity
-		m_vVelocity += acceleration * time_elapsed; 
-
-		//make sure vehicle does not exceed maximum velocity
-		m_vVelocity.Truncate(m_dMaxSpeed);
-
-		//update the position
-		m_vPos += m_vVelocity * time_elapsed;
+		m_vVelocity = m_vNewVelocity;
+		m_vPos = m_vNewPos;
 
 		//update the heading if the vehicle has a non zero velocity
 		if (m_vVelocity.LengthSq() > 0.00000001)
@@ -389,17 +463,24 @@ void SinbadCharacterController::Update(double time_elapsed)
 			m_vSide = m_vHeading.Perp();
 		}
 
-		EnforceNonPenetrationConstraint(this, World()->Agents());
+		EnforceNonPenetrationConstraint(this, *World()->CellSpace(), m_OverlapCandidates);
 
 		//treat the screen as a toroid
 		WrapAround(m_vPos, m_tool->cxClientMin(), m_tool->cyClientMin(), m_tool->cxClient(), m_tool->cyClient());
 
-		//update the vehicle's current cell if space partitioning is turned on
-		if (Steering()->isSpacePartitioningOn())
+		// keep to the polygon corridor, a broken corridor means we need a whole new path
+		if(!updateCorridor(time_elapsed))
 		{
-			World()->CellSpace()->UpdateEntity(this, OldPos);
+			m_pSteering->FollowPathOff();
+			SetVelocity(Vector2D(0.0, 0.0));
+			m_vPos = OldPos;
+			sendFindNewPathMessage();
 		}
 
+		//update the vehicle's current cell, the cell space is used by the
+		//non penetration constraint even when the steering does not use it
+		World()->CellSpace()->UpdateEntity(this, OldPos);
+
 		mBodyNode->setPosition(m_vPos.x, (m_vPos.yUP = mBodyNode->getPosition().y), m_vPos.y);
 
 		if (isSmoothingOn())
@@ -414,6 +495,11 @@ void SinbadCharacterController::Update(double time_elapsed)
 
 		mHasMoved = true;
 	}
+	else if(m_pSteering->PathDone() && !mFindingPath && !m_cornersReachEnd)
+	{
+		// only the first few corners are handed to the steering, carry on along the corridor
+		setSteeringPathFromCorridor();
+	}
 	else if(m_pSteering->PathDone() && !mFindingPath)
 	{
 		m_pSteering->FollowPathOff();
@@ -781,191 +867,358 @@ void SinbadCharacterController::setTopAnimation(AnimID id, bool reset)
 // STATE MACHINE LOGIC START
 //------------------------------------------------------------------------------------
 
+StateTable SinbadCharacterController::s_stateTable;
+
+// the characters dispatch through s_stateTable. States() picks the same handlers through the
+// macros, it is kept so that debug builds can check the table against it
+void SinbadCharacterController::buildStateTable(void)
+{
+	StateTable& t = s_stateTable;
+
+	//Global message responses
+	t.AddMsgHandler( STATE_GLOBAL, NO_SUBSTATE, MSG_Damaged, STATE_HANDLER(SinbadCharacterController::onDamaged) );
+	t.AddMsgHandler( STATE_GLOBAL, NO_SUBSTATE, MSG_ModeChange, STATE_HANDLER(SinbadCharacterController::onModeChange) );
+	t.AddMsgHandler( STATE_GLOBAL, NO_SUBSTATE, MSG_FindPath, STATE_HANDLER(SinbadCharacterController::onFindPath) );
+	// CURRENTLY UNUSED - very low call cycle - for low level state changes, sensory memory updating etc
+	t.AddMsgHandler( STATE_GLOBAL, NO_SUBSTATE, MSG_Think, STATE_HANDLER(SinbadCharacterController::ignoreEvent) );
+
+	t.AddState( STATE_Initialize, "STATE_Initialize" );
+	t.AddEventHandler( STATE_Initialize, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::enterInitialize) );
+	t.AddEventHandler( STATE_Initialize, NO_SUBSTATE, EVENT_Update, STATE_HANDLER(SinbadCharacterController::ignoreEvent) );
+
+	t.AddState( STATE_Wander, "STATE_Wander" );		/* we should never get here yet */
+	t.AddEventHandler( STATE_Wander, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::enterWander) );
+	t.AddEventHandler( STATE_Wander, NO_SUBSTATE, EVENT_Update, STATE_HANDLER(SinbadCharacterController::ignoreEvent) );
+	t.AddMsgHandler( STATE_Wander, NO_SUBSTATE, MSG_Attack, STATE_HANDLER(SinbadCharacterController::onWanderAttack) );
+
+	t.AddState( STATE_Attack, "STATE_Attack" );		/* we should never get here yet */
+	t.AddEventHandler( STATE_Attack, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::enterAttack) );
+	t.AddMsgHandler( STATE_Attack, NO_SUBSTATE, MSG_Attack, STATE_HANDLER(SinbadCharacterController::onAttack) );
+
+	t.AddState( STATE_Die, "STATE_Die" );			/* we shoud NEVER EVER get here*/
+	t.AddEventHandler( STATE_Die, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::enterDie) );
+	t.AddMsgHandler( STATE_Die, NO_SUBSTATE, MSG_Damaged, STATE_HANDLER(SinbadCharacterController::ignoreEvent) );
+
+	t.AddState( STATE_ModeChange, "STATE_ModeChange" );
+	t.AddEventHandler( STATE_ModeChange, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::enterModeChange) );
+
+	t.AddState( STATE_FindPath, "STATE_FindPath" );
+	t.AddEventHandler( STATE_FindPath, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::enterFindPath) );
+	t.AddEventHandler( STATE_FindPath, NO_SUBSTATE, EVENT_Update, STATE_HANDLER(SinbadCharacterController::updateFindPath) );
+	t.AddMsgHandler( STATE_FindPath, NO_SUBSTATE, MSG_SearchPath, STATE_HANDLER(SinbadCharacterController::onSearchPath) );
+	t.AddEventHandler( STATE_FindPath, NO_SUBSTATE, EVENT_Exit, STATE_HANDLER(SinbadCharacterController::stopMoving) );
+
+	t.AddState( STATE_WalkPath, "STATE_WalkPath" );
+	t.AddEventHandler( STATE_WalkPath, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::ignoreEvent) );
+	t.AddEventHandler( STATE_WalkPath, NO_SUBSTATE, EVENT_Update, STATE_HANDLER(SinbadCharacterController::ignoreEvent) );
+	t.AddMsgHandler( STATE_WalkPath, NO_SUBSTATE, MSG_FindPath, STATE_HANDLER(SinbadCharacterController::onFindPath) );
+	t.AddEventHandler( STATE_WalkPath, NO_SUBSTATE, EVENT_Exit, STATE_HANDLER(SinbadCharacterController::ignoreEvent) );
+
+	t.AddState( STATE_Idle, "STATE_Idle" );
+	t.AddEventHandler( STATE_Idle, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::enterIdle) );
+	t.AddEventHandler( STATE_Idle, NO_SUBSTATE, EVENT_Update, STATE_HANDLER(SinbadCharacterController::updateIdle) );
+	t.AddMsgHandler( STATE_Idle, NO_SUBSTATE, MSG_IdleChange, STATE_HANDLER(SinbadCharacterController::onIdleChange) );
+	t.AddEventHandler( STATE_Idle, NO_SUBSTATE, EVENT_Exit, STATE_HANDLER(SinbadCharacterController::stopMoving) );
+
+	t.AddState( STATE_Dance, "STATE_Dance" );
+	t.AddEventHandler( STATE_Dance, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::enterDance) );
+	t.AddEventHandler( STATE_Dance, NO_SUBSTATE, EVENT_Update, STATE_HANDLER(SinbadCharacterController::stopMoving) );
+	t.AddMsgHandler( STATE_Dance, NO_SUBSTATE, MSG_IdleChange, STATE_HANDLER(SinbadCharacterController::onIdleChange) );
+	t.AddEventHandler( STATE_Dance, NO_SUBSTATE, EVENT_Exit, STATE_HANDLER(SinbadCharacterController::stopMoving) );
+
+	t.AddState( STATE_Think, "STATE_Think" );
+	t.AddEventHandler( STATE_Think, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(SinbadCharacterController::ignoreEvent) );
+
+	t.SetBuilt();
+}
+
 bool SinbadCharacterController::States( State_Machine_Event event, MSG_Object * msg, int state, int substate )
 {
 	BeginStateMachine
 	///////////////////////////////////////////////////////////////
 	//Global message responses
-		OnMsg( MSG_Damaged )
-			m_owner->SetHealth( m_owner->GetHealth() - (int)msg->GetIntData() );
-				if( m_owner->GetHealth() == 0 )
-				{
-					ChangeState( STATE_Die );
-				}
-
-		OnMsg( MSG_ModeChange )
-			SetVelocity(Vector2D(0.0, 0.0));
-			ChangeState( STATE_ModeChange );
-
-		OnMsg( MSG_FindPath )
-			SetVelocity(Vector2D(0.0, 0.0));
-			ChangeState( STATE_FindPath );
-
-		OnMsg( MSG_Think )
-			// CURRENTLY UNUSED - very low call cycle - for low level state changes, sensory memory updating etc
-			
+		OnMsg( MSG_Damaged )		runHandler( &SinbadCharacterController::onDamaged, msg );
+		OnMsg( MSG_ModeChange )		runHandler( &SinbadCharacterController::onModeChange, msg );
+		OnMsg( MSG_FindPath )		runHandler( &SinbadCharacterController::onFindPath, msg );
+		OnMsg( MSG_Think )			runHandler( &SinbadCharacterController::ignoreEvent, msg );
 
 	///////////////////////////////////////////////////////////////
 	DeclareState( STATE_Initialize )
-
-		OnEnter
-
-			if(m_owner->GetHealth() <= 49) m_owner->SetHealth(50);
-			ChangeStateDelayed( 2.0f, STATE_ModeChange );
-
-		OnUpdate
+		OnEnter						runHandler( &SinbadCharacterController::enterInitialize, msg );
+		OnUpdate					runHandler( &SinbadCharacterController::ignoreEvent, msg );
 
 	///////////////////////////////////////////////////////////////
 	DeclareState( STATE_Wander ) /* we should never get here yet */
-
-		OnEnter
-			SendMsgDelayedToMe( RandDelay( 2.0f, 5.0f ), MSG_Attack );
-
-		OnUpdate
-			//Wander around
-
-		OnMsg( MSG_Attack )
-			GameObject* target = GetClosestPlayer();
-			if( target && target->IsAlive() )
-			{
-				m_curTarget = target->GetID();
-				ChangeState( STATE_Attack );
-			}
-			else
-			{
-				SendMsgDelayedToMe( RandDelay( 2.0f, 5.0f ), MSG_Attack );
-			}
+		OnEnter						runHandler( &SinbadCharacterController::enterWander, msg );
+		OnUpdate					runHandler( &SinbadCharacterController::ignoreEvent, msg );
+		OnMsg( MSG_Attack )			runHandler( &SinbadCharacterController::onWanderAttack, msg );
 
 	///////////////////////////////////////////////////////////////
 	DeclareState( STATE_Attack ) /* we should never get here yet */
-
-		OnEnter
-			SendMsgToMe( MSG_Attack );
-
-		OnMsg( MSG_Attack )
-			GameObject* target = g_database.Find(m_curTarget);
-			if( target && target->IsAlive() )
-			{
-				SendMsg( MSG_Damaged, m_curTarget, (rand()%20) ); 
-				SendMsgDelayedToMe( RandDelay( 3.0f, 6.0f ), MSG_Attack, SCOPE_TO_STATE );
-			}
-			else
-			{
-				ChangeState( STATE_Wander );
-			}
+		OnEnter						runHandler( &SinbadCharacterController::enterAttack, msg );
+		OnMsg( MSG_Attack )			runHandler( &SinbadCharacterController::onAttack, msg );
 
 	///////////////////////////////////////////////////////////////
 	DeclareState( STATE_Die ) /* we shoud NEVER EVER get here*/ 
+		OnEnter						runHandler( &SinbadCharacterController::enterDie, msg );
+		OnMsg( MSG_Damaged )		runHandler( &SinbadCharacterController::ignoreEvent, msg );
 
-		OnEnter
-			//Play die animation
-			ChangeStateDelayed( 10.0f, STATE_Initialize );	//Respawn after 10 seconds
+	///////////////////////////////////////////////////////////////
+	DeclareState( STATE_ModeChange )
+		OnEnter						runHandler( &SinbadCharacterController::enterModeChange, msg );
 
-		OnMsg( MSG_Damaged )
-			//Do nothing
+	///////////////////////////////////////////////////////////////
+	DeclareState( STATE_FindPath )
+		OnEnter						runHandler( &SinbadCharacterController::enterFindPath, msg );
+		OnUpdate					runHandler( &SinbadCharacterController::updateFindPath, msg );
+		OnMsg( MSG_SearchPath )		runHandler( &SinbadCharacterController::onSearchPath, msg );
+		OnExit						runHandler( &SinbadCharacterController::stopMoving, msg );
 
 	///////////////////////////////////////////////////////////////
-	DeclareState( STATE_ModeChange )
+	DeclareState( STATE_WalkPath )
+		OnEnter						runHandler( &SinbadCharacterController::ignoreEvent, msg );
+		OnUpdate					runHandler( &SinbadCharacterController::ignoreEvent, msg );
+		OnMsg( MSG_FindPath )		runHandler( &SinbadCharacterController::onFindPath, msg );
+		OnExit						runHandler( &SinbadCharacterController::ignoreEvent, msg );
 
-		OnEnter
-			if(m_EntityAIMode == ENTITY_MODE_IDLE)
-			{
-				ChangeState(STATE_Idle);
-			}
-			else if(m_EntityAIMode == ENTITY_MODE_FINDPATH)
-			{
-				ChangeState(STATE_FindPath);
-			}
-			else if(m_EntityAIMode == ENTITY_MODE_AUTOMATED)
-			{
+	///////////////////////////////////////////////////////////////
+	DeclareState( STATE_Idle )
+		OnEnter						runHandler( &SinbadCharacterController::enterIdle, msg );
+		OnUpdate					runHandler( &SinbadCharacterController::updateIdle, msg );
+		OnMsg( MSG_IdleChange )		runHandler( &SinbadCharacterController::onIdleChange, msg );
+		OnExit						runHandler( &SinbadCharacterController::stopMoving, msg );
 
-			}
-			else if(m_EntityAIMode == ENTITY_MODE_NONE)
-			{
-				ChangeState(STATE_Idle);
-			}
-						
+	///////////////////////////////////////////////////////////////
+	DeclareState( STATE_Dance )
+		OnEnter						runHandler( &SinbadCharacterController::enterDance, msg );
+		OnUpdate					runHandler( &SinbadCharacterController::stopMoving, msg );
+		OnMsg( MSG_IdleChange )		runHandler( &SinbadCharacterController::onIdleChange, msg );
+		OnExit						runHandler( &SinbadCharacterController::stopMoving, msg );
 
 	///////////////////////////////////////////////////////////////
-	DeclareState( STATE_FindPath )
+	DeclareState( STATE_Think )
+		OnEnter						runHandler( &SinbadCharacterController::ignoreEvent, msg );
 
-		OnEnter
-			setIdlingAnim();
-			mFindingPath = true;
-			m_pSteering->FollowPathOff();
-			SetVelocity(Vector2D(0.0, 0.0));
-			findStartEndPositions();
+	///////////////////////////////////////////////////////////////
+	EndStateMachine
+}
 
-		OnUpdate
-			mFindingPath = true;
-			SetVelocity(Vector2D(0.0, 0.0));
-			findStartEndPositions();
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::runHandler(Handler handler, MSG_Object* msg)
+{
+	if(m_probeHandlers)
+		m_probedHandler = static_cast<StateHandler>(handler);
+	else
+		(this->*handler)(msg);
+}
 
-		OnExit
-			SetVelocity(Vector2D(0.0, 0.0));
+//------------------------------------------------------------------------------------
+bool SinbadCharacterController::checkStateTable(void)
+{
+	bool same = true;
+	// the probing is not part of the character's history
+	const bool logging = g_debuglog.IsEnabled();
+	g_debuglog.SetEnabled(false);
+	m_probeHandlers = true;
+	for(int state = STATE_GLOBAL; state <= STATE_Think; ++state)
+	{
+		for(int event = EVENT_Update; event < EVENT_NUM; ++event)
+		{
+			const bool isMsg = event == EVENT_Message || event == EVENT_CCMessage;
+			for(int name = 0; name < (isMsg ? (int)MSG_NUM : 1); ++name)
+			{
+				// both paths carry out the delayed state changes themselves, before any handler
+				if(state < 0 && event == EVENT_Message && (name == MSG_CHANGE_STATE_DELAYED || name == MSG_CHANGE_SUBSTATE_DELAYED))
+					continue;
+
+				MSG_Object probe(0.0f, (MSG_Name)name, 0, 0, NO_SCOPING, 0, MSG_Data(), false, false);
+				MSG_Object* msg = isMsg ? &probe : 0;
+				m_probedHandler = 0;
+				const bool handled = States((State_Machine_Event)event, msg, state, NO_SUBSTATE);
+				StateHandler handler = 0;
+				const bool declared = s_stateTable.FindHandler(state, NO_SUBSTATE, (State_Machine_Event)event, msg, handler);
+				if(handled != (declared && handler != 0) || m_probedHandler != handler)
+					same = false;
+			}
+		}
+	}
+	m_probeHandlers = false;
+	g_debuglog.SetEnabled(logging);
+	return same;
+}
 
-	///////////////////////////////////////////////////////////////
-	DeclareState( STATE_WalkPath )
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::ignoreEvent(MSG_Object*)
+{
+}
 
-		OnEnter
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::stopMoving(MSG_Object*)
+{
+	SetVelocity(Vector2D(0.0, 0.0));
+}
 
-		OnUpdate
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::onDamaged(MSG_Object* msg)
+{
+	m_owner->SetHealth( m_owner->GetHealth() - (int)msg->GetIntData() );
+	if( m_owner->GetHealth() == 0 )
+	{
+		ChangeState( STATE_Die );
+	}
+}
 
-		OnMsg( MSG_FindPath )
-			SetVelocity(Vector2D(0.0, 0.0));
-			ChangeState( STATE_FindPath );
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::onModeChange(MSG_Object*)
+{
+	SetVelocity(Vector2D(0.0, 0.0));
+	ChangeState( STATE_ModeChange );
+}
 
-		OnExit
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::onFindPath(MSG_Object*)
+{
+	SetVelocity(Vector2D(0.0, 0.0));
+	ChangeState( STATE_FindPath );
+}
 
-	///////////////////////////////////////////////////////////////
-	DeclareState( STATE_Idle )
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::enterInitialize(MSG_Object*)
+{
+	if(m_owner->GetHealth() <= 49) m_owner->SetHealth(50);
+	ChangeStateDelayed( 2.0f, STATE_ModeChange );
+}
 
-		OnEnter
-			setIdlingAnim();
-			m_pSteering->FollowPathOff();
-			SetVelocity(Vector2D(0.0, 0.0));
-			mIdleTimerToChange = RandDelay(5.0f, 20.0f);
-			SendMsgDelayedToMe( mIdleTimerToChange, MSG_IdleChange, SCOPE_TO_STATE);
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::enterWander(MSG_Object*)
+{
+	SendMsgDelayedToMe( RandDelay( 2.0f, 5.0f ), MSG_Attack );
+}
 
-		OnUpdate
-			SetVelocity(Vector2D(0.0, 0.0));
-			if((RandDelay(0.0f, 100.0f) <= 1.0f) && (mBaseAnimID != ANIM_JUMP_LOOP))
-				setJumpingAnim();
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::onWanderAttack(MSG_Object*)
+{
+	GameObject* target = GetClosestPlayer();
+	if( target && target->IsAlive() )
+	{
+		m_curTarget = target->GetID();
+		ChangeState( STATE_Attack );
+	}
+	else
+	{
+		SendMsgDelayedToMe( RandDelay( 2.0f, 5.0f ), MSG_Attack );
+	}
+}
 
-		OnMsg( MSG_IdleChange )
-			ChangeStateDelayed(0.25f, selectIdleAnimset());
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::enterAttack(MSG_Object*)
+{
+	SendMsgToMe( MSG_Attack );
+}
 
-		OnExit
-			SetVelocity(Vector2D(0.0, 0.0));
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::onAttack(MSG_Object*)
+{
+	GameObject* target = g_database.Find(m_curTarget);
+	if( target && target->IsAlive() )
+	{
+		SendMsg( MSG_Damaged, m_curTarget, (int)RandDelay( 0.0f, 20.0f ) );
+		SendMsgDelayedToMe( RandDelay( 3.0f, 6.0f ), MSG_Attack, SCOPE_TO_STATE );
+	}
+	else
+	{
+		ChangeState( STATE_Wander );
+	}
+}
 
-	///////////////////////////////////////////////////////////////
-	DeclareState( STATE_Dance )
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::enterDie(MSG_Object*)
+{
+	//Play die animation
+	ChangeStateDelayed( 10.0f, STATE_Initialize );	//Respawn after 10 seconds
+}
 
-		OnEnter
-			setDanceAnim();
-			m_pSteering->FollowPathOff();
-			SetVelocity(Vector2D(0.0, 0.0));
-			mIdleTimerToChange = RandDelay(7.0f, 15.0f)	;
-			SendMsgDelayedToMe( mIdleTimerToChange, MSG_IdleChange, SCOPE_TO_STATE);
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::enterModeChange(MSG_Object*)
+{
+	if(m_EntityAIMode == ENTITY_MODE_IDLE)
+	{
+		ChangeState(STATE_Idle);
+	}
+	else if(m_EntityAIMode == ENTITY_MODE_FINDPATH)
+	{
+		ChangeState(STATE_FindPath);
+	}
+	else if(m_EntityAIMode == ENTITY_MODE_AUTOMATED)
+	{
 
-		OnUpdate
-			SetVelocity(Vector2D(0.0, 0.0));
+	}
+	else if(m_EntityAIMode == ENTITY_MODE_NONE)
+	{
+		ChangeState(STATE_Idle);
+	}
+}
 
-		OnMsg( MSG_IdleChange )
-			ChangeStateDelayed(0.25f, selectIdleAnimset());
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::enterFindPath(MSG_Object*)
+{
+	setIdlingAnim();
+	mFindingPath = true;
+	m_pSteering->FollowPathOff();
+	SetVelocity(Vector2D(0.0, 0.0));
+	SendMsgToMe( MSG_SearchPath );
+}
 
-		OnExit
-			SetVelocity(Vector2D(0.0, 0.0));
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::updateFindPath(MSG_Object*)
+{
+	mFindingPath = true;
+	SetVelocity(Vector2D(0.0, 0.0));
+	SendMsgToMe( MSG_SearchPath );
+}
 
-	///////////////////////////////////////////////////////////////
-	DeclareState( STATE_Think )
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::onSearchPath(MSG_Object*)
+{
+	// the parallel update delivers messages serially in update order,
+	// so the navmesh and the path caches are never searched concurrently
+	findStartEndPositions();
+}
+
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::enterIdle(MSG_Object*)
+{
+	setIdlingAnim();
+	m_pSteering->FollowPathOff();
+	SetVelocity(Vector2D(0.0, 0.0));
+	mIdleTimerToChange = RandDelay(5.0f, 20.0f);
+	SendMsgDelayedToMe( mIdleTimerToChange, MSG_IdleChange, SCOPE_TO_STATE);
+}
 
-		OnEnter
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::updateIdle(MSG_Object*)
+{
+	SetVelocity(Vector2D(0.0, 0.0));
+	if((RandDelay(0.0f, 100.0f) <= 1.0f) && (mBaseAnimID != ANIM_JUMP_LOOP))
+		setJumpingAnim();
+}
 
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::onIdleChange(MSG_Object*)
+{
+	ChangeStateDelayed(0.25f, selectIdleAnimset());
+}
 
-	///////////////////////////////////////////////////////////////
-	EndStateMachine
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::enterDance(MSG_Object*)
+{
+	setDanceAnim();
+	m_pSteering->FollowPathOff();
+	SetVelocity(Vector2D(0.0, 0.0));
+	mIdleTimerToChange = RandDelay(7.0f, 15.0f)	;
+	SendMsgDelayedToMe( mIdleTimerToChange, MSG_IdleChange, SCOPE_TO_STATE);
 }
+
 //------------------------------------------------------------------------------------
 // STATE MACHINE LOGIC END
 //------------------------------------------------------------------------------------
@@ -1131,64 +1384,45 @@ void SinbadCharacterController::setRunningAnimEnd(void)
 //------------------------------------------------------------------------------------
 void SinbadCharacterController::findStartEndPositions()
 {
-	//srand(g_time.GetCurTime());
-	// randomly generate an endpoint for a path from present location
-	setPathStart(mBodyNode->getPosition().x, mBodyNode->getPosition().y, mBodyNode->getPosition().z);
-
-	int negpos = RandDelay(0.0f, 10.0f);
-
-	if(negpos > 5)
-		negpos = 1;
-	else
-		negpos = -1;
-
-	float XVal = 0.0f;
-	float ZVal = 0.0f;
+	// randomly pick an endpoint for a path from present location, the navmesh
+	// hands out points which are on a walkable polygon and reachable from here
+	float spos[3];
+	float epos[3];
+	getSearchStart(spos);
+	setPathStart(spos);
 
+	float searchRadius = 1000.0f;
 	if(SharedData::getSingleton().m_AppMode == APPMODE_TERRAINSCENE)
-	{
-		setPathStart(mBodyNode->getPosition().x, mGndHgt, mBodyNode->getPosition().z);
+		searchRadius = 5500.0f;
 
-		XVal = (mBodyNode->getPosition().x + (RandDelay(100.0f, 5500.0f) / negpos));
-		ZVal = (mBodyNode->getPosition().z + (RandDelay(100.0f, 5500.0f) / negpos));
-		
-		float gndAtEnd = m_sample->getInputGeom()->getMesh()->mTerrainGroup->getHeightAtWorldPosition(Ogre::Vector3(XVal, 5000, ZVal));
-		
-		setPathEnd(XVal, gndAtEnd, ZVal);
-	}
-	
-	
-	if( (SharedData::getSingleton().m_AppMode != APPMODE_TERRAINSCENE) )
-	{
-		XVal = (mBodyNode->getPosition().x + (RandDelay(7.5f, 1000.0f) / negpos));
-		ZVal = (mBodyNode->getPosition().z + (RandDelay(7.5f, 1000.0f) / negpos));
-		
-		Ogre::Ray ray;
-		ray.setOrigin(Vector3(XVal, 5000, ZVal));
-		ray.setDirection(Vector3::NEGATIVE_UNIT_Y);
-
-		float tt = 0;
-		float rays[3];
-		float raye[3];
-		float pos[3];
-		memset(pos,  0, sizeof(pos));
-		memset(rays, 0, sizeof(rays));
-		memset(raye, 0, sizeof(raye));
-		rays[0] = (float)ray.getOrigin().x; rays[1] = (float)ray.getOrigin().y; rays[2] = (float)ray.getOrigin().z;
-		raye[0] = (float)ray.getPoint(5000.0).x; raye[1] = (float)ray.getPoint(5000.0).y; raye[2] = (float)ray.getPoint(5000.0).z;
-
-		if (m_sample->getInputGeom()->raycastMesh(rays, raye, tt))
-		{
-			pos[0] = rays[0] + (raye[0] - rays[0])*tt;
-			pos[1] = rays[1] + (raye[1] - rays[1])*tt;
-			pos[2] = rays[2] + (raye[2] - rays[2])*tt;
-		}
-	
-		setPathEnd(XVal, pos[1], ZVal);
+	// only called on MSG_SearchPath, which is never delivered on a worker thread
+	dtNavMesh* navMesh = m_sample->getNavMesh();
+	if (!navMesh)
+		return;
 
-	}
+	// the tool snaps the search start of every waiting agent in one batch before
+	// the messages are delivered, only search here if that missed this agent
+	dtPolyRef startRef = 0;
+	if (m_snapRef && dtVequal(spos, m_snapPos))
+		startRef = m_snapRef;
+	m_snapRef = 0;
+	if (!startRef)
+		startRef = navMesh->findNearestPoly(spos, m_polyPickExt, &m_filter, 0);
+	setPathStart(spos, startRef);
+
+	dtPolyRef endRef = 0;
+	if (startRef)
+		endRef = navMesh->findRandomPointAroundCircle(startRef, spos, searchRadius, &m_filter, frand, epos);
+	// standing off the mesh, anywhere on the mesh is better than nowhere
+	if (!endRef)
+		endRef = navMesh->findRandomPoint(&m_filter, frand, epos);
+
+	// the random point lies on endRef, recalc() does not have to snap it again
+	if (endRef)
+		setPathEnd(epos, endRef);
 
 	recalc();
+
 	// if path valid change state STATE_WalkPath and handle walking the path
 	if(m_nstraightPath > 1)
 	{
@@ -1206,104 +1440,30 @@ void SinbadCharacterController::findStartEndPositions()
 
 
 //------------------------------------------------------------------------------------
-Ogre::Vector3 SinbadCharacterController::findValidSpawnPosition(float _rayHeight)
+void SinbadCharacterController::getSearchStart(float* pos)
 {
-
-	int negpos = RandDelay(0.0f, 10.0f);
-	if(negpos > 5)
-		negpos = 1;
-	else
-		negpos = -1;
-
-	float borderZone = 10.0f;
-	float XVal = 0.0f;
-	float ZVal = 0.0f;
-	float YVal = 0.0f;
-	Ogre::Vector3 checkPos = Ogre::Vector3::ZERO;
-
+	pos[0] = mBodyNode->getPosition().x;
+	pos[1] = mBodyNode->getPosition().y;
+	pos[2] = mBodyNode->getPosition().z;
 	if(SharedData::getSingleton().m_AppMode == APPMODE_TERRAINSCENE)
-	{
-		if(negpos == -1)
-		{
-			XVal = (RandDelay(m_tool->cxClientMin() + borderZone, m_tool->cxClient() - borderZone));
-			ZVal = (RandDelay(m_tool->cyClientMin() + borderZone, m_tool->cyClient() - borderZone));
-		}
-		else
-		{
-			XVal = (RandDelay(m_tool->cxClientMin() + borderZone, m_tool->cxClient() - borderZone));
-			ZVal = (RandDelay(m_tool->cyClientMin() + borderZone, m_tool->cyClient() - borderZone));
-		}
+		pos[1] = mGndHgt;
+}
 
-		YVal = m_sample->getInputGeom()->getMesh()->mTerrainGroup->getHeightAtWorldPosition(Ogre::Vector3(XVal, _rayHeight, ZVal));
-		checkPos = Ogre::Vector3(XVal, YVal, ZVal);
-	}
-	else if( (SharedData::getSingleton().m_AppMode != APPMODE_TERRAINSCENE) )
-	{
-		if(negpos == -1)
-		{
-			XVal = (RandDelay(m_tool->cxClientMin() + borderZone, m_tool->cxClient() - borderZone));
-			ZVal = (RandDelay(m_tool->cyClientMin() + borderZone, m_tool->cyClient() - borderZone));
-		}
-		else
-		{
-			XVal = (RandDelay(m_tool->cxClientMin() + borderZone, m_tool->cxClient() - borderZone));
-			ZVal = (RandDelay(m_tool->cyClientMin() + borderZone, m_tool->cyClient() - borderZone));
-		}
+//------------------------------------------------------------------------------------
+Ogre::Vector3 SinbadCharacterController::findValidSpawnPosition(float _rayHeight)
+{
+	// try a handful of random spots at once, the tool casts their ground rays
+	// in one batch and snaps them to the navmesh in one query
+	static const int MAX_SPAWN_CANDIDATES = 8;
+	float vpos[MAX_SPAWN_CANDIDATES*3];
 
-		Ogre::Ray ray;
-		ray.setOrigin(Vector3(XVal, _rayHeight, ZVal));
-		ray.setDirection(Vector3::NEGATIVE_UNIT_Y);
-
-		float tt = 0;
-		float rays[3];
-		float raye[3];
-		float pos[3];
-		memset(pos,  0, sizeof(pos));
-		memset(rays, 0, sizeof(rays));
-		memset(raye, 0, sizeof(raye));
-		rays[0] = (float)ray.getOrigin().x; rays[1] = (float)ray.getOrigin().y; rays[2] = (float)ray.getOrigin().z;
-		raye[0] = (float)ray.getPoint((_rayHeight * 2)).x; raye[1] = (float)ray.getPoint((_rayHeight * 2)).y; raye[2] = (float)ray.getPoint((_rayHeight * 2)).z;
-
-		if (m_sample->getInputGeom()->raycastMesh(rays, raye, tt))
-		{
-			pos[0] = rays[0] + (raye[0] - rays[0])*tt;
-			pos[1] = rays[1] + (raye[1] - rays[1])*tt;
-			pos[2] = rays[2] + (raye[2] - rays[2])*tt;
-		}
-		YVal = pos[1];
-		checkPos = Ogre::Vector3(XVal, YVal, ZVal);
-	}
+	if(m_tool->findSpawnPositions(vpos, MAX_SPAWN_CANDIDATES, _rayHeight))
+		return Ogre::Vector3(vpos[0], vpos[1], vpos[2]);
 
-	float spos[3];
-	float vpos[3];
-	float polyPickExtent[3];
-	dtPolyRef startRef = 0;
-	memset(spos,  0, sizeof(spos));
-	memset(vpos,  0, sizeof(vpos));
-	memset(polyPickExtent, 0, sizeof(polyPickExtent));
-	spos[0] = checkPos.x;
-	spos[1] = checkPos.y;
-	spos[2] = checkPos.z;
-	// increase the size of the bounding box for our spawn point search to maximize the chances
-	// of actually finding a valid place.
-	polyPickExtent[0] = 75;
-	polyPickExtent[1] = 25; // shorter Y height value for extents box as we want to be able to pick different levels of 3d geom
-	polyPickExtent[2] = 75;
-	startRef = m_sample->getNavMesh()->findNearestPoly(spos, polyPickExtent, &m_filter, vpos);
-
-	if(startRef == 0)
-	{
-		// didn't find a valid position
-		return Ogre::Vector3::ZERO;
-	}
-	else if(startRef != 0 && vpos)
-	{
-		// found a valid position on the navmesh
+	// none of the candidates were near the navmesh, take any spot on the navmesh instead
+	if(m_sample->getNavMesh()->findRandomPoint(&m_filter, frand, vpos))
 		return Ogre::Vector3(vpos[0], vpos[1], vpos[2]);
-	}
 
-	// if we get here return a zero value, shouldnt get here, but to be safe, if we do get here
-	// we return a zero value as for whatever reason we didnt find a valid spawn point
 	return Ogre::Vector3::ZERO;
 }
 
@@ -1329,6 +1489,71 @@ GameObject* SinbadCharacterController::GetClosestPlayer( void )
 }
 
 
+//------------------------------------------------------------------------------------
+bool SinbadCharacterController::updateCorridor(double time_elapsed)
+{
+	dtNavMesh* navMesh = m_sample->getNavMesh();
+	if(!navMesh || !m_corridor.getPathCount())
+		return true;
+
+	// slide along the corridor, polygons we walk past are dropped from its start
+	float npos[3];
+	npos[0] = (float)m_vPos.x;
+	npos[1] = m_corridor.getPos()[1];
+	npos[2] = (float)m_vPos.y;
+	m_corridor.movePosition(npos, navMesh);
+	m_vPos.x = m_corridor.getPos()[0];
+	m_vPos.y = m_corridor.getPos()[2];
+
+	// steering only needs fresh corners every now and then
+	static const float CORRIDOR_UPDATE_INTERVAL = 0.5f;
+	m_corridorTimer += (float)time_elapsed;
+	if(m_corridorTimer < CORRIDOR_UPDATE_INTERVAL)
+		return true;
+	m_corridorTimer = 0.0f;
+
+	// tiles may have been rebuilt under us, search again only from where the corridor broke
+	if(!m_corridor.repairPath(MAX_POLYS, navMesh, &m_filter))
+		return false;
+
+	setSteeringPathFromCorridor();
+	return true;
+}
+
+//------------------------------------------------------------------------------------
+void SinbadCharacterController::setSteeringPathFromCorridor(void)
+{
+	dtNavMesh* navMesh = m_sample->getNavMesh();
+	if(!navMesh)
+		return;
+
+	float cornerVerts[MAX_CORNERS*3];
+	unsigned char cornerFlags[MAX_CORNERS];
+	dtPolyRef cornerPolys[MAX_CORNERS];
+	int ncorners = m_corridor.findCorners(cornerVerts, cornerFlags, cornerPolys, MAX_CORNERS, navMesh);
+	if(!ncorners || !m_pPath)
+		return;
+
+	// cut the corridor short when the next corner can be seen directly
+	static const float PATH_OPTIMIZATION_RANGE = 300.0f;
+	m_corridor.optimizePathVisibility(&cornerVerts[0], PATH_OPTIMIZATION_RANGE, navMesh, &m_filter);
+	ncorners = m_corridor.findCorners(cornerVerts, cornerFlags, cornerPolys, MAX_CORNERS, navMesh);
+	if(!ncorners)
+		return;
+	m_cornersReachEnd = (cornerFlags[ncorners-1] & DT_STRAIGHTPATH_END) != 0;
+
+	m_pPath->Clear();
+	mWalkList.resize(0);
+	for(int i = 0; i < ncorners; ++i)
+	{
+		m_pPath->AddWayPoint(Vector2D(cornerVerts[i * 3], cornerVerts[i * 3 + 1], cornerVerts[i * 3 + 2]));
+		mWalkList.push_back(Ogre::Vector3(cornerVerts[i * 3], cornerVerts[i * 3 + 1], cornerVerts[i * 3 + 2]));
+	}
+	m_pSteering->SetPath(m_pPath->GetPath());
+	m_pSteering->SetPathDone(false);
+	m_pSteering->FollowPathOn();
+}
+
 //------------------------------------------------------------------------------------
 void SinbadCharacterController::recalc(void)
 {
@@ -1341,7 +1566,9 @@ void SinbadCharacterController::recalc(void)
 		m_spos[0] = mPathStart.x;
 		m_spos[1] = mPathStart.y;
 		m_spos[2] = mPathStart.z;
-		m_startRef = m_sample->getNavMesh()->findNearestPoly(m_spos, m_polyPickExt, &m_filter, 0);
+		m_startRef = m_sposRef;
+		if (!m_startRef)
+			m_startRef = m_sample->getNavMesh()->findNearestPoly(m_spos, m_polyPickExt, &m_filter, 0);
 	}
 	else
 		m_startRef = 0;
@@ -1351,7 +1578,9 @@ void SinbadCharacterController::recalc(void)
 		m_epos[0] = mPathEnd.x;
 		m_epos[1] = mPathEnd.y;
 		m_epos[2] = mPathEnd.z;
-		m_endRef = m_sample->getNavMesh()->findNearestPoly(m_epos, m_polyPickExt, &m_filter, 0);
+		m_endRef = m_eposRef;
+		if (!m_endRef)
+			m_endRef = m_sample->getNavMesh()->findNearestPoly(m_epos, m_polyPickExt, &m_filter, 0);
 	}
 	else
 		m_endRef = 0;
@@ -1361,10 +1590,30 @@ void SinbadCharacterController::recalc(void)
 		if(m_pPath)
 			delete m_pPath;
 		m_pPath = new Path();
-		m_npolys = m_sample->getNavMesh()->findPath(m_startRef, m_endRef, m_spos, m_epos, &m_filter, m_polys, MAX_POLYS);
+		// agents heading to the same goal polygon share one search through its flow field,
+		// the straight path below still ends at this agent's own goal location
+		m_npolys = 0;
+		const dtFlowField* flowField = m_tool->FlowFields()->getFlowField(m_sample->getNavMesh(), m_endRef, &m_filter);
+		if (flowField)
+			m_npolys = flowField->getPath(m_startRef, m_polys, MAX_POLYS);
+		if (!m_npolys)
+		{
+			// long paths across the terrain trade a little path quality for far fewer expanded polygons
+			dtPathSearchParams search;
+			if(SharedData::getSingleton().m_AppMode == APPMODE_TERRAINSCENE)
+				search.mode = DT_SEARCH_WEIGHTED;
+			m_npolys = m_tool->PathCache()->findPath(m_sample->getNavMesh(), m_startRef, m_endRef, m_spos, m_epos, &m_filter, m_polys, MAX_POLYS, &search);
+		}
 		m_nstraightPath = 0;
-		if (m_npolys)
+		m_corridorTimer = 0.0f;
+		// the corridor must start on a polygon, without a path the agent stays in
+		// STATE_FindPath and searches again on its next update
+		m_corridor.clear();
+		if (m_startRef && m_npolys)
 		{
+			m_corridor.reset(m_startRef, m_spos);
+			m_corridor.setCorridor(m_epos, m_polys, m_npolys);
+
 			m_nstraightPath = m_sample->getNavMesh()->findStraightPath(m_spos, m_epos, m_polys, m_npolys,
 				m_straightPath, m_straightPathFlags,
 				m_straightPathPolys, MAX_POLYS);
@@ -1375,6 +1624,7 @@ void SinbadCharacterController::recalc(void)
 					m_pPath->AddWayPoint(Vector2D(m_straightPath[i * 3], m_straightPath[i * 3 + 1],  m_straightPath[i * 3 + 2]));
 					mWalkList.push_back(Ogre::Vector3(m_straightPath[i * 3], m_straightPath[i * 3 + 1], m_straightPath[i * 3 + 2]));
 				}
+				m_cornersReachEnd = (m_straightPathFlags[m_nstraightPath-1] & DT_STRAIGHTPATH_END) != 0;
 				m_pSteering->SetPath(m_pPath->GetPath());
 				m_pSteering->SetPathLoopOff();
 				m_pSteering->SetPathDone(false);
@@ -1386,10 +1636,15 @@ void SinbadCharacterController::recalc(void)
 	}
 	else
 	{
+		// off the mesh, drop the old corridor so it is not walked or repaired again
+		m_corridor.clear();
 		m_npolys = 0;
 		m_nstraightPath = 0;
 		SetVelocity(Vector2D(0.0, 0.0));
 	}
+	// the known polygons are only good for this frame, the tiles may change before the next one
+	m_sposRef = 0;
+	m_eposRef = 0;
 }
 
 //------------------------------------------------------------------------------------
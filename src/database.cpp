@@ -40,18 +40,33 @@
 
 #include "database.h"
 #include "gameobject.h"
+#include "msgroute.h"
 
 
 Database::Database( void )
-: m_nextFreeID(1)
+: m_holes(0),
+  m_count(0),
+  m_iterating(0),
+  m_parallelUpdate(false),
+  m_thinking(false),
+  m_nextFreeID(1)
 {
-
+	m_nameBuckets.resize( 64, INVALID_OBJECT_ID );
 }
 
 /*---------------------------------------------------------------------------*
   Name:         Update
 
   Description:  Calls the update function for all objects within the database.
+                Objects may be stored or removed while the update runs,
+                objects marked for deletion are deleted once every object
+                has been updated.
+
+				With the parallel update, the think steps of all objects
+				run on worker threads first. Messages sent meanwhile are
+				delivered afterwards in update order (see
+				MsgRoute::EndBuffering), and objects must not be stored or
+				removed by the think steps.
 
   Arguments:    None.
 
@@ -59,21 +74,64 @@ Database::Database( void )
  *---------------------------------------------------------------------------*/
 void Database::Update( void )
 {
-	dbContainer::iterator i = m_database.begin();
-	while( i != m_database.end() )
+	++m_iterating;
+
+	if( m_parallelUpdate )
 	{
-		(*i)->Update();
-		
-		if( (*i)->IsMarkedForDeletion() )
-		{	//Destroy object
-			delete( *i );
-			i = m_database.erase( i );
+		int count = (int)m_objects.size();
+
+		m_thinking = true;
+		g_msgroute.BeginBuffering();
+
+#pragma omp parallel for schedule(dynamic, 16)
+		for( int i=0; i<count; ++i )
+		{
+			GameObject* object = m_objects[i];
+			if( object ) {
+				g_msgroute.SetBufferOrder( (unsigned int)i );
+				object->Update();
+			}
 		}
-		else
+
+		m_thinking = false;
+		g_msgroute.EndBuffering();
+
+		for( unsigned int i=0; i<m_objects.size(); ++i )
+		{
+			GameObject* object = m_objects[i];
+			if( object && object->IsMarkedForDeletion() )
+			{	//Destroy object after the update
+				Remove( object->GetID() );
+				m_deleted.push_back( object );
+			}
+		}
+	}
+	else
+	{	//Objects stored during the update are appended and updated this frame too
+		for( unsigned int i=0; i<m_objects.size(); ++i )
 		{
-			++i;
+			GameObject* object = m_objects[i];
+			if( object == 0 ) {
+				continue;
+			}
+
+			object->Update();
+			
+			if( object->IsMarkedForDeletion() && Find( object->GetID() ) == object )
+			{	//Destroy object after the update
+				Remove( object->GetID() );
+				m_deleted.push_back( object );
+			}
 		}
 	}
+
+	for( unsigned int i=0; i<m_deleted.size(); ++i )
+	{
+		delete( m_deleted[i] );
+	}
+	m_deleted.clear();
+
+	UnlockLists();
 }
 
 /*---------------------------------------------------------------------------*
@@ -87,8 +145,36 @@ void Database::Update( void )
  *---------------------------------------------------------------------------*/
 void Database::Store( GameObject & object )
 {
-	if( Find( object.GetID() ) == 0 ) {
-		m_database.push_back( &object );
+	objectID id = object.GetID();
+
+	ASSERTMSG( !m_thinking, "Database::Store - Objects can not be stored by parallel think steps." );
+
+	if( Find( id ) == 0 ) {
+		if( id >= m_slots.size() ) {
+			dbSlot empty = { 0, 0, 0, 0, 0, INVALID_OBJECT_ID };
+			m_slots.resize( id + 1, empty );
+		}
+
+		//Few distinct types are in use, find the object's list by scanning
+		unsigned int list = 0;
+		while( list < m_typeLists.size() && m_typeLists[list].type != object.GetType() ) {
+			++list;
+		}
+		if( list == m_typeLists.size() ) {
+			m_typeLists.push_back( dbTypeList() );
+			m_typeLists[list].type = object.GetType();
+			m_typeLists[list].holes = 0;
+		}
+
+		dbSlot & slot = m_slots[id];
+		slot.object = &object;
+		slot.position = (unsigned int)m_objects.size();
+		slot.typeList = list;
+		slot.typePosition = (unsigned int)m_typeLists[list].objects.size();
+		slot.subscriptions = 0;
+		m_objects.push_back( &object );
+		m_typeLists[list].objects.push_back( &object );
+		AddName( id );
 	}
 	else {
 		ASSERTMSG( 0, "Database::Store - Object ID already represented in database." );
@@ -98,7 +184,8 @@ void Database::Store( GameObject & object )
 /*---------------------------------------------------------------------------*
   Name:         Remove
 
-  Description:  Removes an object from the database.
+  Description:  Removes an object from the database. The object is not
+                deleted.
 
   Arguments:    id : the ID of the object
 
@@ -106,16 +193,30 @@ void Database::Store( GameObject & object )
  *---------------------------------------------------------------------------*/
 void Database::Remove( objectID id )
 {
-	dbContainer::iterator i;
-	for( i=m_database.begin(); i!=m_database.end(); ++i )
-	{
-		if( (*i)->GetID() == id ) {
-			m_database.erase(i);	
-			return;
-		}
+	ASSERTMSG( !m_thinking, "Database::Remove - Objects can not be removed by parallel think steps." );
+
+	if( Find( id ) == 0 ) {
+		return;
 	}
 
-	return;
+	dbSlot & slot = m_slots[id];
+
+	for( int name=0; slot.subscriptions > 0 && name<MSG_NUM; ++name ) {
+		Unsubscribe( id, (MSG_Name)name );
+	}
+
+	RemoveName( id );
+	m_objects[slot.position] = 0;
+	m_typeLists[slot.typeList].objects[slot.typePosition] = 0;
+	m_typeLists[slot.typeList].holes++;
+	slot.object = 0;
+	m_holes++;
+
+	//UnlockLists compacts when the iteration is done, otherwise do not let
+	//the holes pile up
+	if( m_iterating == 0 && m_holes * 2 > m_objects.size() ) {
+		Compact();
+	}
 }
 
 /*---------------------------------------------------------------------------*
@@ -129,12 +230,8 @@ void Database::Remove( objectID id )
  *---------------------------------------------------------------------------*/
 GameObject* Database::Find( objectID id )
 {
-	dbContainer::iterator i;
-	for( i=m_database.begin(); i!=m_database.end(); ++i )
-	{
-		if( (*i)->GetID() == id ) {
-			return( *i );
-		}
+	if( id < m_slots.size() ) {
+		return( m_slots[id].object );
 	}
 
 	return( 0 );
@@ -149,15 +246,17 @@ GameObject* Database::Find( objectID id )
   Arguments:    name : the name of the object
 
   Returns:      An ID. If object is not found, returns INVALID_OBJECT_ID.
+                If several objects share the name, the first one stored.
  *---------------------------------------------------------------------------*/
 objectID Database::GetIDByName( char* name )
 {
-	dbContainer::iterator i;
-	for( i=m_database.begin(); i!=m_database.end(); ++i )
+	objectID id = m_nameBuckets[HashName( name )];
+	while( id != INVALID_OBJECT_ID )
 	{
-		if( strcmp( (*i)->GetName(), name ) == 0 ) {
-			return( (*i)->GetID() );
+		if( strcmp( m_slots[id].object->GetName(), name ) == 0 ) {
+			return( id );
 		}
+		id = m_slots[id].nextByName;
 	}
 
 	return( INVALID_OBJECT_ID );
@@ -191,13 +290,285 @@ objectID Database::GetNewObjectID( void )
 void Database::ComposeList( dbCompositionList & list, unsigned int type )
 {
 	//Find all objects of "type"
-	dbContainer::iterator i;
-	for( i=m_database.begin(); i!=m_database.end(); ++i )
+	for( unsigned int i=0; i<m_objects.size(); ++i )
 	{
-		if( type == OBJECT_Ignore_Type || (*i)->GetType() & type )
+		GameObject* object = m_objects[i];
+		if( object && ( type == OBJECT_Ignore_Type || object->GetType() & type ) )
 		{	//Type matches
-			list.push_back(*i);
+			list.push_back( object );
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         Subscribe
+
+  Description:  Subscribes an object to broadcasts of a message name. The
+                object gets the broadcasts of that name whatever type they
+				are sent to, besides the objects of that type. Objects can
+				subscribe while the lists are locked.
+
+  Arguments:    id   : the ID of the object
+                name : the message name
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void Database::Subscribe( objectID id, MSG_Name name )
+{
+	ASSERTMSG( !m_thinking, "Database::Subscribe - Subscriptions can not be changed by parallel think steps." );
+
+	if( Find( id ) == 0 ) {
+		ASSERTMSG( 0, "Database::Subscribe - Object ID not represented in database." );
+		return;
+	}
+
+	std::vector<objectID> & ids = m_subscribers[name];
+	unsigned int i = FindSubscriber( name, m_slots[id].position );
+	if( i < ids.size() && ids[i] == id ) {
+		return;
+	}
+
+	ids.insert( ids.begin() + i, id );
+	m_slots[id].subscriptions++;
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         Unsubscribe
+
+  Description:  Stops an object from receiving broadcasts of a message name
+                through its subscription.
+
+  Arguments:    id   : the ID of the object
+                name : the message name
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void Database::Unsubscribe( objectID id, MSG_Name name )
+{
+	ASSERTMSG( !m_thinking, "Database::Unsubscribe - Subscriptions can not be changed by parallel think steps." );
+
+	if( Find( id ) == 0 ) {
+		return;
+	}
+
+	std::vector<objectID> & ids = m_subscribers[name];
+	unsigned int i = FindSubscriber( name, m_slots[id].position );
+	if( i < ids.size() && ids[i] == id ) {
+		ids.erase( ids.begin() + i );
+		m_slots[id].subscriptions--;
+	}
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         GetSubscriberFrom
+
+  Description:  Finds the first subscriber of a message name stored at or
+                after a position of the object list. Broadcasts walk the
+				subscribers with it, so subscribing or unsubscribing in the
+				middle of a broadcast does not make them skip or repeat one.
+
+  Arguments:    name     : the message name
+                position : the position in the object list to start from
+
+  Returns:      The subscriber, or 0 if there is none from that position on.
+ *---------------------------------------------------------------------------*/
+GameObject* Database::GetSubscriberFrom( MSG_Name name, unsigned int position )
+{
+	unsigned int i = FindSubscriber( name, position );
+	if( i < m_subscribers[name].size() ) {
+		return( m_slots[m_subscribers[name][i]].object );
+	}
+
+	return( 0 );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         FindSubscriber
+
+  Description:  Binary search of the subscriber list of a message name for
+                the first object stored at or after a position.
+
+  Arguments:    name     : the message name
+                position : the position in the object list
+
+  Returns:      The index in the subscriber list, the size of the list if
+                all subscribers were stored before the position.
+ *---------------------------------------------------------------------------*/
+unsigned int Database::FindSubscriber( MSG_Name name, unsigned int position )
+{
+	const std::vector<objectID> & ids = m_subscribers[name];
+	unsigned int lo = 0;
+	unsigned int hi = (unsigned int)ids.size();
+	while( lo < hi )
+	{
+		unsigned int mid = ( lo + hi ) / 2;
+		if( m_slots[ids[mid]].position < position ) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
 		}
 	}
+
+	return( lo );
 }
 
+/*---------------------------------------------------------------------------*
+  Name:         UnlockLists
+
+  Description:  Ends an iteration started with LockLists, the lists are
+                compacted when no iteration is left.
+
+  Arguments:    None.
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void Database::UnlockLists( void )
+{
+	ASSERTMSG( m_iterating > 0, "Database::UnlockLists - Lists are not locked." );
+	--m_iterating;
+
+	if( m_iterating == 0 && m_holes > 0 ) {
+		Compact();
+	}
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         HashName
+
+  Description:  Hashes an object name into the name buckets.
+
+  Arguments:    name : the name of the object
+
+  Returns:      The bucket index.
+ *---------------------------------------------------------------------------*/
+unsigned int Database::HashName( const char* name ) const
+{
+	unsigned int h = 5381;
+	while( *name ) {
+		h = h * 33 + (unsigned char)*name++;
+	}
+
+	return( h & ( (unsigned int)m_nameBuckets.size() - 1 ) );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         AddName
+
+  Description:  Links a stored object into its name bucket. The object goes
+                to the end of the chain so that GetIDByName finds the
+                objects sharing a name in the order they were stored.
+
+  Arguments:    id : the ID of the object
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void Database::AddName( objectID id )
+{
+	if( m_count >= m_nameBuckets.size() ) {
+		GrowNameBuckets();	//Relinks the new object too
+		return;
+	}
+
+	m_slots[id].nextByName = INVALID_OBJECT_ID;
+
+	objectID* link = &m_nameBuckets[HashName( m_slots[id].object->GetName() )];
+	while( *link != INVALID_OBJECT_ID ) {
+		link = &m_slots[*link].nextByName;
+	}
+	*link = id;
+	m_count++;
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         RemoveName
+
+  Description:  Unlinks a stored object from its name bucket.
+
+  Arguments:    id : the ID of the object
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void Database::RemoveName( objectID id )
+{
+	objectID* link = &m_nameBuckets[HashName( m_slots[id].object->GetName() )];
+	while( *link != INVALID_OBJECT_ID )
+	{
+		if( *link == id ) {
+			*link = m_slots[id].nextByName;
+			m_slots[id].nextByName = INVALID_OBJECT_ID;
+			m_count--;
+			return;
+		}
+		link = &m_slots[*link].nextByName;
+	}
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         GrowNameBuckets
+
+  Description:  Doubles the number of name buckets and relinks the stored
+                objects in the order they were stored.
+
+  Arguments:    None.
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void Database::GrowNameBuckets( void )
+{
+	m_nameBuckets.assign( m_nameBuckets.size() * 2, INVALID_OBJECT_ID );
+	m_count = 0;
+
+	for( unsigned int i=0; i<m_objects.size(); ++i )
+	{
+		if( m_objects[i] ) {
+			AddName( m_objects[i]->GetID() );
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         Compact
+
+  Description:  Closes the holes left in the object and type lists by
+                removed objects, keeping the order of the remaining
+                objects. The subscriber lists stay in store order.
+
+  Arguments:    None.
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void Database::Compact( void )
+{
+	unsigned int n = 0;
+	for( unsigned int i=0; i<m_objects.size(); ++i )
+	{
+		GameObject* object = m_objects[i];
+		if( object ) {
+			m_slots[object->GetID()].position = n;
+			m_objects[n++] = object;
+		}
+	}
+	m_objects.resize( n );
+	m_holes = 0;
+
+	for( unsigned int list=0; list<m_typeLists.size(); ++list )
+	{
+		dbTypeList & typeList = m_typeLists[list];
+		if( typeList.holes == 0 ) {
+			continue;
+		}
+
+		n = 0;
+		for( unsigned int i=0; i<typeList.objects.size(); ++i )
+		{
+			GameObject* object = typeList.objects[i];
+			if( object ) {
+				m_slots[object->GetID()].typePosition = n;
+				typeList.objects[n++] = object;
+			}
+		}
+		typeList.objects.resize( n );
+		typeList.holes = 0;
+	}
+}
@@ -40,27 +40,72 @@
 
 #include "debuglog.h"
 #include "database.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-#define MAX_DEBUG_LOG_SIZE 200
+#define MAX_DEBUG_LOG_SIZE 256		//Entries per thread
+
+static const char* EventNameText[] =
+{
+	"EVENT_INVALID",
+	"EVENT_Update",
+	"EVENT_Message",
+	"EVENT_CCMessage",
+	"EVENT_Enter",
+	"EVENT_Exit"
+};
 
 
 LogEntry::LogEntry( void )
 {
+	m_timestamp = -1.0f;
+	m_sequence = 0;
 	m_owner = INVALID_OBJECT_ID;
-	m_name[0] = 0;
+	m_statename = "";
+	m_substatename = "";
+	m_state = -1;
+	m_substate = -1;
+	m_event = EVENT_INVALID;
+	m_msgname = MSG_NULL;
 	m_handled = false;
 
-	m_timestamp = -1.0f;
-	m_statename[0] = 0;
-	m_eventmsgname[0] = 0;
 	m_msg = false;
 	m_receiver = INVALID_OBJECT_ID;
 	m_sender = INVALID_OBJECT_ID;
-	m_data = 0;
 	
 }
 
 
+/*---------------------------------------------------------------------------*
+  Name:         DebugLog
+
+  Description:  Constructor. Allocates a ring of entries for every thread
+                that may run state machines.
+ *---------------------------------------------------------------------------*/
+DebugLog::DebugLog( void )
+: m_sequence( 0 ),
+  m_enabled( true ),
+  m_echo( false )
+{
+#ifdef _OPENMP
+	m_rings.resize( omp_get_max_threads() );
+#else
+	m_rings.resize( 1 );
+#endif
+
+	for( unsigned int i=0; i<m_rings.size(); ++i )
+	{
+		m_rings[i].entries = new LogEntry[MAX_DEBUG_LOG_SIZE];
+		m_rings[i].next = 0;
+		m_rings[i].count = 0;
+	}
+}
+
 /*---------------------------------------------------------------------------*
   Name:         ~DebugLog
 
@@ -68,137 +113,163 @@ LogEntry::LogEntry( void )
  *---------------------------------------------------------------------------*/
 DebugLog::~DebugLog( void )
 {
-	LoggingContainer::iterator i;
-	for( i=m_log.begin(); i!=m_log.end(); ++i )
+	for( unsigned int i=0; i<m_rings.size(); ++i )
 	{
-		LogEntry* entry = *i;
-		delete(entry);
+		delete [] m_rings[i].entries;
 	}
 
-	m_log.clear();
+	m_rings.clear();
 }
 
+/*---------------------------------------------------------------------------*
+  Name:         NextEntry
+
+  Description:  Takes the next entry from the ring of the calling thread,
+                overwriting the oldest entry once the ring is full.
+
+  Arguments:    None.
+
+  Returns:      The entry, or 0 if the thread has no ring.
+ *---------------------------------------------------------------------------*/
+LogEntry* DebugLog::NextEntry( void )
+{
+#ifdef _OPENMP
+	unsigned int thread = (unsigned int)omp_get_thread_num();
+#else
+	unsigned int thread = 0;
+#endif
+	if( thread >= m_rings.size() ) {
+		return( 0 );
+	}
+
+	LogRing & ring = m_rings[thread];
+	LogEntry* entry = &ring.entries[ring.next];
+	ring.next = ( ring.next + 1 ) % MAX_DEBUG_LOG_SIZE;
+	if( ring.count < MAX_DEBUG_LOG_SIZE ) {
+		ring.count++;
+	}
+
+	return( entry );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         NextSequence
+
+  Description:  Hands out the next sequence number with an atomic increment,
+                so that entries logged by different threads can be put back
+				in the order they were logged.
+
+  Arguments:    None.
+
+  Returns:      The sequence number.
+ *---------------------------------------------------------------------------*/
+unsigned int DebugLog::NextSequence( void )
+{
+#if defined( _MSC_VER )
+	return( (unsigned int)_InterlockedIncrement( &m_sequence ) );
+#elif defined( __GNUC__ )
+	return( (unsigned int)__sync_add_and_fetch( &m_sequence, 1 ) );
+#else
+	long sequence;
+#pragma omp critical(debuglog_sequence)
+	sequence = ++m_sequence;
+	return( (unsigned int)sequence );
+#endif
+}
 
 /*---------------------------------------------------------------------------*
-  Name:         LogStateMachineEvent
+  Name:         RecordEvent
 
   Description:  Logs a state machine event, such as a received message.
 
   Arguments:    id           : ID of the object
-                name         : string name of the object
                 msg          : pointer to message object containing event
 				statename    : current state of object
 				substatename : current substate of object
-				eventmsgname : the name of the event
+				event        : the event
 				handled      : whether the event was handled by the object
 
   Returns:      None.
  *---------------------------------------------------------------------------*/
-void DebugLog::LogStateMachineEvent( objectID id, char* name, MSG_Object * msg, const char* statename, const char* substatename, char* eventmsgname, bool handled )
+void DebugLog::RecordEvent( objectID id, MSG_Object * msg, const char* statename, const char* substatename, int event, bool handled )
 {
-	if( msg && ( strcmp( MessageNameText[msg->GetName()], "MSG_SET_STATE_DELAYED" ) == 0 ||
-		strcmp( MessageNameText[msg->GetName()], "MSG_SET_SUBSTATE_DELAYED" ) == 0 ))
+	if( msg && ( msg->GetName() == MSG_CHANGE_STATE_DELAYED ||
+		msg->GetName() == MSG_CHANGE_SUBSTATE_DELAYED ) )
 	{	//Don't log these events
 		return;
 	}
 
-	LogEntry * entry = new LogEntry();
+	LogEntry * entry = NextEntry();
+	if( entry == 0 ) {
+		return;
+	}
 
+	entry->m_timestamp = g_time.GetCurTime();
+	entry->m_sequence = NextSequence();
 	entry->m_owner = id;
-	strcpy(entry->m_name, name);
+	entry->m_statename = statename;
+	entry->m_substatename = substatename;
+	entry->m_event = (unsigned short)event;
 	entry->m_handled = handled;
-	entry->m_timestamp = g_time.GetCurTime();
-	strcpy( entry->m_statename, statename );
-	strcpy( entry->m_substatename, substatename );
-
-	if( !handled )
-	{
-		if( eventmsgname[0] == '1')
-		{
-			strcpy( entry->m_eventmsgname, "EVENT_Update" );
-		}
-		else if( eventmsgname[0] == '2' && msg ) 
-		{
-			strcpy( entry->m_eventmsgname, MessageNameText[msg->GetName()] );
-		}
-		else if( eventmsgname[0] == '3') 
-		{
-			strcpy( entry->m_eventmsgname, "EVENT_CCMessage" );
-		}
-		else if( eventmsgname[0] == '4') 
-		{
-			strcpy( entry->m_eventmsgname, "EVENT_Enter" );
-		}
-		else if( eventmsgname[0] == '5') 
-		{
-			strcpy( entry->m_eventmsgname, "EVENT_Exit" );
-		}
-		else
-		{
-			ASSERTMSG( 0, "DebugLog::LogStateMachineEvent - eventmsgname not handled" );
-			strcpy( entry->m_eventmsgname, "INVALID_EVENT" );
-		}
-	}
-	else
-	{
-		strcpy( entry->m_eventmsgname, eventmsgname );
-	}
 
+	entry->m_msg = msg != 0;
 	if( msg ) {
-		entry->m_msg = true;
+		entry->m_msgname = (unsigned short)msg->GetName();
 		entry->m_receiver = msg->GetReceiver();
 		entry->m_sender = msg->GetSender();
-		entry->m_data = msg->GetIntData();
+		entry->m_data = msg->GetMsgData();
 	}
 
-	if( (handled || eventmsgname[0] == '2') &&
-		strcmp(entry->m_eventmsgname, "EVENT_Update") != 0 )
+	if( m_echo && ( handled || event == EVENT_Message ) && event != EVENT_Update )
 	{
+#pragma omp critical(debuglog)
 		PrintLogEntry( *entry );
 	}
-
-	m_log.push_back( entry );
-	if( m_log.size() > MAX_DEBUG_LOG_SIZE ) {
-		delete( m_log.front() );
-		m_log.pop_front();
-	}
 }
 
 /*---------------------------------------------------------------------------*
-  Name:         LogStateMachineStateChange
+  Name:         RecordStateChange
 
   Description:  Logs a state machine state change.
 
   Arguments:    id        : ID of the object
-                name      : string name of the object
                 state     : new state index
                 substate  : new substate index
-				statename : current state of object
 
   Returns:      None.
  *---------------------------------------------------------------------------*/
-void DebugLog::LogStateMachineStateChange( objectID id, char* name, unsigned int state, int substate )
+void DebugLog::RecordStateChange( objectID id, unsigned int state, int substate )
 {
-	LogEntry * entry = new LogEntry();
+	LogEntry * entry = NextEntry();
+	if( entry == 0 ) {
+		return;
+	}
 
+	entry->m_timestamp = g_time.GetCurTime();
+	entry->m_sequence = NextSequence();
 	entry->m_owner = id;
-	strcpy(entry->m_name, name);
+	entry->m_statename = "";
+	entry->m_substatename = "";
+	entry->m_state = (int)state;
+	entry->m_substate = substate;
+	entry->m_event = LOG_STATE_CHANGE;
 	entry->m_handled = true;
-	entry->m_timestamp = g_time.GetCurTime();
-	sprintf( entry->m_statename, "%d", state );
-	sprintf( entry->m_substatename, "%d", substate );
-	strcpy( entry->m_eventmsgname, "STATE_CHANGE" );
 	entry->m_msg = false;
 
-	PrintLogEntry( *entry );
-
-	m_log.push_back( entry );
-	if( m_log.size() > MAX_DEBUG_LOG_SIZE ) {
-		delete( m_log.front() );
-		m_log.pop_front();
+	if( m_echo )
+	{
+#pragma omp critical(debuglog)
+		PrintLogEntry( *entry );
 	}
 }
 
+//Orders the entries of an object as they were logged. The rings only hold
+//recent entries, so the difference stays correct when the sequence wraps
+static bool IsLoggedEarlier( const LogEntry* a, const LogEntry* b )
+{
+	return( (int)( a->m_sequence - b->m_sequence ) < 0 );
+}
+
 /*---------------------------------------------------------------------------*
   Name:         Dump
 
@@ -212,23 +283,34 @@ void DebugLog::LogStateMachineStateChange( objectID id, char* name, unsigned int
 void DebugLog::Dump( objectID id )
 {
 	GameObject* obj = g_database.Find( id );
-	printf( "DebugLog: %s, id=%d\n", obj->GetName(), id );
+	printf( "DebugLog: %s, id=%d\n", obj ? obj->GetName() : "(removed)", id );
 
-	LoggingContainer::iterator i;
-	for( i=m_log.begin(); i!=m_log.end(); ++i )
+	//Gather the object's entries from every ring, oldest first
+	std::vector<LogEntry*> entries;
+	for( unsigned int r=0; r<m_rings.size(); ++r )
 	{
-		LogEntry* log = *i;
-		if( log && log->m_owner == id )
+		LogRing & ring = m_rings[r];
+		unsigned int first = ( ring.next + MAX_DEBUG_LOG_SIZE - ring.count ) % MAX_DEBUG_LOG_SIZE;
+		for( unsigned int i=0; i<ring.count; ++i )
 		{
-			PrintLogEntry( *log );
+			LogEntry* entry = &ring.entries[( first + i ) % MAX_DEBUG_LOG_SIZE];
+			if( entry->m_owner == id ) {
+				entries.push_back( entry );
+			}
 		}
 	}
+	std::sort( entries.begin(), entries.end(), IsLoggedEarlier );
+
+	for( unsigned int i=0; i<entries.size(); ++i )
+	{
+		PrintLogEntry( *entries[i] );
+	}
 }
 
 /*---------------------------------------------------------------------------*
   Name:         PrintLogEntry
 
-  Description:  Prints a single log entry.
+  Description:  Prints a single log entry, resolving the names.
 
   Arguments:    entry : the log entry to print
 
@@ -240,21 +322,45 @@ void DebugLog::PrintLogEntry( LogEntry& entry )
 	char debug1[1024];
 	char debug2[1024];
 	char state[64];
+	const char* eventname;
 
-	if( entry.m_statename[0] != 0 )
-	{	//Use state
-		strcpy( state, entry.m_statename );
+	GameObject* obj = g_database.Find( entry.m_owner );
+	const char* name = obj ? obj->GetName() : "";
+
+	if( entry.m_event == LOG_STATE_CHANGE )
+	{
+		sprintf( state, "%d", entry.m_state );
+		eventname = "STATE_CHANGE";
 	}
 	else
-	{	//Use substate
-		strcpy( state, entry.m_substatename );
+	{
+		if( entry.m_statename[0] != 0 )
+		{	//Use state
+			strcpy( state, entry.m_statename );
+		}
+		else
+		{	//Use substate
+			strcpy( state, entry.m_substatename );
+		}
+
+		if( entry.m_msg && ( entry.m_handled || entry.m_event == EVENT_Message ) ) {
+			eventname = MessageNameText[entry.m_msgname];
+		}
+		else {
+			eventname = EventNameText[entry.m_event];
+		}
 	}
 
-	sprintf( debug0, "%.3f-[%s,%d] %s:%s ", entry.m_timestamp, entry.m_name, entry.m_owner, state, entry.m_eventmsgname );
+	sprintf( debug0, "%.3f-[%s,%d] %s:%s ", entry.m_timestamp, name, entry.m_owner, state, eventname );
 	
 	if( entry.m_msg )
 	{
-		sprintf( debug1, "from:%d to:%d data:%d ", entry.m_sender, entry.m_receiver, entry.m_data );
+		if( entry.m_data.IsFloat() ) {
+			sprintf( debug1, "from:%d to:%d data:%g ", entry.m_sender, entry.m_receiver, entry.m_data.GetFloat() );
+		}
+		else {
+			sprintf( debug1, "from:%d to:%d data:%d ", entry.m_sender, entry.m_receiver, entry.m_data.IsInt() ? entry.m_data.GetInt() : 0 );
+		}
 	}
 	else
 	{
@@ -271,4 +377,4 @@ void DebugLog::PrintLogEntry( LogEntry& entry )
 	}
 
 	printf( "%s%s%s", debug0, debug1, debug2 );
-}
\ No newline at end of file
+}
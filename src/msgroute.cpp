@@ -41,9 +41,28 @@
 #include "msgroute.h"
 #include "statemch.h"
 #include "database.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define MSGROUTE_ALLOW_INSTANTANEOUS_SEND_MSG
 
+#define MSGROUTE_BLOCK_SIZE 64
+
+/*---------------------------------------------------------------------------*
+  Name:         MsgRoute
+
+  Description:  Constructor
+ *---------------------------------------------------------------------------*/
+MsgRoute::MsgRoute( void )
+: m_buffering( false ),
+  m_freeList( 0 ),
+  m_nextSequence( 0 )
+{
+	m_receiverBuckets.resize( 64, 0 );
+}
+
 /*---------------------------------------------------------------------------*
   Name:         ~MsgRoute
 
@@ -51,14 +70,14 @@
  *---------------------------------------------------------------------------*/
 MsgRoute::~MsgRoute( void )
 {
-	MessageContainer::iterator i;
-	for( i=m_delayedMessages.begin(); i!=m_delayedMessages.end(); ++i )
+	for( unsigned int i=0; i<m_blocks.size(); ++i )
 	{
-		MSG_Object * msg = *i;
-		delete( msg );
+		delete [] m_blocks[i];
 	}
 
+	m_blocks.clear();
 	m_delayedMessages.clear();
+	m_freeList = 0;
 }
 
 
@@ -86,6 +105,12 @@ void MsgRoute::SendMsg( float delay, MSG_Name name,
                         Scope_Rule rule, unsigned int scope,
                         MSG_Data data, bool timer, bool cc )
 {
+	if( m_buffering )
+	{	//Sent from a think step, deliver after the update phase
+		MSG_Object msg( 0.0f, name, sender, receiver, rule, scope, data, timer, cc );
+		BufferMsg( BUFFERED_SEND, delay, msg, 0 );
+		return;
+	}
 
 #ifdef MSGROUTE_ALLOW_INSTANTANEOUS_SEND_MSG
 	if( delay <= 0.0f )
@@ -95,26 +120,37 @@ void MsgRoute::SendMsg( float delay, MSG_Name name,
 	}
 	else
 #endif
-	{	//Check for duplicates - then store
-		MessageContainer::iterator i;
-		for( i=m_delayedMessages.begin(); i!=m_delayedMessages.end(); ++i )
+	{	//Check for duplicates among the receiver's messages - then store
+		DelayedMsg* i;
+		for( i=*GetReceiverBucket( receiver ); i!=0; i=i->next )
 		{
-			if( (*i)->IsDelivered() == false &&
-				(*i)->GetName() == name &&
-				(*i)->GetReceiver() == receiver &&
-				(*i)->GetSender() == sender &&
-				(*i)->GetScopeRule() == rule &&
-				(*i)->GetScope() == scope &&
-				(*i)->IsTimer() == timer )
+			if( i->msg.GetName() == name &&
+				i->msg.GetReceiver() == receiver &&
+				i->msg.GetSender() == sender &&
+				i->msg.GetScopeRule() == rule &&
+				i->msg.GetScope() == scope &&
+				i->msg.IsTimer() == timer )
 			{	//Already in list - don't add
 				return;
 			}
 		}
 		
-		//Store in delivery list
+		if( m_delayedMessages.size() >= m_receiverBuckets.size() ) {
+			GrowReceiverBuckets();
+		}
+
+		//Store in delivery heap
 		float deliveryTime = delay + g_time.GetCurTime();
-		MSG_Object * msg = new MSG_Object( deliveryTime, name, sender, receiver, rule, scope, data, timer, false );
-		m_delayedMessages.push_back( msg );
+		DelayedMsg* delayed = AllocMsg();
+		delayed->msg = MSG_Object( deliveryTime, name, sender, receiver, rule, scope, data, timer, false );
+		delayed->sequence = m_nextSequence++;
+		delayed->heapIndex = (unsigned int)m_delayedMessages.size();
+		m_delayedMessages.push_back( delayed );
+		SiftUp( delayed->heapIndex );
+
+		DelayedMsg** bucket = GetReceiverBucket( receiver );
+		delayed->next = *bucket;
+		*bucket = delayed;
 	}
 
 }
@@ -122,7 +158,13 @@ void MsgRoute::SendMsg( float delay, MSG_Name name,
 /*---------------------------------------------------------------------------*
   Name:         SendMsgBroadcast
 
-  Description:  Sends a message to every object of a certain type.
+  Description:  Sends a message to every object of a certain type and to the
+                objects subscribed to the message name, in the order the
+				objects were stored. Only the type lists matching the type
+				and the subscriber list are walked, they are each in store
+				order and merged by store position. The receivers are read
+				straight from the database lists, objects stored during the
+				broadcast do not get the message.
 
   Arguments:    msg    : the message to broadcast
                 type   : the type of object (optional)
@@ -131,25 +173,125 @@ void MsgRoute::SendMsg( float delay, MSG_Name name,
  *---------------------------------------------------------------------------*/
 void MsgRoute::SendMsgBroadcast( MSG_Object & msg, unsigned int type )
 {
-	dbCompositionList list;
-	g_database.ComposeList( list, type );
+	if( m_buffering ) {
+		BufferMsg( BUFFERED_BROADCAST, 0.0f, msg, type );
+		return;
+	}
+
+	g_database.LockLists();
 
-	dbCompositionList::iterator i;
-	for( i=list.begin(); i!=list.end(); ++i )
+	//Only a few types are in use, more lists than this are taken from the heap
+	static const unsigned int MAX_LOCAL_CURSORS = 32;
+	BroadcastCursor localCursors[MAX_LOCAL_CURSORS];
+	std::vector<BroadcastCursor> heapCursors;
+	BroadcastCursor* cursors = localCursors;
+
+	unsigned int matches = 0;
+	unsigned int lists = g_database.GetTypeListCount();
+	for( unsigned int list=0; list<lists; ++list )
 	{
-		if( msg.GetSender() != (*i)->GetID() )
+		if( type == OBJECT_Ignore_Type || ( g_database.GetTypeListType( list ) & type ) ) {
+			++matches;
+		}
+	}
+	if( matches > MAX_LOCAL_CURSORS ) {
+		heapCursors.resize( matches );
+		cursors = &heapCursors[0];
+	}
+
+	matches = 0;
+	for( unsigned int list=0; list<lists; ++list )
+	{
+		if( type == OBJECT_Ignore_Type || ( g_database.GetTypeListType( list ) & type ) ) {
+			cursors[matches].list = list;
+			cursors[matches].index = 0;
+			cursors[matches].end = g_database.GetTypeListSize( list );
+			++matches;
+		}
+	}
+
+	//Subscribers of a matching type are reached through their type list
+	bool subscribers = type != OBJECT_Ignore_Type && g_database.HasSubscribers( msg.GetName() );
+	unsigned int stored = g_database.GetStoredObjectCount();
+	unsigned int next = 0;
+
+	for(;;)
+	{	//Deliver to the receiver stored first among the heads of the lists
+		GameObject * receiver = 0;
+		unsigned int position = stored;
+		BroadcastCursor * from = 0;
+
+		for( unsigned int c=0; c<matches; ++c )
+		{
+			BroadcastCursor & cursor = cursors[c];
+			while( cursor.index < cursor.end && g_database.GetTypeListObject( cursor.list, cursor.index ) == 0 ) {
+				++cursor.index;		//Removed during the broadcast
+			}
+			if( cursor.index < cursor.end )
+			{
+				GameObject * object = g_database.GetTypeListObject( cursor.list, cursor.index );
+				unsigned int at = g_database.GetStoredPosition( object->GetID() );
+				if( at < position ) {
+					receiver = object;
+					position = at;
+					from = &cursor;
+				}
+			}
+		}
+
+		if( subscribers )
 		{
-			if( (*i)->GetStateMachine() ) {
-				(*i)->GetStateMachine()->Process( EVENT_Message, &msg );
+			GameObject * object = g_database.GetSubscriberFrom( msg.GetName(), next );
+			while( object && ( object->GetType() & type ) ) {
+				object = g_database.GetSubscriberFrom( msg.GetName(), g_database.GetStoredPosition( object->GetID() ) + 1 );
+			}
+			if( object && g_database.GetStoredPosition( object->GetID() ) < position ) {
+				receiver = object;
+				position = g_database.GetStoredPosition( object->GetID() );
+				from = 0;
 			}
 		}
+
+		if( receiver == 0 ) {
+			break;
+		}
+		if( from ) {
+			++from->index;
+		}
+		next = position + 1;
+		BroadcastTo( msg, receiver );
+	}
+
+	g_database.UnlockLists();
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         BroadcastTo
+
+  Description:  Delivers a broadcast message to one receiver, unless it is
+                the sender.
+
+  Arguments:    msg    : the message to broadcast
+                object : the receiver
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::BroadcastTo( MSG_Object & msg, GameObject * object )
+{
+	if( msg.GetSender() != object->GetID() )
+	{
+		if( object->GetStateMachine() ) {
+			object->GetStateMachine()->Process( EVENT_Message, &msg );
+		}
 	}
 }
 
 /*---------------------------------------------------------------------------*
   Name:         DeliverDelayedMessages
 
-  Description:  Checks every delayed message and sends it if the time is right.
+  Description:  Sends the delayed messages whose delivery time has come, in
+                order of delivery time. Only the messages that are due are
+				looked at.
 
   Arguments:    None.
 
@@ -157,20 +299,13 @@ void MsgRoute::SendMsgBroadcast( MSG_Object & msg, unsigned int type )
  *---------------------------------------------------------------------------*/
 void MsgRoute::DeliverDelayedMessages( void )
 {
-	MessageContainer::iterator i = m_delayedMessages.begin();
-	while( i != m_delayedMessages.end() )
-	{
-		if( (*i)->GetDeliveryTime() <= g_time.GetCurTime() )
-		{	//Deliver and delete msg
-			MSG_Object * msg = *i;
-			RouteMsg( *msg );
-			delete( msg );
-			i = m_delayedMessages.erase( i );
-		}
-		else
-		{
-			++i;
-		}
+	while( !m_delayedMessages.empty() &&
+	       m_delayedMessages[0]->msg.GetDeliveryTime() <= g_time.GetCurTime() )
+	{	//Deliver and recycle msg
+		DelayedMsg* delayed = m_delayedMessages[0];
+		UnlinkMsg( delayed );
+		RouteMsg( delayed->msg );
+		FreeMsg( delayed );
 	}
 }
 
@@ -234,23 +369,25 @@ void MsgRoute::RouteMsg( MSG_Object & msg )
  *---------------------------------------------------------------------------*/
 void MsgRoute::RemoveMsg( MSG_Name name, objectID receiver, objectID sender, bool timer )
 {
-	MessageContainer::iterator i = m_delayedMessages.begin();
-	while( i != m_delayedMessages.end() )
+	if( m_buffering ) {
+		MSG_Object msg( 0.0f, name, sender, receiver, NO_SCOPING, 0, 0, timer, false );
+		BufferMsg( BUFFERED_REMOVE, 0.0f, msg, 0 );
+		return;
+	}
+
+	DelayedMsg* i = *GetReceiverBucket( receiver );
+	while( i != 0 )
 	{
-		MSG_Object * msg = *i;
-		if( msg->GetName() == name &&
-			msg->GetReceiver() == receiver &&
-			msg->GetSender() == sender &&
-			msg->IsTimer() == timer &&
-			!msg->IsDelivered() )
-		{
-			delete( msg );
-			i = m_delayedMessages.erase( i );
-		}
-		else
+		DelayedMsg* next = i->next;
+		if( i->msg.GetName() == name &&
+			i->msg.GetReceiver() == receiver &&
+			i->msg.GetSender() == sender &&
+			i->msg.IsTimer() == timer )
 		{
-			++i;
+			UnlinkMsg( i );
+			FreeMsg( i );
 		}
+		i = next;
 	}
 }
 
@@ -268,24 +405,368 @@ void MsgRoute::RemoveMsg( MSG_Name name, objectID receiver, objectID sender, boo
  *---------------------------------------------------------------------------*/
 void MsgRoute::PurgeScopedMsg( objectID receiver )
 {
-	MessageContainer::iterator i = m_delayedMessages.begin();
-	while( i != m_delayedMessages.end() )
+	if( m_buffering ) {
+		MSG_Object msg( 0.0f, MSG_NULL, INVALID_OBJECT_ID, receiver, NO_SCOPING, 0, 0, false, false );
+		BufferMsg( BUFFERED_PURGE, 0.0f, msg, 0 );
+		return;
+	}
+
+	DelayedMsg* i = *GetReceiverBucket( receiver );
+	while( i != 0 )
+	{
+		DelayedMsg* next = i->next;
+		if( i->msg.GetReceiver() == receiver &&
+			i->msg.GetScopeRule() != NO_SCOPING )
+		{
+			UnlinkMsg( i );
+			FreeMsg( i );
+		}
+		i = next;
+	}
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         BeginBuffering
+
+  Description:  Starts buffering the messages sent, removed and purged by
+                think steps. The think steps may run on several threads.
+
+  Arguments:    None.
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::BeginBuffering( void )
+{
+	ASSERTMSG( !m_buffering, "MsgRoute::BeginBuffering - Already buffering." );
+
+#ifdef _OPENMP
+	unsigned int threads = (unsigned int)omp_get_max_threads();
+#else
+	unsigned int threads = 1;
+#endif
+	if( m_buffers.size() < threads ) {
+		m_buffers.resize( threads );
+	}
+
+	m_buffering = true;
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         SetBufferOrder
+
+  Description:  Tells which object the calling thread is about to update.
+                Buffered messages are delivered in the order of the objects
+				that sent them, whatever thread they were sent from.
+
+  Arguments:    order : the update order of the object
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::SetBufferOrder( unsigned int order )
+{
+#ifdef _OPENMP
+	MsgBuffer & buffer = m_buffers[omp_get_thread_num()];
+#else
+	MsgBuffer & buffer = m_buffers[0];
+#endif
+	buffer.order = order;
+	buffer.sequence = 0;
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         EndBuffering
+
+  Description:  Stops buffering and carries out the buffered requests, in
+                update order and then in the order each object made them.
+				The result does not depend on the number of threads.
+
+  Arguments:    None.
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::EndBuffering( void )
+{
+	ASSERTMSG( m_buffering, "MsgRoute::EndBuffering - Not buffering." );
+	m_buffering = false;
+
+	m_merged.clear();
+	for( unsigned int i=0; i<m_buffers.size(); ++i )
 	{
-		MSG_Object * msg = *i;
-		if( msg->GetReceiver() == receiver &&
-			msg->GetScopeRule() != NO_SCOPING &&
-			!msg->IsDelivered() )
+		m_merged.insert( m_merged.end(), m_buffers[i].msgs.begin(), m_buffers[i].msgs.end() );
+		m_buffers[i].msgs.clear();
+	}
+	std::sort( m_merged.begin(), m_merged.end(), IsBufferedEarlier );
+
+	for( unsigned int i=0; i<m_merged.size(); ++i )
+	{
+		MSG_Object & msg = m_merged[i].msg;
+		switch( m_merged[i].command )
 		{
-			delete( msg );
-			i = m_delayedMessages.erase( i );
+			case BUFFERED_SEND:
+				SendMsg( m_merged[i].delay, msg.GetName(), msg.GetReceiver(), msg.GetSender(),
+				         msg.GetScopeRule(), msg.GetScope(), msg.GetMsgData(), msg.IsTimer(), msg.IsCC() );
+				break;
+
+			case BUFFERED_BROADCAST:
+				SendMsgBroadcast( msg, m_merged[i].type );
+				break;
+
+			case BUFFERED_REMOVE:
+				RemoveMsg( msg.GetName(), msg.GetReceiver(), msg.GetSender(), msg.IsTimer() );
+				break;
+
+			case BUFFERED_PURGE:
+				PurgeScopedMsg( msg.GetReceiver() );
+				break;
 		}
-		else
+	}
+	m_merged.clear();
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         BufferMsg
+
+  Description:  Adds a request to the buffer of the calling thread.
+
+  Arguments:    command : what to do with the message
+                delay   : the delay of a sent message
+                msg     : the message
+                type    : the object type of a broadcast
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::BufferMsg( BufferedCommand command, float delay, MSG_Object & msg, unsigned int type )
+{
+#ifdef _OPENMP
+	MsgBuffer & buffer = m_buffers[omp_get_thread_num()];
+#else
+	MsgBuffer & buffer = m_buffers[0];
+#endif
+
+	BufferedMsg buffered;
+	buffered.command = command;
+	buffered.order = buffer.order;
+	buffered.sequence = buffer.sequence++;
+	buffered.delay = delay;
+	buffered.type = type;
+	buffered.msg = msg;
+	buffer.msgs.push_back( buffered );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         IsBufferedEarlier
+
+  Description:  Orders buffered requests by the update order of the object
+                that made them, then by the order it made them in.
+
+  Arguments:    a : a buffered request
+                b : another buffered request
+
+  Returns:      True if a is carried out before b.
+ *---------------------------------------------------------------------------*/
+bool MsgRoute::IsBufferedEarlier( const BufferedMsg & a, const BufferedMsg & b )
+{
+	if( a.order != b.order ) {
+		return( a.order < b.order );
+	}
+
+	return( a.sequence < b.sequence );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         AllocMsg
+
+  Description:  Takes a delayed message from the free list, allocating a
+                new block of messages when the list is empty.
+
+  Arguments:    None.
+
+  Returns:      The delayed message.
+ *---------------------------------------------------------------------------*/
+MsgRoute::DelayedMsg* MsgRoute::AllocMsg( void )
+{
+	if( m_freeList == 0 )
+	{
+		DelayedMsg* block = new DelayedMsg[MSGROUTE_BLOCK_SIZE];
+		m_blocks.push_back( block );
+		for( int i=0; i<MSGROUTE_BLOCK_SIZE; ++i )
 		{
-			++i;
+			block[i].next = m_freeList;
+			m_freeList = &block[i];
+		}
+	}
+
+	DelayedMsg* delayed = m_freeList;
+	m_freeList = delayed->next;
+	delayed->next = 0;
+
+	return( delayed );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         FreeMsg
+
+  Description:  Returns a delayed message to the free list.
+
+  Arguments:    delayed : the message, no longer in the heap or the buckets
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::FreeMsg( DelayedMsg* delayed )
+{
+	delayed->next = m_freeList;
+	m_freeList = delayed;
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         GetReceiverBucket
+
+  Description:  Finds the bucket holding the delayed messages of a receiver.
+
+  Arguments:    receiver : the receiver ID
+
+  Returns:      The head of the bucket chain.
+ *---------------------------------------------------------------------------*/
+MsgRoute::DelayedMsg** MsgRoute::GetReceiverBucket( objectID receiver )
+{
+	unsigned int h = (unsigned int)receiver * 2654435761u;
+	h ^= h >> 16;
+
+	return( &m_receiverBuckets[h & ( (unsigned int)m_receiverBuckets.size() - 1 )] );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         GrowReceiverBuckets
+
+  Description:  Doubles the number of receiver buckets and relinks the
+                delayed messages.
+
+  Arguments:    None.
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::GrowReceiverBuckets( void )
+{
+	m_receiverBuckets.assign( m_receiverBuckets.size() * 2, 0 );
+
+	for( unsigned int i=0; i<m_delayedMessages.size(); ++i )
+	{
+		DelayedMsg* delayed = m_delayedMessages[i];
+		DelayedMsg** bucket = GetReceiverBucket( delayed->msg.GetReceiver() );
+		delayed->next = *bucket;
+		*bucket = delayed;
+	}
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         UnlinkMsg
+
+  Description:  Takes a delayed message out of the heap and its receiver
+                bucket. The message is not freed.
+
+  Arguments:    delayed : the message
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::UnlinkMsg( DelayedMsg* delayed )
+{
+	DelayedMsg** link = GetReceiverBucket( delayed->msg.GetReceiver() );
+	while( *link != delayed ) {
+		link = &(*link)->next;
+	}
+	*link = delayed->next;
+	delayed->next = 0;
+
+	//Fill the hole with the last message and restore the heap order
+	unsigned int index = delayed->heapIndex;
+	DelayedMsg* last = m_delayedMessages.back();
+	m_delayedMessages.pop_back();
+	if( last != delayed )
+	{
+		m_delayedMessages[index] = last;
+		last->heapIndex = index;
+		SiftUp( index );
+		SiftDown( last->heapIndex );
+	}
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         IsEarlier
+
+  Description:  Orders delayed messages by delivery time, messages due at
+                the same time are delivered in the order they were sent.
+
+  Arguments:    a : a delayed message
+                b : another delayed message
+
+  Returns:      True if a is delivered before b.
+ *---------------------------------------------------------------------------*/
+bool MsgRoute::IsEarlier( DelayedMsg* a, DelayedMsg* b )
+{
+	if( a->msg.GetDeliveryTime() != b->msg.GetDeliveryTime() ) {
+		return( a->msg.GetDeliveryTime() < b->msg.GetDeliveryTime() );
+	}
+
+	return( a->sequence < b->sequence );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         SiftUp
+
+  Description:  Moves a heap entry towards the root until its parent is
+                delivered earlier.
+
+  Arguments:    index : the heap index of the entry
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::SiftUp( unsigned int index )
+{
+	DelayedMsg* delayed = m_delayedMessages[index];
+	while( index > 0 )
+	{
+		unsigned int parent = ( index - 1 ) / 2;
+		if( !IsEarlier( delayed, m_delayedMessages[parent] ) ) {
+			break;
 		}
+		m_delayedMessages[index] = m_delayedMessages[parent];
+		m_delayedMessages[index]->heapIndex = index;
+		index = parent;
 	}
+	m_delayedMessages[index] = delayed;
+	delayed->heapIndex = index;
 }
 
+/*---------------------------------------------------------------------------*
+  Name:         SiftDown
 
+  Description:  Moves a heap entry towards the leaves until both children
+                are delivered later.
 
+  Arguments:    index : the heap index of the entry
 
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void MsgRoute::SiftDown( unsigned int index )
+{
+	unsigned int count = (unsigned int)m_delayedMessages.size();
+	DelayedMsg* delayed = m_delayedMessages[index];
+	for( ;; )
+	{
+		unsigned int child = index * 2 + 1;
+		if( child >= count ) {
+			break;
+		}
+		if( child + 1 < count && IsEarlier( m_delayedMessages[child + 1], m_delayedMessages[child] ) ) {
+			++child;
+		}
+		if( !IsEarlier( m_delayedMessages[child], delayed ) ) {
+			break;
+		}
+		m_delayedMessages[index] = m_delayedMessages[child];
+		m_delayedMessages[index]->heapIndex = index;
+		index = child;
+	}
+	m_delayedMessages[index] = delayed;
+	delayed->heapIndex = index;
+}
@@ -46,7 +46,9 @@
 
 
 StateMachine::StateMachine( GameObject & object )
-: m_owner( &object )
+: m_owner( &object ),
+  m_stateTable( 0 ),
+  m_randSeed( object.GetID() * 2654435761u )
 {
 	Initialize();
 }
@@ -141,15 +143,15 @@ void StateMachine::Process( State_Machine_Event event, MSG_Object * msg )
 	bool handled = false;
 	if( m_currentSubstate >= 0 )
 	{	//Send to current substate
-		handled = States( event, msg, m_currentState, m_currentSubstate );
+		handled = Dispatch( event, msg, m_currentState, m_currentSubstate );
 	}
 	if( !handled )
 	{	//Send to current state
-		handled = States( event, msg, m_currentState, -1 );
+		handled = Dispatch( event, msg, m_currentState, -1 );
 	}
 	if( !handled )
 	{	//Send to global state
-		handled = States( event, msg, -1, -1 );
+		handled = Dispatch( event, msg, -1, -1 );
 	}
 	
 	PerformStateChanges();	
@@ -180,11 +182,11 @@ void StateMachine::PerformStateChanges( void )
 		//Let the last state clean-up
 		if( m_currentSubstate > 0 )
 		{	//Moving from a substate
-			States( EVENT_Exit, 0, static_cast<int>( m_currentState ), m_currentSubstate );
+			Dispatch( EVENT_Exit, 0, static_cast<int>( m_currentState ), m_currentSubstate );
 		}
 		if( m_nextSubstate < 0 )
 		{	//Leaving current state
-			States( EVENT_Exit, 0, static_cast<int>( m_currentState ), -1 );
+			Dispatch( EVENT_Exit, 0, static_cast<int>( m_currentState ), -1 );
 		}
 		
 
@@ -205,7 +207,7 @@ void StateMachine::PerformStateChanges( void )
 				m_currentState = m_nextState;
 				m_currentSubstate = m_nextSubstate;
 #ifdef DEBUG_STATE_MACHINE_MACROS
-				g_debuglog.LogStateMachineStateChange( m_owner->GetID(), m_owner->GetName(), m_currentState, m_currentSubstate );
+				g_debuglog.LogStateMachineStateChange( m_owner->GetID(), m_currentState, m_currentSubstate );
 #endif
 				break;
 				
@@ -220,7 +222,7 @@ void StateMachine::PerformStateChanges( void )
 					ASSERTMSG( 0, "StateMachine::PerformStateChanges - Hit bottom of state stack. Can't pop state." );
 				}
 #ifdef DEBUG_STATE_MACHINE_MACROS
-				g_debuglog.LogStateMachineStateChange( m_owner->GetID(), m_owner->GetName(), m_currentState, m_currentSubstate );
+				g_debuglog.LogStateMachineStateChange( m_owner->GetID(), m_currentState, m_currentSubstate );
 #endif
 				break;
 			
@@ -240,11 +242,102 @@ void StateMachine::PerformStateChanges( void )
 		//Let the new state initialize
 		m_stateChange = NO_STATE_CHANGE;
 		m_stateChangeAllowed = true;
-		States( EVENT_Enter, 0, static_cast<int>( m_currentState ), m_currentSubstate );
+		Dispatch( EVENT_Enter, 0, static_cast<int>( m_currentState ), m_currentSubstate );
 	}
 
 }
 
+/*---------------------------------------------------------------------------*
+  Name:         Dispatch
+
+  Description:  Sends an event to one level (substate, state or global
+                state) of the state machine, through the dispatch table if
+				the state machine has one or else through States.
+
+  Arguments:    event    : the event to process
+                msg      : an optional msg to process with the event
+				state    : the state, -1 for the global state
+				substate : the substate, -1 for the state itself
+
+  Returns:      True if the event was handled.
+ *---------------------------------------------------------------------------*/
+bool StateMachine::Dispatch( State_Machine_Event event, MSG_Object * msg, int state, int substate )
+{
+	if( m_stateTable ) {
+		return( DispatchTable( event, msg, state, substate ) );
+	}
+
+	return( States( event, msg, state, substate ) );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         DispatchTable
+
+  Description:  Looks up the handler of an event in the dispatch table and
+                calls it. Does what BeginStateMachine and DeclareState do
+				for the macro state machines: the global state carries out
+				delayed state changes, and the state names are kept for
+				debugging.
+
+  Arguments:    event    : the event to process
+                msg      : an optional msg to process with the event
+				state    : the state, -1 for the global state
+				substate : the substate, -1 for the state itself
+
+  Returns:      True if the event was handled.
+ *---------------------------------------------------------------------------*/
+bool StateMachine::DispatchTable( State_Machine_Event event, MSG_Object * msg, int state, int substate )
+{
+	if( state < 0 && EVENT_Message == event && msg )
+	{
+		if( MSG_CHANGE_STATE_DELAYED == msg->GetName() ) {
+			ChangeState( static_cast<unsigned int>( msg->GetIntData() ) );
+			return( true );
+		}
+		if( MSG_CHANGE_SUBSTATE_DELAYED == msg->GetName() ) {
+			ChangeSubstate( static_cast<unsigned int>( msg->GetIntData() ) );
+			return( true );
+		}
+	}
+
+	StateHandler handler = 0;
+	if( !m_stateTable->FindHandler( state, substate, event, msg, handler ) )
+	{
+		ASSERTMSG( substate >= 0, "StateMachine::DispatchTable - Invalid State" );
+		return( false );
+	}
+
+	const char * name = m_stateTable->GetName( state, substate );
+	if( EVENT_Enter == event && state >= 0 )
+	{
+		if( substate < 0 ) {
+			SetCurrentStateName( name );
+		}
+		else {
+			SetCurrentSubstateName( name );
+		}
+	}
+
+#ifdef DEBUG_STATE_MACHINE_MACROS
+	if( handler || substate < 0 )
+	{
+		if( substate < 0 ) {
+			g_debuglog.LogStateMachineEvent( m_owner->GetID(), msg, name, "", event, handler != 0 );
+		}
+		else {
+			g_debuglog.LogStateMachineEvent( m_owner->GetID(), msg, "", name, event, true );
+		}
+	}
+#endif
+
+	if( handler == 0 ) {
+		return( false );
+	}
+
+	(this->*handler)( msg );
+	return( true );
+}
+
 /*---------------------------------------------------------------------------*
   Name:         ChangeState
 
@@ -574,7 +667,11 @@ void StateMachine::SendMsgDelayedToMeHelper( float delay, MSG_Name name, Scope_R
 /*---------------------------------------------------------------------------*
   Name:         RandDelay
 
-  Description:  Returns a random delay within the range [min,max].
+  Description:  Returns a random delay within the range [min,max). Each
+                state machine draws from its own sequence, seeded from the
+				owner's ID, so think steps running on worker threads do
+				not share rand() and give the same delays for any number
+				of threads.
   
   Arguments:    min : the lower bound
                 max : the higher bound
@@ -584,8 +681,9 @@ void StateMachine::SendMsgDelayedToMeHelper( float delay, MSG_Name name, Scope_R
 float StateMachine::RandDelay( float min, float max )
 {
 	ASSERTMSG( min <= max, "RandDelay - min must be <= to max" );
+	m_randSeed = m_randSeed * 1664525u + 1013904223u;
 	float range = max - min;
-	float value = (float)rand()*(1.0f/(float)(RAND_MAX));
+	float value = (float)( m_randSeed >> 8 )*( 1.0f/16777216.0f );
 	value *= range;
 	value += min;
 
@@ -684,3 +782,238 @@ void StateMachine::PopStateMachine( void )
 }
 
 
+
+
+StateTable::StateTable( void )
+: m_built( false )
+{
+	m_states.resize( 1 );
+	m_states[0].name = "STATE_Global";
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         AddState
+
+  Description:  Adds a state to the table.
+
+  Arguments:    state : the state
+                name  : the state name, a string literal
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void StateTable::AddState( int state, const char * name )
+{
+	ASSERTMSG( state >= 0, "StateTable::AddState - Invalid state." );
+
+	unsigned int index = static_cast<unsigned int>( state + 1 );
+	if( index >= m_states.size() ) {
+		m_states.resize( index + 1 );
+	}
+	m_states[index].name = name;
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         AddSubstate
+
+  Description:  Adds a substate of a declared state to the table.
+
+  Arguments:    state    : the state
+                substate : the substate
+                name     : the substate name, a string literal
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void StateTable::AddSubstate( int state, int substate, const char * name )
+{
+	ASSERTMSG( GetRow( state, NO_SUBSTATE ) != 0, "StateTable::AddSubstate - State not declared." );
+	ASSERTMSG( state >= 0 && substate >= 0, "StateTable::AddSubstate - Invalid substate." );
+
+	unsigned int index = static_cast<unsigned int>( state + 1 );
+	if( index >= m_substates.size() ) {
+		m_substates.resize( index + 1 );
+	}
+
+	StateRowContainer & substates = m_substates[index];
+	if( static_cast<unsigned int>( substate ) >= substates.size() ) {
+		substates.resize( substate + 1 );
+	}
+	substates[substate].name = name;
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         AddEventHandler
+
+  Description:  Registers the handler of an event (update, enter or exit).
+
+  Arguments:    state    : the state, STATE_GLOBAL for every state
+                substate : the substate, or NO_SUBSTATE
+                event    : the event
+                handler  : the handler
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void StateTable::AddEventHandler( int state, int substate, State_Machine_Event event, StateHandler handler )
+{
+	ASSERTMSG( event != EVENT_Message && event != EVENT_CCMessage, "StateTable::AddEventHandler - Use AddMsgHandler for messages." );
+	SetHandler( state, substate, event, handler );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         AddMsgHandler
+
+  Description:  Registers the handler of a message.
+
+  Arguments:    state    : the state, STATE_GLOBAL for every state
+                substate : the substate, or NO_SUBSTATE
+                name     : the message name
+                handler  : the handler
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void StateTable::AddMsgHandler( int state, int substate, MSG_Name name, StateHandler handler )
+{
+	SetHandler( state, substate, SLOT_MSG + name, handler );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         AddCCMsgHandler
+
+  Description:  Registers the handler of a CCd message.
+
+  Arguments:    state    : the state, STATE_GLOBAL for every state
+                substate : the substate, or NO_SUBSTATE
+                name     : the message name
+                handler  : the handler
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void StateTable::AddCCMsgHandler( int state, int substate, MSG_Name name, StateHandler handler )
+{
+	SetHandler( state, substate, SLOT_CCMSG + name, handler );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         FindHandler
+
+  Description:  Looks up the handler of an event.
+
+  Arguments:    state    : the state, -1 for the global state
+                substate : the substate, -1 for the state itself
+                event    : the event
+                msg      : the message of message events
+                handler  : set to the handler, 0 if there is none
+
+  Returns:      False if the state or substate was not declared.
+ *---------------------------------------------------------------------------*/
+bool StateTable::FindHandler( int state, int substate, State_Machine_Event event, MSG_Object * msg, StateHandler & handler )
+{
+	handler = 0;
+
+	StateRow * row = GetRow( state, substate );
+	if( row == 0 ) {
+		return( false );
+	}
+
+	if( !row->handlers.empty() )
+	{
+		if( EVENT_Message == event ) {
+			if( msg ) {
+				handler = row->handlers[SLOT_MSG + msg->GetName()];
+			}
+		}
+		else if( EVENT_CCMessage == event ) {
+			if( msg ) {
+				handler = row->handlers[SLOT_CCMSG + msg->GetName()];
+			}
+		}
+		else if( event > EVENT_INVALID && event < EVENT_NUM ) {
+			handler = row->handlers[event];
+		}
+	}
+
+	return( true );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         GetName
+
+  Description:  Gets the name of a state or substate.
+
+  Arguments:    state    : the state, -1 for the global state
+                substate : the substate, -1 for the state itself
+
+  Returns:      The name, an empty string if it was not declared.
+ *---------------------------------------------------------------------------*/
+const char * StateTable::GetName( int state, int substate )
+{
+	StateRow * row = GetRow( state, substate );
+	if( row == 0 ) {
+		return( "" );
+	}
+
+	return( row->name );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         GetRow
+
+  Description:  Finds the row of a state or substate.
+
+  Arguments:    state    : the state, -1 for the global state
+                substate : the substate, -1 for the state itself
+
+  Returns:      The row, or 0 if it was not declared.
+ *---------------------------------------------------------------------------*/
+StateTable::StateRow * StateTable::GetRow( int state, int substate )
+{
+	if( state < -1 ) {
+		return( 0 );
+	}
+
+	unsigned int index = static_cast<unsigned int>( state + 1 );
+	StateRow * row = 0;
+	if( substate < 0 )
+	{
+		if( index < m_states.size() ) {
+			row = &m_states[index];
+		}
+	}
+	else
+	{
+		if( index < m_substates.size() && static_cast<unsigned int>( substate ) < m_substates[index].size() ) {
+			row = &m_substates[index][substate];
+		}
+	}
+
+	if( row && row->name == 0 ) {
+		return( 0 );
+	}
+
+	return( row );
+}
+
+/*---------------------------------------------------------------------------*
+  Name:         SetHandler
+
+  Description:  Stores a handler in the row of a declared state.
+
+  Arguments:    state    : the state, -1 for the global state
+                substate : the substate, -1 for the state itself
+                slot     : the handler slot
+                handler  : the handler
+
+  Returns:      None.
+ *---------------------------------------------------------------------------*/
+void StateTable::SetHandler( int state, int substate, int slot, StateHandler handler )
+{
+	StateRow * row = GetRow( state, substate );
+	ASSERTMSG( row != 0, "StateTable::SetHandler - State not declared." );
+	if( row == 0 ) {
+		return;
+	}
+
+	if( row->handlers.empty() ) {
+		row->handlers.resize( SLOT_NUM, 0 );
+	}
+	row->handlers[slot] = handler;
+}
@@ -0,0 +1,160 @@
+//
+// Path cache test.
+//
+// Builds a U shaped row of tiles, caches the path around the gap, then fills the gap
+// with a new tile and checks that the cache hands out the shorter path through it
+// instead of the cached detour. Removing the tile again must bring the detour back.
+//
+// Build :
+//   g++ -IDetour/Include Detour/Source/*.cpp tests/DetourPathCacheTest.cpp
+// Returns 0 on success.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+#include "DetourPathCache.h"
+
+static const int TILE_SIZE = 32;
+static const float CELL_SIZE = 0.3f;
+static const int MAX_PATH = 64;
+
+static int failures = 0;
+
+static void check(bool cond, const char* what, int a = 0)
+{
+	if (!cond)
+	{
+		printf("FAILED: %s (%d)\n", what, a);
+		failures++;
+	}
+}
+
+// One square polygon covering the tile, its edges connect to the neighbour tiles.
+static unsigned char* buildTile(int tx, int ty, int& dataSize)
+{
+	const float ts = TILE_SIZE*CELL_SIZE;
+	const unsigned short verts[4*3] = { 0,0,0, 0,0,TILE_SIZE, TILE_SIZE,0,TILE_SIZE, TILE_SIZE,0,0 };
+	unsigned short polys[DT_VERTS_PER_POLYGON*2];
+	memset(polys, 0xff, sizeof(polys));
+	for (int i = 0; i < 4; ++i)
+		polys[i] = (unsigned short)i;
+	const unsigned short polyFlags[1] = { 1 };
+	const unsigned char polyAreas[1] = { 0 };
+	const float x0 = tx*ts, z0 = ty*ts;
+	const float detailVerts[4*3] = { x0,0,z0, x0,0,z0+ts, x0+ts,0,z0+ts, x0+ts,0,z0 };
+	const unsigned short detailMeshes[4] = { 0, 4, 0, 2 };
+	const unsigned char detailTris[2*4] = { 0,1,2,0, 0,2,3,0 };
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = 4;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = 1;
+	params.nvp = DT_VERTS_PER_POLYGON;
+	params.detailMeshes = detailMeshes;
+	params.detailVerts = detailVerts;
+	params.detailVertsCount = 4;
+	params.detailTris = detailTris;
+	params.detailTriCount = 2;
+	params.tileX = tx;
+	params.tileY = ty;
+	params.bmin[0] = x0; params.bmin[1] = -1.0f; params.bmin[2] = z0;
+	params.bmax[0] = x0+ts; params.bmax[1] = 1.0f; params.bmax[2] = z0+ts;
+	params.walkableHeight = 2.0f;
+	params.walkableRadius = 0.6f;
+	params.walkableClimb = 0.9f;
+	params.cs = CELL_SIZE;
+	params.ch = 0.2f;
+	params.tileSize = TILE_SIZE;
+
+	unsigned char* data = 0;
+	if (!dtCreateNavMeshData(&params, &data, &dataSize))
+		return 0;
+	return data;
+}
+
+static dtTileRef addTile(dtNavMesh& mesh, int tx, int ty)
+{
+	int dataSize = 0;
+	unsigned char* data = buildTile(tx, ty, dataSize);
+	if (!data)
+		return 0;
+	const dtTileRef ref = mesh.addTile(data, dataSize, DT_TILE_FREE_DATA);
+	if (!ref)
+		delete [] data;
+	return ref;
+}
+
+static void tileCenter(int tx, int ty, float* pos)
+{
+	const float ts = TILE_SIZE*CELL_SIZE;
+	pos[0] = (tx+0.5f)*ts;
+	pos[1] = 0.0f;
+	pos[2] = (ty+0.5f)*ts;
+}
+
+int main()
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = TILE_SIZE*CELL_SIZE;
+	params.tileHeight = TILE_SIZE*CELL_SIZE;
+	params.maxTiles = 16;
+	params.maxPolys = 1 << 8;
+	params.maxNodes = 256;
+	dtNavMesh mesh;
+	if (!mesh.init(&params))
+	{
+		printf("FAILED: init\n");
+		return 1;
+	}
+
+	// Tiles around a gap at (1,1), the path from (0,1) to (2,1) has to go through row 0.
+	const int tiles[5][2] = { {0,0}, {1,0}, {2,0}, {0,1}, {2,1} };
+	for (int i = 0; i < 5; ++i)
+		check(addTile(mesh, tiles[i][0], tiles[i][1]) != 0, "addTile", i);
+
+	dtQueryFilter filter;
+	const float ext[3] = { 1.0f, 2.0f, 1.0f };
+	float spos[3], epos[3];
+	tileCenter(0, 1, spos);
+	tileCenter(2, 1, epos);
+	const dtPolyRef startRef = mesh.findNearestPoly(spos, ext, &filter, 0);
+	const dtPolyRef endRef = mesh.findNearestPoly(epos, ext, &filter, 0);
+	check(startRef && endRef, "start and end polygons");
+
+	dtPathCache cache;
+	check(cache.init(8, MAX_PATH), "cache init");
+
+	dtPolyRef path[MAX_PATH];
+	int npath = cache.findPath(&mesh, startRef, endRef, spos, epos, &filter, path, MAX_PATH);
+	check(npath == 5, "path around the gap", npath);
+	npath = cache.findPath(&mesh, startRef, endRef, spos, epos, &filter, path, MAX_PATH);
+	check(npath == 5 && cache.getHitCount() == 1, "path around the gap from the cache", cache.getHitCount());
+
+	// None of the cached polygons change, only the new tile opens a shortcut.
+	const dtTileRef gapRef = addTile(mesh, 1, 1);
+	check(gapRef != 0, "addTile into the gap");
+	npath = cache.findPath(&mesh, startRef, endRef, spos, epos, &filter, path, MAX_PATH);
+	check(npath == 3, "fresh path through the new tile", npath);
+	check(cache.getHitCount() == 1, "new tile invalidates the cached path", cache.getHitCount());
+
+	dtPolyRef fresh[MAX_PATH];
+	const int nfresh = mesh.findPath(startRef, endRef, spos, epos, &filter, fresh, MAX_PATH);
+	check(nfresh == npath && memcmp(fresh, path, sizeof(dtPolyRef)*npath) == 0, "cached path matches a new search");
+
+	// Removing the tile again breaks the cached shortcut.
+	mesh.removeTile(gapRef, 0, 0);
+	npath = cache.findPath(&mesh, startRef, endRef, spos, epos, &filter, path, MAX_PATH);
+	check(npath == 5, "path around the gap after removeTile", npath);
+
+	if (failures)
+		return 1;
+	printf("DetourPathCacheTest passed\n");
+	return 0;
+}
@@ -0,0 +1,173 @@
+//
+// Random point test.
+//
+// Builds a 4x4 grid of one polygon tiles where only two corner tiles pass the
+// query filter. Every random point must land on one of them, the two must be
+// picked about equally often, and a filter which passes nothing must fail.
+//
+// Build :
+//   g++ -IDetour/Include Detour/Source/*.cpp tests/DetourRandomPointTest.cpp
+// Returns 0 on success.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+
+static const int TILE_SIZE = 32;
+static const float CELL_SIZE = 0.3f;
+static const int GRID = 4;
+static const int SAMPLES = 4000;
+
+static const unsigned short FLAG_OPEN = 1;
+static const unsigned short FLAG_CLOSED = 2;
+
+static int failures = 0;
+
+static void check(bool cond, const char* what, int a = 0)
+{
+	if (!cond)
+	{
+		printf("FAILED: %s (%d)\n", what, a);
+		failures++;
+	}
+}
+
+// Fixed sequence, so that a failure can be reproduced.
+static unsigned int seed = 12345;
+static float frand()
+{
+	seed = seed*1103515245u + 12345u;
+	return (float)((seed >> 8) & 0xffff) / 65536.0f;
+}
+
+// One square polygon covering the tile.
+static unsigned char* buildTile(int tx, int ty, unsigned short flags, int& dataSize)
+{
+	const float ts = TILE_SIZE*CELL_SIZE;
+	const unsigned short verts[4*3] = { 0,0,0, 0,0,TILE_SIZE, TILE_SIZE,0,TILE_SIZE, TILE_SIZE,0,0 };
+	unsigned short polys[DT_VERTS_PER_POLYGON*2];
+	memset(polys, 0xff, sizeof(polys));
+	for (int i = 0; i < 4; ++i)
+		polys[i] = (unsigned short)i;
+	const unsigned short polyFlags[1] = { flags };
+	const unsigned char polyAreas[1] = { 0 };
+	const float x0 = tx*ts, z0 = ty*ts;
+	const float detailVerts[4*3] = { x0,0,z0, x0,0,z0+ts, x0+ts,0,z0+ts, x0+ts,0,z0 };
+	const unsigned short detailMeshes[4] = { 0, 4, 0, 2 };
+	const unsigned char detailTris[2*4] = { 0,1,2,0, 0,2,3,0 };
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = 4;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = 1;
+	params.nvp = DT_VERTS_PER_POLYGON;
+	params.detailMeshes = detailMeshes;
+	params.detailVerts = detailVerts;
+	params.detailVertsCount = 4;
+	params.detailTris = detailTris;
+	params.detailTriCount = 2;
+	params.tileX = tx;
+	params.tileY = ty;
+	params.bmin[0] = x0; params.bmin[1] = -1.0f; params.bmin[2] = z0;
+	params.bmax[0] = x0+ts; params.bmax[1] = 1.0f; params.bmax[2] = z0+ts;
+	params.walkableHeight = 2.0f;
+	params.walkableRadius = 0.6f;
+	params.walkableClimb = 0.9f;
+	params.cs = CELL_SIZE;
+	params.ch = 0.2f;
+	params.tileSize = TILE_SIZE;
+
+	unsigned char* data = 0;
+	if (!dtCreateNavMeshData(&params, &data, &dataSize))
+		return 0;
+	return data;
+}
+
+int main()
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = TILE_SIZE*CELL_SIZE;
+	params.tileHeight = TILE_SIZE*CELL_SIZE;
+	params.maxTiles = GRID*GRID;
+	params.maxPolys = 1 << 8;
+	params.maxNodes = 256;
+	dtNavMesh mesh;
+	if (!mesh.init(&params))
+	{
+		printf("FAILED: init\n");
+		return 1;
+	}
+
+	// Only the first and the last tile are open.
+	for (int ty = 0; ty < GRID; ++ty)
+	{
+		for (int tx = 0; tx < GRID; ++tx)
+		{
+			const bool open = (tx == 0 && ty == 0) || (tx == GRID-1 && ty == GRID-1);
+			int dataSize = 0;
+			unsigned char* data = buildTile(tx, ty, open ? FLAG_OPEN : FLAG_CLOSED, dataSize);
+			const dtTileRef ref = data ? mesh.addTile(data, dataSize, DT_TILE_FREE_DATA) : 0;
+			check(ref != 0, "addTile", ty*GRID+tx);
+			if (data && !ref)
+				delete [] data;
+		}
+	}
+
+	dtQueryFilter filter;
+	filter.includeFlags = FLAG_OPEN;
+	filter.excludeFlags = 0;
+
+	const float ts = TILE_SIZE*CELL_SIZE;
+	int hits[2] = { 0, 0 };
+	for (int i = 0; i < SAMPLES; ++i)
+	{
+		float pt[3];
+		const dtPolyRef ref = mesh.findRandomPoint(&filter, frand, pt);
+		check(ref != 0, "random point with most of the mesh filtered", i);
+		if (!ref)
+			continue;
+		const dtPoly* poly = mesh.getPolyByRef(ref);
+		check(poly && poly->flags == FLAG_OPEN, "random point on a filtered polygon", i);
+		const int tx = (int)(pt[0] / ts);
+		const int ty = (int)(pt[2] / ts);
+		if (tx == 0 && ty == 0)
+			hits[0]++;
+		else if (tx == GRID-1 && ty == GRID-1)
+			hits[1]++;
+		else
+			check(false, "random point outside the open tiles", i);
+	}
+	// Both open tiles have the same area.
+	check(hits[0] > SAMPLES*4/10 && hits[1] > SAMPLES*4/10, "open tiles picked evenly", hits[0]);
+
+	// Without a filter every tile can be picked.
+	dtQueryFilter all;
+	int closed = 0;
+	for (int i = 0; i < SAMPLES; ++i)
+	{
+		float pt[3];
+		const dtPolyRef ref = mesh.findRandomPoint(&all, frand, pt);
+		check(ref != 0, "random point without a filter", i);
+		const dtPoly* poly = ref ? mesh.getPolyByRef(ref) : 0;
+		if (poly && poly->flags == FLAG_CLOSED)
+			closed++;
+	}
+	check(closed > SAMPLES*8/10, "unfiltered points spread over all tiles", closed);
+
+	dtQueryFilter none;
+	none.includeFlags = 0x8000;
+	float pt[3];
+	check(mesh.findRandomPoint(&none, frand, pt) == 0, "no polygon passes the filter");
+
+	if (failures)
+		return 1;
+	printf("DetourRandomPointTest passed\n");
+	return 0;
+}
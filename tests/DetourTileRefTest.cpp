@@ -0,0 +1,186 @@
+//
+// Tile and polygon reference test.
+//
+// Creates tiled navmeshes with the tile / polygon budget OgreTemplate uses for the
+// tiled build, fills every tile slot and checks that all refs are non zero and
+// resolve back to their tile, also across salt wrap around.
+//
+// Build :
+//   g++ -IDetour/Include Detour/Source/*.cpp tests/DetourTileRefTest.cpp
+// and once more with -DDT_POLYREF64. Returns 0 on success.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+
+static const int TILE_SIZE = 32;
+static const float CELL_SIZE = 0.3f;
+
+static int failures = 0;
+
+static void check(bool cond, const char* what, int a = 0)
+{
+	if (!cond)
+	{
+		printf("FAILED: %s (%d)\n", what, a);
+		failures++;
+	}
+}
+
+// Same budget as the tiled build in OgreTemplate.
+static void calcTileBudget(int tileCount, int& maxTiles, int& maxPolys)
+{
+	int tileBits = 0;
+	while ((1 << tileBits) < tileCount)
+		tileBits++;
+	if (tileBits < 1) tileBits = 1;
+	if (tileBits > 14) tileBits = 14;
+	const int saltBits = 10;
+	const int polyBits = 32 - saltBits - tileBits;
+	maxTiles = 1 << tileBits;
+	maxPolys = 1 << polyBits;
+}
+
+// One square polygon covering the tile.
+static unsigned char* buildTile(int tx, int ty, int& dataSize)
+{
+	const float ts = TILE_SIZE*CELL_SIZE;
+	const unsigned short verts[4*3] = { 0,0,0, 0,0,TILE_SIZE, TILE_SIZE,0,TILE_SIZE, TILE_SIZE,0,0 };
+	unsigned short polys[DT_VERTS_PER_POLYGON*2];
+	memset(polys, 0xff, sizeof(polys));
+	for (int i = 0; i < 4; ++i)
+		polys[i] = (unsigned short)i;
+	const unsigned short polyFlags[1] = { 1 };
+	const unsigned char polyAreas[1] = { 0 };
+	const float x0 = tx*ts, z0 = ty*ts;
+	const float detailVerts[4*3] = { x0,0,z0, x0,0,z0+ts, x0+ts,0,z0+ts, x0+ts,0,z0 };
+	const unsigned short detailMeshes[4] = { 0, 4, 0, 2 };
+	const unsigned char detailTris[2*4] = { 0,1,2,0, 0,2,3,0 };
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = 4;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = 1;
+	params.nvp = DT_VERTS_PER_POLYGON;
+	params.detailMeshes = detailMeshes;
+	params.detailVerts = detailVerts;
+	params.detailVertsCount = 4;
+	params.detailTris = detailTris;
+	params.detailTriCount = 2;
+	params.tileX = tx;
+	params.tileY = ty;
+	params.bmin[0] = x0; params.bmin[1] = -1.0f; params.bmin[2] = z0;
+	params.bmax[0] = x0+ts; params.bmax[1] = 1.0f; params.bmax[2] = z0+ts;
+	params.walkableHeight = 2.0f;
+	params.walkableRadius = 0.6f;
+	params.walkableClimb = 0.9f;
+	params.cs = CELL_SIZE;
+	params.ch = 0.2f;
+	params.tileSize = TILE_SIZE;
+
+	unsigned char* data = 0;
+	if (!dtCreateNavMeshData(&params, &data, &dataSize))
+		return 0;
+	return data;
+}
+
+static bool initNavMesh(dtNavMesh& mesh, int maxTiles, int maxPolys)
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = TILE_SIZE*CELL_SIZE;
+	params.tileHeight = TILE_SIZE*CELL_SIZE;
+	params.maxTiles = maxTiles;
+	params.maxPolys = maxPolys;
+	params.maxNodes = 2048;
+	return mesh.init(&params);
+}
+
+static void checkTileRef(const dtNavMesh& mesh, dtTileRef ref, int tx, int ty)
+{
+	check(ref != 0, "tile ref is zero", tx);
+	const dtMeshTile* tile = mesh.getTileByRef(ref);
+	check(tile && tile->header && tile->header->x == tx && tile->header->y == ty, "tile ref resolves to its tile", tx);
+	const dtPolyRef base = mesh.getTilePolyRefBase(tile);
+	check(base != 0, "poly ref is zero", tx);
+	int ip = -1;
+	check(mesh.getTileByPolyRef(base, &ip) == tile && ip == 0, "poly ref resolves to its tile", tx);
+}
+
+int main()
+{
+	// Every tile count the app can produce must give a valid navmesh layout.
+	const int tileCounts[] = { 1, 2, 3, 17, 256, 1000, 16384, 40000 };
+	for (int i = 0; i < (int)(sizeof(tileCounts)/sizeof(tileCounts[0])); ++i)
+	{
+		int maxTiles, maxPolys;
+		calcTileBudget(tileCounts[i], maxTiles, maxPolys);
+		dtNavMesh mesh;
+		check(initNavMesh(mesh, maxTiles, maxPolys), "init with the app tile budget", tileCounts[i]);
+	}
+
+	// Fill every tile slot, the last slot used to spill into the salt.
+	const int fillCounts[] = { 2, 16, 256, 16384 };
+	for (int i = 0; i < (int)(sizeof(fillCounts)/sizeof(fillCounts[0])); ++i)
+	{
+		int maxTiles, maxPolys;
+		calcTileBudget(fillCounts[i], maxTiles, maxPolys);
+		dtNavMesh mesh;
+		if (!initNavMesh(mesh, maxTiles, maxPolys))
+		{
+			check(false, "init for fill", maxTiles);
+			continue;
+		}
+		int w = 1;
+		while (w*w < maxTiles) w++;
+		for (int j = 0; j < maxTiles; ++j)
+		{
+			int dataSize = 0;
+			unsigned char* data = buildTile(j % w, j / w, dataSize);
+			const dtTileRef ref = mesh.addTile(data, dataSize, DT_TILE_FREE_DATA);
+			check(ref != 0, "addTile", j);
+			if (!ref)
+			{
+				delete [] data;
+				break;
+			}
+			checkTileRef(mesh, ref, j % w, j / w);
+		}
+		int dataSize = 0;
+		unsigned char* data = buildTile(w, w, dataSize);
+		check(mesh.addTile(data, dataSize, DT_TILE_FREE_DATA) == 0, "addTile past maxTiles", maxTiles);
+		delete [] data;
+	}
+
+	// Reuse one slot until the salt wraps, refs must stay non zero and old ones go stale.
+	{
+		int maxTiles, maxPolys;
+		calcTileBudget(4, maxTiles, maxPolys);
+		dtNavMesh mesh;
+		initNavMesh(mesh, maxTiles, maxPolys);
+		dtTileRef prev = 0;
+		for (int j = 0; j < 2100; ++j)
+		{
+			int dataSize = 0;
+			unsigned char* data = buildTile(1, 1, dataSize);
+			const dtTileRef ref = mesh.addTile(data, dataSize, DT_TILE_FREE_DATA);
+			checkTileRef(mesh, ref, 1, 1);
+			if (prev && prev != ref)
+				check(mesh.getTileByRef(prev) == 0, "stale tile ref", j);
+			mesh.removeTile(ref, 0, 0);
+			check(mesh.getTileByRef(ref) == 0, "removed tile ref", j);
+			prev = ref;
+		}
+	}
+
+	if (failures)
+		return 1;
+	printf("DetourTileRefTest passed\n");
+	return 0;
+}
@@ -0,0 +1,204 @@
+//
+// Geometry cache round trip test.
+//
+// Loads a small grid scene through InputGeom::loadMesh, authors convex volumes and
+// off-mesh links after the load (the way the tools do), then loads the scene again
+// and checks that they came back from the cache.
+//
+// rcMeshLoaderObj is replaced by the fake below, so the test needs the Ogre headers
+// but no scene manager. Build with the application include paths :
+//   InputGeom.cpp ChunkyTriMesh.cpp Recast/Source/*.cpp Detour/Source/*.cpp
+//   DebugUtils/Source/*.cpp tests/GeomCacheTest.cpp
+// Returns 0 on success.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "InputGeom.h"
+#include "MeshLoaderObj.h"
+#include "SharedData.h"
+
+template<> SharedData* Ogre::Singleton<SharedData>::ms_Singleton = 0;
+
+static const int GRID = 16;
+
+//-------------------------------------------------------------------------------------
+// rcMeshLoaderObj fake, builds a flat GRID x GRID quad grid instead of reading entities.
+
+rcMeshLoaderObj::rcMeshLoaderObj() :
+	m_verts(0), m_tris(0), m_normals(0), m_vertCount(0), m_triCount(0), m_ownsGeometry(true),
+	ntris(0), tris(0), verts(0), nverts(0), numEnt(0)
+{
+}
+
+rcMeshLoaderObj::~rcMeshLoaderObj()
+{
+	if (m_ownsGeometry)
+	{
+		delete [] m_normals;
+		delete [] tris;
+		delete [] verts;
+	}
+}
+
+bool rcMeshLoaderObj::loadEntities(Ogre::StringVector /*entNames*/, Ogre::StringVector /*fileNames*/)
+{
+	return true;
+}
+
+unsigned int rcMeshLoaderObj::calcSourceHash()
+{
+	return 0x1234u;
+}
+
+bool rcMeshLoaderObj::buildEntityGeometry()
+{
+	nverts = (GRID+1)*(GRID+1);
+	ntris = GRID*GRID*2;
+	verts = new float[nverts*3];
+	tris = new int[ntris*3];
+	m_normals = new float[ntris*3];
+	for (int z = 0; z <= GRID; ++z)
+	{
+		for (int x = 0; x <= GRID; ++x)
+		{
+			float* v = &verts[(z*(GRID+1)+x)*3];
+			v[0] = (float)x;
+			v[1] = 0.0f;
+			v[2] = (float)z;
+		}
+	}
+	int* t = tris;
+	for (int z = 0; z < GRID; ++z)
+	{
+		for (int x = 0; x < GRID; ++x)
+		{
+			const int a = z*(GRID+1)+x;
+			t[0] = a; t[1] = a+GRID+1; t[2] = a+1; t += 3;
+			t[0] = a+1; t[1] = a+GRID+1; t[2] = a+GRID+2; t += 3;
+		}
+	}
+	for (int i = 0; i < ntris; ++i)
+	{
+		m_normals[i*3+0] = 0.0f;
+		m_normals[i*3+1] = 1.0f;
+		m_normals[i*3+2] = 0.0f;
+	}
+	return true;
+}
+
+bool rcMeshLoaderObj::buildTerrainGeometry()
+{
+	return buildEntityGeometry();
+}
+
+void rcMeshLoaderObj::setupContent()
+{
+}
+
+void rcMeshLoaderObj::setCachedGeometry(float* cverts, int cnverts, int* ctris, int cntris, float* cnormals)
+{
+	if (m_ownsGeometry)
+	{
+		delete [] m_normals;
+		delete [] tris;
+		delete [] verts;
+	}
+	verts = cverts;
+	nverts = cnverts;
+	tris = ctris;
+	ntris = cntris;
+	m_normals = cnormals;
+	m_ownsGeometry = false;
+}
+
+void rcMeshLoaderObj::releaseGeometry()
+{
+	if (m_ownsGeometry)
+	{
+		delete [] m_normals;
+		delete [] tris;
+		delete [] verts;
+	}
+	verts = 0;
+	tris = 0;
+	m_normals = 0;
+}
+
+//-------------------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void check(bool cond, const char* what)
+{
+	if (!cond)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+int main()
+{
+	new SharedData();
+
+	Ogre::StringVector names;
+	names.push_back("GeomCacheTest");
+	const Ogre::String cachePath = names[0] + ".geomcache";
+	remove(cachePath.c_str());
+
+	// First load builds the geometry and writes the cache, volumes and links follow.
+	{
+		InputGeom geom;
+		check(geom.loadMesh(names, names), "build load");
+		check(geom.getMesh()->getTriCount() == GRID*GRID*2, "built tri count");
+
+		const float vol[4*3] = { 1,0,1, 5,0,1, 5,0,5, 1,0,5 };
+		geom.addConvexVolume(vol, 4, -1.0f, 2.0f, 3);
+		geom.addConvexVolume(vol, 3, -1.0f, 2.0f, 4);
+		geom.addConvexVolume(vol, 4, -1.0f, 2.0f, 5);
+		geom.deleteConvexVolume(0);
+
+		const float spos[3] = { 2,0,2 }, epos[3] = { 10,0,10 };
+		geom.addOffMeshConnection(spos, epos, 0.6f, 1, 2, 8);
+		geom.addOffMeshConnection(epos, spos, 0.6f, 0, 2, 8);
+	}
+
+	// Second load must come from the cache and bring the authored data back.
+	{
+		InputGeom geom;
+		check(geom.loadMesh(names, names), "cached load");
+		check(geom.getMesh()->getTriCount() == GRID*GRID*2, "cached tri count");
+		check(geom.getConvexVolumeCount() == 2, "convex volume count");
+		check(geom.getOffMeshConnectionCount() == 2, "off-mesh connection count");
+		if (geom.getConvexVolumeCount() == 2)
+		{
+			const ConvexVolume* vols = geom.getConvexVolumes();
+			check(vols[0].area == 5 && vols[0].nverts == 4, "moved convex volume");
+			check(vols[1].area == 4 && vols[1].nverts == 3, "kept convex volume");
+		}
+		if (geom.getOffMeshConnectionCount() == 2)
+		{
+			check(geom.getOffMeshConnectionVerts()[3] == 10.0f, "off-mesh verts");
+			check(geom.getOffMeshConnectionDirs()[0] == 1, "off-mesh dirs");
+			check(geom.getOffMeshConnectionFlags()[1] == 8, "off-mesh flags");
+		}
+
+		// edits while the scene is mapped from the cache are written back as well
+		geom.deleteOffMeshConnection(0);
+	}
+
+	{
+		InputGeom geom;
+		check(geom.loadMesh(names, names), "second cached load");
+		check(geom.getOffMeshConnectionCount() == 1, "off-mesh count after edit on cached scene");
+	}
+
+	remove(cachePath.c_str());
+
+	if (failures)
+		return 1;
+	printf("GeomCacheTest passed\n");
+	return 0;
+}
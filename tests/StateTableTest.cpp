@@ -0,0 +1,190 @@
+//
+// State table test.
+//
+// Runs the same state machine written with the macros and registered in a
+// StateTable side by side. Both share their handlers, which note what they did,
+// so both notes have to match after the same events. Also checks the lookups of
+// StateTable::FindHandler directly.
+//
+// The state machine sources include the Ogre headers, so build with the application
+// include paths (Win32, like the application) :
+//   src/statemch.cpp src/msg.cpp src/msgroute.cpp src/database.cpp src/gameobject.cpp
+//   src/debuglog.cpp src/timesm.cpp tests/StateTableTest.cpp, linked with winmm.lib
+// Returns 0 on success.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "SharedData.h"
+#include "gameobject.h"
+#include "statemch.h"
+#include "database.h"
+#include "msgroute.h"
+#include "debuglog.h"
+#include "timesm.h"
+
+enum StateName
+{
+	STATE_Walk,
+	STATE_Fight,
+};
+
+enum SubstateName
+{
+	SUBSTATE_Fight_Aim,
+};
+
+static int failures = 0;
+
+static void check(bool cond, const char* what)
+{
+	if (!cond)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+//-------------------------------------------------------------------------------------
+// Handlers shared by both machines, each one notes what ran.
+
+class TestMachine : public StateMachine
+{
+public:
+	TestMachine(GameObject& object) : StateMachine(object), m_updates(0) {}
+
+	std::string m_notes;
+	int m_updates;
+
+	void onDamaged(MSG_Object*)		{ m_notes += "damaged "; }
+	void enterWalk(MSG_Object*)		{ m_notes += "enterWalk "; }
+	void updateWalk(MSG_Object*)	{ m_notes += "updateWalk "; if (++m_updates == 2) ChangeState(STATE_Fight); }
+	void exitWalk(MSG_Object*)		{ m_notes += "exitWalk "; }
+	void enterFight(MSG_Object*)	{ m_notes += "enterFight "; ChangeSubstate(SUBSTATE_Fight_Aim); }
+	void onIdle(MSG_Object*)		{ m_notes += "idle "; ChangeState(STATE_Walk); }
+	void ignore(MSG_Object*)		{ m_notes += "ignore "; }
+	void enterAim(MSG_Object*)		{ m_notes += "enterAim "; }
+	void onAttack(MSG_Object*)		{ m_notes += "attack "; }
+};
+
+class MacroMachine : public TestMachine
+{
+public:
+	MacroMachine(GameObject& object) : TestMachine(object) {}
+
+	virtual bool States(State_Machine_Event event, MSG_Object* msg, int state, int substate)
+	{
+		BeginStateMachine
+			OnMsg( MSG_Damaged )		onDamaged(msg);
+
+		DeclareState( STATE_Walk )
+			OnEnter						enterWalk(msg);
+			OnUpdate					updateWalk(msg);
+			OnExit						exitWalk(msg);
+
+		DeclareState( STATE_Fight )
+			OnEnter						enterFight(msg);
+			OnMsg( MSG_Idle )			onIdle(msg);
+			OnMsg( MSG_Damaged )		ignore(msg);
+
+			DeclareSubstate( SUBSTATE_Fight_Aim )
+				OnEnter					enterAim(msg);
+				OnMsg( MSG_Attack )		onAttack(msg);
+
+		EndStateMachine
+	}
+};
+
+static StateTable table;
+
+class TableMachine : public TestMachine
+{
+public:
+	TableMachine(GameObject& object) : TestMachine(object)
+	{
+		if (!table.IsBuilt())
+		{
+			table.AddMsgHandler( STATE_GLOBAL, NO_SUBSTATE, MSG_Damaged, STATE_HANDLER(TestMachine::onDamaged) );
+
+			table.AddState( STATE_Walk, "STATE_Walk" );
+			table.AddEventHandler( STATE_Walk, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(TestMachine::enterWalk) );
+			table.AddEventHandler( STATE_Walk, NO_SUBSTATE, EVENT_Update, STATE_HANDLER(TestMachine::updateWalk) );
+			table.AddEventHandler( STATE_Walk, NO_SUBSTATE, EVENT_Exit, STATE_HANDLER(TestMachine::exitWalk) );
+
+			table.AddState( STATE_Fight, "STATE_Fight" );
+			table.AddEventHandler( STATE_Fight, NO_SUBSTATE, EVENT_Enter, STATE_HANDLER(TestMachine::enterFight) );
+			table.AddMsgHandler( STATE_Fight, NO_SUBSTATE, MSG_Idle, STATE_HANDLER(TestMachine::onIdle) );
+			table.AddMsgHandler( STATE_Fight, NO_SUBSTATE, MSG_Damaged, STATE_HANDLER(TestMachine::ignore) );
+
+			table.AddSubstate( STATE_Fight, SUBSTATE_Fight_Aim, "SUBSTATE_Fight_Aim" );
+			table.AddEventHandler( STATE_Fight, SUBSTATE_Fight_Aim, EVENT_Enter, STATE_HANDLER(TestMachine::enterAim) );
+			table.AddMsgHandler( STATE_Fight, SUBSTATE_Fight_Aim, MSG_Attack, STATE_HANDLER(TestMachine::onAttack) );
+
+			table.SetBuilt();
+		}
+		SetStateTable(&table);
+	}
+};
+
+static void sendMsg(GameObject& object, MSG_Name name)
+{
+	MSG_Object msg(0.0f, name, 0, object.GetID(), NO_SCOPING, 0, MSG_Data(), false, false);
+	object.GetStateMachine()->Process(EVENT_Message, &msg);
+}
+
+int main()
+{
+	Time time;
+	DebugLog debugLog;
+	Database database;
+	MsgRoute msgRoute;
+
+	GameObject macroObject(1, OBJECT_Character, (char*)"macro");
+	GameObject tableObject(2, OBJECT_Character, (char*)"table");
+	MacroMachine* macro = new MacroMachine(macroObject);
+	TableMachine* tabled = new TableMachine(tableObject);
+	macroObject.PushStateMachine(*macro);
+	tableObject.PushStateMachine(*tabled);
+
+	GameObject* objects[2] = { &macroObject, &tableObject };
+	for (int i = 0; i < 2; ++i)
+	{
+		GameObject& object = *objects[i];
+		sendMsg(object, MSG_Damaged);		// global handler
+		sendMsg(object, MSG_Attack);		// not handled anywhere
+		object.GetStateMachine()->Update();
+		object.GetStateMachine()->Update();	// changes to STATE_Fight and its substate
+		sendMsg(object, MSG_Attack);		// substate handler
+		sendMsg(object, MSG_Damaged);		// the state handler hides the global one
+		sendMsg(object, MSG_Idle);			// back to STATE_Walk
+		object.GetStateMachine()->Update();
+	}
+
+	check(!macro->m_notes.empty(), "macro machine ran");
+	check(macro->m_notes == tabled->m_notes, "both machines handle the events the same way");
+	if (macro->m_notes != tabled->m_notes)
+		printf("  macros : %s\n  table  : %s\n", macro->m_notes.c_str(), tabled->m_notes.c_str());
+	check(macro->GetState() == STATE_Walk && tabled->GetState() == STATE_Walk, "both machines end in STATE_Walk");
+	check(strcmp(tabled->GetCurrentStateNameString(), "STATE_Walk") == 0, "table sets the state name on enter");
+
+	MSG_Object attack(0.0f, MSG_Attack, 0, 0, NO_SCOPING, 0, MSG_Data(), false, false);
+	MSG_Object idle(0.0f, MSG_Idle, 0, 0, NO_SCOPING, 0, MSG_Data(), false, false);
+	StateHandler handler = 0;
+	check(table.FindHandler(STATE_Fight, NO_SUBSTATE, EVENT_Message, &idle, handler) &&
+		  handler == STATE_HANDLER(TestMachine::onIdle), "message handler of a state");
+	check(table.FindHandler(STATE_Fight, SUBSTATE_Fight_Aim, EVENT_Message, &attack, handler) &&
+		  handler == STATE_HANDLER(TestMachine::onAttack), "message handler of a substate");
+	check(table.FindHandler(STATE_Walk, NO_SUBSTATE, EVENT_Message, &attack, handler) && handler == 0,
+		  "declared state without a handler");
+	check(table.FindHandler(STATE_GLOBAL, NO_SUBSTATE, EVENT_Update, 0, handler) && handler == 0,
+		  "global state without an update handler");
+	check(!table.FindHandler(STATE_Walk, SUBSTATE_Fight_Aim, EVENT_Enter, 0, handler), "undeclared substate");
+	check(!table.FindHandler(STATE_Fight + 1, NO_SUBSTATE, EVENT_Enter, 0, handler), "undeclared state");
+	check(strcmp(table.GetName(STATE_Fight, SUBSTATE_Fight_Aim), "SUBSTATE_Fight_Aim") == 0, "substate name");
+
+	if (failures)
+		return 1;
+	printf("StateTableTest passed\n");
+	return 0;
+}